@@ -1,32 +1,43 @@
 #include "handmade.h"
 
+#include <math.h>
+#include <string.h>
+
+#define Pi32 3.14159265359f
+
+template<pixel_format Format>
+inline typename pixel_layout<Format>::pixel
+WeirdGradientPixel(int X, int Y, int XOffset, int YOffset)
+{
+  uint8 Blue = (X + XOffset);
+  uint8 Green = (Y + YOffset);
+  uint8 Red = 0;
+  // uint8 Padding = 0;
+
+  // NOTE: Which byte each of these lands in, in memory and in a register,
+  // is entirely up to the format; see pixel_layout.
+  return(PackPixel<Format>(Red, Green, Blue, 0));
+}
+
+template<pixel_format Format>
 internal void
-RenderWeirdGradient(game_offscreen_buffer *Buffer, int XOffset, int YOffset)
+RenderWeirdGradientScalar(game_offscreen_buffer *Buffer, int XOffset, int YOffset)
 {
+  typedef typename pixel_layout<Format>::pixel pixel;
+
   // SDL_LogDebug(SDL_LOG_CATEGORY_APPLICATION, "painting pixels");
   uint8 *Row = (uint8 *)Buffer->Memory;
   for(int Y = 0;
       Y < Buffer->Height;
       ++Y)
     {
-      uint32 *Pixel = (uint32 *)Row;
+      pixel *Pixel = (pixel *)Row;
       for(int X = 0;
           X < Buffer->Width;
           ++X)
         {
-          /*
-           * Pixel (32 bits) structure:
-           *
-           * Memory:    RR GG BB xx
-           * Register:  xx GG BB RR
-           */
-          uint8 Blue = (X + XOffset);
-          uint8 Green = (Y + YOffset);
-          uint8 Red = 0;
-          // uint8 Padding = 0;
-
           // Write the pixel to our buffer.
-          *Pixel++ = ((Red << 16) | (Green << 8) | Blue);
+          *Pixel++ = WeirdGradientPixel<Format>(X, Y, XOffset, YOffset);
         }
 
       // Move to the next row.
@@ -34,8 +45,1848 @@ RenderWeirdGradient(game_offscreen_buffer *Buffer, int XOffset, int YOffset)
     }
 }
 
+#if HANDMADE_X86
+/*
+  NOTE: The SIMD loops work in lanes as wide as the pixels, so a vector
+  always holds 16 (or 32) bytes' worth of them. 8-bit pixels are worked out
+  in 16-bit lanes and packed down. The sizeof tests are constant for any one
+  format, so only one of each gets compiled into it.
+*/
+template<pixel_format Format>
 internal void
-GameUpdateAndRender(game_offscreen_buffer *Buffer, int BlueOffset, int GreenOffset)
+RenderWeirdGradientSSE2(game_offscreen_buffer *Buffer, int XOffset, int YOffset)
 {
-  RenderWeirdGradient(Buffer, BlueOffset, GreenOffset);
+  typedef pixel_layout<Format> layout;
+  typedef typename layout::pixel pixel;
+  int const PixelsPerVector = 16 / sizeof(pixel);
+
+  __m128i LowByteMask = (sizeof(pixel) == 4) ? _mm_set1_epi32(0xFF) : _mm_set1_epi16(0xFF);
+  __m128i LaneStep = (sizeof(pixel) == 4) ? _mm_set1_epi32(4) : _mm_set1_epi16(8);
+  __m128i VectorStep = (sizeof(pixel) == 1) ? _mm_set1_epi16(16) : LaneStep;
+
+  uint8 *Row = (uint8 *)Buffer->Memory;
+  for(int Y = 0;
+      Y < Buffer->Height;
+      ++Y)
+    {
+      pixel *Pixel = (pixel *)Row;
+      int X = 0;
+
+      // Walk up to the first 16-byte boundary so the wide stores can be aligned.
+      while((X < Buffer->Width) && ((uintptr_t)Pixel & 15))
+        {
+          *Pixel++ = WeirdGradientPixel<Format>(X++, Y, XOffset, YOffset);
+        }
+
+      // Green is constant along a row; only the blue channel varies per lane.
+      uint32 GreenBits = PackPixel<Format>(0, (uint8)(Y + YOffset), 0, 0);
+      __m128i Green;
+      __m128i Blue;
+      if(sizeof(pixel) == 4)
+        {
+          Green = _mm_set1_epi32(GreenBits);
+          Blue = _mm_setr_epi32(X + XOffset + 0, X + XOffset + 1,
+                                X + XOffset + 2, X + XOffset + 3);
+        }
+      else
+        {
+          // Only the low byte of each lane matters, so 16 bits is plenty.
+          Green = _mm_set1_epi16((int16)GreenBits);
+          Blue = _mm_add_epi16(_mm_set1_epi16((int16)(X + XOffset)), _mm_setr_epi16(0, 1, 2, 3, 4, 5, 6, 7));
+        }
+      for(;
+          (X + PixelsPerVector) <= Buffer->Width;
+          X += PixelsPerVector)
+        {
+          __m128i Result;
+          if(sizeof(pixel) == 4)
+            {
+              __m128i Channel = _mm_srli_epi32(_mm_and_si128(Blue, LowByteMask), 8 - layout::BlueBits);
+              Result = _mm_or_si128(_mm_slli_epi32(Channel, layout::BlueShift), Green);
+            }
+          else
+            {
+              __m128i Channel = _mm_srli_epi16(_mm_and_si128(Blue, LowByteMask), 8 - layout::BlueBits);
+              Result = _mm_or_si128(_mm_slli_epi16(Channel, layout::BlueShift), Green);
+              if(sizeof(pixel) == 1)
+                {
+                  __m128i NextBlue = _mm_add_epi16(Blue, LaneStep);
+                  __m128i Next = _mm_srli_epi16(_mm_and_si128(NextBlue, LowByteMask), 8 - layout::BlueBits);
+                  Next = _mm_or_si128(_mm_slli_epi16(Next, layout::BlueShift), Green);
+                  Result = _mm_packus_epi16(Result, Next);
+                }
+            }
+          _mm_store_si128((__m128i *)Pixel, Result);
+          Blue = (sizeof(pixel) == 4) ? _mm_add_epi32(Blue, VectorStep) : _mm_add_epi16(Blue, VectorStep);
+          Pixel += PixelsPerVector;
+        }
+
+      // Finish off whatever doesn't fill a whole vector.
+      while(X < Buffer->Width)
+        {
+          *Pixel++ = WeirdGradientPixel<Format>(X++, Y, XOffset, YOffset);
+        }
+
+      // Move to the next row.
+      Row += Buffer->Pitch;
+    }
+}
+
+template<pixel_format Format>
+HANDMADE_TARGET_AVX2 internal void
+RenderWeirdGradientAVX2(game_offscreen_buffer *Buffer, int XOffset, int YOffset)
+{
+  typedef pixel_layout<Format> layout;
+  typedef typename layout::pixel pixel;
+  int const PixelsPerVector = 32 / sizeof(pixel);
+
+  __m256i LowByteMask = (sizeof(pixel) == 4) ? _mm256_set1_epi32(0xFF) : _mm256_set1_epi16(0xFF);
+  __m256i LaneStep = (sizeof(pixel) == 4) ? _mm256_set1_epi32(8) : _mm256_set1_epi16(16);
+  __m256i VectorStep = (sizeof(pixel) == 1) ? _mm256_set1_epi16(32) : LaneStep;
+
+  uint8 *Row = (uint8 *)Buffer->Memory;
+  for(int Y = 0;
+      Y < Buffer->Height;
+      ++Y)
+    {
+      pixel *Pixel = (pixel *)Row;
+      int X = 0;
+
+      // Walk up to the first 32-byte boundary so the wide stores can be aligned.
+      while((X < Buffer->Width) && ((uintptr_t)Pixel & 31))
+        {
+          *Pixel++ = WeirdGradientPixel<Format>(X++, Y, XOffset, YOffset);
+        }
+
+      // Green is constant along a row; only the blue channel varies per lane.
+      uint32 GreenBits = PackPixel<Format>(0, (uint8)(Y + YOffset), 0, 0);
+      __m256i Green;
+      __m256i Blue;
+      if(sizeof(pixel) == 4)
+        {
+          Green = _mm256_set1_epi32(GreenBits);
+          Blue = _mm256_add_epi32(_mm256_set1_epi32(X + XOffset),
+                                  _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+        }
+      else
+        {
+          Green = _mm256_set1_epi16((int16)GreenBits);
+          Blue = _mm256_add_epi16(_mm256_set1_epi16((int16)(X + XOffset)),
+                                  _mm256_setr_epi16(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15));
+        }
+      for(;
+          (X + PixelsPerVector) <= Buffer->Width;
+          X += PixelsPerVector)
+        {
+          __m256i Result;
+          if(sizeof(pixel) == 4)
+            {
+              __m256i Channel = _mm256_srli_epi32(_mm256_and_si256(Blue, LowByteMask), 8 - layout::BlueBits);
+              Result = _mm256_or_si256(_mm256_slli_epi32(Channel, layout::BlueShift), Green);
+            }
+          else
+            {
+              __m256i Channel = _mm256_srli_epi16(_mm256_and_si256(Blue, LowByteMask), 8 - layout::BlueBits);
+              Result = _mm256_or_si256(_mm256_slli_epi16(Channel, layout::BlueShift), Green);
+              if(sizeof(pixel) == 1)
+                {
+                  __m256i NextBlue = _mm256_add_epi16(Blue, LaneStep);
+                  __m256i Next = _mm256_srli_epi16(_mm256_and_si256(NextBlue, LowByteMask), 8 - layout::BlueBits);
+                  Next = _mm256_or_si256(_mm256_slli_epi16(Next, layout::BlueShift), Green);
+                  // NOTE: Packing works within 128-bit halves, which leaves
+                  // the middle two quarters swapped.
+                  Result = _mm256_permute4x64_epi64(_mm256_packus_epi16(Result, Next), 0xD8);
+                }
+            }
+          _mm256_store_si256((__m256i *)Pixel, Result);
+          Blue = (sizeof(pixel) == 4) ? _mm256_add_epi32(Blue, VectorStep) : _mm256_add_epi16(Blue, VectorStep);
+          Pixel += PixelsPerVector;
+        }
+
+      // Finish off whatever doesn't fill a whole vector.
+      while(X < Buffer->Width)
+        {
+          *Pixel++ = WeirdGradientPixel<Format>(X++, Y, XOffset, YOffset);
+        }
+
+      // Move to the next row.
+      Row += Buffer->Pitch;
+    }
+}
+#endif
+
+template<pixel_format Format>
+internal void
+RenderWeirdGradientAs(game_offscreen_buffer *Buffer, int XOffset, int YOffset, simd_kernel Kernel)
+{
+  switch(Kernel)
+  {
+#if HANDMADE_X86
+    case SIMDKernel_SSE2: { RenderWeirdGradientSSE2<Format>(Buffer, XOffset, YOffset); } break;
+    case SIMDKernel_AVX2: { RenderWeirdGradientAVX2<Format>(Buffer, XOffset, YOffset); } break;
+#endif
+    default: { RenderWeirdGradientScalar<Format>(Buffer, XOffset, YOffset); } break;
+  }
+}
+
+internal void
+RenderWeirdGradient(game_offscreen_buffer *Buffer, int XOffset, int YOffset,
+                    simd_kernel Kernel = BestSIMDKernel())
+{
+  switch(Buffer->Format)
+  {
+    case PixelFormat_RGBA32: { RenderWeirdGradientAs<PixelFormat_RGBA32>(Buffer, XOffset, YOffset, Kernel); } break;
+    case PixelFormat_RGB565: { RenderWeirdGradientAs<PixelFormat_RGB565>(Buffer, XOffset, YOffset, Kernel); } break;
+    case PixelFormat_Indexed8: { RenderWeirdGradientAs<PixelFormat_Indexed8>(Buffer, XOffset, YOffset, Kernel); } break;
+    default: { RenderWeirdGradientAs<PixelFormat_BGRA32>(Buffer, XOffset, YOffset, Kernel); } break;
+  }
+}
+
+#if HANDMADE_SLOW
+/*
+  NOTE: Paints odd-sized, deliberately misaligned buffers in every pixel
+  format with every supported kernel and asserts they match the scalar
+  reference byte for byte.
+*/
+internal void
+DEBUGVerifyGradientKernels()
+{
+  int const MaxWidth = 67;
+  int const Height = 3;
+  // Room for a few pixels of misalignment in front of each row.
+  int const Pitch = (MaxWidth + 8) * sizeof(uint32);
+  alignas(32) local_persist uint8 Expected[Pitch * Height];
+  alignas(32) local_persist uint8 Actual[Pitch * Height];
+
+  int Widths[] = {1, 3, 4, 5, 7, 8, 9, 13, 31, 33, 67};
+  int Offsets[] = {0, 1, -1, 7, 255, 256, -300, 12345, -77777};
+
+  for(int Kernel = SIMDKernel_Scalar + 1;
+      Kernel < SIMDKernel_Count;
+      ++Kernel)
+  {
+    if(!SIMDKernelSupported((simd_kernel)Kernel)) continue;
+
+    for(int Format = 0; Format < PixelFormat_Count; ++Format)
+    for(int WidthIndex = 0; WidthIndex < (int)ArrayCount(Widths); ++WidthIndex)
+    for(int Skew = 0; Skew < 8; ++Skew)
+    for(int XIndex = 0; XIndex < (int)ArrayCount(Offsets); ++XIndex)
+    for(int YIndex = 0; YIndex < (int)ArrayCount(Offsets); ++YIndex)
+    {
+      int BytesPerPixel = GetBytesPerPixel((pixel_format)Format);
+      game_offscreen_buffer Reference = {};
+      Reference.Memory = Expected + Skew * BytesPerPixel;
+      Reference.Width = Widths[WidthIndex];
+      Reference.Height = Height;
+      Reference.Pitch = Pitch;
+      Reference.Format = (pixel_format)Format;
+
+      game_offscreen_buffer Candidate = Reference;
+      Candidate.Memory = Actual + Skew * BytesPerPixel;
+
+      // Poison both so untouched bytes (padding between rows) compare equal
+      // but anything written out of bounds does not.
+      for(int ByteIndex = 0; ByteIndex < (int)sizeof(Expected); ++ByteIndex)
+      {
+        Expected[ByteIndex] = 0xCD;
+        Actual[ByteIndex] = 0xCD;
+      }
+
+      RenderWeirdGradient(&Reference, Offsets[XIndex], Offsets[YIndex], SIMDKernel_Scalar);
+      RenderWeirdGradient(&Candidate, Offsets[XIndex], Offsets[YIndex], (simd_kernel)Kernel);
+
+      for(int ByteIndex = 0; ByteIndex < (int)sizeof(Expected); ++ByteIndex)
+      {
+        Assert(Expected[ByteIndex] == Actual[ByteIndex]);
+      }
+    }
+  }
+}
+#endif
+
+/*
+  NOTE: Bitmaps. Pixels are kept the way the offscreen buffer wants them,
+  0xAARRGGBB with the top row first, and with the colour channels already
+  multiplied by alpha, so drawing is a straight "source over" with no
+  divides: Dest = Source + Dest*(255 - SourceAlpha)/255.
+*/
+#pragma pack(push, 1)
+struct bitmap_header
+{
+  uint16 FileType;
+  uint32 FileSize;
+  uint16 Reserved1;
+  uint16 Reserved2;
+  uint32 BitmapOffset;
+
+  uint32 Size; // of the info header, which tells us which version this is
+  int32 Width;
+  int32 Height; // NOTE: Negative for files stored top row first.
+  uint16 Planes;
+  uint16 BitsPerPixel;
+  uint32 Compression;
+  uint32 SizeOfBitmap;
+  int32 HorzResolution;
+  int32 VertResolution;
+  uint32 ColorsUsed;
+  uint32 ColorsImportant;
+
+  // NOTE: Only there for BI_BITFIELDS files and the later header versions.
+  uint32 RedMask;
+  uint32 GreenMask;
+  uint32 BlueMask;
+  uint32 AlphaMask;
+};
+#pragma pack(pop)
+
+#define BMP_COMPRESSION_RGB 0
+#define BMP_COMPRESSION_BITFIELDS 3
+
+// (A*B)/255, rounded to nearest; exact for any two bytes.
+inline uint32
+MultiplyByte(uint32 A, uint32 B)
+{
+  uint32 Temp = A*B + 128;
+  return((Temp + (Temp >> 8)) >> 8);
+}
+
+inline uint32
+ExtractChannel(uint32 Pixel, uint32 Mask)
+{
+  uint32 Result = 0;
+  if(Mask)
+  {
+    Result = (Pixel & Mask) >> __builtin_ctz(Mask);
+    int BitCount = __builtin_popcount(Mask);
+    if(BitCount > 8)
+    {
+      Result >>= (BitCount - 8);
+    }
+    else if(BitCount < 8)
+    {
+      // Stretch narrow channels out over the whole byte.
+      Result = (Result * 255) / ((1u << BitCount) - 1);
+    }
+  }
+  return(Result);
+}
+
+/*
+  NOTE: Reads an uncompressed 32-bit BMP out of memory (say, from
+  ReadEntireFile) and converts it into a new bitmap in Arena. Only 32-bit
+  files are supported; anything else comes back with no Memory.
+*/
+internal loaded_bitmap
+LoadBMP(memory_arena *Arena, void *Contents, uint64 ContentsSize)
+{
+  loaded_bitmap Result = {};
+
+  bitmap_header *Header = (bitmap_header *)Contents;
+  uint64 InfoHeaderOffset = offsetof(bitmap_header, Size);
+  if(!Contents ||
+     (ContentsSize < offsetof(bitmap_header, RedMask)) ||
+     (Header->FileType != 0x4D42) || // "BM"
+     (Header->BitsPerPixel != 32) ||
+     ((Header->Compression != BMP_COMPRESSION_RGB) &&
+      (Header->Compression != BMP_COMPRESSION_BITFIELDS)) ||
+     (Header->Width <= 0) || (Header->Height == 0))
+  {
+    return(Result);
+  }
+
+  int32 Width = Header->Width;
+  int32 Height = (Header->Height < 0) ? -Header->Height : Header->Height;
+  bool32 IsBottomUp = (Header->Height > 0);
+  uint64 SourcePitch = (uint64)Width * sizeof(uint32);
+  if((Header->BitmapOffset > ContentsSize) ||
+     (SourcePitch * (uint64)Height > ContentsSize - Header->BitmapOffset))
+  {
+    return(Result);
+  }
+
+  uint32 RedMask = 0x00FF0000;
+  uint32 GreenMask = 0x0000FF00;
+  uint32 BlueMask = 0x000000FF;
+  uint32 AlphaMask = 0; // NOTE: Plain BI_RGB files have no alpha; they're opaque.
+  // Colour masks either follow a bare 40-byte header or are part of a later one.
+  uint64 MaskBytesAvailable = ContentsSize - offsetof(bitmap_header, RedMask);
+  if(Header->Compression == BMP_COMPRESSION_BITFIELDS)
+  {
+    if(MaskBytesAvailable < 3*sizeof(uint32))
+    {
+      return(Result);
+    }
+    RedMask = Header->RedMask;
+    GreenMask = Header->GreenMask;
+    BlueMask = Header->BlueMask;
+  }
+  if((InfoHeaderOffset + Header->Size >= sizeof(bitmap_header)) &&
+     (MaskBytesAvailable >= 4*sizeof(uint32)))
+  {
+    AlphaMask = Header->AlphaMask;
+  }
+
+  Result.Width = Width;
+  Result.Height = Height;
+  Result.Pitch = Align(Width * (int32)sizeof(uint32), 16);
+  Result.Memory = PushSize(Arena, (memory_index)Result.Pitch * Height, CACHE_LINE_SIZE);
+  Result.IsOpaque = true;
+
+  uint8 *SourceRow = (uint8 *)Contents + Header->BitmapOffset;
+  for(int32 Y = 0;
+      Y < Height;
+      ++Y)
+  {
+    int32 DestY = IsBottomUp ? (Height - 1 - Y) : Y;
+    uint32 *Dest = (uint32 *)((uint8 *)Result.Memory + (memory_index)DestY * Result.Pitch);
+    uint8 *Source = SourceRow;
+    for(int32 X = 0;
+        X < Width;
+        ++X)
+    {
+      uint32 Pixel;
+      memcpy(&Pixel, Source, sizeof(Pixel)); // NOTE: BMP rows needn't be aligned.
+      Source += sizeof(Pixel);
+
+      uint32 Alpha = AlphaMask ? ExtractChannel(Pixel, AlphaMask) : 255;
+      uint32 Red = MultiplyByte(ExtractChannel(Pixel, RedMask), Alpha);
+      uint32 Green = MultiplyByte(ExtractChannel(Pixel, GreenMask), Alpha);
+      uint32 Blue = MultiplyByte(ExtractChannel(Pixel, BlueMask), Alpha);
+      if(Alpha != 255)
+      {
+        Result.IsOpaque = false;
+      }
+
+      *Dest++ = (Alpha << 24) | (Red << 16) | (Green << 8) | Blue;
+    }
+
+    SourceRow += SourcePitch;
+  }
+
+  return(Result);
+}
+
+inline uint32
+BlendPixel(uint32 Source, uint32 Dest)
+{
+  uint32 InverseAlpha = 255 - (Source >> 24);
+  uint32 Result = 0;
+  for(int Shift = 0;
+      Shift < 32;
+      Shift += 8)
+  {
+    uint32 Channel = ((Source >> Shift) & 0xFF) + MultiplyByte((Dest >> Shift) & 0xFF, InverseAlpha);
+    if(Channel > 255)
+    {
+      // NOTE: Only bad (not properly premultiplied) pixels get here.
+      Channel = 255;
+    }
+    Result |= Channel << Shift;
+  }
+  return(Result);
+}
+
+typedef void blend_row(uint32 *Dest, uint32 *Source, int Count);
+
+internal void
+BlendRowScalar(uint32 *Dest, uint32 *Source, int Count)
+{
+  for(int X = 0;
+      X < Count;
+      ++X)
+  {
+    Dest[X] = BlendPixel(Source[X], Dest[X]);
+  }
+}
+
+#if HANDMADE_X86
+internal void
+BlendRowSSE2(uint32 *Dest, uint32 *Source, int Count)
+{
+  __m128i Zero = _mm_setzero_si128();
+  __m128i Max = _mm_set1_epi32(255);
+  __m128i Round = _mm_set1_epi16(128);
+
+  int X = 0;
+  for(;
+      (X + 4) <= Count;
+      X += 4)
+  {
+    __m128i S = _mm_loadu_si128((__m128i *)(Source + X));
+    // Fully transparent pixels are all zeroes once premultiplied.
+    if(_mm_movemask_epi8(_mm_cmpeq_epi32(S, Zero)) == 0xFFFF) continue;
+    __m128i D = _mm_loadu_si128((__m128i *)(Dest + X));
+
+    // 255 - alpha, in both 16-bit halves of each pixel, then spread out to
+    // line up with the four 16-bit channels of each unpacked pixel.
+    __m128i InverseAlpha = _mm_sub_epi32(Max, _mm_srli_epi32(S, 24));
+    InverseAlpha = _mm_or_si128(InverseAlpha, _mm_slli_epi32(InverseAlpha, 16));
+    __m128i InverseAlphaLo = _mm_unpacklo_epi32(InverseAlpha, InverseAlpha);
+    __m128i InverseAlphaHi = _mm_unpackhi_epi32(InverseAlpha, InverseAlpha);
+
+    // MultiplyByte, eight channels at a time.
+    __m128i Lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(D, Zero), InverseAlphaLo), Round);
+    __m128i Hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(D, Zero), InverseAlphaHi), Round);
+    Lo = _mm_srli_epi16(_mm_add_epi16(Lo, _mm_srli_epi16(Lo, 8)), 8);
+    Hi = _mm_srli_epi16(_mm_add_epi16(Hi, _mm_srli_epi16(Hi, 8)), 8);
+
+    _mm_storeu_si128((__m128i *)(Dest + X), _mm_adds_epu8(S, _mm_packus_epi16(Lo, Hi)));
+  }
+
+  BlendRowScalar(Dest + X, Source + X, Count - X);
+}
+
+HANDMADE_TARGET_AVX2 internal void
+BlendRowAVX2(uint32 *Dest, uint32 *Source, int Count)
+{
+  __m256i Zero = _mm256_setzero_si256();
+  __m256i Max = _mm256_set1_epi32(255);
+  __m256i Round = _mm256_set1_epi16(128);
+
+  int X = 0;
+  for(;
+      (X + 8) <= Count;
+      X += 8)
+  {
+    __m256i S = _mm256_loadu_si256((__m256i *)(Source + X));
+    if(_mm256_movemask_epi8(_mm256_cmpeq_epi32(S, Zero)) == -1) continue;
+    __m256i D = _mm256_loadu_si256((__m256i *)(Dest + X));
+
+    // NOTE: Unpacking and packing both work within 128-bit halves, so the
+    // pixels come back out in the order they went in.
+    __m256i InverseAlpha = _mm256_sub_epi32(Max, _mm256_srli_epi32(S, 24));
+    InverseAlpha = _mm256_or_si256(InverseAlpha, _mm256_slli_epi32(InverseAlpha, 16));
+    __m256i InverseAlphaLo = _mm256_unpacklo_epi32(InverseAlpha, InverseAlpha);
+    __m256i InverseAlphaHi = _mm256_unpackhi_epi32(InverseAlpha, InverseAlpha);
+
+    __m256i Lo = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(D, Zero), InverseAlphaLo), Round);
+    __m256i Hi = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(D, Zero), InverseAlphaHi), Round);
+    Lo = _mm256_srli_epi16(_mm256_add_epi16(Lo, _mm256_srli_epi16(Lo, 8)), 8);
+    Hi = _mm256_srli_epi16(_mm256_add_epi16(Hi, _mm256_srli_epi16(Hi, 8)), 8);
+
+    _mm256_storeu_si256((__m256i *)(Dest + X), _mm256_adds_epu8(S, _mm256_packus_epi16(Lo, Hi)));
+  }
+
+  BlendRowScalar(Dest + X, Source + X, Count - X);
+}
+#endif
+
+/*
+  NOTE: Bitmaps are always BGRA32, so drawing into any other format unpacks
+  each destination pixel, blends it as BGRA32 and packs it back up. For
+  BGRA32 itself that all compiles away to BlendRowScalar.
+*/
+template<pixel_format Format>
+internal void
+BlendRowAs(void *DestRow, uint32 *Source, int Count, bool32 IsOpaque)
+{
+  typedef typename pixel_layout<Format>::pixel pixel;
+  pixel *Dest = (pixel *)DestRow;
+  for(int X = 0;
+      X < Count;
+      ++X)
+  {
+    uint32 Pixel = IsOpaque ? Source[X] : BlendPixel(Source[X], UnpackPixel<Format>(Dest[X]));
+    Dest[X] = PackPixel<Format>((Pixel >> 16) & 0xFF, (Pixel >> 8) & 0xFF, Pixel & 0xFF, Pixel >> 24);
+  }
+}
+
+/*
+  NOTE: RGBA32 is BGRA32 with red and blue swapped, and blending treats
+  every colour channel alike, so swapping the bitmap's a few pixels at a
+  time lets RGBA32 buffers use the SIMD blends too.
+*/
+internal void
+BlendRowSwappingRedBlue(blend_row *BlendRow, uint32 *Dest, uint32 *Source, int Count, bool32 IsOpaque)
+{
+  uint32 Swapped[64];
+  for(int X = 0;
+      X < Count;
+      X += ArrayCount(Swapped))
+  {
+    int ChunkCount = Count - X;
+    if(ChunkCount > (int)ArrayCount(Swapped))
+    {
+      ChunkCount = ArrayCount(Swapped);
+    }
+    for(int Index = 0;
+        Index < ChunkCount;
+        ++Index)
+    {
+      uint32 Pixel = Source[X + Index];
+      Swapped[Index] = (Pixel & 0xFF00FF00) | ((Pixel >> 16) & 0xFF) | ((Pixel & 0xFF) << 16);
+    }
+
+    if(IsOpaque)
+    {
+      memcpy(Dest + X, Swapped, ChunkCount * sizeof(uint32));
+    }
+    else
+    {
+      BlendRow(Dest + X, Swapped, ChunkCount);
+    }
+  }
+}
+
+/*
+  NOTE: The narrower formats get the SIMD blends by going through BGRA32 a
+  few pixels at a time: unpack the destination, blend into that and pack
+  it back up, with the unpacking and packing in SIMD too. Unpacking
+  stretches each channel out to 0..255 exactly as UnpackPixel does; the
+  division by the channel's maximum is a multiply and a shift that comes
+  out the same for every channel value a format can hold.
+*/
+typedef void unpack_row(uint32 *Dest, void *Source, int Count);
+typedef void pack_row(void *Dest, uint32 *Source, int Count);
+
+constexpr uint32
+UnpackMultiplier(int Bits)
+{
+  return((Bits == 2) ? 21846 : (Bits == 3) ? 9363 : (Bits == 5) ? 8457 : 8323);
+}
+
+constexpr int
+UnpackShift(int Bits)
+{
+  return((Bits == 5) ? 2 : (Bits == 6) ? 3 : 0);
+}
+
+internal void
+BlendRowThroughBGRA32(blend_row *BlendRow, unpack_row *UnpackRow, pack_row *PackRow, int BytesPerPixel,
+                      void *Dest, uint32 *Source, int Count, bool32 IsOpaque)
+{
+  uint32 Unpacked[64];
+  for(int X = 0;
+      X < Count;
+      X += ArrayCount(Unpacked))
+  {
+    int ChunkCount = Count - X;
+    if(ChunkCount > (int)ArrayCount(Unpacked))
+    {
+      ChunkCount = ArrayCount(Unpacked);
+    }
+
+    uint8 *DestChunk = (uint8 *)Dest + X * BytesPerPixel;
+    if(IsOpaque)
+    {
+      PackRow(DestChunk, Source + X, ChunkCount);
+    }
+    else
+    {
+      UnpackRow(Unpacked, DestChunk, ChunkCount);
+      BlendRow(Unpacked, Source + X, ChunkCount);
+      PackRow(DestChunk, Unpacked, ChunkCount);
+    }
+  }
+}
+
+#if HANDMADE_X86
+// NOTE: One pixel to a 32-bit lane; the 16-bit multiplies leave the top halves at zero.
+template<int Shift, int Bits>
+inline __m128i
+UnpackChannelSSE2(__m128i Pixels)
+{
+  __m128i Channel = _mm_and_si128(_mm_srli_epi32(Pixels, Shift), _mm_set1_epi32((1 << Bits) - 1));
+  Channel = _mm_mullo_epi16(Channel, _mm_set1_epi32(255));
+  return(_mm_srli_epi32(_mm_mulhi_epu16(Channel, _mm_set1_epi32(UnpackMultiplier(Bits))), UnpackShift(Bits)));
+}
+
+template<int SourceShift, int Shift, int Bits>
+inline __m128i
+PackChannelSSE2(__m128i Pixels)
+{
+  __m128i Channel = _mm_and_si128(_mm_srli_epi32(Pixels, SourceShift + 8 - Bits), _mm_set1_epi32((1 << Bits) - 1));
+  return(_mm_slli_epi32(Channel, Shift));
+}
+
+template<pixel_format Format>
+inline __m128i
+UnpackPixelsSSE2(__m128i Pixels)
+{
+  typedef pixel_layout<Format> layout;
+  __m128i Red = UnpackChannelSSE2<layout::RedShift, layout::RedBits>(Pixels);
+  __m128i Green = UnpackChannelSSE2<layout::GreenShift, layout::GreenBits>(Pixels);
+  __m128i Blue = UnpackChannelSSE2<layout::BlueShift, layout::BlueBits>(Pixels);
+  return(_mm_or_si128(_mm_or_si128(_mm_set1_epi32(0xFF000000), _mm_slli_epi32(Red, 16)),
+                      _mm_or_si128(_mm_slli_epi32(Green, 8), Blue)));
+}
+
+template<pixel_format Format>
+inline __m128i
+PackPixelsSSE2(__m128i Pixels)
+{
+  typedef pixel_layout<Format> layout;
+  __m128i Red = PackChannelSSE2<16, layout::RedShift, layout::RedBits>(Pixels);
+  __m128i Green = PackChannelSSE2<8, layout::GreenShift, layout::GreenBits>(Pixels);
+  __m128i Blue = PackChannelSSE2<0, layout::BlueShift, layout::BlueBits>(Pixels);
+  return(_mm_or_si128(_mm_or_si128(Red, Green), Blue));
+}
+
+template<pixel_format Format>
+internal void
+UnpackRowSSE2(uint32 *Dest, void *SourceRow, int Count)
+{
+  typedef typename pixel_layout<Format>::pixel pixel;
+  pixel *Source = (pixel *)SourceRow;
+  __m128i Zero = _mm_setzero_si128();
+
+  int X = 0;
+  for(;
+      (X + 8) <= Count;
+      X += 8)
+  {
+    __m128i Wide;
+    if(sizeof(pixel) == 2)
+    {
+      Wide = _mm_loadu_si128((__m128i *)(Source + X));
+    }
+    else
+    {
+      Wide = _mm_unpacklo_epi8(_mm_loadl_epi64((__m128i *)(Source + X)), Zero);
+    }
+    _mm_storeu_si128((__m128i *)(Dest + X), UnpackPixelsSSE2<Format>(_mm_unpacklo_epi16(Wide, Zero)));
+    _mm_storeu_si128((__m128i *)(Dest + X + 4), UnpackPixelsSSE2<Format>(_mm_unpackhi_epi16(Wide, Zero)));
+  }
+
+  for(;
+      X < Count;
+      ++X)
+  {
+    Dest[X] = UnpackPixel<Format>(Source[X]);
+  }
+}
+
+template<pixel_format Format>
+internal void
+PackRowSSE2(void *DestRow, uint32 *Source, int Count)
+{
+  typedef typename pixel_layout<Format>::pixel pixel;
+  pixel *Dest = (pixel *)DestRow;
+
+  int X = 0;
+  for(;
+      (X + 8) <= Count;
+      X += 8)
+  {
+    __m128i Lo = PackPixelsSSE2<Format>(_mm_loadu_si128((__m128i *)(Source + X)));
+    __m128i Hi = PackPixelsSSE2<Format>(_mm_loadu_si128((__m128i *)(Source + X + 4)));
+    // NOTE: SSE2 only packs with signed saturation, so 16-bit pixels go in
+    // sign-extended to come out bit for bit.
+    Lo = _mm_srai_epi32(_mm_slli_epi32(Lo, 16), 16);
+    Hi = _mm_srai_epi32(_mm_slli_epi32(Hi, 16), 16);
+    __m128i Packed = _mm_packs_epi32(Lo, Hi);
+    if(sizeof(pixel) == 2)
+    {
+      _mm_storeu_si128((__m128i *)(Dest + X), Packed);
+    }
+    else
+    {
+      _mm_storel_epi64((__m128i *)(Dest + X), _mm_packus_epi16(Packed, Packed));
+    }
+  }
+
+  for(;
+      X < Count;
+      ++X)
+  {
+    uint32 Pixel = Source[X];
+    Dest[X] = PackPixel<Format>((Pixel >> 16) & 0xFF, (Pixel >> 8) & 0xFF, Pixel & 0xFF, Pixel >> 24);
+  }
+}
+
+template<int Shift, int Bits>
+HANDMADE_TARGET_AVX2 inline __m256i
+UnpackChannelAVX2(__m256i Pixels)
+{
+  __m256i Channel = _mm256_and_si256(_mm256_srli_epi32(Pixels, Shift), _mm256_set1_epi32((1 << Bits) - 1));
+  Channel = _mm256_mullo_epi16(Channel, _mm256_set1_epi32(255));
+  return(_mm256_srli_epi32(_mm256_mulhi_epu16(Channel, _mm256_set1_epi32(UnpackMultiplier(Bits))), UnpackShift(Bits)));
+}
+
+template<int SourceShift, int Shift, int Bits>
+HANDMADE_TARGET_AVX2 inline __m256i
+PackChannelAVX2(__m256i Pixels)
+{
+  __m256i Channel = _mm256_and_si256(_mm256_srli_epi32(Pixels, SourceShift + 8 - Bits),
+                                     _mm256_set1_epi32((1 << Bits) - 1));
+  return(_mm256_slli_epi32(Channel, Shift));
+}
+
+template<pixel_format Format>
+HANDMADE_TARGET_AVX2 internal void
+UnpackRowAVX2(uint32 *Dest, void *SourceRow, int Count)
+{
+  typedef pixel_layout<Format> layout;
+  typedef typename layout::pixel pixel;
+  pixel *Source = (pixel *)SourceRow;
+  __m256i Alpha = _mm256_set1_epi32(0xFF000000);
+
+  int X = 0;
+  for(;
+      (X + 8) <= Count;
+      X += 8)
+  {
+    __m256i Pixels;
+    if(sizeof(pixel) == 2)
+    {
+      Pixels = _mm256_cvtepu16_epi32(_mm_loadu_si128((__m128i *)(Source + X)));
+    }
+    else
+    {
+      Pixels = _mm256_cvtepu8_epi32(_mm_loadl_epi64((__m128i *)(Source + X)));
+    }
+    __m256i Red = UnpackChannelAVX2<layout::RedShift, layout::RedBits>(Pixels);
+    __m256i Green = UnpackChannelAVX2<layout::GreenShift, layout::GreenBits>(Pixels);
+    __m256i Blue = UnpackChannelAVX2<layout::BlueShift, layout::BlueBits>(Pixels);
+    __m256i Result = _mm256_or_si256(_mm256_or_si256(Alpha, _mm256_slli_epi32(Red, 16)),
+                                     _mm256_or_si256(_mm256_slli_epi32(Green, 8), Blue));
+    _mm256_storeu_si256((__m256i *)(Dest + X), Result);
+  }
+
+  for(;
+      X < Count;
+      ++X)
+  {
+    Dest[X] = UnpackPixel<Format>(Source[X]);
+  }
+}
+
+template<pixel_format Format>
+HANDMADE_TARGET_AVX2 internal void
+PackRowAVX2(void *DestRow, uint32 *Source, int Count)
+{
+  typedef pixel_layout<Format> layout;
+  typedef typename layout::pixel pixel;
+  pixel *Dest = (pixel *)DestRow;
+
+  int X = 0;
+  for(;
+      (X + 8) <= Count;
+      X += 8)
+  {
+    __m256i Pixels = _mm256_loadu_si256((__m256i *)(Source + X));
+    __m256i Red = PackChannelAVX2<16, layout::RedShift, layout::RedBits>(Pixels);
+    __m256i Green = PackChannelAVX2<8, layout::GreenShift, layout::GreenBits>(Pixels);
+    __m256i Blue = PackChannelAVX2<0, layout::BlueShift, layout::BlueBits>(Pixels);
+    __m256i Packed = _mm256_or_si256(_mm256_or_si256(Red, Green), Blue);
+
+    // NOTE: Packed across the two halves rather than within each, so the
+    // pixels stay in order.
+    __m128i Narrow = _mm_packus_epi32(_mm256_castsi256_si128(Packed), _mm256_extracti128_si256(Packed, 1));
+    if(sizeof(pixel) == 2)
+    {
+      _mm_storeu_si128((__m128i *)(Dest + X), Narrow);
+    }
+    else
+    {
+      _mm_storel_epi64((__m128i *)(Dest + X), _mm_packus_epi16(Narrow, Narrow));
+    }
+  }
+
+  for(;
+      X < Count;
+      ++X)
+  {
+    uint32 Pixel = Source[X];
+    Dest[X] = PackPixel<Format>((Pixel >> 16) & 0xFF, (Pixel >> 8) & 0xFF, Pixel & 0xFF, Pixel >> 24);
+  }
+}
+#endif
+
+// NOTE: Only the narrower formats, and only for the SIMD kernels, have these.
+internal bool32
+GetBlitRowConverters(simd_kernel Kernel, pixel_format Format, unpack_row **UnpackRow, pack_row **PackRow)
+{
+  *UnpackRow = 0;
+  *PackRow = 0;
+#if HANDMADE_X86
+  if(Kernel == SIMDKernel_SSE2)
+  {
+    switch(Format)
+    {
+      case PixelFormat_RGB565:
+      {
+        *UnpackRow = UnpackRowSSE2<PixelFormat_RGB565>;
+        *PackRow = PackRowSSE2<PixelFormat_RGB565>;
+      } break;
+      case PixelFormat_Indexed8:
+      {
+        *UnpackRow = UnpackRowSSE2<PixelFormat_Indexed8>;
+        *PackRow = PackRowSSE2<PixelFormat_Indexed8>;
+      } break;
+      default: {} break;
+    }
+  }
+  else if(Kernel == SIMDKernel_AVX2)
+  {
+    switch(Format)
+    {
+      case PixelFormat_RGB565:
+      {
+        *UnpackRow = UnpackRowAVX2<PixelFormat_RGB565>;
+        *PackRow = PackRowAVX2<PixelFormat_RGB565>;
+      } break;
+      case PixelFormat_Indexed8:
+      {
+        *UnpackRow = UnpackRowAVX2<PixelFormat_Indexed8>;
+        *PackRow = PackRowAVX2<PixelFormat_Indexed8>;
+      } break;
+      default: {} break;
+    }
+  }
+#endif
+  return(*UnpackRow != 0);
+}
+
+/*
+  NOTE: Draws Bitmap with its top-left corner at (X, Y), clipped to the
+  buffer. Opaque bitmaps are just copied. The scalar kernel blends the
+  other formats a pixel at a time; the SIMD ones go through BGRA32.
+*/
+internal void
+DrawBitmap(game_offscreen_buffer *Buffer, loaded_bitmap *Bitmap, int X, int Y,
+           simd_kernel Kernel = BestSIMDKernel())
+{
+  if(!Bitmap->Memory) return;
+
+  int MinX = X;
+  int MinY = Y;
+  int MaxX = X + Bitmap->Width;
+  int MaxY = Y + Bitmap->Height;
+  int SourceX = 0;
+  int SourceY = 0;
+  if(MinX < 0) { SourceX = -MinX; MinX = 0; }
+  if(MinY < 0) { SourceY = -MinY; MinY = 0; }
+  if(MaxX > Buffer->Width) { MaxX = Buffer->Width; }
+  if(MaxY > Buffer->Height) { MaxY = Buffer->Height; }
+  if((MinX >= MaxX) || (MinY >= MaxY)) return;
+
+  blend_row *BlendRow = BlendRowScalar;
+  switch(Kernel)
+  {
+#if HANDMADE_X86
+    case SIMDKernel_SSE2: { BlendRow = BlendRowSSE2; } break;
+    case SIMDKernel_AVX2: { BlendRow = BlendRowAVX2; } break;
+#endif
+    default: {} break;
+  }
+
+  int Count = MaxX - MinX;
+  int BytesPerPixel = GetBytesPerPixel(Buffer->Format);
+  uint8 *DestRow = (uint8 *)Buffer->Memory + MinY * Buffer->Pitch + MinX * BytesPerPixel;
+  uint8 *SourceRow = (uint8 *)Bitmap->Memory + SourceY * Bitmap->Pitch + SourceX * sizeof(uint32);
+
+  if((Buffer->Format == PixelFormat_RGBA32) && (BlendRow != BlendRowScalar))
+  {
+    for(int Row = MinY;
+        Row < MaxY;
+        ++Row)
+    {
+      BlendRowSwappingRedBlue(BlendRow, (uint32 *)DestRow, (uint32 *)SourceRow, Count, Bitmap->IsOpaque);
+      DestRow += Buffer->Pitch;
+      SourceRow += Bitmap->Pitch;
+    }
+    return;
+  }
+
+  unpack_row *UnpackRow;
+  pack_row *PackRow;
+  if(GetBlitRowConverters(Kernel, Buffer->Format, &UnpackRow, &PackRow))
+  {
+    for(int Row = MinY;
+        Row < MaxY;
+        ++Row)
+    {
+      BlendRowThroughBGRA32(BlendRow, UnpackRow, PackRow, BytesPerPixel, DestRow, (uint32 *)SourceRow, Count,
+                            Bitmap->IsOpaque);
+      DestRow += Buffer->Pitch;
+      SourceRow += Bitmap->Pitch;
+    }
+    return;
+  }
+
+  if(Buffer->Format != PixelFormat_BGRA32)
+  {
+    void (*BlendRowInFormat)(void *, uint32 *, int, bool32) = BlendRowAs<PixelFormat_BGRA32>;
+    switch(Buffer->Format)
+    {
+      case PixelFormat_RGBA32: { BlendRowInFormat = BlendRowAs<PixelFormat_RGBA32>; } break;
+      case PixelFormat_RGB565: { BlendRowInFormat = BlendRowAs<PixelFormat_RGB565>; } break;
+      case PixelFormat_Indexed8: { BlendRowInFormat = BlendRowAs<PixelFormat_Indexed8>; } break;
+      default: {} break;
+    }
+    for(int Row = MinY;
+        Row < MaxY;
+        ++Row)
+    {
+      BlendRowInFormat(DestRow, (uint32 *)SourceRow, Count, Bitmap->IsOpaque);
+      DestRow += Buffer->Pitch;
+      SourceRow += Bitmap->Pitch;
+    }
+    return;
+  }
+
+  for(int Row = MinY;
+      Row < MaxY;
+      ++Row)
+  {
+    if(Bitmap->IsOpaque)
+    {
+      memcpy(DestRow, SourceRow, Count * sizeof(uint32));
+    }
+    else
+    {
+      BlendRow((uint32 *)DestRow, (uint32 *)SourceRow, Count);
+    }
+
+    DestRow += Buffer->Pitch;
+    SourceRow += Bitmap->Pitch;
+  }
+}
+
+#if HANDMADE_SLOW
+/*
+  NOTE: Blends small bitmaps of every awkward width, including partly
+  off-screen ones, into every format with each supported kernel and
+  asserts they match the scalar reference byte for byte. Every pixel the
+  narrower formats can hold gets unpacked too.
+*/
+internal void
+DEBUGVerifyBlitKernels()
+{
+  int const BufferWidth = 37;
+  int const BufferHeight = 5;
+  local_persist uint32 Expected[BufferWidth * BufferHeight];
+  local_persist uint32 Actual[BufferWidth * BufferHeight];
+  local_persist uint32 Pixels[40 * 3];
+
+  // Every alpha from transparent to opaque, with colours that respect it.
+  for(int PixelIndex = 0; PixelIndex < (int)ArrayCount(Pixels); ++PixelIndex)
+  {
+    uint32 Alpha = (PixelIndex * 37) & 0xFF;
+    if(PixelIndex % 7 == 0) Alpha = 0;
+    if(PixelIndex % 5 == 0) Alpha = 255;
+    Pixels[PixelIndex] = ((Alpha << 24) |
+                          (MultiplyByte(PixelIndex * 11 & 0xFF, Alpha) << 16) |
+                          (MultiplyByte(PixelIndex * 29 & 0xFF, Alpha) << 8) |
+                          MultiplyByte(PixelIndex * 53 & 0xFF, Alpha));
+  }
+
+  int Widths[] = {1, 3, 4, 5, 7, 8, 9, 15, 16, 17, 40};
+  int Positions[] = {-9, -1, 0, 1, 3, 30};
+
+  for(int Kernel = SIMDKernel_Scalar + 1;
+      Kernel < SIMDKernel_Count;
+      ++Kernel)
+  {
+    if(!SIMDKernelSupported((simd_kernel)Kernel)) continue;
+
+    for(int Format = 0; Format < PixelFormat_Count; ++Format)
+    for(int IsOpaque = 0; IsOpaque <= 1; ++IsOpaque)
+    for(int WidthIndex = 0; WidthIndex < (int)ArrayCount(Widths); ++WidthIndex)
+    for(int XIndex = 0; XIndex < (int)ArrayCount(Positions); ++XIndex)
+    for(int Y = -2; Y < 4; ++Y)
+    {
+      loaded_bitmap Bitmap = {};
+      Bitmap.Width = Widths[WidthIndex];
+      Bitmap.Height = 3;
+      Bitmap.Pitch = 40 * sizeof(uint32);
+      Bitmap.Memory = Pixels;
+      Bitmap.IsOpaque = IsOpaque;
+      int Pitch = BufferWidth * GetBytesPerPixel((pixel_format)Format);
+
+      for(int PixelIndex = 0; PixelIndex < (int)ArrayCount(Expected); ++PixelIndex)
+      {
+        Expected[PixelIndex] = Actual[PixelIndex] = 0x80000000 | (PixelIndex * 2654435761u >> 8);
+      }
+
+      game_offscreen_buffer Reference = {};
+      Reference.Memory = Expected;
+      Reference.Width = BufferWidth;
+      Reference.Height = BufferHeight;
+      Reference.Pitch = Pitch;
+      Reference.Format = (pixel_format)Format;
+
+      game_offscreen_buffer Candidate = Reference;
+      Candidate.Memory = Actual;
+      DrawBitmap(&Reference, &Bitmap, Positions[XIndex], Y, SIMDKernel_Scalar);
+      DrawBitmap(&Candidate, &Bitmap, Positions[XIndex], Y, (simd_kernel)Kernel);
+
+      for(int PixelIndex = 0; PixelIndex < (int)ArrayCount(Expected); ++PixelIndex)
+      {
+        Assert(Expected[PixelIndex] == Actual[PixelIndex]);
+      }
+    }
+
+    for(int Format = 0; Format < PixelFormat_Count; ++Format)
+    {
+      unpack_row *UnpackRow;
+      pack_row *PackRow;
+      if(!GetBlitRowConverters((simd_kernel)Kernel, (pixel_format)Format, &UnpackRow, &PackRow)) continue;
+
+      int BytesPerPixel = GetBytesPerPixel((pixel_format)Format);
+      uint32 PixelCount = 1u << (8 * BytesPerPixel);
+      uint32 const ChunkCount = 64;
+      local_persist uint16 Packed[ChunkCount];
+      local_persist uint32 Unpacked[ChunkCount];
+      for(uint32 Base = 0; Base < PixelCount; Base += ChunkCount)
+      {
+        for(uint32 Index = 0; Index < ChunkCount; ++Index)
+        {
+          uint32 Pixel = Base + Index;
+          if(BytesPerPixel == 2) Packed[Index] = (uint16)Pixel;
+          else ((uint8 *)Packed)[Index] = (uint8)Pixel;
+        }
+        UnpackRow(Unpacked, Packed, ChunkCount);
+        for(uint32 Index = 0; Index < ChunkCount; ++Index)
+        {
+          uint32 Pixel = Base + Index;
+          uint32 Reference = ((Format == PixelFormat_RGB565) ?
+                              UnpackPixel<PixelFormat_RGB565>((uint16)Pixel) :
+                              UnpackPixel<PixelFormat_Indexed8>((uint8)Pixel));
+          Assert(Unpacked[Index] == Reference);
+        }
+      }
+    }
+  }
+}
+#endif
+
+global_variable platform_api Platform;
+
+inline game_rect
+RectIntersect(game_rect A, game_rect B)
+{
+  game_rect Result;
+  Result.MinX = (A.MinX > B.MinX) ? A.MinX : B.MinX;
+  Result.MinY = (A.MinY > B.MinY) ? A.MinY : B.MinY;
+  Result.MaxX = (A.MaxX < B.MaxX) ? A.MaxX : B.MaxX;
+  Result.MaxY = (A.MaxY < B.MaxY) ? A.MaxY : B.MaxY;
+  return(Result);
+}
+
+inline bool32
+HasArea(game_rect Rect)
+{
+  return((Rect.MinX < Rect.MaxX) && (Rect.MinY < Rect.MaxY));
+}
+
+// NOTE: Rect must lie inside Buffer.
+inline game_offscreen_buffer
+GetSubBuffer(game_offscreen_buffer *Buffer, game_rect Rect)
+{
+  game_offscreen_buffer Result = {};
+  Result.Memory = (uint8 *)Buffer->Memory + Rect.MinY * Buffer->Pitch + Rect.MinX * GetBytesPerPixel(Buffer->Format);
+  Result.Width = Rect.MaxX - Rect.MinX;
+  Result.Height = Rect.MaxY - Rect.MinY;
+  Result.Pitch = Buffer->Pitch;
+  Result.Format = Buffer->Format;
+  return(Result);
+}
+
+#include "handmade_render_group.cpp"
+#include "handmade_entity.cpp"
+#include "handmade_audio.cpp"
+
+/*
+  NOTE: Dirty tiles. The game marks whatever it changes, in pixels; that gets
+  rounded out to whole tiles, one bit per tile, and the marked tiles are then
+  merged back into as few rects as a row-by-row sweep finds: runs of tiles
+  along each row, stacked with identical runs in the rows below them.
+*/
+#define DIRTY_TILE_SIZE 64
+
+struct dirty_tile_map
+{
+  int TileSize; // NOTE: Grows for buffers too wide for 64 tiles across.
+  int TileCountX;
+  int TileCountY;
+  int Width;
+  int Height;
+  uint64 *Rows;
+};
+
+internal dirty_tile_map
+BeginDirtyTiles(memory_arena *Arena, int Width, int Height)
+{
+  dirty_tile_map Result = {};
+  Result.TileSize = DIRTY_TILE_SIZE;
+  while(Result.TileSize * 64 < Width)
+  {
+    Result.TileSize *= 2;
+  }
+  Result.TileCountX = (Width + Result.TileSize - 1) / Result.TileSize;
+  Result.TileCountY = (Height + Result.TileSize - 1) / Result.TileSize;
+  Result.Width = Width;
+  Result.Height = Height;
+  Result.Rows = PushArray(Arena, Result.TileCountY, uint64);
+  memset(Result.Rows, 0, Result.TileCountY * sizeof(uint64));
+  return(Result);
+}
+
+internal void
+MarkDirty(dirty_tile_map *Map, game_rect Rect)
+{
+  game_rect Screen = {0, 0, Map->Width, Map->Height};
+  Rect = RectIntersect(Rect, Screen);
+  if(!HasArea(Rect)) return;
+
+  int MinTileX = Rect.MinX / Map->TileSize;
+  int MaxTileX = (Rect.MaxX - 1) / Map->TileSize;
+  int TileCount = MaxTileX - MinTileX + 1;
+  uint64 Bits = ((TileCount == 64) ? ~0ull : ((1ull << TileCount) - 1)) << MinTileX;
+  for(int TileY = Rect.MinY / Map->TileSize;
+      TileY <= (Rect.MaxY - 1) / Map->TileSize;
+      ++TileY)
+  {
+    Map->Rows[TileY] |= Bits;
+  }
+}
+
+internal void
+CoalesceDirtyTiles(dirty_tile_map *Map, game_dirty_rects *Out)
+{
+  Out->Count = 0;
+  Out->PixelCount = 0;
+
+  for(int TileY = 0;
+      TileY < Map->TileCountY;
+      ++TileY)
+  {
+    int MinY = TileY * Map->TileSize;
+    uint64 Row = Map->Rows[TileY];
+    while(Row)
+    {
+      int MinTileX = __builtin_ctzll(Row);
+      uint64 RunBits = Row >> MinTileX;
+      int RunLength = (~RunBits) ? __builtin_ctzll(~RunBits) : (64 - MinTileX);
+      Row &= ~(((RunLength == 64) ? ~0ull : ((1ull << RunLength) - 1)) << MinTileX);
+
+      game_rect Run;
+      Run.MinX = MinTileX * Map->TileSize;
+      Run.MinY = MinY;
+      Run.MaxX = (MinTileX + RunLength) * Map->TileSize;
+      Run.MaxY = MinY + Map->TileSize;
+
+      // Grow the rect from the row above if it spans exactly the same tiles.
+      game_rect *Extended = 0;
+      for(int RectIndex = 0; RectIndex < Out->Count; ++RectIndex)
+      {
+        game_rect *Rect = Out->Rects + RectIndex;
+        if((Rect->MaxY == MinY) && (Rect->MinX == Run.MinX) && (Rect->MaxX == Run.MaxX))
+        {
+          Extended = Rect;
+          break;
+        }
+      }
+
+      if(Extended)
+      {
+        Extended->MaxY = Run.MaxY;
+      }
+      else if(Out->Count < MAX_DIRTY_RECTS)
+      {
+        Out->Rects[Out->Count++] = Run;
+      }
+      else
+      {
+        // NOTE: Too scattered to be worth tracking: call it all dirty.
+        Out->Count = 1;
+        Out->Rects[0] = {0, 0, Map->Width, Map->Height};
+        Out->PixelCount = (int64)Map->Width * Map->Height;
+        return;
+      }
+    }
+  }
+
+  // The tiles along the right and bottom edges may hang off the buffer.
+  game_rect Screen = {0, 0, Map->Width, Map->Height};
+  for(int RectIndex = 0; RectIndex < Out->Count; ++RectIndex)
+  {
+    game_rect *Rect = Out->Rects + RectIndex;
+    *Rect = RectIntersect(*Rect, Screen);
+    Out->PixelCount += (int64)(Rect->MaxX - Rect->MinX) * (Rect->MaxY - Rect->MinY);
+  }
+}
+
+/*
+  NOTE: Sound synthesis. Every voice is mixed into a mono real32 buffer four
+  samples at a time and copied to both channels, streams get resampled in
+  on top of that, and then the mix is rounded, clamped and interleaved in
+  one pass at the end.
+*/
+#define SOUND_MIX_LANES 4
+
+/*
+  sin(2*Pi*Turns) for Turns in [-0.5, 0.5]. Folding onto [-0.25, 0.25] lets a
+  degree 9 Taylor polynomial get within ~4e-6 of sinf, well under one 16-bit
+  step.
+*/
+#define SINE_C3 (-1.0f / 6.0f)
+#define SINE_C5 (1.0f / 120.0f)
+#define SINE_C7 (-1.0f / 5040.0f)
+#define SINE_C9 (1.0f / 362880.0f)
+
+inline real32
+SineOfTurns(real32 Turns)
+{
+  if(Turns > 0.25f)
+  {
+    Turns = 0.5f - Turns;
+  }
+  else if(Turns < -0.25f)
+  {
+    Turns = -0.5f - Turns;
+  }
+
+  real32 Z = 2.0f * Pi32 * Turns;
+  real32 Z2 = Z * Z;
+  real32 Result = Z * (1.0f + Z2 * (SINE_C3 + Z2 * (SINE_C5 + Z2 * (SINE_C7 + Z2 * SINE_C9))));
+  return(Result);
+}
+
+// Brings a phase back to [0, 1) turns.
+inline real32
+WrapTurns(real32 Turns)
+{
+  return(Turns - floorf(Turns));
+}
+
+inline int16
+ClampToInt16(real32 Value)
+{
+  int32 Rounded = (int32)floorf(Value + 0.5f);
+  if(Rounded > 32767) Rounded = 32767;
+  if(Rounded < -32768) Rounded = -32768;
+  return((int16)Rounded);
+}
+
+#if HANDMADE_X86
+inline __m128
+SineOfTurns4(__m128 Turns)
+{
+  __m128 SignMask = _mm_set1_ps(-0.0f);
+  __m128 Sign = _mm_and_ps(Turns, SignMask);
+  __m128 Magnitude = _mm_andnot_ps(SignMask, Turns);
+
+  // Mirror anything past a quarter turn back onto [-0.25, 0.25].
+  __m128 Folded = _mm_sub_ps(_mm_or_ps(_mm_set1_ps(0.5f), Sign), Turns);
+  __m128 NeedsFold = _mm_cmpgt_ps(Magnitude, _mm_set1_ps(0.25f));
+  Turns = _mm_or_ps(_mm_and_ps(NeedsFold, Folded), _mm_andnot_ps(NeedsFold, Turns));
+
+  __m128 Z = _mm_mul_ps(_mm_set1_ps(2.0f * Pi32), Turns);
+  __m128 Z2 = _mm_mul_ps(Z, Z);
+  __m128 Poly = _mm_set1_ps(SINE_C9);
+  Poly = _mm_add_ps(_mm_set1_ps(SINE_C7), _mm_mul_ps(Z2, Poly));
+  Poly = _mm_add_ps(_mm_set1_ps(SINE_C5), _mm_mul_ps(Z2, Poly));
+  Poly = _mm_add_ps(_mm_set1_ps(SINE_C3), _mm_mul_ps(Z2, Poly));
+  Poly = _mm_add_ps(_mm_set1_ps(1.0f), _mm_mul_ps(Z2, Poly));
+  return(_mm_mul_ps(Z, Poly));
+}
+#endif
+
+/*
+  Adds every voice into Mix, which must hold SampleCount samples rounded up to
+  a multiple of SOUND_MIX_LANES and be 16-byte aligned. Voices come out with
+  their phases advanced by SampleCount samples.
+*/
+internal void
+MixVoices(sound_voice *Voices, int VoiceCount, real32 *Mix, int SampleCount, int SamplesPerSecond)
+{
+  TIMED_FUNCTION();
+
+  int ChunkCount = (SampleCount + SOUND_MIX_LANES - 1) / SOUND_MIX_LANES;
+
+  for(int VoiceIndex = 0;
+      VoiceIndex < VoiceCount;
+      ++VoiceIndex)
+  {
+    sound_voice *Voice = Voices + VoiceIndex;
+    real32 dPhase = Voice->Hz / (real32)SamplesPerSecond;
+
+#if HANDMADE_X86
+    __m128 Volume = _mm_set1_ps(Voice->Volume);
+    __m128 PhaseStep = _mm_set1_ps(SOUND_MIX_LANES * dPhase);
+    __m128 Phase = _mm_add_ps(_mm_set1_ps(Voice->Phase),
+                              _mm_mul_ps(_mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f), _mm_set1_ps(dPhase)));
+    for(int ChunkIndex = 0;
+        ChunkIndex < ChunkCount;
+        ++ChunkIndex)
+    {
+      // Rounding to the nearest whole turn leaves us in [-0.5, 0.5].
+      __m128 Turns = _mm_sub_ps(Phase, _mm_cvtepi32_ps(_mm_cvtps_epi32(Phase)));
+      __m128 *Dest = (__m128 *)(Mix + ChunkIndex * SOUND_MIX_LANES);
+      *Dest = _mm_add_ps(*Dest, _mm_mul_ps(Volume, SineOfTurns4(Turns)));
+
+      // Drop whole turns as we go, so the lanes never lose precision.
+      Phase = _mm_add_ps(Phase, PhaseStep);
+      Phase = _mm_sub_ps(Phase, _mm_cvtepi32_ps(_mm_cvttps_epi32(Phase)));
+    }
+#else
+    for(int SampleIndex = 0;
+        SampleIndex < ChunkCount * SOUND_MIX_LANES;
+        ++SampleIndex)
+    {
+      real32 Phase = WrapTurns(Voice->Phase + (real32)SampleIndex * dPhase);
+      real32 Turns = (Phase > 0.5f) ? (Phase - 1.0f) : Phase;
+      Mix[SampleIndex] += Voice->Volume * SineOfTurns(Turns);
+    }
+#endif
+
+    Voice->Phase = WrapTurns(Voice->Phase + (real32)SampleCount * dPhase);
+  }
+}
+
+// Rounds and clamps the left and right mixes into interleaved stereo 16-bit samples.
+internal void
+OutputMix(real32 **Mix, game_sound_output_buffer *SoundBuffer)
+{
+  int16 *SampleOut = SoundBuffer->Samples;
+  int SampleIndex = 0;
+
+#if HANDMADE_X86
+  for(;
+      (SampleIndex + SOUND_MIX_LANES) <= SoundBuffer->SampleCount;
+      SampleIndex += SOUND_MIX_LANES)
+  {
+    // NOTE: packs saturates to the int16 range for us.
+    __m128i Left = _mm_cvtps_epi32(_mm_load_ps(Mix[0] + SampleIndex));
+    __m128i Right = _mm_cvtps_epi32(_mm_load_ps(Mix[1] + SampleIndex));
+    __m128i Stereo = _mm_packs_epi32(_mm_unpacklo_epi32(Left, Right), _mm_unpackhi_epi32(Left, Right));
+    _mm_storeu_si128((__m128i *)SampleOut, Stereo);
+    SampleOut += 2 * SOUND_MIX_LANES;
+  }
+#endif
+
+  for(;
+      SampleIndex < SoundBuffer->SampleCount;
+      ++SampleIndex)
+  {
+    *SampleOut++ = ClampToInt16(Mix[0][SampleIndex]);
+    *SampleOut++ = ClampToInt16(Mix[1][SampleIndex]);
+  }
+}
+
+// NOTE: Mixer may be 0, for just the voices.
+internal void
+OutputSound(memory_arena *TempArena, sound_voice *Voices, int VoiceCount, audio_mixer *Mixer,
+            game_sound_output_buffer *SoundBuffer)
+{
+  temporary_memory MixMemory = BeginTemporaryMemory(TempArena);
+
+  int MixSampleCount = Align(SoundBuffer->SampleCount, SOUND_MIX_LANES);
+  real32 *Mix[2];
+  Mix[0] = PushArray(TempArena, MixSampleCount, real32, 16);
+  Mix[1] = PushArray(TempArena, MixSampleCount, real32, 16);
+  for(int SampleIndex = 0;
+      SampleIndex < MixSampleCount;
+      ++SampleIndex)
+  {
+    Mix[0][SampleIndex] = 0.0f;
+  }
+
+  MixVoices(Voices, VoiceCount, Mix[0], SoundBuffer->SampleCount, SoundBuffer->SamplesPerSecond);
+  memcpy(Mix[1], Mix[0], MixSampleCount*sizeof(real32));
+  if(Mixer)
+  {
+    MixStreams(Mixer, Mix, SoundBuffer->SampleCount, SoundBuffer->SamplesPerSecond);
+  }
+  OutputMix(Mix, SoundBuffer);
+
+  EndTemporaryMemory(MixMemory);
+}
+
+/*
+  NOTE: Asset streaming. Loads go onto the platform's low priority queue and
+  are read in a chunk at a time straight into game memory, so the frame
+  never waits on the disk; poll IsFileLoaded to find out when one is done.
+*/
+#define LOAD_CHUNK_SIZE Megabytes(1)
+
+internal
+PLATFORM_WORK_QUEUE_CALLBACK(DoLoadFileWork)
+{
+  TIMED_BLOCK("LoadFile");
+  loaded_file *File = (loaded_file *)Data;
+
+  for(uint64 Offset = 0;
+      Offset < File->Size;
+      Offset += LOAD_CHUNK_SIZE)
+  {
+    uint64 ChunkSize = File->Size - Offset;
+    if(ChunkSize > LOAD_CHUNK_SIZE)
+    {
+      ChunkSize = LOAD_CHUNK_SIZE;
+    }
+    if(!Platform.ReadDataFromFile(&File->Handle, Offset, ChunkSize, (uint8 *)File->Contents + Offset))
+    {
+      break;
+    }
+  }
+
+  File->LoadFailed = !File->Handle.NoErrors;
+  Platform.CloseFile(&File->Handle);
+  __atomic_store_n(&File->IsLoaded, true, __ATOMIC_RELEASE);
+}
+
+/*
+  NOTE: Makes room for the whole file in Arena right away, so the arena is
+  only ever touched from the calling thread. Returns false, and starts
+  nothing, if the file can't be opened or doesn't fit.
+*/
+internal bool32
+LoadFileAsync(memory_arena *Arena, char *Filename, loaded_file *File)
+{
+  *File = {};
+  File->Handle = Platform.OpenFile(Filename);
+  if(!File->Handle.NoErrors)
+  {
+    return(false);
+  }
+
+  File->Size = File->Handle.Size;
+  if(File->Size > GetArenaSizeRemaining(Arena, CACHE_LINE_SIZE))
+  {
+    Platform.CloseFile(&File->Handle);
+    return(false);
+  }
+  File->Contents = PushSize(Arena, File->Size, CACHE_LINE_SIZE);
+
+  Platform.AddEntry(Platform.LowPriorityQueue, DoLoadFileWork, File);
+  return(true);
+}
+
+// NOTE: xorshift32; State must never be zero.
+inline uint32
+NextRandom(uint32 *State)
+{
+  uint32 X = *State;
+  X ^= X << 13;
+  X ^= X >> 17;
+  X ^= X << 5;
+  *State = X;
+  return(X);
+}
+
+// -1..1
+inline real32
+NextRandomBilateral(uint32 *State)
+{
+  real32 Result = (real32)(NextRandom(State) >> 8) * (2.0f / 16777216.0f) - 1.0f;
+  return(Result);
+}
+
+inline game_rect
+GetMoteRect(entity_table *Motes, uint32 Index)
+{
+  game_rect Result;
+  Result.MinX = (int)floorf(Motes->PositionX[Index]) - MOTE_SIZE / 2;
+  Result.MinY = (int)floorf(Motes->PositionY[Index]) - MOTE_SIZE / 2;
+  Result.MaxX = Result.MinX + MOTE_SIZE;
+  Result.MaxY = Result.MinY + MOTE_SIZE;
+  return(Result);
+}
+
+// The motes with any part of them on the screen, as of the last BuildSpatialHash.
+internal uint32
+GetVisibleMotes(game_state *GameState, int Width, int Height, uint32 *Results)
+{
+  real32 Margin = (real32)(MOTE_SIZE / 2);
+  uint32 Result = QueryEntitiesInRect(&GameState->MoteHash, &GameState->DrawnMotes, -Margin, -Margin,
+                                      (real32)Width + Margin, (real32)Height + Margin,
+                                      Results, GameState->DrawnMotes.Count);
+  return(Result);
+}
+
+inline game_rect
+GetSpriteRect(game_state *GameState, int Width, int Height)
+{
+  loaded_bitmap *Sprite = &GameState->Sprite;
+  game_rect Result;
+  Result.MinX = (Width - Sprite->Width) / 2 + GameState->SpriteOffsetX;
+  Result.MinY = (Height - Sprite->Height) / 2 + GameState->SpriteOffsetY;
+  Result.MaxX = Result.MinX + Sprite->Width;
+  Result.MaxY = Result.MinY + Sprite->Height;
+  return(Result);
+}
+
+#if HANDMADE_SLOW
+// NOTE: Every game-side kernel check; the headless bench runs these too (--verify).
+internal void
+DEBUGVerifyKernels()
+{
+  DEBUGVerifyGradientKernels();
+  DEBUGVerifyBlitKernels();
+  DEBUGVerifyEntityKernels();
+  DEBUGVerifyResampleKernels();
+}
+#endif
+
+internal game_state *
+GetGameState(game_memory *Memory)
+{
+  Assert(sizeof(game_state) <= Memory->PermanentStorageSize);
+
+  game_state *GameState = (game_state *)Memory->PermanentStorage;
+  if(!Memory->IsInitialized)
+  {
+#if HANDMADE_SLOW
+    DEBUGVerifyKernels();
+#endif
+
+    InitializeArena(&GameState->PermanentArena,
+                    Memory->PermanentStorageSize - sizeof(game_state),
+                    (uint8 *)Memory->PermanentStorage + sizeof(game_state));
+    InitializeArena(&GameState->TransientArena,
+                    Memory->TransientStorageSize,
+                    Memory->TransientStorage);
+
+    GameState->ToneHz = 256; // close to a middle C note
+    GameState->ToneVoice.Hz = (real32)GameState->ToneHz;
+    GameState->ToneVoice.Volume = 7000.0f;
+    InitializeAudioMixer(&GameState->Mixer, &GameState->PermanentArena, &GameState->TransientArena);
+
+    InitializeEntityTable(&GameState->Motes, &GameState->PermanentArena, MOTE_MAX_COUNT);
+    entity_table *DrawnMotes = &GameState->DrawnMotes;
+    *DrawnMotes = GameState->Motes;
+    DrawnMotes->PositionX = PushArray(&GameState->PermanentArena, DrawnMotes->MaxCount, real32, CACHE_LINE_SIZE);
+    DrawnMotes->PositionY = PushArray(&GameState->PermanentArena, DrawnMotes->MaxCount, real32, CACHE_LINE_SIZE);
+    memset(DrawnMotes->PositionX, 0, DrawnMotes->MaxCount * sizeof(real32));
+    memset(DrawnMotes->PositionY, 0, DrawnMotes->MaxCount * sizeof(real32));
+    InitializeSpatialHash(&GameState->MoteHash, &GameState->PermanentArena, MOTE_MAX_COUNT,
+                          (uint32)((MOTE_WORLD_WIDTH / MOTE_CELL_SIZE) * (MOTE_WORLD_HEIGHT / MOTE_CELL_SIZE)),
+                          MOTE_CELL_SIZE);
+    GameState->RandomState = 0x2545F491;
+
+    // NOTE: The sprite is optional; the game runs fine without the file,
+    // and without it until it's in.
+    GameState->SpriteIsLoading = LoadFileAsync(&GameState->PermanentArena, (char *)"test_sprite.bmp",
+                                               &GameState->SpriteFile);
+
+    Memory->IsInitialized = true;
+  }
+
+  return(GameState);
+}
+
+extern "C"
+GAME_UPDATE(GameUpdate)
+{
+  Platform = Memory->PlatformAPI;
+#if HANDMADE_INTERNAL
+  GlobalDebugTable = Memory->DebugTable;
+#endif
+  TIMED_FUNCTION();
+
+  Assert((&Input->Controllers[0].Terminator - &Input->Controllers[0].Buttons[0]) ==
+         (int)ArrayCount(Input->Controllers[0].Buttons));
+
+  game_state *GameState = GetGameState(Memory);
+  entity_table *Motes = &GameState->Motes;
+  real32 dt = Input->dtForUpdate;
+
+  if(GameState->SpriteIsLoading && IsFileLoaded(&GameState->SpriteFile))
+  {
+    loaded_file *SpriteFile = &GameState->SpriteFile;
+    if(!SpriteFile->LoadFailed)
+    {
+      GameState->Sprite = LoadBMP(&GameState->PermanentArena, SpriteFile->Contents, SpriteFile->Size);
+    }
+    GameState->SpriteIsLoading = false;
+  }
+
+  GameState->LastXOffset = GameState->XOffset;
+  GameState->LastYOffset = GameState->YOffset;
+  GameState->dtForLastUpdate = dt;
+
+  int MotesToAdd = 0;
+  int MotesToRemove = 0;
+  for(int ControllerIndex = 0;
+      ControllerIndex < (int)ArrayCount(Input->Controllers);
+      ++ControllerIndex)
+  {
+    game_controller_input *Controller = GetController(Input, ControllerIndex);
+    if(!Controller->IsConnected) continue;
+
+    if(Controller->IsAnalog)
+    {
+      // Control side-scrolling with joystick.
+      GameState->XOffset += GRADIENT_SCROLL_SPEED*dt*Controller->StickAverageX;
+      GameState->YOffset += GRADIENT_SCROLL_SPEED*dt*Controller->StickAverageY;
+
+      // Control pitch with joystick
+      GameState->ToneHz = 512 + (int)(256.0f*Controller->StickAverageY);
+    }
+
+    // Step the gradient around, one notch per press.
+    GameState->YOffset += 12.0f*GetPressCount(Controller->MoveUp);
+    GameState->XOffset += 12.0f*GetPressCount(Controller->MoveLeft);
+    GameState->YOffset -= 12.0f*GetPressCount(Controller->MoveDown);
+    GameState->XOffset -= 12.0f*GetPressCount(Controller->MoveRight);
+
+    // And the sprite, with the action buttons.
+    GameState->SpriteOffsetY -= 8*GetPressCount(Controller->ActionUp);
+    GameState->SpriteOffsetX -= 8*GetPressCount(Controller->ActionLeft);
+    GameState->SpriteOffsetY += 8*GetPressCount(Controller->ActionDown);
+    GameState->SpriteOffsetX += 8*GetPressCount(Controller->ActionRight);
+
+    MotesToAdd += MOTE_BURST_COUNT*GetPressCount(Controller->RightShoulder);
+    MotesToRemove += MOTE_BURST_COUNT*GetPressCount(Controller->LeftShoulder);
+
+    // Music on and off.
+    for(int PressIndex = GetPressCount(Controller->Start); PressIndex > 0; --PressIndex)
+    {
+      // NOTE: The stream stops by itself if the file turns out to be no good.
+      if(GameState->Music && GameState->Music->IsPlaying)
+      {
+        StopStream(GameState->Music);
+        GameState->Music = 0;
+      }
+      else
+      {
+        GameState->Music = PlayWAV(&GameState->Mixer, (char *)"test_music.wav", 0.5f, true);
+      }
+    }
+  }
+
+  // NOTE: New motes come out of the sprite, as placed on the last frame drawn.
+  for(int MoteIndex = 0; (MoteIndex < MotesToRemove) && Motes->Count; ++MoteIndex)
+  {
+    RemoveEntity(Motes, GetEntityHandle(Motes, 0));
+  }
+  game_rect SpriteRect = GetSpriteRect(GameState, GameState->DrawnWidth, GameState->DrawnHeight);
+  real32 SpriteCenterX = 0.5f*(real32)(SpriteRect.MinX + SpriteRect.MaxX);
+  real32 SpriteCenterY = 0.5f*(real32)(SpriteRect.MinY + SpriteRect.MaxY);
+  for(int MoteIndex = 0; MoteIndex < MotesToAdd; ++MoteIndex)
+  {
+    uint32 *Random = &GameState->RandomState;
+    real32 dX = MOTE_MAX_SPEED*NextRandomBilateral(Random);
+    real32 dY = MOTE_MAX_SPEED*NextRandomBilateral(Random);
+    uint32 Color = 0xFF000000 | NextRandom(Random);
+    AddEntity(Motes, WrapCoordinate(SpriteCenterX, MOTE_WORLD_WIDTH), WrapCoordinate(SpriteCenterY, MOTE_WORLD_HEIGHT),
+              dX, dY, Color);
+  }
+  MoveEntities(Motes, dt, MOTE_WORLD_WIDTH, MOTE_WORLD_HEIGHT);
+
+  CheckArena(&GameState->PermanentArena);
+  CheckArena(&GameState->TransientArena);
+}
+
+extern "C"
+GAME_RENDER(GameRender)
+{
+  Platform = Memory->PlatformAPI;
+#if HANDMADE_INTERNAL
+  GlobalDebugTable = Memory->DebugTable;
+#endif
+  TIMED_FUNCTION();
+
+  game_state *GameState = GetGameState(Memory);
+  entity_table *Motes = &GameState->Motes;
+  entity_table *DrawnMotes = &GameState->DrawnMotes;
+
+  // NOTE: Wherever the motes on screen were drawn last frame has to be
+  // redrawn, whatever has happened to them since.
+  temporary_memory DirtyMemory = BeginTemporaryMemory(&GameState->TransientArena);
+  dirty_tile_map DirtyTiles = BeginDirtyTiles(&GameState->TransientArena, Buffer->Width, Buffer->Height);
+  uint32 *VisibleMotes = PushArray(&GameState->TransientArena, Motes->MaxCount, uint32);
+  if(GameState->HasDrawn)
+  {
+    uint32 VisibleCount = GetVisibleMotes(GameState, GameState->DrawnWidth, GameState->DrawnHeight, VisibleMotes);
+    for(uint32 VisibleIndex = 0; VisibleIndex < VisibleCount; ++VisibleIndex)
+    {
+      MarkDirty(&DirtyTiles, GetMoteRect(DrawnMotes, VisibleMotes[VisibleIndex]));
+    }
+  }
+
+  // NOTE: Motes only ever move in straight lines, so stepping each one back
+  // from where the last update left it lands it exactly Alpha of the way
+  // along from the update before, and gets the wrap-around right where
+  // blending the two positions wouldn't.
+  DrawnMotes->Count = Motes->Count;
+  memcpy(DrawnMotes->PositionX, Motes->PositionX, Motes->Count*sizeof(real32));
+  memcpy(DrawnMotes->PositionY, Motes->PositionY, Motes->Count*sizeof(real32));
+  MoveEntities(DrawnMotes, (Alpha - 1.0f)*GameState->dtForLastUpdate, MOTE_WORLD_WIDTH, MOTE_WORLD_HEIGHT);
+  BuildSpatialHash(&GameState->MoteHash, DrawnMotes);
+  uint32 VisibleCount = GetVisibleMotes(GameState, Buffer->Width, Buffer->Height, VisibleMotes);
+  for(uint32 VisibleIndex = 0; VisibleIndex < VisibleCount; ++VisibleIndex)
+  {
+    MarkDirty(&DirtyTiles, GetMoteRect(DrawnMotes, VisibleMotes[VisibleIndex]));
+  }
+
+  int XOffset = (int)floorf(GameState->LastXOffset + Alpha*(GameState->XOffset - GameState->LastXOffset));
+  int YOffset = (int)floorf(GameState->LastYOffset + Alpha*(GameState->YOffset - GameState->LastYOffset));
+  loaded_bitmap *Sprite = &GameState->Sprite;
+  game_rect SpriteRect = GetSpriteRect(GameState, Buffer->Width, Buffer->Height);
+
+  // NOTE: Work out what else changed since the last frame...
+  game_rect Screen = {0, 0, Buffer->Width, Buffer->Height};
+  if(!GameState->HasDrawn ||
+     (GameState->DrawnWidth != Buffer->Width) || (GameState->DrawnHeight != Buffer->Height) ||
+     (GameState->DrawnXOffset != XOffset) || (GameState->DrawnYOffset != YOffset))
+  {
+    MarkDirty(&DirtyTiles, Screen);
+  }
+  else if(memcmp(&GameState->DrawnSpriteRect, &SpriteRect, sizeof(SpriteRect)) != 0)
+  {
+    MarkDirty(&DirtyTiles, GameState->DrawnSpriteRect);
+    MarkDirty(&DirtyTiles, SpriteRect);
+  }
+
+  game_dirty_rects *DirtyRects = Buffer->DirtyRects;
+  if(!DirtyRects)
+  {
+    DirtyRects = PushStruct(&GameState->TransientArena, game_dirty_rects);
+  }
+  CoalesceDirtyTiles(&DirtyTiles, DirtyRects);
+
+  // ...and redraw just that, unless what was in the buffer is gone.
+  game_rect *RedrawRects = DirtyRects->Rects;
+  int RedrawCount = DirtyRects->Count;
+  if(!Buffer->DirtyRects || !Buffer->IsPreserved)
+  {
+    RedrawRects = &Screen;
+    RedrawCount = 1;
+  }
+
+  // NOTE: The commands for the whole frame go in every time; only the
+  // parts of them inside the rects being redrawn actually get drawn.
+  render_group *RenderGroup = AllocateRenderGroup(&GameState->TransientArena, Megabytes(4), Buffer);
+  PushGradient(RenderGroup, 0, Screen, XOffset, YOffset);
+  for(uint32 VisibleIndex = 0; VisibleIndex < VisibleCount; ++VisibleIndex)
+  {
+    uint32 Index = VisibleMotes[VisibleIndex];
+    PushRectangle(RenderGroup, 1, GetMoteRect(DrawnMotes, Index), DrawnMotes->Color[Index]);
+  }
+  PushBitmap(RenderGroup, 2, Sprite, SpriteRect.MinX, SpriteRect.MinY);
+  EndRender(RenderGroup, Platform.RenderQueue, &GameState->TransientArena, RedrawRects, RedrawCount,
+            Buffer->RenderStats);
+  EndTemporaryMemory(DirtyMemory);
+
+  GameState->HasDrawn = true;
+  GameState->DrawnWidth = Buffer->Width;
+  GameState->DrawnHeight = Buffer->Height;
+  GameState->DrawnXOffset = XOffset;
+  GameState->DrawnYOffset = YOffset;
+  GameState->DrawnSpriteRect = SpriteRect;
+
+  CheckArena(&GameState->PermanentArena);
+  CheckArena(&GameState->TransientArena);
+}
+
+extern "C"
+GAME_GET_SOUND_SAMPLES(GameGetSoundSamples)
+{
+  Platform = Memory->PlatformAPI;
+#if HANDMADE_INTERNAL
+  GlobalDebugTable = Memory->DebugTable;
+#endif
+  TIMED_FUNCTION();
+
+  game_state *GameState = GetGameState(Memory);
+
+  GameState->ToneVoice.Hz = (real32)GameState->ToneHz;
+  OutputSound(&GameState->TransientArena, &GameState->ToneVoice, 1, &GameState->Mixer, SoundBuffer);
+
+  CheckArena(&GameState->TransientArena);
 }
@@ -1,21 +1,719 @@
 #if !defined(HANDMADE_H)
 
 /*
-  TODO: Services that the platform layer provides to the game.
+  NOTE: This header is shared by the platform layer and the game, which is
+  built on its own as a shared object. Nothing in here may depend on SDL.
 */
 
+#include <stdint.h>
+#include <stddef.h>
+
+/* Macros and type aliases */
+
+// The many faces of 'static'
+#define internal static
+#define local_persist static
+#define global_variable static
+
+typedef int8_t int8;
+typedef int16_t int16;
+typedef int32_t int32;
+typedef int64_t int64;
+typedef int32 bool32;
+
+typedef uint8_t uint8;
+typedef uint16_t uint16;
+typedef uint32_t uint32;
+typedef uint64_t uint64;
+
+typedef size_t memory_index;
+
+typedef float real32;
+typedef double real64;
+
+/*
+  NOTE: Build switches.
+
+  HANDMADE_INTERNAL:
+    0 - Build for public release.
+    1 - Build for developer only.
+
+  HANDMADE_SLOW:
+    0 - No slow code allowed!
+    1 - Slow code welcome (assertions, self-checks).
+*/
+
+#if HANDMADE_SLOW
+// Crash into the debugger right where things went wrong.
+#define Assert(Expression) if(!(Expression)) { *(volatile int *)0 = 0; }
+#else
+#define Assert(Expression)
+#endif
+
+#define Kilobytes(Value) ((Value)*1024LL)
+#define Megabytes(Value) (Kilobytes(Value)*1024LL)
+#define Gigabytes(Value) (Megabytes(Value)*1024LL)
+#define Terabytes(Value) (Gigabytes(Value)*1024LL)
+
+#define ArrayCount(Array) (sizeof(Array) / sizeof((Array)[0]))
+
+// Work split across threads is split on cache line boundaries.
+#define CACHE_LINE_SIZE 64
+#define Align(Value, Alignment) (((Value) + ((Alignment) - 1)) & ~((Alignment) - 1))
+
+/*
+  NOTE: SIMD. Each hot loop (the gradient, blits, scaling, moving entities,
+  resampling) comes as a plain scalar loop plus SSE2 and AVX2 versions of
+  it, and the scalar one is the reference: the others must give exactly the
+  same results, which each module's DEBUGVerify*Kernels() checks. Nothing
+  gets built with -mavx2; the AVX2 functions say so one at a time.
+
+  Define HANDMADE_SIMD_KERNEL to pin every module to one kernel at compile
+  time; otherwise the best one the CPU supports gets picked at startup.
+*/
+#if defined(__x86_64__) || defined(__i386__)
+#define HANDMADE_X86 1
+#include <immintrin.h>
+#define HANDMADE_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define HANDMADE_X86 0
+#endif
+
+enum simd_kernel
+{
+  SIMDKernel_Scalar,
+  SIMDKernel_SSE2,
+  SIMDKernel_AVX2,
+
+  SIMDKernel_Count,
+};
+
+inline bool32
+SIMDKernelSupported(simd_kernel Kernel)
+{
+  bool32 Result = false;
+  switch(Kernel)
+  {
+    case SIMDKernel_Scalar: { Result = true; } break;
+#if HANDMADE_X86
+    case SIMDKernel_SSE2: { Result = __builtin_cpu_supports("sse2"); } break;
+    case SIMDKernel_AVX2: { Result = __builtin_cpu_supports("avx2"); } break;
+#endif
+    default: {} break;
+  }
+  return(Result);
+}
+
+inline simd_kernel
+BestSIMDKernel()
+{
+#if defined(HANDMADE_SIMD_KERNEL)
+  simd_kernel Result = (simd_kernel)HANDMADE_SIMD_KERNEL;
+#else
+  simd_kernel Result = SIMDKernel_Scalar;
+  for(int Kernel = SIMDKernel_Scalar;
+      Kernel < SIMDKernel_Count;
+      ++Kernel)
+  {
+    if(SIMDKernelSupported((simd_kernel)Kernel))
+    {
+      Result = (simd_kernel)Kernel;
+    }
+  }
+#endif
+  return(Result);
+}
+
+#include "handmade_debug.h"
+
+/*
+  NOTE: Services that the platform layer provides to the game.
+*/
+
+/*
+  Work queue: the platform owns a pool of worker threads that pull entries off
+  a queue. The game adds entries and then waits for all of them to finish
+  before touching their results.
+*/
+struct platform_work_queue;
+#define PLATFORM_WORK_QUEUE_CALLBACK(name) void name(platform_work_queue *Queue, void *Data)
+typedef PLATFORM_WORK_QUEUE_CALLBACK(platform_work_queue_callback);
+
+typedef void platform_add_entry(platform_work_queue *Queue, platform_work_queue_callback *Callback, void *Data);
+typedef void platform_complete_all_work(platform_work_queue *Queue);
+
+/*
+  Audio cursors: where the audio device is, counted in (stereo) samples since
+  it started. The platform keeps the write cursor LatencySampleCount samples
+  ahead of the play cursor. Both counts wrap, so only compare differences.
+*/
+struct game_audio_cursors
+{
+  int SamplesPerSecond;
+  uint32 PlayCursor;  // next sample the device will play
+  uint32 WriteCursor; // next sample that will be written
+  uint32 LatencySampleCount;
+};
+
+#define PLATFORM_GET_AUDIO_CURSORS(name) game_audio_cursors name(void)
+typedef PLATFORM_GET_AUDIO_CURSORS(platform_get_audio_cursors);
+
+/*
+  Files: whole-file reads hand back read-only memory (mapped straight from
+  the file where possible) that must be given back with FreeFileMemory.
+  Whole-file writes replace the file only once everything has been written.
+*/
+struct platform_file_contents
+{
+  uint64 Size;
+  void *Contents; // NOTE: Read-only!
+};
+
+#define PLATFORM_READ_ENTIRE_FILE(name) platform_file_contents name(char *Filename)
+typedef PLATFORM_READ_ENTIRE_FILE(platform_read_entire_file);
+
+#define PLATFORM_FREE_FILE_MEMORY(name) void name(platform_file_contents *File)
+typedef PLATFORM_FREE_FILE_MEMORY(platform_free_file_memory);
+
+#define PLATFORM_WRITE_ENTIRE_FILE(name) bool32 name(char *Filename, uint64 MemorySize, void *Memory)
+typedef PLATFORM_WRITE_ENTIRE_FILE(platform_write_entire_file);
+
+/*
+  Streaming: open a file, then read pieces of it into memory the game owns.
+  Reads don't move any file position, so they're safe to make from any
+  thread, including several at once on the same handle.
+*/
+struct platform_file_handle
+{
+  uint64 Size;
+  bool32 NoErrors;
+  int64 PlatformHandle;
+};
+
+#define PLATFORM_OPEN_FILE(name) platform_file_handle name(char *Filename)
+typedef PLATFORM_OPEN_FILE(platform_open_file);
+
+#define PLATFORM_READ_DATA_FROM_FILE(name) bool32 name(platform_file_handle *Handle, uint64 Offset, uint64 Size, void *Dest)
+typedef PLATFORM_READ_DATA_FROM_FILE(platform_read_data_from_file);
+
+#define PLATFORM_CLOSE_FILE(name) void name(platform_file_handle *Handle)
+typedef PLATFORM_CLOSE_FILE(platform_close_file);
+
+struct platform_api
+{
+  platform_work_queue *RenderQueue;
+  // NOTE: For work that may take a while, like loading assets; nobody ever
+  // waits on this one within a frame.
+  platform_work_queue *LowPriorityQueue;
+  platform_add_entry *AddEntry;
+  platform_complete_all_work *CompleteAllWork;
+
+  platform_get_audio_cursors *GetAudioCursors;
+
+  platform_read_entire_file *ReadEntireFile;
+  platform_free_file_memory *FreeFileMemory;
+  platform_write_entire_file *WriteEntireFile;
+
+  platform_open_file *OpenFile;
+  platform_read_data_from_file *ReadDataFromFile;
+  platform_close_file *CloseFile;
+};
+
 /*
-  NOTE: Servces that the game provides to the platform layer.
+  NOTE: Services that the game provides to the platform layer.
 */
 
+/*
+  NOTE: All of the game's memory comes from these two blocks. The platform
+  layer reserves them once at startup and never frees them, so the game never
+  needs to touch the heap.
+*/
+struct game_memory
+{
+  bool32 IsInitialized;
+
+  uint64 PermanentStorageSize;
+  void *PermanentStorage; // NOTE: REQUIRED to be cleared to zero at startup
+
+  uint64 TransientStorageSize;
+  void *TransientStorage; // NOTE: REQUIRED to be cleared to zero at startup
+
+  platform_api PlatformAPI;
+
+#if HANDMADE_INTERNAL
+  debug_table *DebugTable;
+#endif
+};
+
+// NOTE: A rectangle of pixels; Min is inclusive and Max exclusive.
+struct game_rect
+{
+  int32 MinX;
+  int32 MinY;
+  int32 MaxX;
+  int32 MaxY;
+};
+
+#define MAX_DIRTY_RECTS 128
+
+/*
+  NOTE: What the game changed in the buffer this frame, compared with the
+  frame before. The rects never overlap, so PixelCount is exactly how much
+  of the screen changed.
+*/
+struct game_dirty_rects
+{
+  int32 Count;
+  int64 PixelCount;
+  game_rect Rects[MAX_DIRTY_RECTS];
+};
+
+/*
+  NOTE: What the game's renderer got through in a frame. Pixels drawn over
+  more than once count every time.
+*/
+struct game_render_stats
+{
+  int32 CommandCount;
+  int32 TileCount; // screen tiles that had anything drawn in them
+  int64 PixelCount;
+};
+
+/*
+  NOTE: The pixel layouts the game can draw in. The platform picks whichever
+  one the renderer takes natively, so SDL never has to convert a frame. How
+  each one packs its channels is fixed at compile time by its pixel_layout,
+  and the render loops are templates over that, so choosing one costs a
+  single switch per call rather than a branch per pixel.
+*/
+enum pixel_format
+{
+  PixelFormat_BGRA32,   // B, G, R, A in memory: 0xAARRGGBB in a register
+  PixelFormat_RGBA32,   // R, G, B, A in memory: 0xAABBGGRR in a register
+  PixelFormat_RGB565,   // 16 bits, RRRRRGGGGGGBBBBB
+  PixelFormat_Indexed8, // 8 bits, RRRGGGBB: an index into a fixed 3-3-2 palette
+
+  PixelFormat_Count,
+};
+
+constexpr uint32
+ChannelMask(int Bits, int Shift)
+{
+  return(((1u << Bits) - 1) << Shift);
+}
+
+template<pixel_format Format> struct pixel_layout;
+
+template<> struct pixel_layout<PixelFormat_BGRA32>
+{
+  typedef uint32 pixel;
+  static constexpr int RedShift = 16, GreenShift = 8, BlueShift = 0, AlphaShift = 24;
+  static constexpr int RedBits = 8, GreenBits = 8, BlueBits = 8, AlphaBits = 8;
+};
+
+template<> struct pixel_layout<PixelFormat_RGBA32>
+{
+  typedef uint32 pixel;
+  static constexpr int RedShift = 0, GreenShift = 8, BlueShift = 16, AlphaShift = 24;
+  static constexpr int RedBits = 8, GreenBits = 8, BlueBits = 8, AlphaBits = 8;
+};
+
+template<> struct pixel_layout<PixelFormat_RGB565>
+{
+  typedef uint16 pixel;
+  static constexpr int RedShift = 11, GreenShift = 5, BlueShift = 0, AlphaShift = 0;
+  static constexpr int RedBits = 5, GreenBits = 6, BlueBits = 5, AlphaBits = 0;
+};
+
+template<> struct pixel_layout<PixelFormat_Indexed8>
+{
+  typedef uint8 pixel;
+  static constexpr int RedShift = 5, GreenShift = 2, BlueShift = 0, AlphaShift = 0;
+  static constexpr int RedBits = 3, GreenBits = 3, BlueBits = 2, AlphaBits = 0;
+};
+
+// Packs 8-bit channels into Format, keeping the top bits of each.
+template<pixel_format Format>
+inline typename pixel_layout<Format>::pixel
+PackPixel(uint32 Red, uint32 Green, uint32 Blue, uint32 Alpha)
+{
+  typedef pixel_layout<Format> layout;
+  uint32 Result = (((Red >> (8 - layout::RedBits)) << layout::RedShift) |
+                   ((Green >> (8 - layout::GreenBits)) << layout::GreenShift) |
+                   ((Blue >> (8 - layout::BlueBits)) << layout::BlueShift));
+  if(layout::AlphaBits)
+  {
+    Result |= (Alpha >> (8 - layout::AlphaBits)) << layout::AlphaShift;
+  }
+  return((typename pixel_layout<Format>::pixel)Result);
+}
+
+// The other way: back out to 0xAARRGGBB, stretching short channels to the
+// full 0..255 and making formats without alpha opaque.
+template<pixel_format Format>
+inline uint32
+UnpackPixel(typename pixel_layout<Format>::pixel Pixel)
+{
+  typedef pixel_layout<Format> layout;
+  uint32 Red = (Pixel & ChannelMask(layout::RedBits, layout::RedShift)) >> layout::RedShift;
+  uint32 Green = (Pixel & ChannelMask(layout::GreenBits, layout::GreenShift)) >> layout::GreenShift;
+  uint32 Blue = (Pixel & ChannelMask(layout::BlueBits, layout::BlueShift)) >> layout::BlueShift;
+  uint32 Alpha = 255;
+  if(layout::AlphaBits)
+  {
+    Alpha = (Pixel & ChannelMask(layout::AlphaBits, layout::AlphaShift)) >> layout::AlphaShift;
+  }
+  Red = (Red * 255) / ((1u << layout::RedBits) - 1);
+  Green = (Green * 255) / ((1u << layout::GreenBits) - 1);
+  Blue = (Blue * 255) / ((1u << layout::BlueBits) - 1);
+  return((Alpha << 24) | (Red << 16) | (Green << 8) | Blue);
+}
+
+inline int
+GetBytesPerPixel(pixel_format Format)
+{
+  int Result = 4;
+  switch(Format)
+  {
+    case PixelFormat_RGB565: { Result = 2; } break;
+    case PixelFormat_Indexed8: { Result = 1; } break;
+    default: {} break;
+  }
+  return(Result);
+}
+
 struct game_offscreen_buffer {
   void *Memory;
   int Width;
   int Height;
   int Pitch;
+  pixel_format Format; // NOTE: Zero, BGRA32, unless the platform says otherwise.
+
+  // NOTE: Set by the platform when Memory still holds the last frame, in
+  // which case the game only needs to redraw what changed.
+  bool32 IsPreserved;
+  // NOTE: If the platform passes this in, the game fills it in with what it
+  // changed. Without it the game redraws everything every frame.
+  game_dirty_rects *DirtyRects;
+  // NOTE: Likewise, filled in with how much drawing that took.
+  game_render_stats *RenderStats;
+};
+
+struct game_button_state
+{
+  int HalfTransitionCount; // how many times the button flipped this update
+  bool32 EndedDown;
+};
+
+struct game_controller_input
+{
+  bool32 IsConnected;
+  bool32 IsAnalog;
+  // NOTE: Already deadzoned, so a stick at rest reads exactly 0.
+  real32 StickAverageX; // -1..1, left to right
+  real32 StickAverageY; // -1..1, up to down
+
+  union
+  {
+    game_button_state Buttons[12];
+    struct
+    {
+      game_button_state MoveUp;
+      game_button_state MoveDown;
+      game_button_state MoveLeft;
+      game_button_state MoveRight;
+
+      game_button_state ActionUp;
+      game_button_state ActionDown;
+      game_button_state ActionLeft;
+      game_button_state ActionRight;
+
+      game_button_state LeftShoulder;
+      game_button_state RightShoulder;
+
+      game_button_state Back;
+      game_button_state Start;
+
+      // NOTE: All buttons must be added above this line.
+      game_button_state Terminator;
+    };
+  };
+};
+
+/*
+  NOTE: Everything the game gets to know about the player, once per update.
+  This is plain data with no pointers, so it can be written to disk and
+  played back to reproduce a run exactly. The platform keeps the last
+  update's around and starts each one from it, so buttons stay down between
+  updates and every transition in between gets counted.
+*/
+struct game_input
+{
+  // NOTE: How far this update steps the game forward. Always the same in
+  // practice, but it's recorded along with everything else.
+  real32 dtForUpdate;
+
+  // Controller 0 is the keyboard; the rest are gamepads.
+  game_controller_input Controllers[5];
+};
+
+inline game_controller_input *
+GetController(game_input *Input, int ControllerIndex)
+{
+  Assert(ControllerIndex < (int)ArrayCount(Input->Controllers));
+  game_controller_input *Result = &Input->Controllers[ControllerIndex];
+  return(Result);
+}
+
+// How many times the button went down this update.
+inline int
+GetPressCount(game_button_state Button)
+{
+  int Result = (Button.HalfTransitionCount + (Button.EndedDown ? 1 : 0)) / 2;
+  return(Result);
+}
+
+struct game_sound_output_buffer
+{
+  int SamplesPerSecond;
+  int SampleCount;
+  int16 *Samples; // interleaved stereo: SampleCount left/right pairs
+};
+
+/*
+  NOTE: The game's entry points. The platform layer looks these up by name in
+  the game's shared object, so they must keep C linkage.
+
+  The simulation runs at a fixed rate of its own, whatever rate frames go
+  out at: the platform calls GameUpdate as many times as it takes to catch
+  up with the clock, which may be none, and then GameRender once to draw
+  the frame. Alpha says how far the clock has got from the next-to-last
+  update (0) to the last one (1), and the game draws its state that far
+  between the two.
+*/
+#define GAME_UPDATE(name) void name(game_memory *Memory, game_input *Input)
+typedef GAME_UPDATE(game_update);
+
+#define GAME_RENDER(name) void name(game_memory *Memory, game_offscreen_buffer *Buffer, real32 Alpha)
+typedef GAME_RENDER(game_render);
+
+// NOTE: At the moment, this has to be a very fast function (< 1ms or so).
+#define GAME_GET_SOUND_SAMPLES(name) void name(game_memory *Memory, game_sound_output_buffer *SoundBuffer)
+typedef GAME_GET_SOUND_SAMPLES(game_get_sound_samples);
+
+/*
+  NOTE: Push-style arena allocation. Memory is handed out by bumping Used and
+  is only ever given back all at once, either by ending a temporary memory
+  block or by throwing the whole arena away.
+*/
+struct memory_arena
+{
+  memory_index Size;
+  uint8 *Base;
+  memory_index Used;
+
+  int32 TempCount;
 };
 
-internal void GameUpdateAndRender(game_offscreen_buffer *Buffer, int BlueOffset, int GreenOffset);
+struct temporary_memory
+{
+  memory_arena *Arena;
+  memory_index Used;
+};
+
+inline void
+InitializeArena(memory_arena *Arena, memory_index Size, void *Base)
+{
+  Arena->Size = Size;
+  Arena->Base = (uint8 *)Base;
+  Arena->Used = 0;
+  Arena->TempCount = 0;
+}
+
+inline memory_index
+GetAlignmentOffset(memory_arena *Arena, memory_index Alignment)
+{
+  // Alignment must be a power of two.
+  Assert((Alignment & (Alignment - 1)) == 0);
+
+  memory_index AlignmentOffset = 0;
+  memory_index ResultPointer = (memory_index)Arena->Base + Arena->Used;
+  memory_index AlignmentMask = Alignment - 1;
+  if(ResultPointer & AlignmentMask)
+  {
+    AlignmentOffset = Alignment - (ResultPointer & AlignmentMask);
+  }
+
+  return(AlignmentOffset);
+}
+
+inline memory_index
+GetArenaSizeRemaining(memory_arena *Arena, memory_index Alignment = 4)
+{
+  memory_index Result = Arena->Size - (Arena->Used + GetAlignmentOffset(Arena, Alignment));
+  return(Result);
+}
+
+#define PushStruct(Arena, type, ...) (type *)PushSize_(Arena, sizeof(type), ## __VA_ARGS__)
+#define PushArray(Arena, Count, type, ...) (type *)PushSize_(Arena, (Count)*sizeof(type), ## __VA_ARGS__)
+#define PushSize(Arena, Size, ...) PushSize_(Arena, Size, ## __VA_ARGS__)
+inline void *
+PushSize_(memory_arena *Arena, memory_index SizeInit, memory_index Alignment = 4)
+{
+  memory_index AlignmentOffset = GetAlignmentOffset(Arena, Alignment);
+  memory_index Size = SizeInit + AlignmentOffset;
+
+  Assert((Arena->Used + Size) <= Arena->Size);
+  void *Result = Arena->Base + Arena->Used + AlignmentOffset;
+  Arena->Used += Size;
+
+  return(Result);
+}
+
+// Carves a child arena out of the end of a parent arena.
+inline void
+SubArena(memory_arena *Result, memory_arena *Arena, memory_index Size, memory_index Alignment = 16)
+{
+  Result->Size = Size;
+  Result->Base = (uint8 *)PushSize_(Arena, Size, Alignment);
+  Result->Used = 0;
+  Result->TempCount = 0;
+}
+
+inline temporary_memory
+BeginTemporaryMemory(memory_arena *Arena)
+{
+  temporary_memory Result;
+
+  Result.Arena = Arena;
+  Result.Used = Arena->Used;
+
+  ++Arena->TempCount;
+
+  return(Result);
+}
+
+inline void
+EndTemporaryMemory(temporary_memory TempMem)
+{
+  memory_arena *Arena = TempMem.Arena;
+  Assert(Arena->Used >= TempMem.Used);
+  Arena->Used = TempMem.Used;
+  Assert(Arena->TempCount > 0);
+  --Arena->TempCount;
+}
+
+// Every temporary memory block must be closed by the end of the frame.
+inline void
+CheckArena(memory_arena *Arena)
+{
+  Assert(Arena->TempCount == 0);
+}
+
+/*
+  NOTE: One oscillator feeding the mixer. Phase is kept in turns (0..1) and
+  wrapped every time it advances, so it never loses precision no matter how
+  long the game runs.
+*/
+struct sound_voice
+{
+  real32 Phase;
+  real32 Hz;
+  real32 Volume; // peak amplitude, in 16-bit sample units
+};
+
+// NOTE: Pixels are premultiplied 0xAARRGGBB, top row first.
+struct loaded_bitmap
+{
+  int32 Width;
+  int32 Height;
+  int32 Pitch;
+  bool32 IsOpaque;
+  void *Memory;
+};
+
+/*
+  NOTE: A file being streamed in on the low priority queue. Contents and
+  Size are good to use once IsFileLoaded says so; until then the loading
+  thread owns all of it.
+*/
+struct loaded_file
+{
+  uint64 Size;
+  void *Contents;
+
+  platform_file_handle Handle;
+  bool32 volatile IsLoaded;
+  bool32 LoadFailed;
+};
+
+inline bool32
+IsFileLoaded(loaded_file *File)
+{
+  bool32 Result = __atomic_load_n(&File->IsLoaded, __ATOMIC_ACQUIRE);
+  return(Result);
+}
+
+/*
+  NOTE: Game-side state. This lives at the very start of permanent storage.
+*/
+#include "handmade_entity.h"
+#include "handmade_audio.h"
+
+/*
+  NOTE: Motes: little squares drifting around a world bigger than the
+  screen, which shows its top-left corner. Each press of the right
+  shoulder lets a burst of them out from the sprite, each press of the left
+  one takes a burst's worth away again.
+*/
+#define MOTE_MAX_COUNT 131072
+#define MOTE_BURST_COUNT 256
+#define MOTE_SIZE 4
+#define MOTE_WORLD_WIDTH 4096.0f
+#define MOTE_WORLD_HEIGHT 4096.0f
+#define MOTE_CELL_SIZE 64.0f
+#define MOTE_MAX_SPEED 120.0f // pixels per second, along each axis
+
+// NOTE: How fast the gradient scrolls with the stick all the way over.
+#define GRADIENT_SCROLL_SPEED 240.0f // pixels per second
+
+struct game_state
+{
+  memory_arena PermanentArena;
+  memory_arena TransientArena;
+
+  // NOTE: As of the last update, and the one before it.
+  real32 XOffset;
+  real32 YOffset;
+  real32 LastXOffset;
+  real32 LastYOffset;
+  real32 dtForLastUpdate;
+  int ToneHz;
+  sound_voice ToneVoice;
+  audio_mixer Mixer;
+  audio_stream *Music; // NOTE: Start turns it on and off.
+
+  loaded_bitmap Sprite; // NOTE: No Memory until it's loaded, if it ever is.
+  loaded_file SpriteFile;
+  bool32 SpriteIsLoading;
+  int SpriteOffsetX; // from the middle of the screen
+  int SpriteOffsetY;
+
+  // NOTE: What the last frame drew, to work out what changed since.
+  bool32 HasDrawn;
+  int DrawnWidth;
+  int DrawnHeight;
+  int DrawnXOffset;
+  int DrawnYOffset;
+  game_rect DrawnSpriteRect;
+
+  entity_table Motes;
+  // NOTE: The motes as they were last drawn, in between updates: the same
+  // table, but with positions of its own. The hash is over these.
+  entity_table DrawnMotes;
+  spatial_hash MoteHash;
+  uint32 RandomState;
+};
 
 #define HANDMADE_H
 #endif
@@ -0,0 +1,822 @@
+#include "handmade_audio.h"
+
+#define AUDIO_MAX_BYTES_PER_FRAME (2*sizeof(real32))
+
+// NOTE: The files go in FileArena, which has to be in the transient storage.
+internal void
+InitializeAudioMixer(audio_mixer *Mixer, memory_arena *Arena, memory_arena *FileArena)
+{
+  Mixer->Kernel = BestSIMDKernel();
+  for(int StreamIndex = 0;
+      StreamIndex < AUDIO_MAX_STREAMS;
+      ++StreamIndex)
+  {
+    audio_stream *Stream = Mixer->Streams + StreamIndex;
+    *Stream = {};
+    // NOTE: Not cleared: a file still open from before the game started
+    // over gets closed once the mixer sees its stream isn't playing it.
+    Stream->File = PushStruct(FileArena, audio_stream_file);
+    Stream->Ring = PushArray(Arena, 2*AUDIO_STREAM_RING_FRAMES, real32, CACHE_LINE_SIZE);
+    Stream->Staging = (uint8 *)PushSize(Arena, AUDIO_STREAM_CHUNK_FRAMES*AUDIO_MAX_BYTES_PER_FRAME, CACHE_LINE_SIZE);
+  }
+}
+
+/*
+  NOTE: Resampling. Every output sample reads the source at its own 32.32
+  position: the whole part picks the frames and the fraction, cut down to
+  the 24 bits a real32 holds exactly, weighs them. Each kernel works its
+  positions out from the start of the run the same way, so they agree on
+  every one of them.
+*/
+struct resample_source
+{
+  real32 *Samples[2];
+  real32 Volume[2];
+};
+
+#define RESAMPLE_FRACTION_SCALE (1.0f / 16777216.0f)
+
+inline uint32
+GetResampleIndex(uint64 Position)
+{
+  uint32 Result = (uint32)(Position >> AUDIO_POSITION_FRACTION_BITS);
+  return(Result);
+}
+
+inline int32
+GetResampleFractionBits(uint64 Position)
+{
+  int32 Result = (int32)((uint32)Position >> 8);
+  return(Result);
+}
+
+inline real32
+InterpolateLinear(real32 A, real32 B, real32 t)
+{
+  real32 Result = A + (B - A)*t;
+  return(Result);
+}
+
+// Catmull-Rom: passes through P1 at t = 0 and P2 at t = 1.
+inline real32
+InterpolateCubic(real32 P0, real32 P1, real32 P2, real32 P3, real32 t)
+{
+  real32 C1 = 0.5f*(P2 - P0);
+  real32 C2 = ((P0 - 2.5f*P1) + 2.0f*P2) - 0.5f*P3;
+  real32 C3 = 0.5f*(P3 - P0) + 1.5f*(P1 - P2);
+  real32 Result = ((C3*t + C2)*t + C1)*t + P1;
+  return(Result);
+}
+
+template<resample_filter Filter>
+internal void
+ResampleScalar(resample_source *Source, uint64 Position, uint64 Step, real32 **Mix, uint32 Count)
+{
+  for(uint32 SampleIndex = 0;
+      SampleIndex < Count;
+      ++SampleIndex)
+  {
+    uint64 SamplePosition = Position + SampleIndex*Step;
+    uint32 Index = GetResampleIndex(SamplePosition);
+    real32 t = (real32)GetResampleFractionBits(SamplePosition) * RESAMPLE_FRACTION_SCALE;
+    for(int Channel = 0; Channel < 2; ++Channel)
+    {
+      real32 *Samples = Source->Samples[Channel];
+      real32 Value;
+      if(Filter == ResampleFilter_Cubic)
+      {
+        Value = InterpolateCubic(Samples[(Index - 1) & AUDIO_STREAM_RING_MASK], Samples[Index & AUDIO_STREAM_RING_MASK],
+                                 Samples[(Index + 1) & AUDIO_STREAM_RING_MASK], Samples[(Index + 2) & AUDIO_STREAM_RING_MASK], t);
+      }
+      else
+      {
+        Value = InterpolateLinear(Samples[Index & AUDIO_STREAM_RING_MASK], Samples[(Index + 1) & AUDIO_STREAM_RING_MASK], t);
+      }
+      Mix[Channel][SampleIndex] += Source->Volume[Channel]*Value;
+    }
+  }
+}
+
+#if HANDMADE_X86
+/*
+  NOTE: The SIMD kernels step their positions along in 64-bit lanes, two
+  to a register, and split them into whole and fraction parts four at a
+  time: the high halves are the indices and the low halves the fractions.
+*/
+inline void
+SplitResamplePositions4(__m128i Positions01, __m128i Positions23, __m128i *Index, __m128i *FractionBits)
+{
+  __m128 A = _mm_castsi128_ps(Positions01);
+  __m128 B = _mm_castsi128_ps(Positions23);
+  *Index = _mm_castps_si128(_mm_shuffle_ps(A, B, _MM_SHUFFLE(3, 1, 3, 1)));
+  *FractionBits = _mm_srli_epi32(_mm_castps_si128(_mm_shuffle_ps(A, B, _MM_SHUFFLE(2, 0, 2, 0))), 8);
+}
+
+// NOTE: Gathers frame Index + Offset of four positions.
+inline __m128
+GatherSamples4(real32 *Samples, uint32 *Index, uint32 Offset)
+{
+  __m128 Result = _mm_setr_ps(Samples[(Index[0] + Offset) & AUDIO_STREAM_RING_MASK],
+                              Samples[(Index[1] + Offset) & AUDIO_STREAM_RING_MASK],
+                              Samples[(Index[2] + Offset) & AUDIO_STREAM_RING_MASK],
+                              Samples[(Index[3] + Offset) & AUDIO_STREAM_RING_MASK]);
+  return(Result);
+}
+
+template<resample_filter Filter>
+internal void
+ResampleSSE2(resample_source *Source, uint64 Position, uint64 Step, real32 **Mix, uint32 Count)
+{
+  __m128 FractionScale = _mm_set1_ps(RESAMPLE_FRACTION_SCALE);
+  __m128i RingMask = _mm_set1_epi32(AUDIO_STREAM_RING_MASK);
+  __m128i Positions01 = _mm_set_epi64x((long long)(Position + Step), (long long)Position);
+  __m128i Positions23 = _mm_add_epi64(Positions01, _mm_set1_epi64x((long long)(2*Step)));
+  __m128i Step4 = _mm_set1_epi64x((long long)(4*Step));
+  uint32 SampleIndex = 0;
+  for(;
+      (SampleIndex + 4) <= Count;
+      SampleIndex += 4)
+  {
+    __m128i IndexLanes, FractionLanes;
+    SplitResamplePositions4(Positions01, Positions23, &IndexLanes, &FractionLanes);
+    Positions01 = _mm_add_epi64(Positions01, Step4);
+    Positions23 = _mm_add_epi64(Positions23, Step4);
+
+    // NOTE: SSE2 has no gather, so the indices go out to memory for scalar loads.
+    alignas(16) uint32 Index[4];
+    _mm_store_si128((__m128i *)Index, _mm_and_si128(IndexLanes, RingMask));
+    __m128 t = _mm_mul_ps(_mm_cvtepi32_ps(FractionLanes), FractionScale);
+
+    for(int Channel = 0; Channel < 2; ++Channel)
+    {
+      real32 *Samples = Source->Samples[Channel];
+      __m128 Value;
+      if(Filter == ResampleFilter_Cubic)
+      {
+        __m128 P0 = GatherSamples4(Samples, Index, (uint32)-1);
+        __m128 P1 = GatherSamples4(Samples, Index, 0);
+        __m128 P2 = GatherSamples4(Samples, Index, 1);
+        __m128 P3 = GatherSamples4(Samples, Index, 2);
+        __m128 C1 = _mm_mul_ps(_mm_set1_ps(0.5f), _mm_sub_ps(P2, P0));
+        __m128 C2 = _mm_sub_ps(_mm_add_ps(_mm_sub_ps(P0, _mm_mul_ps(_mm_set1_ps(2.5f), P1)),
+                                          _mm_mul_ps(_mm_set1_ps(2.0f), P2)),
+                               _mm_mul_ps(_mm_set1_ps(0.5f), P3));
+        __m128 C3 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(0.5f), _mm_sub_ps(P3, P0)),
+                               _mm_mul_ps(_mm_set1_ps(1.5f), _mm_sub_ps(P1, P2)));
+        Value = _mm_add_ps(_mm_mul_ps(C3, t), C2);
+        Value = _mm_add_ps(_mm_mul_ps(Value, t), C1);
+        Value = _mm_add_ps(_mm_mul_ps(Value, t), P1);
+      }
+      else
+      {
+        __m128 A = GatherSamples4(Samples, Index, 0);
+        __m128 B = GatherSamples4(Samples, Index, 1);
+        Value = _mm_add_ps(A, _mm_mul_ps(_mm_sub_ps(B, A), t));
+      }
+      real32 *Dest = Mix[Channel] + SampleIndex;
+      _mm_storeu_ps(Dest, _mm_add_ps(_mm_loadu_ps(Dest), _mm_mul_ps(_mm_set1_ps(Source->Volume[Channel]), Value)));
+    }
+  }
+
+  real32 *Rest[2] = {Mix[0] + SampleIndex, Mix[1] + SampleIndex};
+  ResampleScalar<Filter>(Source, Position + SampleIndex*Step, Step, Rest, Count - SampleIndex);
+}
+
+template<resample_filter Filter>
+HANDMADE_TARGET_AVX2 internal void
+ResampleAVX2(resample_source *Source, uint64 Position, uint64 Step, real32 **Mix, uint32 Count)
+{
+  __m256 FractionScale = _mm256_set1_ps(RESAMPLE_FRACTION_SCALE);
+  __m256i RingMask = _mm256_set1_epi32(AUDIO_STREAM_RING_MASK);
+  __m256i Positions0123 = _mm256_add_epi64(_mm256_set1_epi64x((long long)Position),
+                                           _mm256_set_epi64x((long long)(3*Step), (long long)(2*Step),
+                                                             (long long)Step, 0));
+  __m256i Positions4567 = _mm256_add_epi64(Positions0123, _mm256_set1_epi64x((long long)(4*Step)));
+  __m256i Step8 = _mm256_set1_epi64x((long long)(8*Step));
+  uint32 SampleIndex = 0;
+  for(;
+      (SampleIndex + 8) <= Count;
+      SampleIndex += 8)
+  {
+    // NOTE: The shuffles work within 128-bit halves, which leaves the lanes
+    // in 0 1 4 5 2 3 6 7 order until the permute puts them back.
+    __m256 Lanes0123 = _mm256_castsi256_ps(Positions0123);
+    __m256 Lanes4567 = _mm256_castsi256_ps(Positions4567);
+    __m256i Index = _mm256_permute4x64_epi64(_mm256_castps_si256(_mm256_shuffle_ps(Lanes0123, Lanes4567, _MM_SHUFFLE(3, 1, 3, 1))),
+                                             _MM_SHUFFLE(3, 1, 2, 0));
+    __m256i FractionBits = _mm256_permute4x64_epi64(_mm256_castps_si256(_mm256_shuffle_ps(Lanes0123, Lanes4567, _MM_SHUFFLE(2, 0, 2, 0))),
+                                                    _MM_SHUFFLE(3, 1, 2, 0));
+    FractionBits = _mm256_srli_epi32(FractionBits, 8);
+    Positions0123 = _mm256_add_epi64(Positions0123, Step8);
+    Positions4567 = _mm256_add_epi64(Positions4567, Step8);
+    __m256 t = _mm256_mul_ps(_mm256_cvtepi32_ps(FractionBits), FractionScale);
+
+    for(int Channel = 0; Channel < 2; ++Channel)
+    {
+      real32 *Samples = Source->Samples[Channel];
+      __m256 Value;
+      if(Filter == ResampleFilter_Cubic)
+      {
+        __m256 P0 = _mm256_i32gather_ps(Samples, _mm256_and_si256(_mm256_sub_epi32(Index, _mm256_set1_epi32(1)), RingMask), 4);
+        __m256 P1 = _mm256_i32gather_ps(Samples, _mm256_and_si256(Index, RingMask), 4);
+        __m256 P2 = _mm256_i32gather_ps(Samples, _mm256_and_si256(_mm256_add_epi32(Index, _mm256_set1_epi32(1)), RingMask), 4);
+        __m256 P3 = _mm256_i32gather_ps(Samples, _mm256_and_si256(_mm256_add_epi32(Index, _mm256_set1_epi32(2)), RingMask), 4);
+        __m256 C1 = _mm256_mul_ps(_mm256_set1_ps(0.5f), _mm256_sub_ps(P2, P0));
+        __m256 C2 = _mm256_sub_ps(_mm256_add_ps(_mm256_sub_ps(P0, _mm256_mul_ps(_mm256_set1_ps(2.5f), P1)),
+                                                _mm256_mul_ps(_mm256_set1_ps(2.0f), P2)),
+                                  _mm256_mul_ps(_mm256_set1_ps(0.5f), P3));
+        __m256 C3 = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(0.5f), _mm256_sub_ps(P3, P0)),
+                                  _mm256_mul_ps(_mm256_set1_ps(1.5f), _mm256_sub_ps(P1, P2)));
+        Value = _mm256_add_ps(_mm256_mul_ps(C3, t), C2);
+        Value = _mm256_add_ps(_mm256_mul_ps(Value, t), C1);
+        Value = _mm256_add_ps(_mm256_mul_ps(Value, t), P1);
+      }
+      else
+      {
+        __m256 A = _mm256_i32gather_ps(Samples, _mm256_and_si256(Index, RingMask), 4);
+        __m256 B = _mm256_i32gather_ps(Samples, _mm256_and_si256(_mm256_add_epi32(Index, _mm256_set1_epi32(1)), RingMask), 4);
+        Value = _mm256_add_ps(A, _mm256_mul_ps(_mm256_sub_ps(B, A), t));
+      }
+      real32 *Dest = Mix[Channel] + SampleIndex;
+      _mm256_storeu_ps(Dest, _mm256_add_ps(_mm256_loadu_ps(Dest),
+                                           _mm256_mul_ps(_mm256_set1_ps(Source->Volume[Channel]), Value)));
+    }
+  }
+
+  real32 *Rest[2] = {Mix[0] + SampleIndex, Mix[1] + SampleIndex};
+  ResampleScalar<Filter>(Source, Position + SampleIndex*Step, Step, Rest, Count - SampleIndex);
+}
+#endif
+
+template<resample_filter Filter>
+internal void
+ResampleAs(resample_source *Source, uint64 Position, uint64 Step, real32 **Mix, uint32 Count, simd_kernel Kernel)
+{
+  switch(Kernel)
+  {
+#if HANDMADE_X86
+    case SIMDKernel_SSE2: { ResampleSSE2<Filter>(Source, Position, Step, Mix, Count); } break;
+    case SIMDKernel_AVX2: { ResampleAVX2<Filter>(Source, Position, Step, Mix, Count); } break;
+#endif
+    default: { ResampleScalar<Filter>(Source, Position, Step, Mix, Count); } break;
+  }
+}
+
+// Adds Count samples of Source, starting at Position and Step apart, into Mix.
+internal void
+Resample(resample_source *Source, resample_filter Filter, uint64 Position, uint64 Step, real32 **Mix, uint32 Count,
+         simd_kernel Kernel)
+{
+  switch(Filter)
+  {
+    case ResampleFilter_Cubic: { ResampleAs<ResampleFilter_Cubic>(Source, Position, Step, Mix, Count, Kernel); } break;
+    default: { ResampleAs<ResampleFilter_Linear>(Source, Position, Step, Mix, Count, Kernel); } break;
+  }
+}
+
+#if HANDMADE_SLOW
+/*
+  NOTE: Resamples a ring of noise with every supported kernel and filter,
+  at rates either side of the source's, across the ring's wrap and for
+  counts that leave each kernel a partial last group, and asserts every
+  kernel mixes exactly what the scalar loop does.
+*/
+internal void
+DEBUGVerifyResampleKernels()
+{
+  uint32 const MaxCount = 77;
+  local_persist real32 Rings[2][AUDIO_STREAM_RING_FRAMES];
+  local_persist real32 Mixes[2][2][MaxCount];
+  uint32 Random = 0x9E3779B9;
+  for(uint32 Index = 0; Index < 2*AUDIO_STREAM_RING_FRAMES; ++Index)
+  {
+    Random ^= Random << 13;
+    Random ^= Random >> 17;
+    Random ^= Random << 5;
+    Rings[Index & 1][Index >> 1] = (real32)(Random >> 16) - 32768.0f;
+  }
+
+  resample_source Source = {};
+  Source.Samples[0] = Rings[0];
+  Source.Samples[1] = Rings[1];
+  Source.Volume[0] = 0.75f;
+  Source.Volume[1] = 0.3f;
+
+  uint64 const One = (uint64)1 << AUDIO_POSITION_FRACTION_BITS;
+  uint64 Steps[] = {One, (One*44100) / 48000, (One*48000) / 44100, (One*22050) / 96000, One*3 + 12345};
+  uint64 Positions[] = {0, One / 3, (AUDIO_STREAM_RING_FRAMES - 5)*One + 987654321};
+  uint32 Counts[] = {1, 3, 4, 7, 8, 9, 31, MaxCount};
+
+  for(int Kernel = SIMDKernel_Scalar + 1;
+      Kernel < SIMDKernel_Count;
+      ++Kernel)
+  {
+    if(!SIMDKernelSupported((simd_kernel)Kernel)) continue;
+
+    for(int Filter = 0; Filter < ResampleFilter_Count; ++Filter)
+    {
+      for(int StepIndex = 0; StepIndex < (int)ArrayCount(Steps); ++StepIndex)
+      {
+        for(int PositionIndex = 0; PositionIndex < (int)ArrayCount(Positions); ++PositionIndex)
+        {
+          for(int CountIndex = 0; CountIndex < (int)ArrayCount(Counts); ++CountIndex)
+          {
+            for(int MixIndex = 0; MixIndex < 2; ++MixIndex)
+            {
+              for(uint32 Index = 0; Index < MaxCount; ++Index)
+              {
+                Mixes[MixIndex][0][Index] = (real32)Index;
+                Mixes[MixIndex][1][Index] = -(real32)Index;
+              }
+            }
+
+            real32 *Reference[2] = {Mixes[0][0], Mixes[0][1]};
+            real32 *Tested[2] = {Mixes[1][0], Mixes[1][1]};
+            Resample(&Source, (resample_filter)Filter, Positions[PositionIndex], Steps[StepIndex], Reference,
+                     Counts[CountIndex], SIMDKernel_Scalar);
+            Resample(&Source, (resample_filter)Filter, Positions[PositionIndex], Steps[StepIndex], Tested,
+                     Counts[CountIndex], (simd_kernel)Kernel);
+            Assert(memcmp(Mixes[0], Mixes[1], sizeof(Mixes[0])) == 0);
+          }
+        }
+      }
+    }
+  }
+}
+#endif
+
+/*
+  NOTE: Finds the format and the sample data in a RIFF WAVE file, reading
+  just the chunk headers it has to step over. 8 and 16-bit PCM and 32-bit
+  float, mono or stereo, are all it knows.
+*/
+#pragma pack(push, 1)
+struct wav_header
+{
+  uint32 RIFFID;
+  uint32 Size;
+  uint32 WAVEID;
+};
+
+struct wav_chunk_header
+{
+  uint32 ID;
+  uint32 Size;
+};
+
+struct wav_fmt
+{
+  uint16 FormatTag;
+  uint16 ChannelCount;
+  uint32 SamplesPerSecond;
+  uint32 AverageBytesPerSecond;
+  uint16 BlockAlign;
+  uint16 BitsPerSample;
+  uint16 ExtensionSize;
+  uint16 ValidBitsPerSample;
+  uint32 ChannelMask;
+  uint16 SubFormat; // NOTE: The first two bytes of a GUID, which is all that tells the formats apart.
+};
+#pragma pack(pop)
+
+#define WAV_FOURCC(a, b, c, d) ((uint32)(a) | ((uint32)(b) << 8) | ((uint32)(c) << 16) | ((uint32)(d) << 24))
+#define WAV_FORMAT_PCM 1
+#define WAV_FORMAT_IEEE_FLOAT 3
+#define WAV_FORMAT_EXTENSIBLE 0xFFFE
+
+internal bool32
+ReadWAVFormat(platform_file_handle *File, wav_format *Format)
+{
+  *Format = {};
+
+  wav_header Header;
+  if(!Platform.ReadDataFromFile(File, 0, sizeof(Header), &Header) ||
+     (Header.RIFFID != WAV_FOURCC('R', 'I', 'F', 'F')) ||
+     (Header.WAVEID != WAV_FOURCC('W', 'A', 'V', 'E')))
+  {
+    return(false);
+  }
+
+  wav_fmt Fmt = {};
+  bool32 HasFmt = false;
+  bool32 HasData = false;
+  uint64 DataSize = 0;
+  uint64 Offset = sizeof(Header);
+  while(!HasData && ((Offset + sizeof(wav_chunk_header)) <= File->Size))
+  {
+    wav_chunk_header Chunk;
+    if(!Platform.ReadDataFromFile(File, Offset, sizeof(Chunk), &Chunk))
+    {
+      return(false);
+    }
+    Offset += sizeof(Chunk);
+
+    if(Chunk.ID == WAV_FOURCC('f', 'm', 't', ' '))
+    {
+      uint32 FmtSize = (Chunk.Size < sizeof(Fmt)) ? Chunk.Size : (uint32)sizeof(Fmt);
+      if((FmtSize < offsetof(wav_fmt, ExtensionSize)) ||
+         !Platform.ReadDataFromFile(File, Offset, FmtSize, &Fmt))
+      {
+        return(false);
+      }
+      HasFmt = true;
+    }
+    else if(Chunk.ID == WAV_FOURCC('d', 'a', 't', 'a'))
+    {
+      Format->DataOffset = Offset;
+      DataSize = Chunk.Size;
+      HasData = true;
+    }
+
+    // NOTE: Chunks are padded out to an even length.
+    Offset += Chunk.Size + (Chunk.Size & 1);
+  }
+  if(!HasFmt || !HasData)
+  {
+    return(false);
+  }
+
+  uint32 FormatTag = Fmt.FormatTag;
+  if((FormatTag == WAV_FORMAT_EXTENSIBLE) && (Fmt.ExtensionSize >= 22))
+  {
+    FormatTag = Fmt.SubFormat;
+  }
+  if((FormatTag == WAV_FORMAT_PCM) && (Fmt.BitsPerSample == 8))
+  {
+    Format->SampleFormat = WAVSample_U8;
+  }
+  else if((FormatTag == WAV_FORMAT_PCM) && (Fmt.BitsPerSample == 16))
+  {
+    Format->SampleFormat = WAVSample_S16;
+  }
+  else if((FormatTag == WAV_FORMAT_IEEE_FLOAT) && (Fmt.BitsPerSample == 32))
+  {
+    Format->SampleFormat = WAVSample_F32;
+  }
+  else
+  {
+    return(false);
+  }
+
+  Format->SamplesPerSecond = Fmt.SamplesPerSecond;
+  Format->ChannelCount = Fmt.ChannelCount;
+  Format->BytesPerFrame = Fmt.ChannelCount * (Fmt.BitsPerSample / 8);
+  if((Format->ChannelCount < 1) || (Format->ChannelCount > 2) || !Format->SamplesPerSecond)
+  {
+    return(false);
+  }
+
+  // NOTE: Writers that never came back to fill the size in leave it too big.
+  if(DataSize > File->Size - Format->DataOffset)
+  {
+    DataSize = File->Size - Format->DataOffset;
+  }
+  Format->FrameCount = DataSize / Format->BytesPerFrame;
+  return(Format->FrameCount >= 3);
+}
+
+// Decodes Count frames from Source into the ring, starting at stream frame FirstFrame.
+internal void
+DecodeWAVFrames(audio_stream *Stream, uint8 *Source, uint64 FirstFrame, uint32 Count)
+{
+  wav_format *Format = &Stream->Format;
+  for(uint32 Channel = 0; Channel < Format->ChannelCount; ++Channel)
+  {
+    real32 *Dest = Stream->Samples[Channel];
+    for(uint32 FrameIndex = 0;
+        FrameIndex < Count;
+        ++FrameIndex)
+    {
+      uint32 SampleIndex = FrameIndex*Format->ChannelCount + Channel;
+      // NOTE: The mixer works in 16-bit sample units.
+      real32 Value;
+      switch(Format->SampleFormat)
+      {
+        case WAVSample_U8: { Value = 256.0f*((real32)Source[SampleIndex] - 128.0f); } break;
+        case WAVSample_F32: { Value = 32768.0f*((real32 *)Source)[SampleIndex]; } break;
+        default: { Value = (real32)((int16 *)Source)[SampleIndex]; } break;
+      }
+      Dest[(FirstFrame + FrameIndex) & AUDIO_STREAM_RING_MASK] = Value;
+    }
+  }
+}
+
+internal
+PLATFORM_WORK_QUEUE_CALLBACK(DoLoadStreamWork)
+{
+  TIMED_BLOCK("LoadStream");
+  audio_stream *Stream = (audio_stream *)Data;
+  wav_format *Format = &Stream->Format;
+
+  // NOTE: A looping stream's chunk carries on from the start of the file when it reaches the end.
+  uint64 FileFrame = Stream->LoadFileFrame;
+  uint32 FramesRead = 0;
+  while(FramesRead < Stream->LoadFrameCount)
+  {
+    uint64 Count = Format->FrameCount - FileFrame;
+    if(Count > (Stream->LoadFrameCount - FramesRead))
+    {
+      Count = Stream->LoadFrameCount - FramesRead;
+    }
+
+    uint8 *Dest = Stream->Staging + FramesRead*Format->BytesPerFrame;
+    uint64 Size = Count*Format->BytesPerFrame;
+    if(!Platform.ReadDataFromFile(&Stream->File->Handle, Format->DataOffset + FileFrame*Format->BytesPerFrame, Size, Dest))
+    {
+      // NOTE: The mixer stops the stream once it sees the error.
+      memset(Dest, 0, Size);
+    }
+    FramesRead += (uint32)Count;
+    FileFrame = 0;
+  }
+  DecodeWAVFrames(Stream, Stream->Staging, Stream->LoadFrame, Stream->LoadFrameCount);
+
+  __atomic_store_n(&Stream->FramesLoaded, Stream->LoadFrame + Stream->LoadFrameCount, __ATOMIC_RELEASE);
+  __atomic_store_n(&Stream->IsLoading, false, __ATOMIC_RELEASE);
+}
+
+// NOTE: Only when the stream isn't already loading.
+internal void
+LoadNextChunk(audio_stream *Stream)
+{
+  uint64 FileFrame = Stream->FramesQueued % Stream->Format.FrameCount;
+  uint64 Count = AUDIO_STREAM_CHUNK_FRAMES;
+  if(!Stream->IsLooping && (Count > (Stream->Format.FrameCount - FileFrame)))
+  {
+    Count = Stream->Format.FrameCount - FileFrame;
+  }
+
+  Stream->LoadFrame = Stream->FramesQueued;
+  Stream->LoadFileFrame = FileFrame;
+  Stream->LoadFrameCount = (uint32)Count;
+  Stream->FramesQueued += Count;
+  Stream->IsLoading = true;
+  Platform.AddEntry(Platform.LowPriorityQueue, DoLoadStreamWork, Stream);
+}
+
+internal bool32
+CopyFilename(char *Dest, char *Source)
+{
+  for(int Index = 0;
+      Index < AUDIO_MAX_FILENAME_SIZE;
+      ++Index)
+  {
+    Dest[Index] = Source[Index];
+    if(!Source[Index])
+    {
+      return(true);
+    }
+  }
+  Dest[0] = 0;
+  return(false);
+}
+
+internal bool32
+FilenamesAreEqual(char *A, char *B)
+{
+  while(*A && (*A == *B))
+  {
+    ++A;
+    ++B;
+  }
+  return(*A == *B);
+}
+
+internal void
+CloseStreamFile(audio_stream_file *File)
+{
+  if(File->Filename[0])
+  {
+    Platform.CloseFile(&File->Handle);
+    File->Filename[0] = 0;
+  }
+}
+
+internal platform_file_handle *
+OpenStreamFile(audio_stream_file *File, char *Filename)
+{
+  CloseStreamFile(File);
+  CopyFilename(File->Filename, Filename);
+  File->Handle = Platform.OpenFile(Filename);
+  return(&File->Handle);
+}
+
+/*
+  NOTE: Opens the file the stream is playing. A stream that's only just
+  started doesn't know its format yet, so that gets read from the headers.
+  One put back by a restore does, and its file only has to still be big
+  enough for it; the file on disk may have changed since, in which case
+  the stream stops. Either way a bad file leaves the handle with an error
+  for the mixer to find.
+*/
+internal
+PLATFORM_WORK_QUEUE_CALLBACK(DoOpenStreamWork)
+{
+  TIMED_BLOCK("OpenStream");
+  audio_stream *Stream = (audio_stream *)Data;
+  wav_format *Format = &Stream->Format;
+
+  platform_file_handle *File = OpenStreamFile(Stream->File, Stream->Filename);
+  if(File->NoErrors && !Format->FrameCount)
+  {
+    if(ReadWAVFormat(File, Format))
+    {
+      Stream->Samples[0] = Stream->Ring;
+      Stream->Samples[1] = (Format->ChannelCount == 2) ? (Stream->Ring + AUDIO_STREAM_RING_FRAMES) : Stream->Ring;
+
+      // NOTE: The first sample looks one frame back, to before the stream began.
+      Stream->Samples[0][AUDIO_STREAM_RING_MASK] = 0.0f;
+      Stream->Samples[1][AUDIO_STREAM_RING_MASK] = 0.0f;
+    }
+    else
+    {
+      File->NoErrors = false;
+    }
+  }
+  else if(File->Size < (Format->DataOffset + Format->FrameCount*Format->BytesPerFrame))
+  {
+    File->NoErrors = false;
+  }
+
+  __atomic_store_n(&Stream->IsLoading, false, __ATOMIC_RELEASE);
+}
+
+// NOTE: Only when the stream isn't already loading.
+internal void
+OpenStream(audio_stream *Stream)
+{
+  Stream->IsLoading = true;
+  Platform.AddEntry(Platform.LowPriorityQueue, DoOpenStreamWork, Stream);
+}
+
+/*
+  NOTE: Starts a WAV file playing, at full volume for Volume = 1, and hands
+  back its stream, or 0 if every stream is busy. Nothing gets read here:
+  the file is opened and its headers read on the low priority queue, like
+  the samples after them, and the mixer starts the stream once they're in.
+  A file that turns out not to be playable stops the stream.
+*/
+internal audio_stream *
+PlayWAV(audio_mixer *Mixer, char *Filename, real32 Volume, bool32 IsLooping,
+        resample_filter Filter = ResampleFilter_Cubic)
+{
+  audio_stream *Stream = 0;
+  for(int StreamIndex = 0;
+      StreamIndex < AUDIO_MAX_STREAMS;
+      ++StreamIndex)
+  {
+    if(!Mixer->Streams[StreamIndex].IsPlaying)
+    {
+      Stream = Mixer->Streams + StreamIndex;
+      break;
+    }
+  }
+  if(!Stream)
+  {
+    return(0);
+  }
+
+  if(!CopyFilename(Stream->Filename, Filename))
+  {
+    return(0);
+  }
+
+  Stream->IsLooping = IsLooping;
+  Stream->StopRequested = false;
+  Stream->Filter = Filter;
+  Stream->Volume[0] = Volume;
+  Stream->Volume[1] = Volume;
+  Stream->Format = {};
+  Stream->Position = 0;
+  Stream->FramesQueued = 0;
+  Stream->FramesLoaded = 0;
+  Stream->UnderrunCount = 0;
+
+  Stream->IsPlaying = true;
+  OpenStream(Stream);
+  return(Stream);
+}
+
+// NOTE: The stream stays busy until any load still in flight is done.
+inline void
+StopStream(audio_stream *Stream)
+{
+  Stream->StopRequested = true;
+}
+
+internal void
+CloseStream(audio_stream *Stream)
+{
+  CloseStreamFile(Stream->File);
+  Stream->Filename[0] = 0;
+  Stream->IsPlaying = false;
+}
+
+/*
+  NOTE: Mixes as much of the stream as is loaded, up to SampleCount samples,
+  and returns how many that was. A cubic sample reaches two frames past the
+  one it's in, so that's how far short of the loaded frames it stops.
+*/
+internal uint32
+MixStream(audio_stream *Stream, real32 **Mix, uint32 SampleCount, int SamplesPerSecond, simd_kernel Kernel)
+{
+  uint64 Step = ((uint64)Stream->Format.SamplesPerSecond << AUDIO_POSITION_FRACTION_BITS) / (uint64)SamplesPerSecond;
+  uint64 FramesLoaded = __atomic_load_n(&Stream->FramesLoaded, __ATOMIC_ACQUIRE);
+
+  uint32 Count = 0;
+  if(FramesLoaded >= 3)
+  {
+    uint64 LastPosition = ((FramesLoaded - 2) << AUDIO_POSITION_FRACTION_BITS) - 1;
+    if(Stream->Position <= LastPosition)
+    {
+      uint64 Available = (LastPosition - Stream->Position) / Step + 1;
+      Count = (Available < SampleCount) ? (uint32)Available : SampleCount;
+    }
+  }
+
+  resample_source Source;
+  Source.Samples[0] = Stream->Samples[0];
+  Source.Samples[1] = Stream->Samples[1];
+  Source.Volume[0] = Stream->Volume[0];
+  Source.Volume[1] = Stream->Volume[1];
+  Resample(&Source, Stream->Filter, Stream->Position, Step, Mix, Count, Kernel);
+  Stream->Position += Count*Step;
+
+  return(Count);
+}
+
+/*
+  NOTE: Adds every playing stream into the left and right channels of Mix,
+  and keeps each one's loads going. A stream that runs short plays silence
+  for the rest and picks up from the same spot next time.
+*/
+internal void
+MixStreams(audio_mixer *Mixer, real32 **Mix, uint32 SampleCount, int SamplesPerSecond)
+{
+  TIMED_FUNCTION();
+
+  for(int StreamIndex = 0;
+      StreamIndex < AUDIO_MAX_STREAMS;
+      ++StreamIndex)
+  {
+    audio_stream *Stream = Mixer->Streams + StreamIndex;
+    if(!Stream->IsPlaying)
+    {
+      // NOTE: Still open if a restore took back the play that opened it.
+      CloseStreamFile(Stream->File);
+      continue;
+    }
+
+    bool32 IsLoading = __atomic_load_n(&Stream->IsLoading, __ATOMIC_ACQUIRE);
+    if(!IsLoading)
+    {
+      if(!FilenamesAreEqual(Stream->File->Filename, Stream->Filename))
+      {
+        // NOTE: A restore put the stream back; what's loaded still plays meanwhile.
+        OpenStream(Stream);
+      }
+      else if(Stream->StopRequested || !Stream->File->Handle.NoErrors)
+      {
+        CloseStream(Stream);
+        continue;
+      }
+      else
+      {
+        // NOTE: A chunk may go in over frames up to one before the one being played.
+        uint64 PlayFrame = Stream->Position >> AUDIO_POSITION_FRACTION_BITS;
+        bool32 HasMore = (Stream->IsLooping || (Stream->FramesQueued < Stream->Format.FrameCount));
+        if(HasMore && ((Stream->FramesQueued + AUDIO_STREAM_CHUNK_FRAMES + 1) <=
+                       (PlayFrame + AUDIO_STREAM_RING_FRAMES)))
+        {
+          LoadNextChunk(Stream);
+        }
+      }
+    }
+    else if(Stream->StopRequested)
+    {
+      continue;
+    }
+
+    // NOTE: Nothing's been asked for until the file's open and its format known.
+    if(!Stream->FramesQueued)
+    {
+      continue;
+    }
+
+    uint32 MixedCount = MixStream(Stream, Mix, SampleCount, SamplesPerSecond, Mixer->Kernel);
+    if(MixedCount < SampleCount)
+    {
+      bool32 IsDone = (!Stream->IsLooping &&
+                       !__atomic_load_n(&Stream->IsLoading, __ATOMIC_ACQUIRE) &&
+                       (Stream->FramesLoaded == Stream->Format.FrameCount));
+      if(IsDone)
+      {
+        CloseStream(Stream);
+      }
+      else if(Stream->FramesLoaded)
+      {
+        ++Stream->UnderrunCount;
+      }
+    }
+  }
+}
@@ -0,0 +1,102 @@
+#if !defined(HANDMADE_AUDIO_H)
+
+/*
+  NOTE: Streamed sounds. A WAV file plays straight off the disk, never
+  loaded whole: each stream has a ring of decoded frames that the low
+  priority queue keeps topped up a chunk at a time, and the mixer resamples
+  out of the ring to whatever rate the platform's device runs at.
+
+  Positions count frames since the stream started, not since the start of
+  the file, so a looping stream just keeps counting; the ring holds frame N
+  at N & AUDIO_STREAM_RING_MASK.
+*/
+#define AUDIO_STREAM_CHUNK_FRAMES 4096
+#define AUDIO_STREAM_RING_FRAMES (4*AUDIO_STREAM_CHUNK_FRAMES)
+#define AUDIO_STREAM_RING_MASK (AUDIO_STREAM_RING_FRAMES - 1)
+#define AUDIO_MAX_STREAMS 16
+#define AUDIO_MAX_FILENAME_SIZE 256
+
+// NOTE: Positions are 32.32 fixed point, in frames.
+#define AUDIO_POSITION_FRACTION_BITS 32
+
+enum resample_filter
+{
+  ResampleFilter_Linear,
+  ResampleFilter_Cubic, // Catmull-Rom, through the two frames either side
+
+  ResampleFilter_Count,
+};
+
+enum wav_sample_format
+{
+  WAVSample_U8,
+  WAVSample_S16,
+  WAVSample_F32,
+};
+
+struct wav_format
+{
+  uint32 SamplesPerSecond;
+  uint32 ChannelCount; // 1 or 2
+  wav_sample_format SampleFormat;
+  uint32 BytesPerFrame;
+  uint64 DataOffset;
+  uint64 FrameCount;
+};
+
+/*
+  NOTE: A stream's open file lives in transient storage, out of the way of
+  the permanent storage being put back the way it was, by a snapshot or a
+  recording going around again: the file a restored stream had open may
+  long since have been closed, and one opened after the snapshot would
+  never be. So the file notes which one it is, and whenever that isn't
+  the one its stream is playing, it gets closed and opened again.
+*/
+struct audio_stream_file
+{
+  char Filename[AUDIO_MAX_FILENAME_SIZE]; // empty when nothing's open
+  platform_file_handle Handle;
+};
+
+/*
+  NOTE: While IsLoading is set, the loading thread owns the load fields and
+  the part of the ring it's filling, or, while it opens the file, the file
+  and the format too; everything else belongs to the mixer.
+  The ring never gets refilled past the oldest frame the mixer may still
+  read, so the two never touch the same frames.
+*/
+struct audio_stream
+{
+  bool32 IsPlaying;
+  bool32 IsLooping;
+  bool32 StopRequested;
+  resample_filter Filter;
+  real32 Volume[2]; // left, right
+
+  char Filename[AUDIO_MAX_FILENAME_SIZE];
+  audio_stream_file *File;
+  wav_format Format;
+
+  uint64 Position;
+  uint64 FramesQueued; // handed to the loading thread so far
+  uint64 volatile FramesLoaded;
+  bool32 volatile IsLoading;
+  uint32 UnderrunCount; // mixes that ran out of loaded frames
+
+  uint64 LoadFrame; // where the load in flight goes in the stream...
+  uint64 LoadFileFrame; // ...and where it comes from in the file
+  uint32 LoadFrameCount;
+
+  real32 *Samples[2]; // by channel; the same ring twice for mono files
+  real32 *Ring; // AUDIO_STREAM_RING_FRAMES per channel
+  uint8 *Staging; // a chunk of the file, as it is on disk
+};
+
+struct audio_mixer
+{
+  simd_kernel Kernel; // what the streams get resampled with, picked once up front
+  audio_stream Streams[AUDIO_MAX_STREAMS];
+};
+
+#define HANDMADE_AUDIO_H
+#endif
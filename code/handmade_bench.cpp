@@ -0,0 +1,1750 @@
+/*
+  NOTE: Headless benchmarks for the game's hot paths.
+
+  No window, no audio device, no SDL: the game code is compiled straight in,
+  so this runs anywhere, including boxes without a display or sound card.
+
+  Usage: handmade_bench [--frames N] [--threads N] [--size WxH]... [--json FILE] [--profile]
+                        [--io-mb N] [--verify]
+
+  --threads 0 runs every work entry on the calling thread. Without --size it
+  runs at 720p, 1080p and 4K. --json writes the results out for tracking
+  from commit to commit. --profile prints the TIMED_BLOCK breakdown of the
+  last frame at each size. "still us" is a frame in which nothing moved,
+  drawn into the buffer kept from the frame before, as the platform does.
+  The bitmap blits always run, opaque and alpha-blended at a few sprite
+  sizes, as does scaling a 960x540 picture up to 1080p and 4K, nearest
+  and bilinear, on the render queue, and painting and blitting into each
+  of the pixel formats the game can draw in. The bandwidth table holds
+  filling, painting and uploading a frame at each size and a few pitches
+  up against memcpy, along with the audio fill, and the render group gets
+  a few thousand commands pushed into it at once. The entity table and
+  its spatial hash run at 1k to 1M entities. Startup is the game's part
+  of the time to first frame, from memory nothing has touched. Streamed audio gets
+  resampled from 44.1kHz with each kernel and filter, to see how many
+  streams fit in a millisecond per frame. --io-mb sets the size of
+  the scratch file the file loading benchmark reads back (0 skips it).
+
+  --verify skips the benchmarks and instead checks every SIMD kernel
+  against its scalar reference, which takes a HANDMADE_SLOW build ("make
+  test"). A mismatch trips an Assert, so the process dies and exits
+  non-zero.
+*/
+
+#include "handmade.cpp"
+#include "posix_handmade.cpp"
+#include "handmade_scale.cpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <unistd.h>
+
+internal uint64
+BenchGetWallClock()
+{
+  struct timespec Now;
+  clock_gettime(CLOCK_MONOTONIC, &Now);
+  return((uint64)Now.tv_sec * 1000000000ull + (uint64)Now.tv_nsec);
+}
+
+internal real64
+BenchSecondsElapsed(uint64 Start, uint64 End)
+{
+  return((real64)(End - Start) / 1.0e9);
+}
+
+/*
+  NOTE: The mixer as it used to live in the platform layer, as the baseline:
+  one sinf per voice per sample, on an ever-growing radian phase.
+*/
+internal void
+BenchMixVoicesSinf(real32 *tSine, int *WavePeriods, int VoiceCount, real32 Volume,
+                   game_sound_output_buffer *SoundBuffer)
+{
+  int16 *SampleOut = SoundBuffer->Samples;
+  for(int SampleIndex = 0;
+      SampleIndex < SoundBuffer->SampleCount;
+      ++SampleIndex)
+  {
+    real32 Sum = 0.0f;
+    for(int VoiceIndex = 0;
+        VoiceIndex < VoiceCount;
+        ++VoiceIndex)
+    {
+      Sum += sinf(tSine[VoiceIndex]) * Volume;
+      tSine[VoiceIndex] += 2.0f * Pi32 * 1.0f/(real32)WavePeriods[VoiceIndex];
+    }
+
+    int16 SampleValue = ClampToInt16(Sum);
+    *SampleOut++ = SampleValue;
+    *SampleOut++ = SampleValue;
+  }
+}
+
+/*
+  NOTE: The same single-producer, multi-consumer queue the platform layer
+  gives the game, on pthreads instead of SDL, so the banded renderer runs
+  here exactly as it does in the real thing.
+*/
+struct bench_work_queue_entry
+{
+  platform_work_queue_callback *Callback;
+  void *Data;
+};
+
+struct platform_work_queue
+{
+  uint32 CompletionGoal; // only touched by the producer
+  uint32 volatile CompletionCount;
+
+  uint32 volatile NextEntryToWrite;
+  uint32 volatile NextEntryToRead;
+  sem_t Semaphore;
+
+  bench_work_queue_entry Entries[256];
+};
+
+internal void
+BenchAddEntry(platform_work_queue *Queue, platform_work_queue_callback *Callback, void *Data)
+{
+  uint32 EntryIndex = Queue->NextEntryToWrite;
+  uint32 NewNextEntryToWrite = (EntryIndex + 1) % ArrayCount(Queue->Entries);
+  Assert(NewNextEntryToWrite != Queue->NextEntryToRead);
+  bench_work_queue_entry *Entry = Queue->Entries + EntryIndex;
+  Entry->Callback = Callback;
+  Entry->Data = Data;
+  ++Queue->CompletionGoal;
+  __atomic_store_n(&Queue->NextEntryToWrite, NewNextEntryToWrite, __ATOMIC_RELEASE);
+  sem_post(&Queue->Semaphore);
+}
+
+internal bool32
+BenchDoNextWorkQueueEntry(platform_work_queue *Queue)
+{
+  bool32 WeShouldSleep = false;
+
+  uint32 OriginalNextEntryToRead = __atomic_load_n(&Queue->NextEntryToRead, __ATOMIC_ACQUIRE);
+  uint32 NewNextEntryToRead = (OriginalNextEntryToRead + 1) % ArrayCount(Queue->Entries);
+  if(OriginalNextEntryToRead != __atomic_load_n(&Queue->NextEntryToWrite, __ATOMIC_ACQUIRE))
+  {
+    if(__atomic_compare_exchange_n(&Queue->NextEntryToRead, &OriginalNextEntryToRead, NewNextEntryToRead,
+                                   false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+    {
+      bench_work_queue_entry Entry = Queue->Entries[OriginalNextEntryToRead];
+      Entry.Callback(Queue, Entry.Data);
+      __atomic_add_fetch(&Queue->CompletionCount, 1, __ATOMIC_RELEASE);
+    }
+  }
+  else
+  {
+    WeShouldSleep = true;
+  }
+
+  return(WeShouldSleep);
+}
+
+internal void
+BenchCompleteAllWork(platform_work_queue *Queue)
+{
+  while(Queue->CompletionGoal != __atomic_load_n(&Queue->CompletionCount, __ATOMIC_ACQUIRE))
+  {
+    BenchDoNextWorkQueueEntry(Queue);
+  }
+
+  Queue->CompletionGoal = 0;
+  __atomic_store_n(&Queue->CompletionCount, 0, __ATOMIC_RELEASE);
+}
+
+internal void *
+BenchWorkerThreadProc(void *Parameter)
+{
+  platform_work_queue *Queue = (platform_work_queue *)Parameter;
+  for(;;)
+  {
+    if(BenchDoNextWorkQueueEntry(Queue))
+    {
+      sem_wait(&Queue->Semaphore);
+    }
+  }
+  return(0);
+}
+
+internal void
+BenchMakeQueue(platform_work_queue *Queue, int ThreadCount)
+{
+  sem_init(&Queue->Semaphore, 0, 0);
+  for(int ThreadIndex = 0;
+      ThreadIndex < ThreadCount;
+      ++ThreadIndex)
+  {
+    pthread_t Thread;
+    pthread_create(&Thread, 0, BenchWorkerThreadProc, Queue);
+    pthread_detach(Thread);
+  }
+}
+
+// There's no audio device here; the game only needs a sample rate from this.
+internal PLATFORM_GET_AUDIO_CURSORS(BenchGetAudioCursors)
+{
+  game_audio_cursors Result = {};
+  Result.SamplesPerSecond = 48000;
+  return(Result);
+}
+
+internal uint64
+BenchGetCycleCount()
+{
+#if HANDMADE_X86
+  return(__rdtsc());
+#else
+  return(0);
+#endif
+}
+
+#define BENCH_SAMPLES_PER_SECOND 48000
+#define BENCH_SAMPLES_PER_FRAME (BENCH_SAMPLES_PER_SECOND / 60)
+
+internal void
+BenchSound(memory_arena *Arena, FILE *JSON)
+{
+  int VoiceCounts[] = {1, 16, 256};
+
+  printf("sound mixer (%d Hz, %d samples per call)\n", BENCH_SAMPLES_PER_SECOND, BENCH_SAMPLES_PER_FRAME);
+  printf("  %6s %16s %16s %8s %12s\n", "voices", "sinf samples/s", "simd samples/s", "speedup", "simd x rt");
+
+  for(int CountIndex = 0;
+      CountIndex < (int)ArrayCount(VoiceCounts);
+      ++CountIndex)
+  {
+    int VoiceCount = VoiceCounts[CountIndex];
+    temporary_memory BenchMemory = BeginTemporaryMemory(Arena);
+
+    sound_voice *Voices = PushArray(Arena, VoiceCount, sound_voice);
+    real32 *tSine = PushArray(Arena, VoiceCount, real32);
+    int *WavePeriods = PushArray(Arena, VoiceCount, int);
+    real32 Volume = 7000.0f / (real32)VoiceCount;
+    for(int VoiceIndex = 0;
+        VoiceIndex < VoiceCount;
+        ++VoiceIndex)
+    {
+      // Spread the voices out over a few octaves.
+      int ToneHz = 110 + 7 * VoiceIndex;
+      Voices[VoiceIndex].Phase = 0.0f;
+      Voices[VoiceIndex].Hz = (real32)ToneHz;
+      Voices[VoiceIndex].Volume = Volume;
+      tSine[VoiceIndex] = 0.0f;
+      WavePeriods[VoiceIndex] = BENCH_SAMPLES_PER_SECOND / ToneHz;
+    }
+
+    game_sound_output_buffer SoundBuffer = {};
+    SoundBuffer.SamplesPerSecond = BENCH_SAMPLES_PER_SECOND;
+    SoundBuffer.SampleCount = BENCH_SAMPLES_PER_FRAME;
+    SoundBuffer.Samples = PushArray(Arena, 2 * BENCH_SAMPLES_PER_FRAME, int16, 16);
+
+    // Keep the total amount of voice-samples roughly constant per row.
+    int FrameCount = (60 * 64) / VoiceCount;
+    if(FrameCount < 60) FrameCount = 60;
+
+    uint64 SinfStart = BenchGetWallClock();
+    for(int FrameIndex = 0; FrameIndex < FrameCount; ++FrameIndex)
+    {
+      BenchMixVoicesSinf(tSine, WavePeriods, VoiceCount, Volume, &SoundBuffer);
+    }
+    uint64 SinfEnd = BenchGetWallClock();
+
+    for(int FrameIndex = 0; FrameIndex < FrameCount; ++FrameIndex)
+    {
+      OutputSound(Arena, Voices, VoiceCount, 0, &SoundBuffer);
+    }
+    uint64 SIMDEnd = BenchGetWallClock();
+
+    real64 SampleTotal = (real64)FrameCount * (real64)BENCH_SAMPLES_PER_FRAME;
+    real64 SinfRate = SampleTotal / BenchSecondsElapsed(SinfStart, SinfEnd);
+    real64 SIMDRate = SampleTotal / BenchSecondsElapsed(SinfEnd, SIMDEnd);
+    printf("  %6d %16.0f %16.0f %7.1fx %11.1fx\n", VoiceCount, SinfRate, SIMDRate,
+           SIMDRate / SinfRate, SIMDRate / BENCH_SAMPLES_PER_SECOND);
+    if(JSON)
+    {
+      fprintf(JSON, "%s\n    {\"voices\": %d, \"sinf_samples_per_second\": %.0f, \"simd_samples_per_second\": %.0f}",
+              CountIndex ? "," : "", VoiceCount, SinfRate, SIMDRate);
+    }
+
+    EndTemporaryMemory(BenchMemory);
+  }
+}
+
+#define BENCH_STREAM_SAMPLES_PER_SECOND 44100
+#define BENCH_STREAM_BUDGET_MS 1.0
+
+/*
+  NOTE: Resamples a stereo stream whose ring is already full, so this is
+  the mixing alone, with no file reads: ns per sample out, and how many
+  streams one frame's mix could take in BENCH_STREAM_BUDGET_MS.
+*/
+internal void
+BenchAudioStreams(memory_arena *Arena, FILE *JSON)
+{
+  temporary_memory BenchMemory = BeginTemporaryMemory(Arena);
+
+  audio_stream *Stream = PushStruct(Arena, audio_stream);
+  Stream->Ring = PushArray(Arena, 2*AUDIO_STREAM_RING_FRAMES, real32, 32);
+  Stream->Samples[0] = Stream->Ring;
+  Stream->Samples[1] = Stream->Ring + AUDIO_STREAM_RING_FRAMES;
+  Stream->Volume[0] = 0.5f;
+  Stream->Volume[1] = 0.5f;
+  Stream->Format.SamplesPerSecond = BENCH_STREAM_SAMPLES_PER_SECOND;
+  Stream->Format.ChannelCount = 2;
+  Stream->FramesLoaded = (uint64)1 << 40;
+  uint32 Random = 0x2545F491;
+  for(int SampleIndex = 0;
+      SampleIndex < 2*AUDIO_STREAM_RING_FRAMES;
+      ++SampleIndex)
+  {
+    Stream->Ring[SampleIndex] = 16000.0f*NextRandomBilateral(&Random);
+  }
+
+  real32 *Mix[2];
+  Mix[0] = PushArray(Arena, BENCH_SAMPLES_PER_FRAME, real32, 32);
+  Mix[1] = PushArray(Arena, BENCH_SAMPLES_PER_FRAME, real32, 32);
+  memset(Mix[0], 0, BENCH_SAMPLES_PER_FRAME*sizeof(real32));
+  memset(Mix[1], 0, BENCH_SAMPLES_PER_FRAME*sizeof(real32));
+
+  char const *FilterNames[] = {"linear", "cubic"};
+  char const *KernelNames[] = {"scalar", "sse2", "avx2"};
+  printf("audio streams (%d Hz to %d Hz, %d samples per frame, %.1fms budget)\n", BENCH_STREAM_SAMPLES_PER_SECOND,
+         BENCH_SAMPLES_PER_SECOND, BENCH_SAMPLES_PER_FRAME, BENCH_STREAM_BUDGET_MS);
+  printf("  %8s %8s %12s %12s %10s\n", "filter", "kernel", "ns/sample", "us/stream", "streams");
+
+  int RowIndex = 0;
+  for(int Filter = 0; Filter < ResampleFilter_Count; ++Filter)
+  {
+    for(int Kernel = SIMDKernel_Scalar; Kernel < SIMDKernel_Count; ++Kernel)
+    {
+      if(!SIMDKernelSupported((simd_kernel)Kernel)) continue;
+
+      Stream->Filter = (resample_filter)Filter;
+      Stream->Position = 0;
+      int CallCount = 4000;
+      uint64 Start = BenchGetWallClock();
+      for(int CallIndex = 0; CallIndex < CallCount; ++CallIndex)
+      {
+        MixStream(Stream, Mix, BENCH_SAMPLES_PER_FRAME, BENCH_SAMPLES_PER_SECOND, (simd_kernel)Kernel);
+      }
+      uint64 End = BenchGetWallClock();
+
+      real64 CallUS = 1.0e6 * BenchSecondsElapsed(Start, End) / CallCount;
+      real64 SampleNS = 1000.0 * CallUS / BENCH_SAMPLES_PER_FRAME;
+      real64 Streams = 1000.0 * BENCH_STREAM_BUDGET_MS / CallUS;
+      printf("  %8s %8s %12.3f %12.3f %10.0f\n", FilterNames[Filter], KernelNames[Kernel], SampleNS, CallUS, Streams);
+      if(JSON)
+      {
+        fprintf(JSON, "%s\n    {\"filter\": \"%s\", \"kernel\": \"%s\", \"ns_per_sample\": %.4f, "
+                "\"us_per_stream\": %.4f, \"streams_per_ms\": %.1f}",
+                RowIndex ? "," : "", FilterNames[Filter], KernelNames[Kernel], SampleNS, CallUS, Streams);
+      }
+      ++RowIndex;
+    }
+  }
+
+  EndTemporaryMemory(BenchMemory);
+}
+
+struct bench_frame_stats
+{
+  real64 MinMS;
+  real64 MedianMS;
+  real64 P99MS;
+  real64 CyclesPerPixel;
+  real64 SoundMedianMS;
+  real64 StillMedianMS;
+};
+
+/*
+  NOTE: Builds a 32-bit BMP in memory the way an art tool would write it
+  (bottom row first, explicit channel masks), so the blits below measure
+  bitmaps that went through the real loader.
+*/
+internal loaded_bitmap
+BenchMakeBitmap(memory_arena *Arena, int Size, bool32 Opaque)
+{
+  loaded_bitmap Result = {};
+
+  uint64 PixelBytes = (uint64)Size * Size * sizeof(uint32);
+  uint64 FileSize = sizeof(bitmap_header) + PixelBytes;
+  bitmap_header *Header = (bitmap_header *)calloc(1, FileSize);
+  if(!Header)
+  {
+    return(Result);
+  }
+  Header->FileType = 0x4D42;
+  Header->FileSize = (uint32)FileSize;
+  Header->BitmapOffset = sizeof(bitmap_header);
+  Header->Size = sizeof(bitmap_header) - offsetof(bitmap_header, Size);
+  Header->Width = Size;
+  Header->Height = Size;
+  Header->Planes = 1;
+  Header->BitsPerPixel = 32;
+  Header->Compression = BMP_COMPRESSION_BITFIELDS;
+  Header->SizeOfBitmap = (uint32)PixelBytes;
+  Header->RedMask = 0x00FF0000;
+  Header->GreenMask = 0x0000FF00;
+  Header->BlueMask = 0x000000FF;
+  Header->AlphaMask = 0xFF000000;
+
+  // A soft-edged disc: opaque middle, a ramp of alpha, transparent corners.
+  uint32 *Pixel = (uint32 *)(Header + 1);
+  real32 Radius = 0.5f * (real32)Size;
+  for(int Y = 0; Y < Size; ++Y)
+  {
+    for(int X = 0; X < Size; ++X)
+    {
+      real32 dX = ((real32)X + 0.5f - Radius) / Radius;
+      real32 dY = ((real32)Y + 0.5f - Radius) / Radius;
+      real32 Coverage = 4.0f * (1.0f - sqrtf(dX*dX + dY*dY));
+      if(Coverage < 0.0f) Coverage = 0.0f;
+      if(Coverage > 1.0f) Coverage = 1.0f;
+      uint32 Alpha = Opaque ? 255 : (uint32)(255.0f * Coverage + 0.5f);
+      *Pixel++ = (Alpha << 24) | ((uint32)(X * 255 / Size) << 16) | ((uint32)(Y * 255 / Size) << 8) | 0x40;
+    }
+  }
+
+  Result = LoadBMP(Arena, Header, FileSize);
+  free(Header);
+  return(Result);
+}
+
+// Draws Bitmap over and over, stepping it across Buffer, and returns megapixels/second.
+internal real64
+BenchDrawBitmap(game_offscreen_buffer *Buffer, loaded_bitmap *Bitmap, simd_kernel Kernel)
+{
+  // NOTE: Roughly the same number of pixels for every size, so small sprites
+  // show their per-call overhead and big ones their per-pixel cost.
+  int64 PixelBudget = 64ll * 1024 * 1024;
+  int64 PixelsPerDraw = (int64)Bitmap->Width * Bitmap->Height;
+  int64 DrawCount = PixelBudget / PixelsPerDraw;
+  if(DrawCount < 16) DrawCount = 16;
+
+  int RangeX = Buffer->Width - Bitmap->Width + 1;
+  int RangeY = Buffer->Height - Bitmap->Height + 1;
+  uint64 Start = BenchGetWallClock();
+  for(int64 DrawIndex = 0;
+      DrawIndex < DrawCount;
+      ++DrawIndex)
+  {
+    int X = (int)((DrawIndex * 97) % RangeX);
+    int Y = (int)((DrawIndex * 61) % RangeY);
+    DrawBitmap(Buffer, Bitmap, X, Y, Kernel);
+  }
+  uint64 End = BenchGetWallClock();
+
+  return((real64)(DrawCount * PixelsPerDraw) / 1.0e6 / BenchSecondsElapsed(Start, End));
+}
+
+internal void
+BenchBlit(memory_arena *Arena, FILE *JSON)
+{
+  int SpriteSizes[] = {16, 64, 256, 1024};
+
+  temporary_memory BenchMemory = BeginTemporaryMemory(Arena);
+  game_offscreen_buffer Buffer = {};
+  Buffer.Width = 1920;
+  Buffer.Height = 1080;
+  Buffer.Pitch = Buffer.Width * sizeof(uint32);
+  Buffer.Memory = PushSize(Arena, (memory_index)Buffer.Pitch * Buffer.Height, CACHE_LINE_SIZE);
+  RenderWeirdGradient(&Buffer, 0, 0);
+
+  simd_kernel Kernel = BestSIMDKernel();
+  printf("bitmap blits (into %dx%d, SIMD kernel %d)\n", Buffer.Width, Buffer.Height, (int)Kernel);
+  printf("  %9s %11s %14s %14s %8s\n", "sprite", "opaque MP/s", "blended MP/s", "scalar MP/s", "speedup");
+
+  for(int SizeIndex = 0;
+      SizeIndex < (int)ArrayCount(SpriteSizes);
+      ++SizeIndex)
+  {
+    int Size = SpriteSizes[SizeIndex];
+    temporary_memory SpriteMemory = BeginTemporaryMemory(Arena);
+
+    loaded_bitmap Opaque = BenchMakeBitmap(Arena, Size, true);
+    loaded_bitmap Blended = BenchMakeBitmap(Arena, Size, false);
+    if(!Opaque.Memory || !Blended.Memory || !Opaque.IsOpaque || Blended.IsOpaque)
+    {
+      fprintf(stderr, "Unable to make a %dx%d test bitmap\n", Size, Size);
+      EndTemporaryMemory(SpriteMemory);
+      continue;
+    }
+
+    real64 OpaqueRate = BenchDrawBitmap(&Buffer, &Opaque, Kernel);
+    real64 BlendedRate = BenchDrawBitmap(&Buffer, &Blended, Kernel);
+    real64 ScalarRate = BenchDrawBitmap(&Buffer, &Blended, SIMDKernel_Scalar);
+
+    char SizeName[32];
+    snprintf(SizeName, sizeof(SizeName), "%dx%d", Size, Size);
+    printf("  %9s %11.1f %14.1f %14.1f %7.1fx\n", SizeName, OpaqueRate, BlendedRate, ScalarRate,
+           BlendedRate / ScalarRate);
+    if(JSON)
+    {
+      fprintf(JSON, "%s\n    {\"sprite_size\": %d, \"opaque_mp_per_second\": %.1f, "
+              "\"blended_mp_per_second\": %.1f, \"scalar_mp_per_second\": %.1f}",
+              (SizeIndex == 0) ? "" : ",", Size, OpaqueRate, BlendedRate, ScalarRate);
+    }
+
+    EndTemporaryMemory(SpriteMemory);
+  }
+
+  EndTemporaryMemory(BenchMemory);
+}
+
+// Paints the whole buffer over and over on this thread and returns megapixels/second.
+internal real64
+BenchRenderWeirdGradient(game_offscreen_buffer *Buffer, simd_kernel Kernel)
+{
+  int FrameCount = 30;
+  uint64 Start = BenchGetWallClock();
+  for(int FrameIndex = 0;
+      FrameIndex < FrameCount;
+      ++FrameIndex)
+  {
+    RenderWeirdGradient(Buffer, FrameIndex, FrameIndex, Kernel);
+  }
+  uint64 End = BenchGetWallClock();
+
+  return((real64)FrameCount * Buffer->Width * Buffer->Height / 1.0e6 / BenchSecondsElapsed(Start, End));
+}
+
+internal void
+BenchPixelFormats(memory_arena *Arena, FILE *JSON)
+{
+  const char *FormatNames[] = {"bgra32", "rgba32", "rgb565", "indexed8"};
+
+  temporary_memory BenchMemory = BeginTemporaryMemory(Arena);
+  game_offscreen_buffer Buffer = {};
+  Buffer.Width = 1920;
+  Buffer.Height = 1080;
+  Buffer.Pitch = Buffer.Width * sizeof(uint32);
+  Buffer.Memory = PushSize(Arena, (memory_index)Buffer.Pitch * Buffer.Height, CACHE_LINE_SIZE);
+  loaded_bitmap Sprite = BenchMakeBitmap(Arena, 256, false);
+
+  simd_kernel Kernel = BestSIMDKernel();
+  printf("pixel formats (%dx%d on one thread, SIMD kernel %d)\n", Buffer.Width, Buffer.Height, (int)Kernel);
+  printf("  %9s %13s %13s %8s %14s\n", "format", "gradient MP/s", "scalar MP/s", "speedup", "blended MP/s");
+
+  for(int Format = 0;
+      Format < PixelFormat_Count;
+      ++Format)
+  {
+    Buffer.Format = (pixel_format)Format;
+    Buffer.Pitch = Align(Buffer.Width * GetBytesPerPixel(Buffer.Format), CACHE_LINE_SIZE);
+
+    real64 ScalarRate = BenchRenderWeirdGradient(&Buffer, SIMDKernel_Scalar);
+    real64 Rate = BenchRenderWeirdGradient(&Buffer, Kernel);
+    real64 BlendedRate = Sprite.Memory ? BenchDrawBitmap(&Buffer, &Sprite, BestSIMDKernel()) : 0;
+
+    printf("  %9s %13.1f %13.1f %7.1fx %14.1f\n", FormatNames[Format], Rate, ScalarRate, Rate / ScalarRate,
+           BlendedRate);
+    if(JSON)
+    {
+      fprintf(JSON, "%s\n    {\"format\": \"%s\", \"bytes_per_pixel\": %d, \"gradient_mp_per_second\": %.1f, "
+              "\"scalar_mp_per_second\": %.1f, \"blended_mp_per_second\": %.1f}",
+              Format ? "," : "", FormatNames[Format], GetBytesPerPixel(Buffer.Format), Rate, ScalarRate,
+              BlendedRate);
+    }
+  }
+
+  EndTemporaryMemory(BenchMemory);
+}
+
+struct bench_size
+{
+  int Width;
+  int Height;
+};
+
+// Scales Source to Dest over and over and returns destination megapixels/second.
+internal real64
+BenchScaleBuffer(platform_api *API, scaler *Scaler, game_offscreen_buffer *Source, game_offscreen_buffer *Dest)
+{
+  int ScaleCount = 20;
+  uint64 Start = BenchGetWallClock();
+  for(int ScaleIndex = 0;
+      ScaleIndex < ScaleCount;
+      ++ScaleIndex)
+  {
+    ScaleBuffer(API, API->RenderQueue, Scaler, Source, Dest);
+  }
+  uint64 End = BenchGetWallClock();
+
+  return((real64)ScaleCount * Dest->Width * Dest->Height / 1.0e6 / BenchSecondsElapsed(Start, End));
+}
+
+internal void
+BenchScale(platform_api *API, memory_arena *Arena, FILE *JSON)
+{
+  bench_size DestSizes[] = {{1920, 1080}, {3840, 2160}};
+  const char *FilterNames[] = {"nearest", "bilinear"};
+
+  temporary_memory BenchMemory = BeginTemporaryMemory(Arena);
+  game_offscreen_buffer Source = {};
+  Source.Width = 960;
+  Source.Height = 540;
+  Source.Pitch = Source.Width * sizeof(uint32);
+  Source.Memory = PushSize(Arena, (memory_index)Source.Pitch * Source.Height, CACHE_LINE_SIZE);
+  RenderWeirdGradient(&Source, 0, 0);
+  scaler *Scaler = PushStruct(Arena, scaler);
+
+  simd_kernel Kernel = BestSIMDKernel();
+  printf("software scaling (from %dx%d, SIMD kernel %d)\n", Source.Width, Source.Height, (int)Kernel);
+  printf("  %11s %9s %9s %14s %8s\n", "to", "filter", "MP/s", "scalar MP/s", "speedup");
+
+  int RunIndex = 0;
+  for(int SizeIndex = 0;
+      SizeIndex < (int)ArrayCount(DestSizes);
+      ++SizeIndex)
+  {
+    temporary_memory DestMemory = BeginTemporaryMemory(Arena);
+    game_offscreen_buffer Dest = {};
+    Dest.Width = DestSizes[SizeIndex].Width;
+    Dest.Height = DestSizes[SizeIndex].Height;
+    Dest.Pitch = Dest.Width * sizeof(uint32);
+    Dest.Memory = PushSize(Arena, (memory_index)Dest.Pitch * Dest.Height, CACHE_LINE_SIZE);
+
+    for(int FilterIndex = 0;
+        FilterIndex < (int)ArrayCount(FilterNames);
+        ++FilterIndex)
+    {
+      scale_filter Filter = (scale_filter)FilterIndex;
+      InitializeScaler(Scaler, Filter, Source.Width, Source.Height, Dest.Width, Dest.Height, SIMDKernel_Scalar);
+      real64 ScalarRate = BenchScaleBuffer(API, Scaler, &Source, &Dest);
+      InitializeScaler(Scaler, Filter, Source.Width, Source.Height, Dest.Width, Dest.Height, Kernel);
+      real64 Rate = BenchScaleBuffer(API, Scaler, &Source, &Dest);
+
+      char SizeName[32];
+      snprintf(SizeName, sizeof(SizeName), "%dx%d", Dest.Width, Dest.Height);
+      printf("  %11s %9s %9.1f %14.1f %7.1fx\n", SizeName, FilterNames[FilterIndex], Rate, ScalarRate,
+             Rate / ScalarRate);
+      if(JSON)
+      {
+        fprintf(JSON, "%s\n    {\"width\": %d, \"height\": %d, \"filter\": \"%s\", \"mp_per_second\": %.1f, "
+                "\"scalar_mp_per_second\": %.1f}",
+                RunIndex ? "," : "", Dest.Width, Dest.Height, FilterNames[FilterIndex], Rate, ScalarRate);
+      }
+      ++RunIndex;
+    }
+
+    EndTemporaryMemory(DestMemory);
+  }
+
+  EndTemporaryMemory(BenchMemory);
+}
+
+/*
+  NOTE: Memory bandwidth, to tell whether a pass over the frame is bound by
+  the memory system or by its own arithmetic. Every pass runs on this thread
+  and is reported in GB/s of pixels written, next to its fraction of what
+  memcpy manages on a frame of the same size (so the same caches are in
+  play: a 720p frame still fits in most L3s, a 4K one doesn't). A fill
+  writes without reading, so it can come out above 1.
+
+  Pitches: tight rows, rows padded out by one cache line, and rows padded
+  out to a power of two, whose starts all land in the same few cache sets.
+*/
+enum bench_fill_store
+{
+  BenchFill_Regular,
+  BenchFill_NonTemporal,
+};
+
+internal void
+BenchFillBuffer(game_offscreen_buffer *Buffer, uint32 Color, bench_fill_store Store)
+{
+  uint8 *Row = (uint8 *)Buffer->Memory;
+  for(int Y = 0;
+      Y < Buffer->Height;
+      ++Y)
+  {
+    uint32 *Pixel = (uint32 *)Row;
+    int X = 0;
+#if HANDMADE_X86
+    __m128i Color4x = _mm_set1_epi32((int)Color);
+    if(Store == BenchFill_NonTemporal)
+    {
+      for(; X + 4 <= Buffer->Width; X += 4)
+      {
+        _mm_stream_si128((__m128i *)(Pixel + X), Color4x);
+      }
+    }
+    else
+    {
+      for(; X + 4 <= Buffer->Width; X += 4)
+      {
+        _mm_store_si128((__m128i *)(Pixel + X), Color4x);
+      }
+    }
+#endif
+    for(; X < Buffer->Width; ++X)
+    {
+      Pixel[X] = Color;
+    }
+
+    Row += Buffer->Pitch;
+  }
+#if HANDMADE_X86
+  if(Store == BenchFill_NonTemporal)
+  {
+    // Streaming stores aren't ordered with anything else; make them visible.
+    _mm_sfence();
+  }
+#endif
+}
+
+// Copies the buffer row by row into a tightly packed texture, as SDL_UpdateTexture does.
+internal void
+BenchUploadBuffer(game_offscreen_buffer *Buffer, void *Texture)
+{
+  int RowBytes = Buffer->Width * sizeof(uint32);
+  uint8 *Source = (uint8 *)Buffer->Memory;
+  uint8 *Dest = (uint8 *)Texture;
+  for(int Y = 0;
+      Y < Buffer->Height;
+      ++Y)
+  {
+    memcpy(Dest, Source, RowBytes);
+    Source += Buffer->Pitch;
+    Dest += RowBytes;
+  }
+}
+
+enum bench_bandwidth_pass
+{
+  BenchPass_Memcpy,
+  BenchPass_Fill,
+  BenchPass_NonTemporalFill,
+  BenchPass_Gradient,
+  BenchPass_Upload,
+
+  BenchPass_Count,
+};
+
+// Runs one pass over the buffer until about 256MB have gone by and returns GB/s.
+internal real64
+BenchBandwidthPass(game_offscreen_buffer *Buffer, void *Scratch, bench_bandwidth_pass Pass)
+{
+  memory_index Bytes = (memory_index)Buffer->Width * Buffer->Height * sizeof(uint32);
+  int RunCount = (int)(Megabytes(256) / Bytes);
+  if(RunCount < 4) RunCount = 4;
+
+  simd_kernel Kernel = BestSIMDKernel();
+  uint64 Start = BenchGetWallClock();
+  for(int RunIndex = 0;
+      RunIndex < RunCount;
+      ++RunIndex)
+  {
+    switch(Pass)
+    {
+      case BenchPass_Memcpy: { memcpy(Scratch, Buffer->Memory, Bytes); } break;
+      case BenchPass_Fill: { BenchFillBuffer(Buffer, 0xFF000000 | RunIndex, BenchFill_Regular); } break;
+      case BenchPass_NonTemporalFill: { BenchFillBuffer(Buffer, 0xFF000000 | RunIndex, BenchFill_NonTemporal); } break;
+      case BenchPass_Gradient: { RenderWeirdGradient(Buffer, RunIndex, RunIndex, Kernel); } break;
+      case BenchPass_Upload: { BenchUploadBuffer(Buffer, Scratch); } break;
+      default: {} break;
+    }
+  }
+  uint64 End = BenchGetWallClock();
+
+  return((real64)RunCount * (real64)Bytes / 1.0e9 / BenchSecondsElapsed(Start, End));
+}
+
+internal void
+BenchBandwidth(memory_arena *Arena, bench_size *Sizes, int SizeCount, FILE *JSON)
+{
+  const char *PitchNames[] = {"tight", "padded", "pow2"};
+  const char *PassNames[] = {"memcpy", "fill", "nt_fill", "gradient", "upload"};
+
+  printf("bandwidth (one thread, GB/s and fraction of memcpy at the same size)\n");
+  printf("  %11s %7s %6s %7s %14s %14s %14s %14s\n", "size", "pitch", "bytes", "memcpy", "fill", "nt fill",
+         "gradient", "upload");
+
+  if(JSON)
+  {
+    fprintf(JSON, ",\n  \"bandwidth\": [");
+  }
+
+  int RunIndex = 0;
+  for(int SizeIndex = 0;
+      SizeIndex < SizeCount;
+      ++SizeIndex)
+  {
+    for(int PitchIndex = 0;
+        PitchIndex < (int)ArrayCount(PitchNames);
+        ++PitchIndex)
+    {
+      temporary_memory BenchMemory = BeginTemporaryMemory(Arena);
+
+      game_offscreen_buffer Buffer = {};
+      Buffer.Width = Sizes[SizeIndex].Width;
+      Buffer.Height = Sizes[SizeIndex].Height;
+      int RowBytes = Buffer.Width * sizeof(uint32);
+      if(PitchIndex == 0)
+      {
+        Buffer.Pitch = Align(RowBytes, 16);
+      }
+      else if(PitchIndex == 1)
+      {
+        Buffer.Pitch = Align(RowBytes, CACHE_LINE_SIZE) + CACHE_LINE_SIZE;
+      }
+      else
+      {
+        Buffer.Pitch = 4096;
+        while(Buffer.Pitch < RowBytes)
+        {
+          Buffer.Pitch *= 2;
+        }
+      }
+      memory_index BufferSize = (memory_index)Buffer.Pitch * Buffer.Height;
+      memory_index FrameSize = (memory_index)RowBytes * Buffer.Height;
+      if((BufferSize + FrameSize + 2*CACHE_LINE_SIZE) > (Arena->Size - Arena->Used))
+      {
+        EndTemporaryMemory(BenchMemory);
+        continue;
+      }
+      Buffer.Memory = PushSize(Arena, BufferSize, CACHE_LINE_SIZE);
+      void *Scratch = PushSize(Arena, FrameSize, CACHE_LINE_SIZE);
+
+      // Fault both in before timing anything.
+      BenchFillBuffer(&Buffer, 0, BenchFill_Regular);
+      memset(Scratch, 0, FrameSize);
+
+      // NOTE: memcpy only ever sees the tight frame, so every pitch is
+      // measured against the same peak.
+      game_offscreen_buffer Frame = Buffer;
+      Frame.Pitch = RowBytes;
+
+      real64 Rates[BenchPass_Count];
+      for(int Pass = 0;
+          Pass < BenchPass_Count;
+          ++Pass)
+      {
+        Rates[Pass] = BenchBandwidthPass((Pass == BenchPass_Memcpy) ? &Frame : &Buffer, Scratch,
+                                         (bench_bandwidth_pass)Pass);
+      }
+      real64 Peak = Rates[BenchPass_Memcpy];
+
+      char SizeName[32];
+      snprintf(SizeName, sizeof(SizeName), "%dx%d", Buffer.Width, Buffer.Height);
+      printf("  %11s %7s %6d %7.2f", SizeName, PitchNames[PitchIndex], Buffer.Pitch, Peak);
+      for(int Pass = BenchPass_Fill;
+          Pass < BenchPass_Count;
+          ++Pass)
+      {
+        printf(" %7.2f (%4.2f)", Rates[Pass], Rates[Pass] / Peak);
+      }
+      printf("\n");
+
+      if(JSON)
+      {
+        fprintf(JSON, "%s\n    {\"width\": %d, \"height\": %d, \"pitch\": %d, \"pitch_kind\": \"%s\"",
+                RunIndex ? "," : "", Buffer.Width, Buffer.Height, Buffer.Pitch, PitchNames[PitchIndex]);
+        for(int Pass = 0;
+            Pass < BenchPass_Count;
+            ++Pass)
+        {
+          fprintf(JSON, ", \"%s_gb_per_second\": %.3f", PassNames[Pass], Rates[Pass]);
+        }
+        fprintf(JSON, "}");
+      }
+      ++RunIndex;
+
+      EndTemporaryMemory(BenchMemory);
+    }
+  }
+
+  // NOTE: The audio fill writes a frame's worth of samples at a time; the
+  // memcpy it's held against is the same size, so straight out of L1.
+  temporary_memory SoundMemory = BeginTemporaryMemory(Arena);
+  int VoiceCount = 16;
+  sound_voice *Voices = PushArray(Arena, VoiceCount, sound_voice);
+  for(int VoiceIndex = 0;
+      VoiceIndex < VoiceCount;
+      ++VoiceIndex)
+  {
+    Voices[VoiceIndex].Hz = (real32)(110 + 7 * VoiceIndex);
+    Voices[VoiceIndex].Volume = 7000.0f / (real32)VoiceCount;
+  }
+  game_sound_output_buffer SoundBuffer = {};
+  SoundBuffer.SamplesPerSecond = BENCH_SAMPLES_PER_SECOND;
+  SoundBuffer.SampleCount = BENCH_SAMPLES_PER_FRAME;
+  SoundBuffer.Samples = PushArray(Arena, 2 * BENCH_SAMPLES_PER_FRAME, int16, 16);
+  int16 *SoundScratch = PushArray(Arena, 2 * BENCH_SAMPLES_PER_FRAME, int16, 16);
+  memory_index SoundBytes = 2 * BENCH_SAMPLES_PER_FRAME * sizeof(int16);
+
+  int FillCount = 2000;
+  uint64 FillStart = BenchGetWallClock();
+  for(int FillIndex = 0; FillIndex < FillCount; ++FillIndex)
+  {
+    OutputSound(Arena, Voices, VoiceCount, 0, &SoundBuffer);
+  }
+  uint64 FillEnd = BenchGetWallClock();
+  // Keep the copies from being folded together.
+  for(int FillIndex = 0; FillIndex < 64 * FillCount; ++FillIndex)
+  {
+    SoundBuffer.Samples[0] = (int16)FillIndex;
+    memcpy(SoundScratch, SoundBuffer.Samples, SoundBytes);
+  }
+  uint64 CopyEnd = BenchGetWallClock();
+
+  real64 SoundRate = (real64)FillCount * (real64)SoundBytes / 1.0e9 / BenchSecondsElapsed(FillStart, FillEnd);
+  real64 SoundPeak = 64.0 * (real64)FillCount * (real64)SoundBytes / 1.0e9 / BenchSecondsElapsed(FillEnd, CopyEnd);
+  printf("  audio fill (%d voices, %d bytes) %.2f GB/s against memcpy %.2f (%.4f)\n", VoiceCount, (int)SoundBytes,
+         SoundRate, SoundPeak, SoundRate / SoundPeak);
+  if(JSON)
+  {
+    fprintf(JSON, "\n  ],\n  \"audio_fill\": {\"voices\": %d, \"bytes\": %d, \"gb_per_second\": %.4f, "
+            "\"memcpy_gb_per_second\": %.3f}",
+            VoiceCount, (int)SoundBytes, SoundRate, SoundPeak);
+  }
+  EndTemporaryMemory(SoundMemory);
+}
+
+internal int
+BenchCompareReal64(const void *A, const void *B)
+{
+  real64 X = *(real64 *)A;
+  real64 Y = *(real64 *)B;
+  return((X > Y) - (X < Y));
+}
+
+// NOTE: Sorts Values in place.
+internal real64
+BenchPercentile(real64 *Values, int Count, real64 Percentile)
+{
+  qsort(Values, Count, sizeof(real64), BenchCompareReal64);
+  int Index = (int)(Percentile * (real64)(Count - 1) + 0.5);
+  return(Values[Index]);
+}
+
+/*
+  NOTE: The render group with a lot more in it than the game pushes: a
+  clear, then rectangles and blended sprites scattered over four layers,
+  drawn into the whole 1080p buffer on the render queue. "tiles" is how
+  many screen tiles had anything in them, "overdraw" pixels drawn per
+  pixel of screen.
+*/
+internal void
+BenchRenderGroup(platform_api *API, memory_arena *Arena, FILE *JSON)
+{
+  int CommandCounts[] = {16, 256, 4096};
+
+  temporary_memory BenchMemory = BeginTemporaryMemory(Arena);
+  game_offscreen_buffer Buffer = {};
+  Buffer.Width = 1920;
+  Buffer.Height = 1080;
+  Buffer.Pitch = Buffer.Width * sizeof(uint32);
+  Buffer.Memory = PushSize(Arena, (memory_index)Buffer.Pitch * Buffer.Height, CACHE_LINE_SIZE);
+  loaded_bitmap Sprite = BenchMakeBitmap(Arena, 64, false);
+  game_rect Screen = {0, 0, Buffer.Width, Buffer.Height};
+
+  printf("render group (into %dx%d)\n", Buffer.Width, Buffer.Height);
+  printf("  %8s %9s %7s %9s %10s %9s\n", "commands", "median ms", "tiles", "overdraw", "MP/s", "sort us");
+
+  for(int CountIndex = 0;
+      CountIndex < (int)ArrayCount(CommandCounts);
+      ++CountIndex)
+  {
+    int CommandCount = CommandCounts[CountIndex];
+    int FrameCount = 30;
+    real64 *FrameMS = PushArray(Arena, FrameCount, real64);
+    game_render_stats Stats = {};
+    real64 SortSeconds = 0;
+
+    for(int FrameIndex = 0;
+        FrameIndex < FrameCount;
+        ++FrameIndex)
+    {
+      temporary_memory FrameMemory = BeginTemporaryMemory(Arena);
+      uint64 Start = BenchGetWallClock();
+
+      render_group *Group = AllocateRenderGroup(Arena, Megabytes(1), &Buffer);
+      PushClear(Group, 0xFF202020);
+      uint32 Random = 12345;
+      for(int CommandIndex = 1;
+          CommandIndex < CommandCount;
+          ++CommandIndex)
+      {
+        Random = Random * 1664525 + 1013904223;
+        int X = (int)((Random >> 8) % (uint32)Buffer.Width) - 32;
+        Random = Random * 1664525 + 1013904223;
+        int Y = (int)((Random >> 8) % (uint32)Buffer.Height) - 32;
+        uint32 Layer = 1 + (Random >> 30);
+        if(CommandIndex & 1)
+        {
+          game_rect Rect = {X, Y, X + 8 + (int)(Random & 127), Y + 8 + (int)((Random >> 7) & 127)};
+          PushRectangle(Group, Layer, Rect, 0xFF000000 | Random);
+        }
+        else
+        {
+          PushBitmap(Group, Layer, &Sprite, X, Y);
+        }
+      }
+
+      // NOTE: Sorting and binning on their own, on a copy, to see what they cost.
+      if(FrameIndex == 0)
+      {
+        temporary_memory SortMemory = BeginTemporaryMemory(Arena);
+        render_sort_entry *SortEntries = PushArray(Arena, Group->CommandCount, render_sort_entry);
+        render_sort_entry *SortTemp = PushArray(Arena, Group->CommandCount, render_sort_entry);
+        memcpy(SortEntries, GetSortEntries(Group), Group->CommandCount * sizeof(render_sort_entry));
+        uint64 SortStart = BenchGetWallClock();
+        SortRenderEntries(Group->CommandCount, SortEntries, SortTemp);
+        BinRenderEntries(Arena, Group, SortEntries);
+        SortSeconds = BenchSecondsElapsed(SortStart, BenchGetWallClock());
+        EndTemporaryMemory(SortMemory);
+      }
+
+      EndRender(Group, API->RenderQueue, Arena, &Screen, 1, &Stats);
+      FrameMS[FrameIndex] = 1000.0 * BenchSecondsElapsed(Start, BenchGetWallClock());
+      EndTemporaryMemory(FrameMemory);
+    }
+
+    real64 MedianMS = BenchPercentile(FrameMS, FrameCount, 0.5);
+    real64 Overdraw = (real64)Stats.PixelCount / ((real64)Buffer.Width * Buffer.Height);
+    real64 Rate = (real64)Stats.PixelCount / 1000.0 / MedianMS;
+    printf("  %8d %9.3f %7d %9.2f %10.1f %9.1f\n", Stats.CommandCount, MedianMS, Stats.TileCount, Overdraw, Rate,
+           1.0e6 * SortSeconds);
+    if(JSON)
+    {
+      fprintf(JSON, "%s\n    {\"commands\": %d, \"median_ms\": %.4f, \"tiles\": %d, \"pixels\": %lld, "
+              "\"mp_per_second\": %.1f, \"sort_and_bin_us\": %.1f}",
+              CountIndex ? "," : "", Stats.CommandCount, MedianMS, Stats.TileCount,
+              (long long)Stats.PixelCount, Rate, 1.0e6 * SortSeconds);
+    }
+  }
+
+  EndTemporaryMemory(BenchMemory);
+}
+
+/*
+  NOTE: The entity table and spatial hash at growing entity counts, spread
+  over a world that grows with them so there's always about one entity per
+  32x32 pixels. Per entity: moving them all with the scalar and the best
+  kernel, and rebuilding the hash. Per query: a 1080p camera's worth of
+  screen, a 64 pixel radius around a point, and that same radius found by
+  looking at every entity. "churn" is removing a tenth of the entities and
+  adding them back, per entity.
+*/
+internal void
+BenchEntities(memory_arena *Arena, FILE *JSON)
+{
+  uint32 EntityCounts[] = {1000, 10000, 100000, 1000000};
+  real32 const CellSize = 64.0f;
+  real32 const Radius = 64.0f;
+
+  simd_kernel Kernel = BestSIMDKernel();
+  printf("entities (SIMD kernel %d, ns per entity or per query)\n", (int)Kernel);
+  printf("  %8s %9s %9s %9s %10s %8s %9s %9s %9s\n", "entities", "scalar", "simd", "rebuild", "camera us",
+         "visible", "near", "brute", "churn");
+
+  for(int CountIndex = 0;
+      CountIndex < (int)ArrayCount(EntityCounts);
+      ++CountIndex)
+  {
+    uint32 EntityCount = EntityCounts[CountIndex];
+    temporary_memory BenchMemory = BeginTemporaryMemory(Arena);
+
+    entity_table *Table = PushStruct(Arena, entity_table);
+    InitializeEntityTable(Table, Arena, EntityCount);
+    spatial_hash *Hash = PushStruct(Arena, spatial_hash);
+    InitializeSpatialHash(Hash, Arena, Table->MaxCount, EntityCount, CellSize);
+    uint32 *Results = PushArray(Arena, Table->MaxCount, uint32);
+    entity_handle *Handles = PushArray(Arena, EntityCount / 10, entity_handle);
+
+    real32 WorldSize = 32.0f*sqrtf((real32)EntityCount);
+    uint32 Random = 0x9E3779B9;
+    for(uint32 Index = 0; Index < EntityCount; ++Index)
+    {
+      AddEntity(Table, 0.5f*WorldSize*(NextRandomBilateral(&Random) + 1.0f),
+                0.5f*WorldSize*(NextRandomBilateral(&Random) + 1.0f),
+                2.0f*NextRandomBilateral(&Random), 2.0f*NextRandomBilateral(&Random), NextRandom(&Random));
+    }
+
+    int MoveCount = (int)(20000000 / EntityCount) + 4;
+    Table->Kernel = SIMDKernel_Scalar;
+    uint64 ScalarStart = BenchGetWallClock();
+    for(int MoveIndex = 0; MoveIndex < MoveCount; ++MoveIndex)
+    {
+      MoveEntities(Table, 1.0f, WorldSize, WorldSize);
+    }
+    Table->Kernel = Kernel;
+    uint64 SIMDStart = BenchGetWallClock();
+    for(int MoveIndex = 0; MoveIndex < MoveCount; ++MoveIndex)
+    {
+      MoveEntities(Table, 1.0f, WorldSize, WorldSize);
+    }
+    uint64 BuildStart = BenchGetWallClock();
+    int BuildCount = MoveCount / 4 + 1;
+    for(int BuildIndex = 0; BuildIndex < BuildCount; ++BuildIndex)
+    {
+      BuildSpatialHash(Hash, Table);
+    }
+    uint64 BuildEnd = BenchGetWallClock();
+
+    real64 EntityMoves = (real64)MoveCount * EntityCount;
+    real64 ScalarNS = 1.0e9 * BenchSecondsElapsed(ScalarStart, SIMDStart) / EntityMoves;
+    real64 SIMDNS = 1.0e9 * BenchSecondsElapsed(SIMDStart, BuildStart) / EntityMoves;
+    real64 BuildNS = 1.0e9 * BenchSecondsElapsed(BuildStart, BuildEnd) / ((real64)BuildCount * EntityCount);
+
+    int CameraCount = 200;
+    uint64 VisibleTotal = 0;
+    uint64 CameraStart = BenchGetWallClock();
+    for(int QueryIndex = 0; QueryIndex < CameraCount; ++QueryIndex)
+    {
+      real32 X = 0.5f*WorldSize*(NextRandomBilateral(&Random) + 1.0f) - 960.0f;
+      real32 Y = 0.5f*WorldSize*(NextRandomBilateral(&Random) + 1.0f) - 540.0f;
+      VisibleTotal += QueryEntitiesInRect(Hash, Table, X, Y, X + 1920.0f, Y + 1080.0f, Results, Table->MaxCount);
+    }
+    uint64 CameraEnd = BenchGetWallClock();
+
+    int NearCount = 20000;
+    uint64 NearTotal = 0;
+    for(int QueryIndex = 0; QueryIndex < NearCount; ++QueryIndex)
+    {
+      real32 X = 0.5f*WorldSize*(NextRandomBilateral(&Random) + 1.0f);
+      real32 Y = 0.5f*WorldSize*(NextRandomBilateral(&Random) + 1.0f);
+      NearTotal += QueryEntitiesNear(Hash, Table, X, Y, Radius, Results, Table->MaxCount);
+    }
+    uint64 NearEnd = BenchGetWallClock();
+
+    // NOTE: Without the hash: every entity, every query.
+    int BruteCount = (int)(20000000 / EntityCount) + 1;
+    uint64 BruteTotal = 0;
+    for(int QueryIndex = 0; QueryIndex < BruteCount; ++QueryIndex)
+    {
+      real32 X = 0.5f*WorldSize*(NextRandomBilateral(&Random) + 1.0f);
+      real32 Y = 0.5f*WorldSize*(NextRandomBilateral(&Random) + 1.0f);
+      for(uint32 Index = 0; Index < Table->Count; ++Index)
+      {
+        real32 dX = Table->PositionX[Index] - X;
+        real32 dY = Table->PositionY[Index] - Y;
+        BruteTotal += ((dX*dX + dY*dY) <= Radius*Radius);
+      }
+    }
+    uint64 BruteEnd = BenchGetWallClock();
+
+    uint32 ChurnCount = EntityCount / 10;
+    for(uint32 Index = 0; Index < ChurnCount; ++Index)
+    {
+      Handles[Index] = GetEntityHandle(Table, (NextRandom(&Random) >> 4) % Table->Count);
+    }
+    uint64 ChurnStart = BenchGetWallClock();
+    uint32 Removed = 0;
+    for(uint32 Index = 0; Index < ChurnCount; ++Index)
+    {
+      // Some get picked twice; the second handle is stale by then.
+      Removed += RemoveEntity(Table, Handles[Index]);
+    }
+    for(uint32 Index = 0; Index < Removed; ++Index)
+    {
+      AddEntity(Table, 0.0f, 0.0f, 1.0f, 1.0f, 0);
+    }
+    uint64 ChurnEnd = BenchGetWallClock();
+    Assert(Table->Count == EntityCount);
+
+    real64 CameraUS = 1.0e6 * BenchSecondsElapsed(CameraStart, CameraEnd) / CameraCount;
+    real64 NearNS = 1.0e9 * BenchSecondsElapsed(CameraEnd, NearEnd) / NearCount;
+    real64 BruteNS = 1.0e9 * BenchSecondsElapsed(NearEnd, BruteEnd) / BruteCount;
+    real64 ChurnNS = 1.0e9 * BenchSecondsElapsed(ChurnStart, ChurnEnd) / (2.0 * (ChurnCount ? ChurnCount : 1));
+    real64 Visible = (real64)VisibleTotal / CameraCount;
+
+    printf("  %8u %9.2f %9.2f %9.2f %10.1f %8.0f %9.0f %9.0f %9.2f\n", EntityCount, ScalarNS, SIMDNS, BuildNS,
+           CameraUS, Visible, NearNS, BruteNS, ChurnNS);
+    if(JSON)
+    {
+      fprintf(JSON, "%s\n    {\"entities\": %u, \"scalar_move_ns\": %.3f, \"simd_move_ns\": %.3f, "
+              "\"rebuild_ns\": %.3f, \"camera_query_us\": %.2f, \"visible\": %.0f, \"near_query_ns\": %.1f, "
+              "\"near_found\": %.2f, \"brute_query_ns\": %.1f, \"brute_found\": %.2f, \"churn_ns\": %.3f}",
+              CountIndex ? "," : "", EntityCount, ScalarNS, SIMDNS, BuildNS, CameraUS, Visible, NearNS,
+              (real64)NearTotal / NearCount, BruteNS, (real64)BruteTotal / BruteCount, ChurnNS);
+    }
+
+    EndTemporaryMemory(BenchMemory);
+  }
+}
+
+#define BENCH_STARTUP_RUNS 9
+
+/*
+  NOTE: The game's share of the time to first frame: the first GameUpdate,
+  which sets the game up in memory nothing has touched yet, and the first
+  GameRender after it, into a buffer just as fresh, much as the platform
+  has it at startup. Every run gets newly mapped memory, so none of them
+  finds the pages already faulted in.
+*/
+internal void
+BenchStartup(game_memory *Template, int Width, int Height, FILE *JSON)
+{
+  real64 UpdateMS[BENCH_STARTUP_RUNS];
+  real64 RenderMS[BENCH_STARTUP_RUNS];
+  real64 FrameMS[BENCH_STARTUP_RUNS];
+  real64 WarmMS[BENCH_STARTUP_RUNS];
+
+  game_input Input = {};
+  Input.dtForUpdate = 1.0f / 60.0f;
+
+  int RunCount = 0;
+  for(int RunIndex = 0;
+      RunIndex < BENCH_STARTUP_RUNS;
+      ++RunIndex)
+  {
+    game_memory GameMemory = {};
+    GameMemory.PermanentStorageSize = Template->PermanentStorageSize;
+    GameMemory.TransientStorageSize = Template->TransientStorageSize;
+    GameMemory.PlatformAPI = Template->PlatformAPI;
+    GameMemory.DebugTable = Template->DebugTable;
+
+    game_offscreen_buffer Buffer = {};
+    Buffer.Width = Width;
+    Buffer.Height = Height;
+    Buffer.Pitch = Align(Width * 4, CACHE_LINE_SIZE);
+    memory_index BufferSize = (memory_index)Buffer.Pitch * Height;
+    memory_index TotalSize = GameMemory.PermanentStorageSize + GameMemory.TransientStorageSize + BufferSize;
+
+    uint8 *Memory = (uint8 *)mmap(0, TotalSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(Memory == MAP_FAILED)
+    {
+      break;
+    }
+    GameMemory.PermanentStorage = Memory;
+    GameMemory.TransientStorage = Memory + GameMemory.PermanentStorageSize;
+    Buffer.Memory = Memory + GameMemory.PermanentStorageSize + GameMemory.TransientStorageSize;
+
+    uint64 Start = BenchGetWallClock();
+    GameUpdate(&GameMemory, &Input);
+    uint64 UpdateEnd = BenchGetWallClock();
+    GameRender(&GameMemory, &Buffer, 1.0f);
+    uint64 RenderEnd = BenchGetWallClock();
+    GameUpdate(&GameMemory, &Input);
+    GameRender(&GameMemory, &Buffer, 1.0f);
+    uint64 WarmEnd = BenchGetWallClock();
+
+    UpdateMS[RunCount] = 1000.0 * BenchSecondsElapsed(Start, UpdateEnd);
+    RenderMS[RunCount] = 1000.0 * BenchSecondsElapsed(UpdateEnd, RenderEnd);
+    FrameMS[RunCount] = 1000.0 * BenchSecondsElapsed(Start, RenderEnd);
+    WarmMS[RunCount] = 1000.0 * BenchSecondsElapsed(RenderEnd, WarmEnd);
+    ++RunCount;
+
+    // NOTE: Nothing may still be loading into the memory when it goes.
+    GameMemory.PlatformAPI.CompleteAllWork(GameMemory.PlatformAPI.LowPriorityQueue);
+    munmap(Memory, TotalSize);
+  }
+  if(!RunCount)
+  {
+    return;
+  }
+
+  real64 FrameMinMS = BenchPercentile(FrameMS, RunCount, 0.0);
+  real64 FrameMedianMS = BenchPercentile(FrameMS, RunCount, 0.5);
+  real64 UpdateMedianMS = BenchPercentile(UpdateMS, RunCount, 0.5);
+  real64 RenderMedianMS = BenchPercentile(RenderMS, RunCount, 0.5);
+  real64 WarmMedianMS = BenchPercentile(WarmMS, RunCount, 0.5);
+
+  printf("startup (%d cold starts at %dx%d, median ms)\n", RunCount, Width, Height);
+  printf("  %12s %12s %12s %12s %12s\n", "first update", "first render", "first frame", "min", "next frame");
+  printf("  %12.3f %12.3f %12.3f %12.3f %12.3f\n", UpdateMedianMS, RenderMedianMS, FrameMedianMS, FrameMinMS,
+         WarmMedianMS);
+  if(JSON)
+  {
+    fprintf(JSON, ",\n  \"startup\": {\"runs\": %d, \"width\": %d, \"height\": %d, \"first_update_ms\": %.4f, "
+            "\"first_render_ms\": %.4f, \"first_frame_ms\": %.4f, \"first_frame_min_ms\": %.4f, "
+            "\"next_frame_ms\": %.4f}",
+            RunCount, Width, Height, UpdateMedianMS, RenderMedianMS, FrameMedianMS, FrameMinMS, WarmMedianMS);
+  }
+}
+
+/*
+  NOTE: Runs whole game frames into an offscreen buffer of the given size:
+  a GameUpdate with a stick held over, so the picture keeps moving, a
+  GameRender of where that left things, and then a frame's worth of
+  GameGetSoundSamples. That's one update per frame, the way the platform
+  runs the game when frames go out at the update rate.
+*/
+internal void
+BenchPrintDebugFrame(debug_frame *Frame)
+{
+  printf("    %-28s %12s %12s %6s %12s\n", "block", "self cy", "incl cy", "hits", "cy/hit");
+  for(uint32 BlockIndex = 0;
+      BlockIndex < Frame->BlockCount;
+      ++BlockIndex)
+  {
+    debug_block_stats *Block = Frame->Blocks + BlockIndex;
+    printf("    %-28s %12llu %12llu %6u %12llu\n", Block->Name,
+           (unsigned long long)Block->SelfCycles, (unsigned long long)Block->InclusiveCycles,
+           Block->HitCount, (unsigned long long)(Block->InclusiveCycles / Block->HitCount));
+  }
+}
+
+internal bench_frame_stats
+BenchFrames(game_memory *GameMemory, memory_arena *Arena, int Width, int Height, int FrameCount,
+            debug_frame *DebugFrame)
+{
+  temporary_memory BenchMemory = BeginTemporaryMemory(Arena);
+
+  game_offscreen_buffer Buffer = {};
+  Buffer.Width = Width;
+  Buffer.Height = Height;
+  Buffer.Pitch = Align(Width * 4, CACHE_LINE_SIZE);
+  Buffer.Memory = PushSize(Arena, (memory_index)Buffer.Pitch * Height, CACHE_LINE_SIZE);
+
+  game_input Input = {};
+  Input.dtForUpdate = 1.0f / 60.0f;
+  game_controller_input *Controller = GetController(&Input, 1);
+  Controller->IsConnected = true;
+  Controller->IsAnalog = true;
+  Controller->StickAverageX = 0.5f;
+  Controller->StickAverageY = 0.25f;
+
+  game_sound_output_buffer SoundBuffer = {};
+  SoundBuffer.SamplesPerSecond = BENCH_SAMPLES_PER_SECOND;
+  SoundBuffer.SampleCount = BENCH_SAMPLES_PER_FRAME;
+  SoundBuffer.Samples = PushArray(Arena, 2 * BENCH_SAMPLES_PER_FRAME, int16, 16);
+
+  real64 *FrameMS = PushArray(Arena, FrameCount, real64);
+  real64 *FrameCycles = PushArray(Arena, FrameCount, real64);
+  real64 *SoundMS = PushArray(Arena, FrameCount, real64);
+
+  // Fault the buffer in and let the workers spin up before timing anything.
+  for(int FrameIndex = 0; FrameIndex < 8; ++FrameIndex)
+  {
+    GameUpdate(GameMemory, &Input);
+    GameRender(GameMemory, &Buffer, 1.0f);
+  }
+
+  // NOTE: First, frames with nothing moving, the way the platform runs them
+  // when it keeps the buffer around and tracks what changed.
+  game_dirty_rects *DirtyRects = PushStruct(Arena, game_dirty_rects);
+  game_input StillInput = {};
+  Buffer.IsPreserved = true;
+  Buffer.DirtyRects = DirtyRects;
+  StillInput.dtForUpdate = Input.dtForUpdate;
+  GameUpdate(GameMemory, &StillInput);
+  GameRender(GameMemory, &Buffer, 1.0f);
+  for(int FrameIndex = 0;
+      FrameIndex < FrameCount;
+      ++FrameIndex)
+  {
+    uint64 FrameStart = BenchGetWallClock();
+    GameUpdate(GameMemory, &StillInput);
+    GameRender(GameMemory, &Buffer, 1.0f);
+    uint64 FrameEnd = BenchGetWallClock();
+    Assert(DirtyRects->PixelCount == 0);
+
+    FrameMS[FrameIndex] = 1000.0 * BenchSecondsElapsed(FrameStart, FrameEnd);
+    if(GameMemory->DebugTable)
+    {
+      DEBUGCollateEvents(GameMemory->DebugTable, DebugFrame);
+    }
+  }
+  real64 StillMedianMS = BenchPercentile(FrameMS, FrameCount, 0.5);
+  Buffer.IsPreserved = false;
+  Buffer.DirtyRects = 0;
+
+  for(int FrameIndex = 0;
+      FrameIndex < FrameCount;
+      ++FrameIndex)
+  {
+    uint64 FrameStart = BenchGetWallClock();
+    uint64 FrameStartCycles = BenchGetCycleCount();
+    GameUpdate(GameMemory, &Input);
+    GameRender(GameMemory, &Buffer, 1.0f);
+    uint64 FrameEndCycles = BenchGetCycleCount();
+    uint64 FrameEnd = BenchGetWallClock();
+    GameGetSoundSamples(GameMemory, &SoundBuffer);
+    uint64 SoundEnd = BenchGetWallClock();
+
+    FrameMS[FrameIndex] = 1000.0 * BenchSecondsElapsed(FrameStart, FrameEnd);
+    FrameCycles[FrameIndex] = (real64)(FrameEndCycles - FrameStartCycles);
+    SoundMS[FrameIndex] = 1000.0 * BenchSecondsElapsed(FrameEnd, SoundEnd);
+
+    if(GameMemory->DebugTable)
+    {
+      DEBUGCollateEvents(GameMemory->DebugTable, DebugFrame);
+    }
+  }
+
+  bench_frame_stats Stats = {};
+  Stats.MinMS = BenchPercentile(FrameMS, FrameCount, 0.0);
+  Stats.MedianMS = BenchPercentile(FrameMS, FrameCount, 0.5);
+  Stats.P99MS = BenchPercentile(FrameMS, FrameCount, 0.99);
+  Stats.CyclesPerPixel = BenchPercentile(FrameCycles, FrameCount, 0.5) / ((real64)Width * (real64)Height);
+  Stats.SoundMedianMS = BenchPercentile(SoundMS, FrameCount, 0.5);
+  Stats.StillMedianMS = StillMedianMS;
+
+  EndTemporaryMemory(BenchMemory);
+
+  return(Stats);
+}
+
+/*
+  NOTE: File loading throughput. Writes a scratch file, then reads it back
+  with ReadEntireFile (touching every page, since a mapping costs nothing
+  until then) and by streaming several copies at once through the low
+  priority queue, the way the game loads assets. The scratch file was only
+  just written, so this measures reads out of the page cache: the best the
+  loading path can possibly do, not the disk.
+*/
+internal void
+BenchFileLoading(int FileMegabytes, FILE *JSON)
+{
+  char Filename[4096];
+  char *TempDirectory = getenv("TMPDIR");
+  snprintf(Filename, sizeof(Filename), "%s/handmade_bench_%d.bin",
+           TempDirectory ? TempDirectory : "/tmp", (int)getpid());
+
+  uint64 FileSize = (uint64)Megabytes(FileMegabytes);
+  int const StreamCount = 4;
+  memory_index IOMemorySize = StreamCount * FileSize + StreamCount * CACHE_LINE_SIZE;
+  void *IOMemory = calloc(1, IOMemorySize);
+  uint32 *Pattern = (uint32 *)malloc(FileSize);
+  if(!IOMemory || !Pattern)
+  {
+    fprintf(stderr, "Unable to allocate file loading memory\n");
+    free(IOMemory);
+    free(Pattern);
+    return;
+  }
+  memory_arena IOArena;
+  InitializeArena(&IOArena, IOMemorySize, IOMemory);
+
+  // Something other than zeroes, so a short read would show.
+  for(uint64 WordIndex = 0; WordIndex < FileSize / sizeof(uint32); ++WordIndex)
+  {
+    Pattern[WordIndex] = (uint32)(WordIndex * 2654435761u);
+  }
+
+  uint64 WriteStart = BenchGetWallClock();
+  bool32 Written = Platform.WriteEntireFile(Filename, FileSize, Pattern);
+  uint64 WriteEnd = BenchGetWallClock();
+  if(!Written)
+  {
+    fprintf(stderr, "Unable to write %s\n", Filename);
+    free(IOMemory);
+    free(Pattern);
+    return;
+  }
+
+  uint64 MapStart = BenchGetWallClock();
+  platform_file_contents Contents = Platform.ReadEntireFile(Filename);
+  volatile uint8 *Touch = (volatile uint8 *)Contents.Contents;
+  for(uint64 Offset = 0; Offset < Contents.Size; Offset += 4096)
+  {
+    Touch[Offset];
+  }
+  uint64 MapEnd = BenchGetWallClock();
+  bool32 MapOK = (Contents.Size == FileSize) && (memcmp(Contents.Contents, Pattern, FileSize) == 0);
+  Platform.FreeFileMemory(&Contents);
+
+  loaded_file Files[StreamCount];
+  uint64 StreamStart = BenchGetWallClock();
+  int StartedCount = 0;
+  for(int StreamIndex = 0; StreamIndex < StreamCount; ++StreamIndex)
+  {
+    StartedCount += LoadFileAsync(&IOArena, Filename, Files + StreamIndex) ? 1 : 0;
+  }
+  bool32 StreamOK = (StartedCount == StreamCount);
+  for(int StreamIndex = 0; StreamOK && (StreamIndex < StreamCount); ++StreamIndex)
+  {
+    while(!IsFileLoaded(Files + StreamIndex))
+    {
+      _mm_pause();
+    }
+  }
+  uint64 StreamEnd = BenchGetWallClock();
+  for(int StreamIndex = 0; StreamOK && (StreamIndex < StreamCount); ++StreamIndex)
+  {
+    loaded_file *File = Files + StreamIndex;
+    StreamOK = !File->LoadFailed && (File->Size == FileSize) && (memcmp(File->Contents, Pattern, FileSize) == 0);
+  }
+
+  unlink(Filename);
+  free(IOMemory);
+  free(Pattern);
+
+  real64 Megabyte = (real64)Megabytes(1);
+  real64 WriteRate = (real64)FileSize / Megabyte / BenchSecondsElapsed(WriteStart, WriteEnd);
+  real64 MapRate = (real64)FileSize / Megabyte / BenchSecondsElapsed(MapStart, MapEnd);
+  real64 StreamRate = (real64)(StreamCount * FileSize) / Megabyte / BenchSecondsElapsed(StreamStart, StreamEnd);
+
+  printf("file loading (%d MB file, page cache warm)\n", FileMegabytes);
+  printf("  %-36s %10.1f MB/s\n", "WriteEntireFile", WriteRate);
+  printf("  %-36s %10.1f MB/s%s\n", "ReadEntireFile + touch every page", MapRate, MapOK ? "" : "  MISMATCH");
+  printf("  %-36s %10.1f MB/s%s\n", "LoadFileAsync x4 on the queue", StreamRate, StreamOK ? "" : "  MISMATCH");
+  if(JSON)
+  {
+    fprintf(JSON, ",\n  \"file_loading\": {\"file_megabytes\": %d, \"write_mb_per_second\": %.1f, "
+            "\"map_mb_per_second\": %.1f, \"stream_mb_per_second\": %.1f, \"ok\": %s}",
+            FileMegabytes, WriteRate, MapRate, StreamRate, (MapOK && StreamOK) ? "true" : "false");
+  }
+}
+
+int main(int argc, char **argv)
+{
+  int FrameCount = 240;
+  int ThreadCount = (int)sysconf(_SC_NPROCESSORS_ONLN) - 1;
+  char *JSONPath = 0;
+  bool32 Profile = false;
+  bool32 Verify = false;
+  int FileMegabytes = 64;
+  bench_size Sizes[16];
+  int SizeCount = 0;
+
+  for(int ArgIndex = 1;
+      ArgIndex < argc;
+      ++ArgIndex)
+  {
+    char *Arg = argv[ArgIndex];
+    char *Value = (ArgIndex + 1 < argc) ? argv[ArgIndex + 1] : 0;
+    if(strcmp(Arg, "--profile") == 0)
+    {
+      Profile = true;
+    }
+    else if(strcmp(Arg, "--verify") == 0)
+    {
+      Verify = true;
+    }
+    else if(Value && (strcmp(Arg, "--frames") == 0))
+    {
+      FrameCount = atoi(Value);
+      ++ArgIndex;
+    }
+    else if(Value && (strcmp(Arg, "--threads") == 0))
+    {
+      ThreadCount = atoi(Value);
+      ++ArgIndex;
+    }
+    else if(Value && (strcmp(Arg, "--io-mb") == 0))
+    {
+      FileMegabytes = atoi(Value);
+      ++ArgIndex;
+    }
+    else if(Value && (strcmp(Arg, "--json") == 0))
+    {
+      JSONPath = Value;
+      ++ArgIndex;
+    }
+    else if(Value && (strcmp(Arg, "--size") == 0) && (SizeCount < (int)ArrayCount(Sizes)) &&
+            (sscanf(Value, "%dx%d", &Sizes[SizeCount].Width, &Sizes[SizeCount].Height) == 2))
+    {
+      ++SizeCount;
+      ++ArgIndex;
+    }
+    else
+    {
+      fprintf(stderr, "usage: %s [--frames N] [--threads N] [--size WxH]... [--json FILE] [--profile] [--io-mb N] "
+              "[--verify]\n", argv[0]);
+      return(1);
+    }
+  }
+
+  if(Verify)
+  {
+#if HANDMADE_SLOW
+    DEBUGVerifyKernels();
+    DEBUGVerifyScaleKernels();
+    printf("kernels: every SIMD kernel matches its scalar reference\n");
+    return(0);
+#else
+    fprintf(stderr, "--verify needs a build with HANDMADE_SLOW=1 (make test)\n");
+    return(1);
+#endif
+  }
+
+  if(SizeCount == 0)
+  {
+    bench_size DefaultSizes[] = {{1280, 720}, {1920, 1080}, {3840, 2160}};
+    for(int SizeIndex = 0; SizeIndex < (int)ArrayCount(DefaultSizes); ++SizeIndex)
+    {
+      Sizes[SizeCount++] = DefaultSizes[SizeIndex];
+    }
+  }
+  if(FrameCount < 1) FrameCount = 1;
+  if(ThreadCount < 0) ThreadCount = 0;
+
+  memory_index BenchMemorySize = Megabytes(256);
+  void *BenchMemory = calloc(1, BenchMemorySize);
+
+  game_memory GameMemory = {};
+  GameMemory.PermanentStorageSize = Megabytes(64);
+  GameMemory.TransientStorageSize = Megabytes(256);
+  GameMemory.PermanentStorage = calloc(1, GameMemory.PermanentStorageSize + GameMemory.TransientStorageSize);
+  if(!BenchMemory || !GameMemory.PermanentStorage)
+  {
+    fprintf(stderr, "Unable to allocate benchmark memory\n");
+    return(1);
+  }
+  GameMemory.TransientStorage = (uint8 *)GameMemory.PermanentStorage + GameMemory.PermanentStorageSize;
+
+  platform_work_queue RenderQueue = {};
+  BenchMakeQueue(&RenderQueue, ThreadCount);
+  // NOTE: Loads only ever complete on their own threads, so this queue gets
+  // some even when the render queue is asked to run serially.
+  platform_work_queue LowPriorityQueue = {};
+  BenchMakeQueue(&LowPriorityQueue, 2);
+  GameMemory.PlatformAPI.RenderQueue = &RenderQueue;
+  GameMemory.PlatformAPI.LowPriorityQueue = &LowPriorityQueue;
+  GameMemory.PlatformAPI.AddEntry = BenchAddEntry;
+  GameMemory.PlatformAPI.CompleteAllWork = BenchCompleteAllWork;
+  GameMemory.PlatformAPI.GetAudioCursors = BenchGetAudioCursors;
+  GameMemory.PlatformAPI.ReadEntireFile = PosixReadEntireFile;
+  GameMemory.PlatformAPI.FreeFileMemory = PosixFreeFileMemory;
+  GameMemory.PlatformAPI.WriteEntireFile = PosixWriteEntireFile;
+  GameMemory.PlatformAPI.OpenFile = PosixOpenFile;
+  GameMemory.PlatformAPI.ReadDataFromFile = PosixReadDataFromFile;
+  GameMemory.PlatformAPI.CloseFile = PosixCloseFile;
+  Platform = GameMemory.PlatformAPI;
+
+  memory_arena Arena;
+  InitializeArena(&Arena, BenchMemorySize, BenchMemory);
+
+  // NOTE: Only profile when asked to, so the timings above stay comparable
+  // with runs that don't record any events.
+  debug_frame *DebugFrame = 0;
+  if(Profile)
+  {
+    GameMemory.DebugTable = PushStruct(&Arena, debug_table);
+    DebugFrame = PushStruct(&Arena, debug_frame);
+    GlobalDebugTable = GameMemory.DebugTable;
+  }
+
+  FILE *JSON = 0;
+  if(JSONPath)
+  {
+    JSON = fopen(JSONPath, "w");
+    if(!JSON)
+    {
+      fprintf(stderr, "Unable to open %s\n", JSONPath);
+      return(1);
+    }
+    fprintf(JSON, "{\n  \"frames_per_run\": %d,\n  \"worker_threads\": %d,\n  \"simd_kernel\": %d,\n  \"frames\": [",
+            FrameCount, ThreadCount, (int)BestSIMDKernel());
+  }
+
+  printf("game frames (%d frames, %d worker threads)\n", FrameCount, ThreadCount);
+  printf("  %11s %9s %9s %9s %12s %9s %9s\n", "size", "min ms", "median ms", "p99 ms", "cycles/pixel", "sound ms",
+         "still us");
+  for(int SizeIndex = 0;
+      SizeIndex < SizeCount;
+      ++SizeIndex)
+  {
+    bench_size Size = Sizes[SizeIndex];
+    bench_frame_stats Stats = BenchFrames(&GameMemory, &Arena, Size.Width, Size.Height, FrameCount, DebugFrame);
+
+    char SizeName[32];
+    snprintf(SizeName, sizeof(SizeName), "%dx%d", Size.Width, Size.Height);
+    printf("  %11s %9.3f %9.3f %9.3f %12.3f %9.3f %9.1f\n", SizeName, Stats.MinMS, Stats.MedianMS,
+           Stats.P99MS, Stats.CyclesPerPixel, Stats.SoundMedianMS, 1000.0*Stats.StillMedianMS);
+    if(DebugFrame)
+    {
+      BenchPrintDebugFrame(DebugFrame);
+    }
+    if(JSON)
+    {
+      fprintf(JSON, "%s\n    {\"width\": %d, \"height\": %d, \"min_ms\": %.4f, \"median_ms\": %.4f, "
+              "\"p99_ms\": %.4f, \"cycles_per_pixel\": %.4f, \"sound_median_ms\": %.4f, "
+              "\"still_median_ms\": %.4f}",
+              SizeIndex ? "," : "", Size.Width, Size.Height, Stats.MinMS, Stats.MedianMS,
+              Stats.P99MS, Stats.CyclesPerPixel, Stats.SoundMedianMS, Stats.StillMedianMS);
+    }
+  }
+
+  if(JSON)
+  {
+    fprintf(JSON, "\n  ]");
+  }
+  BenchStartup(&GameMemory, 1280, 720, JSON);
+
+  if(JSON)
+  {
+    fprintf(JSON, ",\n  \"mixer\": [");
+  }
+  BenchSound(&Arena, JSON);
+  if(JSON)
+  {
+    fprintf(JSON, "\n  ]");
+  }
+
+  if(JSON)
+  {
+    fprintf(JSON, ",\n  \"audio_streams\": [");
+  }
+  BenchAudioStreams(&Arena, JSON);
+  if(JSON)
+  {
+    fprintf(JSON, "\n  ]");
+  }
+
+  if(JSON)
+  {
+    fprintf(JSON, ",\n  \"blit\": [");
+  }
+  BenchBlit(&Arena, JSON);
+  if(JSON)
+  {
+    fprintf(JSON, "\n  ]");
+  }
+
+  if(JSON)
+  {
+    fprintf(JSON, ",\n  \"scale\": [");
+  }
+  BenchScale(&GameMemory.PlatformAPI, &Arena, JSON);
+  if(JSON)
+  {
+    fprintf(JSON, "\n  ]");
+  }
+
+  if(JSON)
+  {
+    fprintf(JSON, ",\n  \"pixel_formats\": [");
+  }
+  BenchPixelFormats(&Arena, JSON);
+  if(JSON)
+  {
+    fprintf(JSON, "\n  ]");
+  }
+
+  if(JSON)
+  {
+    fprintf(JSON, ",\n  \"render_group\": [");
+  }
+  BenchRenderGroup(&GameMemory.PlatformAPI, &Arena, JSON);
+  if(JSON)
+  {
+    fprintf(JSON, "\n  ]");
+  }
+
+  if(JSON)
+  {
+    fprintf(JSON, ",\n  \"entities\": [");
+  }
+  BenchEntities(&Arena, JSON);
+  if(JSON)
+  {
+    fprintf(JSON, "\n  ]");
+  }
+
+  BenchBandwidth(&Arena, Sizes, SizeCount, JSON);
+
+  if(FileMegabytes > 0)
+  {
+    BenchFileLoading(FileMegabytes, JSON);
+  }
+
+  if(JSON)
+  {
+    fprintf(JSON, "\n}\n");
+    fclose(JSON);
+  }
+
+  return(0);
+}
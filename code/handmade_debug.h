@@ -0,0 +1,275 @@
+#if !defined(HANDMADE_DEBUG_H)
+
+/*
+  NOTE: Cycle-counting profiler.
+
+  Wrap a scope in TIMED_BLOCK("Name") (or TIMED_FUNCTION()) and its begin and
+  end get stamped with the cycle counter into one big ring of events that the
+  platform layer owns and shares with the game. Recording an event is one
+  atomic add and a few stores; nothing is added up until the platform
+  collates the frame's events at the end of the frame.
+
+  All of this compiles away to nothing unless HANDMADE_INTERNAL is set.
+*/
+
+#if HANDMADE_INTERNAL
+
+#include <string.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#if !(defined(__x86_64__) && defined(__linux__))
+#include <pthread.h>
+#endif
+
+enum debug_event_type
+{
+  DebugEvent_BeginBlock,
+  DebugEvent_EndBlock,
+};
+
+struct debug_event
+{
+  uint64 Clock;
+  uint64 ThreadID;
+  // NOTE: Points at a string literal in whichever module recorded the event,
+  // so it's only good until the game code is next reloaded.
+  char *BlockName;
+  uint32 Type;
+};
+
+#define DEBUG_MAX_EVENT_COUNT 65536
+
+/*
+  NOTE: Two event arrays. Everybody records into the current one while the
+  platform collates the one before it. The top 32 bits of
+  EventArrayIndex_EventIndex pick the array and the bottom 32 bits count the
+  events in it, so claiming a slot is a single atomic add.
+*/
+struct debug_table
+{
+  uint64 volatile EventArrayIndex_EventIndex;
+  debug_event Events[2][DEBUG_MAX_EVENT_COUNT];
+};
+
+// NOTE: Each module points this at the platform's table before recording.
+global_variable debug_table *GlobalDebugTable;
+
+inline uint64
+GetThreadID(void)
+{
+  uint64 ThreadID;
+#if defined(__x86_64__) && defined(__linux__)
+  // NOTE: The thread control block starts with a pointer to itself, which is
+  // cheaper to read than any system call, and the same from every module.
+  __asm__("mov %%fs:0, %0" : "=r"(ThreadID));
+#else
+  ThreadID = (uint64)pthread_self();
+#endif
+  return(ThreadID);
+}
+
+inline void
+RecordDebugEvent(debug_event_type Type, char *BlockName)
+{
+  debug_table *Table = GlobalDebugTable;
+  if(Table)
+  {
+    uint64 ArrayIndex_EventIndex = __atomic_fetch_add(&Table->EventArrayIndex_EventIndex, 1, __ATOMIC_RELAXED);
+    uint32 EventIndex = (uint32)ArrayIndex_EventIndex;
+    if(EventIndex < DEBUG_MAX_EVENT_COUNT)
+    {
+      debug_event *Event = Table->Events[ArrayIndex_EventIndex >> 32] + EventIndex;
+      Event->Clock = __rdtsc();
+      Event->ThreadID = GetThreadID();
+      Event->BlockName = BlockName;
+      Event->Type = Type;
+    }
+  }
+}
+
+struct timed_block
+{
+  char *BlockName;
+
+  timed_block(char *BlockNameInit)
+  {
+    BlockName = BlockNameInit;
+    RecordDebugEvent(DebugEvent_BeginBlock, BlockName);
+  }
+
+  ~timed_block()
+  {
+    RecordDebugEvent(DebugEvent_EndBlock, BlockName);
+  }
+};
+
+#define TIMED_BLOCK__(Name, Number) timed_block TimedBlock_##Number((char *)(Name))
+#define TIMED_BLOCK_(Name, Number) TIMED_BLOCK__(Name, Number)
+#define TIMED_BLOCK(Name) TIMED_BLOCK_(Name, __LINE__)
+#define TIMED_FUNCTION() TIMED_BLOCK(__FUNCTION__)
+
+#define BEGIN_BLOCK(Name) RecordDebugEvent(DebugEvent_BeginBlock, (char *)(Name))
+#define END_BLOCK(Name) RecordDebugEvent(DebugEvent_EndBlock, (char *)(Name))
+
+/*
+  NOTE: A frame's worth of events, added up per block name. Inclusive cycles
+  count everything between a block's begin and end; self cycles leave out
+  the blocks nested inside it on the same thread.
+*/
+struct debug_block_stats
+{
+  char Name[48];
+  uint64 InclusiveCycles;
+  uint64 SelfCycles;
+  uint32 HitCount;
+};
+
+struct debug_frame
+{
+  uint32 EventCount;
+  uint32 DroppedEventCount;
+  uint32 ThreadCount;
+  uint32 BlockCount;
+  debug_block_stats Blocks[128];
+};
+
+// Starts a new frame of events and returns which array holds the last one.
+inline uint32
+DEBUGSwapEventArrays(debug_table *Table, uint32 *EventCount)
+{
+  uint64 ArrayIndex_EventIndex = __atomic_load_n(&Table->EventArrayIndex_EventIndex, __ATOMIC_RELAXED);
+  uint64 NextArrayIndex = ((ArrayIndex_EventIndex >> 32) ^ 1);
+  ArrayIndex_EventIndex = __atomic_exchange_n(&Table->EventArrayIndex_EventIndex, NextArrayIndex << 32, __ATOMIC_ACQ_REL);
+
+  *EventCount = (uint32)ArrayIndex_EventIndex;
+  return((uint32)(ArrayIndex_EventIndex >> 32));
+}
+
+inline debug_block_stats *
+DEBUGGetBlockStats(debug_frame *Frame, char *Name)
+{
+  debug_block_stats *Result = 0;
+  for(uint32 BlockIndex = 0;
+      BlockIndex < Frame->BlockCount;
+      ++BlockIndex)
+  {
+    if(strcmp(Frame->Blocks[BlockIndex].Name, Name) == 0)
+    {
+      Result = Frame->Blocks + BlockIndex;
+      break;
+    }
+  }
+
+  if(!Result && (Frame->BlockCount < ArrayCount(Frame->Blocks)))
+  {
+    Result = Frame->Blocks + Frame->BlockCount++;
+    strncpy(Result->Name, Name, sizeof(Result->Name) - 1);
+    Result->Name[sizeof(Result->Name) - 1] = 0;
+  }
+
+  return(Result);
+}
+
+/*
+  NOTE: Pairs up every begin with its end, per thread, and adds the results
+  into Frame. Blocks still open when the arrays were swapped are dropped.
+*/
+inline void
+DEBUGCollateEvents(debug_table *Table, debug_frame *Frame)
+{
+  struct open_block
+  {
+    debug_event *Begin;
+    uint64 ChildCycles;
+  };
+  struct thread_stack
+  {
+    uint64 ThreadID;
+    uint32 Depth;
+    open_block Blocks[32];
+  };
+  thread_stack Threads[64];
+  uint32 ThreadCount = 0;
+
+  uint32 EventCount;
+  uint32 ArrayIndex = DEBUGSwapEventArrays(Table, &EventCount);
+
+  memset(Frame, 0, sizeof(*Frame));
+  Frame->EventCount = EventCount;
+  if(EventCount > DEBUG_MAX_EVENT_COUNT)
+  {
+    Frame->DroppedEventCount = EventCount - DEBUG_MAX_EVENT_COUNT;
+    EventCount = DEBUG_MAX_EVENT_COUNT;
+  }
+
+  for(uint32 EventIndex = 0;
+      EventIndex < EventCount;
+      ++EventIndex)
+  {
+    debug_event *Event = Table->Events[ArrayIndex] + EventIndex;
+
+    thread_stack *Thread = 0;
+    for(uint32 ThreadIndex = 0; ThreadIndex < ThreadCount; ++ThreadIndex)
+    {
+      if(Threads[ThreadIndex].ThreadID == Event->ThreadID)
+      {
+        Thread = Threads + ThreadIndex;
+        break;
+      }
+    }
+    if(!Thread)
+    {
+      if(ThreadCount == ArrayCount(Threads)) continue;
+      Thread = Threads + ThreadCount++;
+      Thread->ThreadID = Event->ThreadID;
+      Thread->Depth = 0;
+    }
+
+    if(Event->Type == DebugEvent_BeginBlock)
+    {
+      if(Thread->Depth < ArrayCount(Thread->Blocks))
+      {
+        open_block *Open = Thread->Blocks + Thread->Depth;
+        Open->Begin = Event;
+        Open->ChildCycles = 0;
+      }
+      ++Thread->Depth;
+    }
+    else if(Thread->Depth > 0)
+    {
+      --Thread->Depth;
+      if(Thread->Depth < ArrayCount(Thread->Blocks))
+      {
+        open_block *Open = Thread->Blocks + Thread->Depth;
+        uint64 InclusiveCycles = Event->Clock - Open->Begin->Clock;
+        if(Thread->Depth > 0)
+        {
+          Thread->Blocks[Thread->Depth - 1].ChildCycles += InclusiveCycles;
+        }
+
+        debug_block_stats *Stats = DEBUGGetBlockStats(Frame, Open->Begin->BlockName);
+        if(Stats)
+        {
+          Stats->InclusiveCycles += InclusiveCycles;
+          Stats->SelfCycles += InclusiveCycles - Open->ChildCycles;
+          ++Stats->HitCount;
+        }
+      }
+    }
+  }
+
+  Frame->ThreadCount = ThreadCount;
+}
+
+#else
+
+#define TIMED_BLOCK(...)
+#define TIMED_FUNCTION(...)
+#define BEGIN_BLOCK(...)
+#define END_BLOCK(...)
+
+#endif
+
+#define HANDMADE_DEBUG_H
+#endif
@@ -0,0 +1,438 @@
+#include "handmade_entity.h"
+
+internal void
+InitializeEntityTable(entity_table *Table, memory_arena *Arena, uint32 MaxCount)
+{
+  MaxCount = (uint32)Align(MaxCount, ENTITY_LANE_COUNT);
+  Table->MaxCount = MaxCount;
+  Table->Count = 0;
+  Table->Kernel = BestSIMDKernel();
+
+  Table->PositionX = PushArray(Arena, MaxCount, real32, CACHE_LINE_SIZE);
+  Table->PositionY = PushArray(Arena, MaxCount, real32, CACHE_LINE_SIZE);
+  Table->VelocityX = PushArray(Arena, MaxCount, real32, CACHE_LINE_SIZE);
+  Table->VelocityY = PushArray(Arena, MaxCount, real32, CACHE_LINE_SIZE);
+  Table->Color = PushArray(Arena, MaxCount, uint32, CACHE_LINE_SIZE);
+  Table->SlotOf = PushArray(Arena, MaxCount, uint32, CACHE_LINE_SIZE);
+
+  Table->Generation = PushArray(Arena, MaxCount, uint32, CACHE_LINE_SIZE);
+  Table->DenseIndex = PushArray(Arena, MaxCount, uint32, CACHE_LINE_SIZE);
+  Table->FirstFreeSlot = ENTITY_NULL_SLOT;
+  Table->SlotCount = 0;
+
+  // NOTE: The SIMD passes run over the whole of the last group of lanes,
+  // so what lies past Count has to be numbers, if meaningless ones.
+  memset(Table->PositionX, 0, MaxCount * sizeof(real32));
+  memset(Table->PositionY, 0, MaxCount * sizeof(real32));
+  memset(Table->VelocityX, 0, MaxCount * sizeof(real32));
+  memset(Table->VelocityY, 0, MaxCount * sizeof(real32));
+}
+
+// Returns a handle with a zero generation when the table is full.
+internal entity_handle
+AddEntity(entity_table *Table, real32 X, real32 Y, real32 dX, real32 dY, uint32 Color)
+{
+  entity_handle Result = {};
+
+  uint32 Slot = Table->FirstFreeSlot;
+  if(Slot != ENTITY_NULL_SLOT)
+  {
+    Table->FirstFreeSlot = Table->DenseIndex[Slot];
+  }
+  else if(Table->SlotCount < Table->MaxCount)
+  {
+    Slot = Table->SlotCount++;
+    Table->Generation[Slot] = 0;
+  }
+  else
+  {
+    return(Result);
+  }
+
+  // NOTE: There's one live entity per slot in use, so finding a slot means
+  // there's room in the dense arrays too.
+  Assert(Table->Count < Table->MaxCount);
+  uint32 Index = Table->Count++;
+  Table->PositionX[Index] = X;
+  Table->PositionY[Index] = Y;
+  Table->VelocityX[Index] = dX;
+  Table->VelocityY[Index] = dY;
+  Table->Color[Index] = Color;
+  Table->SlotOf[Index] = Slot;
+
+  // Skip zero on wrap-around, so it never names anything.
+  if(++Table->Generation[Slot] == 0)
+  {
+    Table->Generation[Slot] = 1;
+  }
+  Table->DenseIndex[Slot] = Index;
+
+  Result.Slot = Slot;
+  Result.Generation = Table->Generation[Slot];
+  return(Result);
+}
+
+inline bool32
+IsValid(entity_table *Table, entity_handle Handle)
+{
+  bool32 Result = ((Handle.Generation != 0) &&
+                   (Handle.Slot < Table->SlotCount) &&
+                   (Table->Generation[Handle.Slot] == Handle.Generation));
+  return(Result);
+}
+
+// Where the entity lives in the dense arrays right now, or ENTITY_NULL_SLOT if it's gone.
+inline uint32
+GetEntityIndex(entity_table *Table, entity_handle Handle)
+{
+  uint32 Result = IsValid(Table, Handle) ? Table->DenseIndex[Handle.Slot] : ENTITY_NULL_SLOT;
+  return(Result);
+}
+
+inline entity_handle
+GetEntityHandle(entity_table *Table, uint32 Index)
+{
+  Assert(Index < Table->Count);
+  entity_handle Result;
+  Result.Slot = Table->SlotOf[Index];
+  Result.Generation = Table->Generation[Result.Slot];
+  return(Result);
+}
+
+internal bool32
+RemoveEntity(entity_table *Table, entity_handle Handle)
+{
+  if(!IsValid(Table, Handle)) return(false);
+
+  uint32 Slot = Handle.Slot;
+  uint32 Index = Table->DenseIndex[Slot];
+  uint32 Last = --Table->Count;
+  if(Index != Last)
+  {
+    Table->PositionX[Index] = Table->PositionX[Last];
+    Table->PositionY[Index] = Table->PositionY[Last];
+    Table->VelocityX[Index] = Table->VelocityX[Last];
+    Table->VelocityY[Index] = Table->VelocityY[Last];
+    Table->Color[Index] = Table->Color[Last];
+    Table->SlotOf[Index] = Table->SlotOf[Last];
+    Table->DenseIndex[Table->SlotOf[Index]] = Index;
+  }
+
+  // NOTE: Bumping the generation now, rather than when the slot gets
+  // reused, turns every handle to it stale straight away.
+  if(++Table->Generation[Slot] == 0)
+  {
+    Table->Generation[Slot] = 1;
+  }
+  Table->DenseIndex[Slot] = Table->FirstFreeSlot;
+  Table->FirstFreeSlot = Slot;
+
+  return(true);
+}
+
+/*
+  NOTE: Moves every entity along its velocity for dt and wraps it back into
+  [0, WorldWidth) x [0, WorldHeight). An entity can't cross more than a
+  whole world in one step.
+*/
+inline real32
+WrapCoordinate(real32 Value, real32 Size)
+{
+  if(Value < 0.0f) Value += Size;
+  if(Value >= Size) Value -= Size;
+  return(Value);
+}
+
+internal void
+MoveEntitiesScalar(entity_table *Table, real32 dt, real32 WorldWidth, real32 WorldHeight)
+{
+  for(uint32 Index = 0;
+      Index < Table->Count;
+      ++Index)
+  {
+    Table->PositionX[Index] = WrapCoordinate(Table->PositionX[Index] + Table->VelocityX[Index]*dt, WorldWidth);
+    Table->PositionY[Index] = WrapCoordinate(Table->PositionY[Index] + Table->VelocityY[Index]*dt, WorldHeight);
+  }
+}
+
+#if HANDMADE_X86
+inline __m128
+WrapCoordinate4(__m128 Value, __m128 Size)
+{
+  Value = _mm_add_ps(Value, _mm_and_ps(_mm_cmplt_ps(Value, _mm_setzero_ps()), Size));
+  Value = _mm_sub_ps(Value, _mm_and_ps(_mm_cmpge_ps(Value, Size), Size));
+  return(Value);
+}
+
+internal void
+MoveEntitiesSSE2(entity_table *Table, real32 dt, real32 WorldWidth, real32 WorldHeight)
+{
+  __m128 dt4 = _mm_set1_ps(dt);
+  __m128 Width4 = _mm_set1_ps(WorldWidth);
+  __m128 Height4 = _mm_set1_ps(WorldHeight);
+  for(uint32 Index = 0;
+      Index < Table->Count;
+      Index += 4)
+  {
+    __m128 X = _mm_add_ps(_mm_load_ps(Table->PositionX + Index),
+                          _mm_mul_ps(_mm_load_ps(Table->VelocityX + Index), dt4));
+    __m128 Y = _mm_add_ps(_mm_load_ps(Table->PositionY + Index),
+                          _mm_mul_ps(_mm_load_ps(Table->VelocityY + Index), dt4));
+    _mm_store_ps(Table->PositionX + Index, WrapCoordinate4(X, Width4));
+    _mm_store_ps(Table->PositionY + Index, WrapCoordinate4(Y, Height4));
+  }
+}
+
+HANDMADE_TARGET_AVX2 inline __m256
+WrapCoordinate8(__m256 Value, __m256 Size)
+{
+  Value = _mm256_add_ps(Value, _mm256_and_ps(_mm256_cmp_ps(Value, _mm256_setzero_ps(), _CMP_LT_OQ), Size));
+  Value = _mm256_sub_ps(Value, _mm256_and_ps(_mm256_cmp_ps(Value, Size, _CMP_GE_OQ), Size));
+  return(Value);
+}
+
+HANDMADE_TARGET_AVX2 internal void
+MoveEntitiesAVX2(entity_table *Table, real32 dt, real32 WorldWidth, real32 WorldHeight)
+{
+  __m256 dt8 = _mm256_set1_ps(dt);
+  __m256 Width8 = _mm256_set1_ps(WorldWidth);
+  __m256 Height8 = _mm256_set1_ps(WorldHeight);
+  for(uint32 Index = 0;
+      Index < Table->Count;
+      Index += 8)
+  {
+    __m256 X = _mm256_add_ps(_mm256_load_ps(Table->PositionX + Index),
+                             _mm256_mul_ps(_mm256_load_ps(Table->VelocityX + Index), dt8));
+    __m256 Y = _mm256_add_ps(_mm256_load_ps(Table->PositionY + Index),
+                             _mm256_mul_ps(_mm256_load_ps(Table->VelocityY + Index), dt8));
+    _mm256_store_ps(Table->PositionX + Index, WrapCoordinate8(X, Width8));
+    _mm256_store_ps(Table->PositionY + Index, WrapCoordinate8(Y, Height8));
+  }
+}
+#endif
+
+// NOTE: The SIMD loops only match the scalar one as long as none of them
+// fuse the multiply and add.
+internal void
+MoveEntities(entity_table *Table, real32 dt, real32 WorldWidth, real32 WorldHeight)
+{
+  TIMED_FUNCTION();
+  switch(Table->Kernel)
+  {
+#if HANDMADE_X86
+    case SIMDKernel_SSE2: { MoveEntitiesSSE2(Table, dt, WorldWidth, WorldHeight); } break;
+    case SIMDKernel_AVX2: { MoveEntitiesAVX2(Table, dt, WorldWidth, WorldHeight); } break;
+#endif
+    default: { MoveEntitiesScalar(Table, dt, WorldWidth, WorldHeight); } break;
+  }
+}
+
+#if HANDMADE_SLOW
+/*
+  NOTE: Moves a table of entities sitting on and around both edges of the
+  world with every supported kernel, for counts that leave each kernel a
+  partial last group, and asserts they land exactly where the scalar loop
+  puts them.
+*/
+internal void
+DEBUGVerifyEntityKernels()
+{
+  uint32 const MaxCount = 40;
+  alignas(32) local_persist real32 Arrays[2][4][MaxCount];
+  real32 const Width = 640.0f;
+  real32 const Height = 360.0f;
+  real32 Positions[] = {0.0f, 0.5f, 1.0f, 359.5f, 639.0f, 639.99f, 320.0f, 0.001f};
+  real32 Velocities[] = {-3.0f, 3.0f, -0.75f, 0.5f, -639.0f, 639.0f, 0.0f, -0.001f};
+  uint32 Counts[] = {1, 3, 4, 5, 8, 9, 17, 40};
+
+  for(int Kernel = SIMDKernel_Scalar + 1;
+      Kernel < SIMDKernel_Count;
+      ++Kernel)
+  {
+    if(!SIMDKernelSupported((simd_kernel)Kernel)) continue;
+
+    for(int CountIndex = 0; CountIndex < (int)ArrayCount(Counts); ++CountIndex)
+    {
+      entity_table Tables[2] = {};
+      for(int TableIndex = 0; TableIndex < 2; ++TableIndex)
+      {
+        entity_table *Table = Tables + TableIndex;
+        Table->MaxCount = MaxCount;
+        Table->Count = Counts[CountIndex];
+        Table->Kernel = TableIndex ? (simd_kernel)Kernel : SIMDKernel_Scalar;
+        Table->PositionX = Arrays[TableIndex][0];
+        Table->PositionY = Arrays[TableIndex][1];
+        Table->VelocityX = Arrays[TableIndex][2];
+        Table->VelocityY = Arrays[TableIndex][3];
+        for(uint32 Index = 0; Index < MaxCount; ++Index)
+        {
+          Table->PositionX[Index] = Positions[Index % ArrayCount(Positions)];
+          Table->PositionY[Index] = Positions[(Index / 3) % ArrayCount(Positions)] * 0.5f;
+          Table->VelocityX[Index] = Velocities[(Index / 2) % ArrayCount(Velocities)];
+          Table->VelocityY[Index] = Velocities[(Index + 5) % ArrayCount(Velocities)] * 0.5f;
+        }
+      }
+
+      MoveEntities(&Tables[0], 1.25f, Width, Height);
+      MoveEntities(&Tables[1], 1.25f, Width, Height);
+      Assert(memcmp(Arrays[0][0], Arrays[1][0], Counts[CountIndex] * sizeof(real32)) == 0);
+      Assert(memcmp(Arrays[0][1], Arrays[1][1], Counts[CountIndex] * sizeof(real32)) == 0);
+    }
+  }
+}
+#endif
+
+// NOTE: About one bucket per occupied cell is plenty; more only makes rebuilding slower.
+internal void
+InitializeSpatialHash(spatial_hash *Hash, memory_arena *Arena, uint32 MaxCount, uint32 BucketCount, real32 CellSize)
+{
+  Hash->CellSize = CellSize;
+  Hash->InvCellSize = 1.0f / CellSize;
+  Hash->BucketCount = 1;
+  while(Hash->BucketCount < BucketCount)
+  {
+    Hash->BucketCount *= 2;
+  }
+  Hash->EntityCount = 0;
+  Hash->FirstInBucket = PushArray(Arena, Hash->BucketCount + 1, uint32, CACHE_LINE_SIZE);
+  Hash->Entities = PushArray(Arena, MaxCount, uint32, CACHE_LINE_SIZE);
+  Hash->BucketOf = PushArray(Arena, MaxCount, uint32, CACHE_LINE_SIZE);
+  memset(Hash->FirstInBucket, 0, (Hash->BucketCount + 1) * sizeof(uint32));
+}
+
+inline int32
+GetCell(spatial_hash *Hash, real32 Value)
+{
+  int32 Result = (int32)floorf(Value * Hash->InvCellSize);
+  return(Result);
+}
+
+inline uint32
+GetBucket(spatial_hash *Hash, int32 CellX, int32 CellY)
+{
+  uint32 Result = (((uint32)CellX * 73856093u) ^ ((uint32)CellY * 19349663u)) & (Hash->BucketCount - 1);
+  return(Result);
+}
+
+/*
+  NOTE: A counting sort by bucket: count, turn the counts into where each
+  bucket ends, then drop the entities in from the back. Has to be rebuilt
+  after anything moves, is added or is removed.
+*/
+internal void
+BuildSpatialHash(spatial_hash *Hash, entity_table *Table)
+{
+  TIMED_FUNCTION();
+
+  // Nothing was in it and nothing's going in.
+  if(!Hash->EntityCount && !Table->Count) return;
+
+  memset(Hash->FirstInBucket, 0, (Hash->BucketCount + 1) * sizeof(uint32));
+  Hash->EntityCount = Table->Count;
+  for(uint32 Index = 0;
+      Index < Table->Count;
+      ++Index)
+  {
+    uint32 Bucket = GetBucket(Hash, GetCell(Hash, Table->PositionX[Index]), GetCell(Hash, Table->PositionY[Index]));
+    Hash->BucketOf[Index] = Bucket;
+    ++Hash->FirstInBucket[Bucket];
+  }
+
+  uint32 Total = 0;
+  for(uint32 Bucket = 0; Bucket <= Hash->BucketCount; ++Bucket)
+  {
+    Total += Hash->FirstInBucket[Bucket];
+    Hash->FirstInBucket[Bucket] = Total;
+  }
+
+  for(uint32 Index = Table->Count; Index > 0; --Index)
+  {
+    Hash->Entities[--Hash->FirstInBucket[Hash->BucketOf[Index - 1]]] = Index - 1;
+  }
+}
+
+/*
+  NOTE: Fills Results with the dense indices of up to MaxResults entities
+  inside [MinX, MaxX) x [MinY, MaxY), and, when Radius is above zero, also
+  within Radius of (CenterX, CenterY). Returns how many there were in all,
+  which can be more than MaxResults.
+*/
+internal uint32
+QuerySpatialHash(spatial_hash *Hash, entity_table *Table, real32 MinX, real32 MinY, real32 MaxX, real32 MaxY,
+                 real32 CenterX, real32 CenterY, real32 Radius, uint32 *Results, uint32 MaxResults)
+{
+  uint32 Result = 0;
+  if(!Hash->EntityCount) return(Result);
+
+  real32 RadiusSq = Radius*Radius;
+
+  int32 MinCellX = GetCell(Hash, MinX);
+  int32 MinCellY = GetCell(Hash, MinY);
+  int32 MaxCellX = GetCell(Hash, MaxX);
+  int32 MaxCellY = GetCell(Hash, MaxY);
+  uint64 CellCount = (uint64)(MaxCellX - MinCellX + 1) * (uint64)(MaxCellY - MinCellY + 1);
+  if(CellCount > Hash->BucketCount)
+  {
+    // NOTE: Bigger than the whole table: just look at everything once.
+    MinCellX = MaxCellX = MinCellY = MaxCellY = 0;
+  }
+
+  for(int32 CellY = MinCellY; CellY <= MaxCellY; ++CellY)
+  {
+    for(int32 CellX = MinCellX; CellX <= MaxCellX; ++CellX)
+    {
+      uint32 Bucket = GetBucket(Hash, CellX, CellY);
+      uint32 First = Hash->FirstInBucket[Bucket];
+      uint32 OnePastLast = Hash->FirstInBucket[Bucket + 1];
+      if(CellCount > Hash->BucketCount)
+      {
+        First = 0;
+        OnePastLast = Hash->EntityCount;
+      }
+
+      for(uint32 EntryIndex = First; EntryIndex < OnePastLast; ++EntryIndex)
+      {
+        uint32 Index = Hash->Entities[EntryIndex];
+        real32 X = Table->PositionX[Index];
+        real32 Y = Table->PositionY[Index];
+        if((X < MinX) || (X >= MaxX) || (Y < MinY) || (Y >= MaxY)) continue;
+        if(CellCount <= Hash->BucketCount)
+        {
+          // Only count it from its own cell, not one that shares its bucket.
+          if((GetCell(Hash, X) != CellX) || (GetCell(Hash, Y) != CellY)) continue;
+        }
+        if(Radius > 0.0f)
+        {
+          real32 dX = X - CenterX;
+          real32 dY = Y - CenterY;
+          if((dX*dX + dY*dY) > RadiusSq) continue;
+        }
+
+        if(Result < MaxResults)
+        {
+          Results[Result] = Index;
+        }
+        ++Result;
+      }
+    }
+  }
+
+  return(Result);
+}
+
+internal uint32
+QueryEntitiesInRect(spatial_hash *Hash, entity_table *Table, real32 MinX, real32 MinY, real32 MaxX, real32 MaxY,
+                    uint32 *Results, uint32 MaxResults)
+{
+  uint32 Result = QuerySpatialHash(Hash, Table, MinX, MinY, MaxX, MaxY, 0.0f, 0.0f, 0.0f, Results, MaxResults);
+  return(Result);
+}
+
+internal uint32
+QueryEntitiesNear(spatial_hash *Hash, entity_table *Table, real32 X, real32 Y, real32 Radius,
+                  uint32 *Results, uint32 MaxResults)
+{
+  uint32 Result = QuerySpatialHash(Hash, Table, X - Radius, Y - Radius, X + Radius, Y + Radius,
+                                   X, Y, Radius, Results, MaxResults);
+  return(Result);
+}
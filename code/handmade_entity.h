@@ -0,0 +1,67 @@
+#if !defined(HANDMADE_ENTITY_H)
+
+/*
+  NOTE: Entities, stored as structure-of-arrays so the passes over every
+  entity stream through just the fields they use.
+
+  The live entities are packed into 0..Count-1, in no particular order:
+  removing one moves the last one into its place. So a dense index is only
+  good until the next removal; anything that has to hang on to an entity
+  keeps an entity_handle instead, which names a slot that stays put, plus
+  the generation the slot was on when it was handed out. Freed slots go on
+  a free list and get handed out again one generation later, which is what
+  turns the handles still pointing at them stale.
+
+  Arrays are allocated in multiples of ENTITY_LANE_COUNT, so the SIMD
+  passes never need a scalar loop for what's left over.
+*/
+#define ENTITY_LANE_COUNT 8
+#define ENTITY_NULL_SLOT 0xFFFFFFFF
+
+struct entity_handle
+{
+  uint32 Slot;
+  uint32 Generation; // NOTE: Zero never names a live entity.
+};
+
+struct entity_table
+{
+  uint32 MaxCount;
+  uint32 Count;
+  simd_kernel Kernel; // what MoveEntities runs, picked once up front
+
+  // NOTE: By dense index.
+  real32 *PositionX;
+  real32 *PositionY;
+  real32 *VelocityX;
+  real32 *VelocityY;
+  uint32 *Color; // 0xAARRGGBB
+  uint32 *SlotOf;
+
+  // NOTE: By slot.
+  uint32 *Generation;
+  uint32 *DenseIndex; // or, once the slot is freed, the next free slot
+  uint32 FirstFreeSlot;
+  uint32 SlotCount; // slots handed out at least once
+};
+
+/*
+  NOTE: A uniform grid, hashed into a fixed number of buckets so the world
+  doesn't need bounds. Rebuilt from scratch whenever the entities move: the
+  dense indices of the entities in bucket N are
+  Entities[FirstInBucket[N]] up to Entities[FirstInBucket[N + 1]].
+  Different cells can share a bucket, so queries check each entity's cell.
+*/
+struct spatial_hash
+{
+  real32 CellSize;
+  real32 InvCellSize;
+  uint32 BucketCount; // NOTE: Must be a power of two.
+  uint32 EntityCount;
+  uint32 *FirstInBucket;
+  uint32 *Entities;
+  uint32 *BucketOf; // by dense index, scratch for the rebuild
+};
+
+#define HANDMADE_ENTITY_H
+#endif
@@ -0,0 +1,449 @@
+#include "handmade_render_group.h"
+
+#define RENDER_ENTRY_HEADER_SIZE Align(sizeof(render_entry_header), 8)
+
+internal render_group *
+AllocateRenderGroup(memory_arena *Arena, uint32 MaxPushBufferSize, game_offscreen_buffer *Buffer)
+{
+  render_group *Result = PushStruct(Arena, render_group);
+  Result->Buffer = Buffer;
+  Result->MaxPushBufferSize = MaxPushBufferSize;
+  Result->PushBufferSize = 0;
+  Result->PushBufferBase = (uint8 *)PushSize(Arena, MaxPushBufferSize, CACHE_LINE_SIZE);
+  Result->CommandCount = 0;
+  Result->DroppedCount = 0;
+
+  return(Result);
+}
+
+inline render_sort_entry *
+GetSortEntries(render_group *Group)
+{
+  render_sort_entry *Result = (render_sort_entry *)(Group->PushBufferBase + Group->MaxPushBufferSize) -
+    Group->CommandCount;
+  return(Result);
+}
+
+#define PushRenderElement(Group, type, Type, Layer, Bounds) \
+  (type *)PushRenderElement_(Group, sizeof(type), Type, Layer, Bounds)
+internal void *
+PushRenderElement_(render_group *Group, uint32 Size, render_entry_type Type, uint32 Layer, game_rect Bounds)
+{
+  void *Result = 0;
+
+  // NOTE: Anything that ends up entirely off the buffer never takes up room.
+  game_rect Screen = {0, 0, Group->Buffer->Width, Group->Buffer->Height};
+  Bounds = RectIntersect(Bounds, Screen);
+  if(!HasArea(Bounds)) return(Result);
+
+  Assert(Layer < 256);
+  Size = (uint32)Align(RENDER_ENTRY_HEADER_SIZE + Size, 8);
+  uint32 SortEntrySize = (Group->CommandCount + 1) * sizeof(render_sort_entry);
+  if(((Group->PushBufferSize + Size + SortEntrySize) <= Group->MaxPushBufferSize) &&
+     (Group->CommandCount < RENDER_MAX_COMMANDS))
+  {
+    render_entry_header *Header = (render_entry_header *)(Group->PushBufferBase + Group->PushBufferSize);
+    Header->Type = Type;
+    Header->Bounds = Bounds;
+
+    // The material is just which routine draws it, for now.
+    ++Group->CommandCount;
+    render_sort_entry *SortEntry = GetSortEntries(Group);
+    SortEntry->SortKey = ((Layer << RENDER_SORT_LAYER_SHIFT) |
+                          ((uint32)Type << RENDER_SORT_MATERIAL_SHIFT) |
+                          (Group->CommandCount - 1));
+    SortEntry->PushBufferOffset = Group->PushBufferSize;
+
+    Result = (uint8 *)Header + RENDER_ENTRY_HEADER_SIZE;
+    Group->PushBufferSize += Size;
+  }
+  else
+  {
+    ++Group->DroppedCount;
+  }
+
+  return(Result);
+}
+
+// NOTE: Always goes under everything else.
+inline void
+PushClear(render_group *Group, uint32 Color)
+{
+  game_rect Screen = {0, 0, Group->Buffer->Width, Group->Buffer->Height};
+  render_entry_clear *Entry = PushRenderElement(Group, render_entry_clear, RenderEntry_Clear, 0, Screen);
+  if(Entry)
+  {
+    Entry->Color = Color;
+  }
+}
+
+// The gradient is a function of the absolute pixel, whichever part of it Rect covers.
+inline void
+PushGradient(render_group *Group, uint32 Layer, game_rect Rect, int XOffset, int YOffset)
+{
+  render_entry_gradient *Entry = PushRenderElement(Group, render_entry_gradient, RenderEntry_Gradient, Layer, Rect);
+  if(Entry)
+  {
+    Entry->XOffset = XOffset;
+    Entry->YOffset = YOffset;
+  }
+}
+
+inline void
+PushRectangle(render_group *Group, uint32 Layer, game_rect Rect, uint32 Color)
+{
+  render_entry_rectangle *Entry = PushRenderElement(Group, render_entry_rectangle, RenderEntry_Rectangle,
+                                                    Layer, Rect);
+  if(Entry)
+  {
+    Entry->Color = Color;
+  }
+}
+
+// NOTE: Bitmap has to stay put until the group has been drawn.
+inline void
+PushBitmap(render_group *Group, uint32 Layer, loaded_bitmap *Bitmap, int X, int Y)
+{
+  if(!Bitmap->Memory) return;
+
+  game_rect Bounds = {X, Y, X + Bitmap->Width, Y + Bitmap->Height};
+  render_entry_bitmap *Entry = PushRenderElement(Group, render_entry_bitmap, RenderEntry_Bitmap, Layer, Bounds);
+  if(Entry)
+  {
+    Entry->Bitmap = Bitmap;
+    Entry->X = X;
+    Entry->Y = Y;
+  }
+}
+
+/*
+  NOTE: A radix sort, a byte at a time. The push order in the bottom of the
+  key makes every key unique, so which way round the sort entries start out
+  doesn't matter. Four passes leave the result back in First.
+*/
+internal void
+SortRenderEntries(uint32 Count, render_sort_entry *First, render_sort_entry *Temp)
+{
+  render_sort_entry *Source = First;
+  render_sort_entry *Dest = Temp;
+  for(uint32 ByteIndex = 0;
+      ByteIndex < 32;
+      ByteIndex += 8)
+  {
+    uint32 SortKeyOffsets[256] = {};
+    for(uint32 Index = 0; Index < Count; ++Index)
+    {
+      ++SortKeyOffsets[(Source[Index].SortKey >> ByteIndex) & 0xFF];
+    }
+
+    uint32 Total = 0;
+    for(uint32 KeyIndex = 0; KeyIndex < ArrayCount(SortKeyOffsets); ++KeyIndex)
+    {
+      uint32 KeyCount = SortKeyOffsets[KeyIndex];
+      SortKeyOffsets[KeyIndex] = Total;
+      Total += KeyCount;
+    }
+
+    for(uint32 Index = 0; Index < Count; ++Index)
+    {
+      Dest[SortKeyOffsets[(Source[Index].SortKey >> ByteIndex) & 0xFF]++] = Source[Index];
+    }
+
+    render_sort_entry *Swap = Dest;
+    Dest = Source;
+    Source = Swap;
+  }
+}
+
+/*
+  NOTE: Which commands touch which tile, still in sort order. The commands
+  for tile N are Entries[FirstEntry[N]] up to Entries[FirstEntry[N + 1]].
+*/
+struct render_tile_bins
+{
+  int TileWidth;
+  int TileHeight;
+  int TileCountX;
+  int TileCountY;
+  uint32 *FirstEntry;
+  uint32 *Entries; // push buffer offsets
+};
+
+internal render_tile_bins
+BinRenderEntries(memory_arena *Arena, render_group *Group, render_sort_entry *SortEntries)
+{
+  render_tile_bins Result = {};
+  Result.TileWidth = RENDER_TILE_WIDTH;
+  Result.TileHeight = RENDER_TILE_HEIGHT;
+  while(((Group->Buffer->Height + Result.TileHeight - 1) / Result.TileHeight) > RENDER_MAX_TILE_ROWS)
+  {
+    Result.TileHeight *= 2;
+  }
+  Result.TileCountX = (Group->Buffer->Width + Result.TileWidth - 1) / Result.TileWidth;
+  Result.TileCountY = (Group->Buffer->Height + Result.TileHeight - 1) / Result.TileHeight;
+
+  uint32 TileCount = (uint32)(Result.TileCountX * Result.TileCountY);
+  Result.FirstEntry = PushArray(Arena, TileCount + 1, uint32);
+  memset(Result.FirstEntry, 0, (TileCount + 1) * sizeof(uint32));
+
+  // Count the commands in each tile...
+  for(uint32 SortIndex = 0; SortIndex < Group->CommandCount; ++SortIndex)
+  {
+    render_entry_header *Header = (render_entry_header *)(Group->PushBufferBase +
+                                                          SortEntries[SortIndex].PushBufferOffset);
+    game_rect Bounds = Header->Bounds;
+    for(int TileY = Bounds.MinY / Result.TileHeight; TileY <= (Bounds.MaxY - 1) / Result.TileHeight; ++TileY)
+    {
+      for(int TileX = Bounds.MinX / Result.TileWidth; TileX <= (Bounds.MaxX - 1) / Result.TileWidth; ++TileX)
+      {
+        ++Result.FirstEntry[TileY * Result.TileCountX + TileX];
+      }
+    }
+  }
+
+  // ...turn the counts into where each tile's run ends...
+  uint32 Total = 0;
+  for(uint32 TileIndex = 0; TileIndex <= TileCount; ++TileIndex)
+  {
+    Total += Result.FirstEntry[TileIndex];
+    Result.FirstEntry[TileIndex] = Total;
+  }
+  Result.Entries = PushArray(Arena, Total, uint32);
+
+  // ...and fill the runs in from the back, so they end up where they start.
+  for(uint32 SortIndex = Group->CommandCount; SortIndex > 0; --SortIndex)
+  {
+    uint32 Offset = SortEntries[SortIndex - 1].PushBufferOffset;
+    game_rect Bounds = ((render_entry_header *)(Group->PushBufferBase + Offset))->Bounds;
+    for(int TileY = Bounds.MinY / Result.TileHeight; TileY <= (Bounds.MaxY - 1) / Result.TileHeight; ++TileY)
+    {
+      for(int TileX = Bounds.MinX / Result.TileWidth; TileX <= (Bounds.MaxX - 1) / Result.TileWidth; ++TileX)
+      {
+        Result.Entries[--Result.FirstEntry[TileY * Result.TileCountX + TileX]] = Offset;
+      }
+    }
+  }
+
+  return(Result);
+}
+
+template<pixel_format Format>
+internal void
+FillBufferAs(game_offscreen_buffer *Buffer, uint32 Color)
+{
+  typedef typename pixel_layout<Format>::pixel pixel;
+  pixel Pixel = PackPixel<Format>((Color >> 16) & 0xFF, (Color >> 8) & 0xFF, Color & 0xFF, Color >> 24);
+
+  uint8 *Row = (uint8 *)Buffer->Memory;
+  for(int Y = 0;
+      Y < Buffer->Height;
+      ++Y)
+  {
+    pixel *Dest = (pixel *)Row;
+    for(int X = 0;
+        X < Buffer->Width;
+        ++X)
+    {
+      *Dest++ = Pixel;
+    }
+
+    Row += Buffer->Pitch;
+  }
+}
+
+internal void
+FillBuffer(game_offscreen_buffer *Buffer, uint32 Color)
+{
+  switch(Buffer->Format)
+  {
+    case PixelFormat_RGBA32: { FillBufferAs<PixelFormat_RGBA32>(Buffer, Color); } break;
+    case PixelFormat_RGB565: { FillBufferAs<PixelFormat_RGB565>(Buffer, Color); } break;
+    case PixelFormat_Indexed8: { FillBufferAs<PixelFormat_Indexed8>(Buffer, Color); } break;
+    default: { FillBufferAs<PixelFormat_BGRA32>(Buffer, Color); } break;
+  }
+}
+
+// Draws the part of the command inside ClipRect and returns how many pixels that was.
+internal int64
+DrawRenderEntry(game_offscreen_buffer *Buffer, render_entry_header *Header, game_rect ClipRect,
+                simd_kernel Kernel)
+{
+  game_rect Rect = RectIntersect(Header->Bounds, ClipRect);
+  if(!HasArea(Rect)) return(0);
+
+  game_offscreen_buffer Region = GetSubBuffer(Buffer, Rect);
+  void *Data = (uint8 *)Header + RENDER_ENTRY_HEADER_SIZE;
+  switch(Header->Type)
+  {
+    case RenderEntry_Clear:
+    {
+      render_entry_clear *Entry = (render_entry_clear *)Data;
+      FillBuffer(&Region, Entry->Color);
+    } break;
+
+    case RenderEntry_Gradient:
+    {
+      render_entry_gradient *Entry = (render_entry_gradient *)Data;
+      RenderWeirdGradient(&Region, Entry->XOffset + Rect.MinX, Entry->YOffset + Rect.MinY, Kernel);
+    } break;
+
+    case RenderEntry_Rectangle:
+    {
+      render_entry_rectangle *Entry = (render_entry_rectangle *)Data;
+      FillBuffer(&Region, Entry->Color);
+    } break;
+
+    case RenderEntry_Bitmap:
+    {
+      render_entry_bitmap *Entry = (render_entry_bitmap *)Data;
+      DrawBitmap(&Region, Entry->Bitmap, Entry->X - Rect.MinX, Entry->Y - Rect.MinY, Kernel);
+    } break;
+  }
+
+  return((int64)(Rect.MaxX - Rect.MinX) * (Rect.MaxY - Rect.MinY));
+}
+
+struct render_tile_row_work
+{
+  render_group *Group;
+  render_tile_bins *Bins;
+  game_rect *ClipRects;
+  int ClipRectCount;
+  int TileY;
+  simd_kernel Kernel;
+
+  // NOTE: Filled in by the work.
+  int TileCount;
+  int64 PixelCount;
+};
+
+internal
+PLATFORM_WORK_QUEUE_CALLBACK(DoRenderTileRowWork)
+{
+  TIMED_BLOCK("RenderTileRow");
+  render_tile_row_work *Work = (render_tile_row_work *)Data;
+  render_tile_bins *Bins = Work->Bins;
+  game_offscreen_buffer *Buffer = Work->Group->Buffer;
+
+  int TileCount = 0;
+  int64 PixelCount = 0;
+  for(int TileX = 0;
+      TileX < Bins->TileCountX;
+      ++TileX)
+  {
+    int TileIndex = Work->TileY * Bins->TileCountX + TileX;
+    uint32 FirstEntry = Bins->FirstEntry[TileIndex];
+    uint32 OnePastLastEntry = Bins->FirstEntry[TileIndex + 1];
+    if(FirstEntry == OnePastLastEntry) continue;
+
+    game_rect Tile;
+    Tile.MinX = TileX * Bins->TileWidth;
+    Tile.MinY = Work->TileY * Bins->TileHeight;
+    Tile.MaxX = Tile.MinX + Bins->TileWidth;
+    Tile.MaxY = Tile.MinY + Bins->TileHeight;
+
+    bool32 TileWasDrawn = false;
+    for(int ClipIndex = 0;
+        ClipIndex < Work->ClipRectCount;
+        ++ClipIndex)
+    {
+      game_rect ClipRect = RectIntersect(Tile, Work->ClipRects[ClipIndex]);
+      if(!HasArea(ClipRect)) continue;
+
+      for(uint32 EntryIndex = FirstEntry;
+          EntryIndex < OnePastLastEntry;
+          ++EntryIndex)
+      {
+        render_entry_header *Header = (render_entry_header *)(Work->Group->PushBufferBase + Bins->Entries[EntryIndex]);
+        PixelCount += DrawRenderEntry(Buffer, Header, ClipRect, Work->Kernel);
+      }
+      TileWasDrawn = true;
+    }
+    TileCount += TileWasDrawn;
+  }
+
+  Work->TileCount = TileCount;
+  Work->PixelCount = PixelCount;
+}
+
+/*
+  NOTE: Draws everything pushed into the group, but only inside ClipRects,
+  which must not overlap. The tile rows go out on Queue; this returns once
+  they're all done. Everything it needs beyond that comes out of TempArena
+  and is given back before it returns.
+*/
+internal void
+EndRender(render_group *Group, platform_work_queue *Queue, memory_arena *TempArena,
+          game_rect *ClipRects, int ClipRectCount, game_render_stats *Stats)
+{
+  TIMED_FUNCTION();
+
+  game_render_stats FrameStats = {};
+  FrameStats.CommandCount = (int32)Group->CommandCount;
+
+  if(Group->CommandCount && ClipRectCount)
+  {
+    temporary_memory RenderMemory = BeginTemporaryMemory(TempArena);
+
+    render_sort_entry *SortEntries = GetSortEntries(Group);
+    BEGIN_BLOCK("SortAndBin");
+    render_sort_entry *SortTemp = PushArray(TempArena, Group->CommandCount, render_sort_entry);
+    SortRenderEntries(Group->CommandCount, SortEntries, SortTemp);
+    render_tile_bins Bins = BinRenderEntries(TempArena, Group, SortEntries);
+    END_BLOCK("SortAndBin");
+
+    render_tile_row_work *Works = PushArray(TempArena, Bins.TileCountY, render_tile_row_work, CACHE_LINE_SIZE);
+    simd_kernel Kernel = BestSIMDKernel();
+
+    int WorkCount = 0;
+    for(int TileY = 0;
+        TileY < Bins.TileCountY;
+        ++TileY)
+    {
+      // Don't wake anybody up for a row with nothing to redraw in it.
+      int MinY = TileY * Bins.TileHeight;
+      int MaxY = MinY + Bins.TileHeight;
+      bool32 RowIsClipped = true;
+      for(int ClipIndex = 0; ClipIndex < ClipRectCount; ++ClipIndex)
+      {
+        if((ClipRects[ClipIndex].MinY < MaxY) && (ClipRects[ClipIndex].MaxY > MinY))
+        {
+          RowIsClipped = false;
+          break;
+        }
+      }
+      if(RowIsClipped) continue;
+
+      render_tile_row_work *Work = Works + WorkCount++;
+      Work->Group = Group;
+      Work->Bins = &Bins;
+      Work->ClipRects = ClipRects;
+      Work->ClipRectCount = ClipRectCount;
+      Work->TileY = TileY;
+      Work->Kernel = Kernel;
+      Work->TileCount = 0;
+      Work->PixelCount = 0;
+
+      Platform.AddEntry(Queue, DoRenderTileRowWork, Work);
+    }
+
+    // The work entries live in temporary memory, so they must all be done
+    // before we give it back.
+    BEGIN_BLOCK("CompleteAllWork");
+    Platform.CompleteAllWork(Queue);
+    END_BLOCK("CompleteAllWork");
+
+    for(int WorkIndex = 0; WorkIndex < WorkCount; ++WorkIndex)
+    {
+      FrameStats.TileCount += Works[WorkIndex].TileCount;
+      FrameStats.PixelCount += Works[WorkIndex].PixelCount;
+    }
+
+    EndTemporaryMemory(RenderMemory);
+  }
+
+  if(Stats)
+  {
+    *Stats = FrameStats;
+  }
+}
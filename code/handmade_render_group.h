@@ -0,0 +1,94 @@
+#if !defined(HANDMADE_RENDER_GROUP_H)
+
+/*
+  NOTE: Render commands. The game doesn't draw anything itself: it pushes
+  commands into a render group, and EndRender sorts them, bins them into
+  screen tiles and then draws the tiles on the render queue, each one all
+  the way through before the next.
+
+  Commands are drawn in order of their sort key: layer first, then
+  material, then the order they were pushed in. So everything on a lower
+  layer ends up under everything on a higher one, but within a layer the
+  commands get grouped by material; anything that has to go on top of
+  something else in its layer belongs on a higher layer.
+
+  Colors are 0xAARRGGBB, whatever format the buffer is in.
+*/
+enum render_entry_type
+{
+  RenderEntry_Clear,
+  RenderEntry_Gradient,
+  RenderEntry_Rectangle,
+  RenderEntry_Bitmap,
+};
+
+struct render_entry_header
+{
+  render_entry_type Type;
+  game_rect Bounds; // NOTE: In pixels, already clipped to the buffer.
+};
+
+struct render_entry_clear
+{
+  uint32 Color;
+};
+
+struct render_entry_gradient
+{
+  int XOffset;
+  int YOffset;
+};
+
+struct render_entry_rectangle
+{
+  uint32 Color;
+};
+
+struct render_entry_bitmap
+{
+  loaded_bitmap *Bitmap;
+  int X;
+  int Y;
+};
+
+// NOTE: Layer in the top byte, material in the next, push order in the rest.
+#define RENDER_SORT_LAYER_SHIFT 24
+#define RENDER_SORT_MATERIAL_SHIFT 16
+#define RENDER_MAX_COMMANDS (1 << RENDER_SORT_MATERIAL_SHIFT)
+
+struct render_sort_entry
+{
+  uint32 SortKey;
+  uint32 PushBufferOffset;
+};
+
+/*
+  NOTE: The commands go up from the bottom of the push buffer and their sort
+  entries come down from the top; the group is full when they meet.
+*/
+struct render_group
+{
+  game_offscreen_buffer *Buffer;
+
+  uint32 MaxPushBufferSize;
+  uint32 PushBufferSize;
+  uint8 *PushBufferBase;
+
+  uint32 CommandCount;
+  uint32 DroppedCount; // pushed once the buffer was already full
+};
+
+/*
+  NOTE: Tiles are drawn a row at a time, one work queue entry per row.
+  Tiles start on a multiple of RENDER_TILE_WIDTH pixels, so as long as the
+  platform hands us a cache-line-aligned Memory and Pitch no two threads
+  ever write into the same cache line. They grow taller on buffers too
+  tall for RENDER_MAX_TILE_ROWS rows, which keeps the work queue from
+  filling up.
+*/
+#define RENDER_TILE_WIDTH 64
+#define RENDER_TILE_HEIGHT 16
+#define RENDER_MAX_TILE_ROWS 128
+
+#define HANDMADE_RENDER_GROUP_H
+#endif
@@ -0,0 +1,410 @@
+/*
+  NOTE: Software scaling of the game's buffer to the window, for when the
+  game renders at a fixed resolution and we'd rather not leave the stretch
+  to the renderer. Nothing in here depends on SDL, so the headless bench
+  can measure it too.
+
+  Each destination row is worked out from one source row (nearest) or two
+  (bilinear), using per-column and per-row lookup tables built once per
+  window size. The rows are split into bands on a work queue.
+
+  Nearest only has an AVX2 loop (a gather) and bilinear only an SSE2 one,
+  so each uses the best it has at or below the scaler's kernel.
+*/
+
+#include <string.h>
+
+enum scale_filter
+{
+  ScaleFilter_Nearest,
+  ScaleFilter_Bilinear,
+};
+
+#define SCALE_MAX_DIMENSION 8192
+#define SCALE_BAND_COUNT 64
+
+struct scaler
+{
+  scale_filter Filter;
+  simd_kernel Kernel;
+  int SourceWidth;
+  int SourceHeight;
+  int DestWidth;
+  int DestHeight;
+
+  // NOTE: For each destination column and row, the source column or row it
+  // comes from (the left or upper one, for bilinear) and, for bilinear, how
+  // much of the next one to blend in, out of 256.
+  int32 SourceX[SCALE_MAX_DIMENSION];
+  int32 SourceY[SCALE_MAX_DIMENSION];
+  uint16 WeightX[SCALE_MAX_DIMENSION];
+  uint16 WeightY[SCALE_MAX_DIMENSION];
+};
+
+// Maps destination pixel centres onto the source, for one axis.
+internal void
+BuildScaleTable(scale_filter Filter, int SourceCount, int DestCount, int32 *Source, uint16 *Weight)
+{
+  for(int Dest = 0;
+      Dest < DestCount;
+      ++Dest)
+  {
+    // NOTE: The centre of destination pixel Dest lands on source coordinate
+    // ((2*Dest + 1)*SourceCount / DestCount - 1) / 2, in pixels.
+    int64 Numerator = (int64)(2*Dest + 1) * SourceCount;
+    if(Filter == ScaleFilter_Nearest)
+    {
+      Source[Dest] = (int32)(Numerator / (2*(int64)DestCount));
+      Weight[Dest] = 0;
+    }
+    else
+    {
+      int64 Position = ((Numerator - DestCount) * 256) / (2*(int64)DestCount);
+      if(Position < 0) Position = 0;
+      Source[Dest] = (int32)(Position >> 8);
+      Weight[Dest] = (uint16)(Position & 0xFF);
+    }
+
+    if(Source[Dest] >= SourceCount - 1)
+    {
+      Source[Dest] = SourceCount - 1;
+      Weight[Dest] = 0;
+    }
+  }
+}
+
+internal bool32
+InitializeScaler(scaler *Scaler, scale_filter Filter, int SourceWidth, int SourceHeight,
+                 int DestWidth, int DestHeight, simd_kernel Kernel = BestSIMDKernel())
+{
+  if((SourceWidth <= 0) || (SourceHeight <= 0) || (DestWidth <= 0) || (DestHeight <= 0) ||
+     (SourceWidth > SCALE_MAX_DIMENSION) || (DestWidth > SCALE_MAX_DIMENSION) ||
+     (DestHeight > SCALE_MAX_DIMENSION))
+  {
+    return(false);
+  }
+
+  Scaler->Filter = Filter;
+  Scaler->Kernel = Kernel;
+  Scaler->SourceWidth = SourceWidth;
+  Scaler->SourceHeight = SourceHeight;
+  Scaler->DestWidth = DestWidth;
+  Scaler->DestHeight = DestHeight;
+  BuildScaleTable(Filter, SourceWidth, DestWidth, Scaler->SourceX, Scaler->WeightX);
+  BuildScaleTable(Filter, SourceHeight, DestHeight, Scaler->SourceY, Scaler->WeightY);
+
+  return(true);
+}
+
+inline uint32
+LerpPixel(uint32 A, uint32 B, uint32 Weight)
+{
+  uint32 Result = 0;
+  for(int Shift = 0;
+      Shift < 32;
+      Shift += 8)
+  {
+    uint32 Channel = (((A >> Shift) & 0xFF)*(256 - Weight) + ((B >> Shift) & 0xFF)*Weight + 128) >> 8;
+    Result |= Channel << Shift;
+  }
+  return(Result);
+}
+
+/*
+  NOTE: Each row loop does columns [X, DestWidth) (or SourceWidth) and the
+  SIMD ones hand whatever's left over to the scalar ones.
+*/
+internal void
+ScaleRowNearestScalar(scaler *Scaler, uint32 *Dest, uint32 *Source, int X)
+{
+  for(;
+      X < Scaler->DestWidth;
+      ++X)
+  {
+    Dest[X] = Source[Scaler->SourceX[X]];
+  }
+}
+
+// Blends two source rows together into Dest, with Weight of the second.
+internal void
+BlendRowsScalar(uint32 *Dest, uint32 *Row0, uint32 *Row1, uint32 Weight, int X, int Count)
+{
+  for(;
+      X < Count;
+      ++X)
+  {
+    Dest[X] = LerpPixel(Row0[X], Row1[X], Weight);
+  }
+}
+
+// NOTE: Source must have one extra pixel past the last column it's read at.
+internal void
+ScaleRowBilinearScalar(scaler *Scaler, uint32 *Dest, uint32 *Source, int X)
+{
+  for(;
+      X < Scaler->DestWidth;
+      ++X)
+  {
+    int32 SourceX = Scaler->SourceX[X];
+    Dest[X] = LerpPixel(Source[SourceX], Source[SourceX + 1], Scaler->WeightX[X]);
+  }
+}
+
+#if HANDMADE_X86
+HANDMADE_TARGET_AVX2 internal void
+ScaleRowNearestAVX2(scaler *Scaler, uint32 *Dest, uint32 *Source)
+{
+  int X = 0;
+  for(;
+      (X + 8) <= Scaler->DestWidth;
+      X += 8)
+  {
+    __m256i SourceX = _mm256_loadu_si256((__m256i *)(Scaler->SourceX + X));
+    __m256i Pixels = _mm256_i32gather_epi32((int const *)Source, SourceX, 4);
+    _mm256_storeu_si256((__m256i *)(Dest + X), Pixels);
+  }
+
+  ScaleRowNearestScalar(Scaler, Dest, Source, X);
+}
+
+internal void
+BlendRowsSSE2(uint32 *Dest, uint32 *Row0, uint32 *Row1, uint32 Weight, int Count)
+{
+  __m128i Zero = _mm_setzero_si128();
+  __m128i Weight1 = _mm_set1_epi16((int16)Weight);
+  __m128i Weight0 = _mm_set1_epi16((int16)(256 - Weight));
+  __m128i Round = _mm_set1_epi16(128);
+
+  // NOTE: 255*256 + 128 still fits in an unsigned 16-bit lane.
+  int X = 0;
+  for(;
+      (X + 4) <= Count;
+      X += 4)
+  {
+    __m128i A = _mm_loadu_si128((__m128i *)(Row0 + X));
+    __m128i B = _mm_loadu_si128((__m128i *)(Row1 + X));
+    __m128i Lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(A, Zero), Weight0),
+                               _mm_mullo_epi16(_mm_unpacklo_epi8(B, Zero), Weight1));
+    __m128i Hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(A, Zero), Weight0),
+                               _mm_mullo_epi16(_mm_unpackhi_epi8(B, Zero), Weight1));
+    Lo = _mm_srli_epi16(_mm_add_epi16(Lo, Round), 8);
+    Hi = _mm_srli_epi16(_mm_add_epi16(Hi, Round), 8);
+    _mm_storeu_si128((__m128i *)(Dest + X), _mm_packus_epi16(Lo, Hi));
+  }
+
+  BlendRowsScalar(Dest, Row0, Row1, Weight, X, Count);
+}
+
+internal void
+ScaleRowBilinearSSE2(scaler *Scaler, uint32 *Dest, uint32 *Source)
+{
+  __m128i Zero = _mm_setzero_si128();
+  __m128i Round = _mm_set1_epi16(128);
+
+  // Two destination pixels at a time, each from a pair of neighbouring source pixels.
+  int X = 0;
+  for(;
+      (X + 2) <= Scaler->DestWidth;
+      X += 2)
+  {
+    __m128i PairA = _mm_loadl_epi64((__m128i *)(Source + Scaler->SourceX[X]));
+    __m128i PairB = _mm_loadl_epi64((__m128i *)(Source + Scaler->SourceX[X + 1]));
+    int16 WeightA = (int16)Scaler->WeightX[X];
+    int16 WeightB = (int16)Scaler->WeightX[X + 1];
+    __m128i WeightsA = _mm_set_epi16(WeightA, WeightA, WeightA, WeightA,
+                                     256 - WeightA, 256 - WeightA, 256 - WeightA, 256 - WeightA);
+    __m128i WeightsB = _mm_set_epi16(WeightB, WeightB, WeightB, WeightB,
+                                     256 - WeightB, 256 - WeightB, 256 - WeightB, 256 - WeightB);
+
+    __m128i A = _mm_mullo_epi16(_mm_unpacklo_epi8(PairA, Zero), WeightsA);
+    __m128i B = _mm_mullo_epi16(_mm_unpacklo_epi8(PairB, Zero), WeightsB);
+    // Add the right pixel of each pair (top 64 bits) onto the left one.
+    A = _mm_add_epi16(A, _mm_srli_si128(A, 8));
+    B = _mm_add_epi16(B, _mm_srli_si128(B, 8));
+    __m128i Result = _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(A, B), Round), 8);
+    _mm_storel_epi64((__m128i *)(Dest + X), _mm_packus_epi16(Result, Zero));
+  }
+
+  ScaleRowBilinearScalar(Scaler, Dest, Source, X);
+}
+#endif
+
+struct scale_band_work
+{
+  scaler *Scaler;
+  game_offscreen_buffer *Source;
+  game_offscreen_buffer *Dest;
+  int MinY;
+  int MaxY;
+};
+
+inline uint32 *
+GetRow(game_offscreen_buffer *Buffer, int Y)
+{
+  return((uint32 *)((uint8 *)Buffer->Memory + (memory_index)Y * Buffer->Pitch));
+}
+
+internal void
+ScaleBand(scaler *Scaler, game_offscreen_buffer *Source, game_offscreen_buffer *Dest, int MinY, int MaxY)
+{
+  // NOTE: One vertically blended source row, plus the extra pixel the
+  // horizontal pass reads past its end.
+  uint32 Blended[SCALE_MAX_DIMENSION + 1];
+
+  int LastSourceY = -1;
+  uint32 LastWeightY = 0;
+  for(int Y = MinY;
+      Y < MaxY;
+      ++Y)
+  {
+    uint32 *DestRow = GetRow(Dest, Y);
+    int SourceY = Scaler->SourceY[Y];
+    uint32 WeightY = Scaler->WeightY[Y];
+
+    if((Y > MinY) && (SourceY == LastSourceY) && (WeightY == LastWeightY))
+    {
+      // Upscaling repeats rows: just copy the one we already did.
+      memcpy(DestRow, GetRow(Dest, Y - 1), Scaler->DestWidth * sizeof(uint32));
+    }
+    else if(Scaler->Filter == ScaleFilter_Nearest)
+    {
+      uint32 *SourceRow = GetRow(Source, SourceY);
+#if HANDMADE_X86
+      if(Scaler->Kernel >= SIMDKernel_AVX2)
+      {
+        ScaleRowNearestAVX2(Scaler, DestRow, SourceRow);
+      }
+      else
+#endif
+      {
+        ScaleRowNearestScalar(Scaler, DestRow, SourceRow, 0);
+      }
+    }
+    else
+    {
+      uint32 *Row0 = GetRow(Source, SourceY);
+      uint32 *Row1 = GetRow(Source, (SourceY + 1 < Scaler->SourceHeight) ? (SourceY + 1) : SourceY);
+#if HANDMADE_X86
+      if(Scaler->Kernel >= SIMDKernel_SSE2)
+      {
+        BlendRowsSSE2(Blended, Row0, Row1, WeightY, Scaler->SourceWidth);
+        Blended[Scaler->SourceWidth] = Blended[Scaler->SourceWidth - 1];
+        ScaleRowBilinearSSE2(Scaler, DestRow, Blended);
+      }
+      else
+#endif
+      {
+        BlendRowsScalar(Blended, Row0, Row1, WeightY, 0, Scaler->SourceWidth);
+        Blended[Scaler->SourceWidth] = Blended[Scaler->SourceWidth - 1];
+        ScaleRowBilinearScalar(Scaler, DestRow, Blended, 0);
+      }
+    }
+
+    LastSourceY = SourceY;
+    LastWeightY = WeightY;
+  }
+}
+
+internal
+PLATFORM_WORK_QUEUE_CALLBACK(DoScaleBandWork)
+{
+  TIMED_BLOCK("ScaleBand");
+  scale_band_work *Work = (scale_band_work *)Data;
+  ScaleBand(Work->Scaler, Work->Source, Work->Dest, Work->MinY, Work->MaxY);
+}
+
+/*
+  NOTE: Scales all of Source into all of Dest, which must be the sizes the
+  scaler was set up for, spread across Queue.
+*/
+internal void
+ScaleBuffer(platform_api *API, platform_work_queue *Queue, scaler *Scaler,
+            game_offscreen_buffer *Source, game_offscreen_buffer *Dest)
+{
+  TIMED_FUNCTION();
+  Assert((Source->Width == Scaler->SourceWidth) && (Source->Height == Scaler->SourceHeight));
+  Assert((Dest->Width == Scaler->DestWidth) && (Dest->Height == Scaler->DestHeight));
+  // NOTE: Any 32-bit format will do, as long as both are the same one.
+  Assert((GetBytesPerPixel(Source->Format) == 4) && (Dest->Format == Source->Format));
+
+  scale_band_work Works[SCALE_BAND_COUNT];
+  int RowsPerBand = (Dest->Height + SCALE_BAND_COUNT - 1) / SCALE_BAND_COUNT;
+  int BandCount = 0;
+  for(int MinY = 0;
+      MinY < Dest->Height;
+      MinY += RowsPerBand)
+  {
+    Assert(BandCount < SCALE_BAND_COUNT);
+    scale_band_work *Work = Works + BandCount++;
+    Work->Scaler = Scaler;
+    Work->Source = Source;
+    Work->Dest = Dest;
+    Work->MinY = MinY;
+    Work->MaxY = (MinY + RowsPerBand < Dest->Height) ? (MinY + RowsPerBand) : Dest->Height;
+    API->AddEntry(Queue, DoScaleBandWork, Work);
+  }
+
+  // The work entries live on our stack.
+  API->CompleteAllWork(Queue);
+}
+
+#if HANDMADE_SLOW
+/*
+  NOTE: Scales odd sizes up and down with every supported kernel and asserts
+  they all match the scalar loops byte for byte.
+*/
+internal void
+DEBUGVerifyScaleKernels()
+{
+  // NOTE: Far too big for the stack.
+  local_persist scaler Scaler;
+  int const MaxSize = 41;
+  local_persist uint32 Source[MaxSize * (MaxSize + 1)];
+  local_persist uint32 Expected[MaxSize * MaxSize];
+  local_persist uint32 Actual[MaxSize * MaxSize];
+  for(int PixelIndex = 0; PixelIndex < (int)ArrayCount(Source); ++PixelIndex)
+  {
+    Source[PixelIndex] = (uint32)PixelIndex * 2654435761u;
+  }
+
+  int Sizes[] = {1, 2, 3, 5, 8, 9, 17, 41};
+  for(int Filter = ScaleFilter_Nearest; Filter <= ScaleFilter_Bilinear; ++Filter)
+  for(int Kernel = SIMDKernel_Scalar + 1; Kernel < SIMDKernel_Count; ++Kernel)
+  {
+    if(!SIMDKernelSupported((simd_kernel)Kernel)) continue;
+
+    for(int SourceIndex = 0; SourceIndex < (int)ArrayCount(Sizes); ++SourceIndex)
+    for(int DestIndex = 0; DestIndex < (int)ArrayCount(Sizes); ++DestIndex)
+    {
+      int SourceSize = Sizes[SourceIndex];
+      int DestSize = Sizes[DestIndex];
+      game_offscreen_buffer SourceBuffer = {};
+      SourceBuffer.Memory = Source;
+      SourceBuffer.Width = SourceSize;
+      SourceBuffer.Height = SourceSize + 1;
+      SourceBuffer.Pitch = MaxSize * 4;
+      SourceBuffer.Format = PixelFormat_BGRA32;
+
+      game_offscreen_buffer ExpectedBuffer = SourceBuffer;
+      ExpectedBuffer.Memory = Expected;
+      ExpectedBuffer.Width = DestSize;
+      ExpectedBuffer.Height = DestSize;
+
+      game_offscreen_buffer ActualBuffer = ExpectedBuffer;
+      ActualBuffer.Memory = Actual;
+
+      InitializeScaler(&Scaler, (scale_filter)Filter, SourceSize, SourceSize + 1, DestSize, DestSize,
+                       SIMDKernel_Scalar);
+      ScaleBand(&Scaler, &SourceBuffer, &ExpectedBuffer, 0, DestSize);
+      InitializeScaler(&Scaler, (scale_filter)Filter, SourceSize, SourceSize + 1, DestSize, DestSize,
+                       (simd_kernel)Kernel);
+      ScaleBand(&Scaler, &SourceBuffer, &ActualBuffer, 0, DestSize);
+
+      for(int Y = 0; Y < DestSize; ++Y)
+      {
+        Assert(memcmp(Expected + Y*MaxSize, Actual + Y*MaxSize, DestSize * sizeof(uint32)) == 0);
+      }
+    }
+  }
+}
+#endif
@@ -0,0 +1,198 @@
+/*
+  NOTE: File services on plain POSIX calls. The SDL platform layer and the
+  headless bench both hand these to the game, so nothing in here may depend
+  on SDL either.
+*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*
+  NOTE: Maps the file straight into memory, so nothing gets copied until the
+  game actually touches it, and then only once, by the kernel. Things that
+  can't be mapped (pipes, and some special files) get read into anonymous
+  pages instead, which FreeFileMemory can give back the same way.
+*/
+internal
+PLATFORM_READ_ENTIRE_FILE(PosixReadEntireFile)
+{
+  platform_file_contents Result = {};
+
+  int FileDescriptor = open(Filename, O_RDONLY);
+  if(FileDescriptor == -1)
+  {
+    return(Result);
+  }
+
+  struct stat FileStatus;
+  if((fstat(FileDescriptor, &FileStatus) == 0) && (FileStatus.st_size > 0))
+  {
+    uint64 FileSize = (uint64)FileStatus.st_size;
+    void *Contents = mmap(0, FileSize, PROT_READ, MAP_PRIVATE, FileDescriptor, 0);
+    if(Contents != MAP_FAILED)
+    {
+      Result.Size = FileSize;
+      Result.Contents = Contents;
+    }
+    else
+    {
+      Contents = mmap(0, FileSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if(Contents != MAP_FAILED)
+      {
+        uint64 BytesRead = 0;
+        while(BytesRead < FileSize)
+        {
+          ssize_t Read = read(FileDescriptor, (uint8 *)Contents + BytesRead, FileSize - BytesRead);
+          if(Read <= 0)
+          {
+            if((Read == -1) && (errno == EINTR)) continue;
+            break;
+          }
+          BytesRead += (uint64)Read;
+        }
+
+        if(BytesRead == FileSize)
+        {
+          mprotect(Contents, FileSize, PROT_READ);
+          Result.Size = FileSize;
+          Result.Contents = Contents;
+        }
+        else
+        {
+          munmap(Contents, FileSize);
+        }
+      }
+    }
+  }
+
+  // NOTE: A mapping stays good after its file descriptor is closed.
+  close(FileDescriptor);
+
+  return(Result);
+}
+
+internal
+PLATFORM_FREE_FILE_MEMORY(PosixFreeFileMemory)
+{
+  if(File->Contents)
+  {
+    munmap(File->Contents, File->Size);
+  }
+  File->Contents = 0;
+  File->Size = 0;
+}
+
+/*
+  NOTE: Writes everything to a file next to the real one, then renames it
+  into place, so a crash halfway through never leaves a torn file behind.
+*/
+internal
+PLATFORM_WRITE_ENTIRE_FILE(PosixWriteEntireFile)
+{
+  bool32 Result = false;
+
+  char TempFilename[4096];
+  if(snprintf(TempFilename, sizeof(TempFilename), "%s.tmp", Filename) >= (int)sizeof(TempFilename))
+  {
+    return(Result);
+  }
+
+  int FileDescriptor = open(TempFilename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if(FileDescriptor == -1)
+  {
+    return(Result);
+  }
+
+  uint64 BytesWritten = 0;
+  while(BytesWritten < MemorySize)
+  {
+    ssize_t Written = write(FileDescriptor, (uint8 *)Memory + BytesWritten, MemorySize - BytesWritten);
+    if(Written <= 0)
+    {
+      if((Written == -1) && (errno == EINTR)) continue;
+      break;
+    }
+    BytesWritten += (uint64)Written;
+  }
+
+  if((close(FileDescriptor) == 0) && (BytesWritten == MemorySize))
+  {
+    Result = (rename(TempFilename, Filename) == 0);
+  }
+  if(!Result)
+  {
+    unlink(TempFilename);
+  }
+
+  return(Result);
+}
+
+internal
+PLATFORM_OPEN_FILE(PosixOpenFile)
+{
+  platform_file_handle Result = {};
+  Result.PlatformHandle = -1;
+
+  int FileDescriptor = open(Filename, O_RDONLY);
+  struct stat FileStatus;
+  if((FileDescriptor != -1) && (fstat(FileDescriptor, &FileStatus) == 0))
+  {
+#if defined(POSIX_FADV_SEQUENTIAL)
+    // We read files front to back, so let the kernel read ahead harder.
+    posix_fadvise(FileDescriptor, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    Result.Size = (uint64)FileStatus.st_size;
+    Result.NoErrors = true;
+    Result.PlatformHandle = FileDescriptor;
+  }
+  else if(FileDescriptor != -1)
+  {
+    close(FileDescriptor);
+  }
+
+  return(Result);
+}
+
+// NOTE: Once a read fails, every later read of the same handle fails too.
+internal
+PLATFORM_READ_DATA_FROM_FILE(PosixReadDataFromFile)
+{
+  TIMED_FUNCTION();
+
+  if(Handle->NoErrors)
+  {
+    uint64 BytesRead = 0;
+    while(BytesRead < Size)
+    {
+      ssize_t Read = pread((int)Handle->PlatformHandle, (uint8 *)Dest + BytesRead,
+                           Size - BytesRead, (off_t)(Offset + BytesRead));
+      if(Read <= 0)
+      {
+        if((Read == -1) && (errno == EINTR)) continue;
+        break;
+      }
+      BytesRead += (uint64)Read;
+    }
+
+    if(BytesRead != Size)
+    {
+      Handle->NoErrors = false;
+    }
+  }
+
+  return(Handle->NoErrors);
+}
+
+internal
+PLATFORM_CLOSE_FILE(PosixCloseFile)
+{
+  if(Handle->PlatformHandle != -1)
+  {
+    close((int)Handle->PlatformHandle);
+  }
+  Handle->PlatformHandle = -1;
+}
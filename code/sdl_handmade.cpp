@@ -1,16 +1,21 @@
 #include <SDL.h>
 #include <stdlib.h>
-#include <math.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "handmade.h"
+#include "posix_handmade.cpp"
+#include "handmade_scale.cpp"
 
 /*
    TODO: THIS IS NOT A FINAL PLATFORM LAYER!!!
 
    - Saved game locations
-   - Getting a handle to our own executable file
-   - Asset loading path
-   - Threading (launch a thread)
    - Raw input (support for multiple keyboards)
-   - Sleep/timeBeginPeriod
    - ClipCursor() (for multimonitor support)
    - Fullscreen support
    - WM_SETCURSOR (control cursor visibility)
@@ -23,16 +28,19 @@
    Just a partial list of stuff!!
 */
 
-/* Macros and type aliases */
-
-// The many faces of 'static'
-#define internal static
-#define local_persist static
-#define global_variable static
-
 // The maximum number of game controllers we'll allow to be used at once
 #define MAX_CONTROLLERS 4
 
+// How far a stick has to move off centre before the game hears about it.
+// Worn sticks rest a little way off centre; this is XInput's figure.
+#define STICK_DEADZONE 7849
+
+// How far ahead of the audio device we write. Lower means snappier sound, but
+// less slack for a slow frame before the device runs dry.
+#if !defined(AUDIO_LATENCY_MS)
+#define AUDIO_LATENCY_MS 67 // about 4 frames @ 60FPS
+#endif
+
 // Device mappings for Nintendo Switch "Joy-Con" controllers
 #define JOY_CON_L_MAPPING "030000007e0500000620000001000000,Joy-Con (L),+leftx:h0.2,+lefty:h0.4,-leftx:h0.8,-lefty:h0.1,a:b0,b:b1,back:b13,leftshoulder:b4,leftstick:b10,rightshoulder:b5,start:b8,x:b2,y:b3"
 // #define JOY_CON_R_MAPPING "030000007e0500000720000001000000,Joy-Con (R),+leftx:h0.2,+lefty:h0.4,-leftx:h0.8,-lefty:h0.1,a:b0,b:b1,back:b12,leftshoulder:b4,leftstick:b11,rightshoulder:b5,start:b9,x:b2,y:b3"
@@ -44,33 +52,101 @@
 // And (non?)inverted joystick: up goes up, down goes down, left goes left, right goes right.
 #define JOY_CON_R_MAPPING "030000007e0500000720000001000000,Joy-Con (R),+leftx:h0.8,+lefty:h0.1,-leftx:h0.2,-lefty:h0.4,a:b1,b:b0,back:b12,leftshoulder:b4,leftstick:b11,rightshoulder:b5,start:b9,x:b3,y:b2"
 
-#define Pi32 3.14159265359
-
-typedef Sint8 int8;
-typedef Sint16 int16;
-typedef Sint32 int32;
-typedef Sint64 int64;
-typedef int32 bool32;
-
-typedef Uint8 uint8;
-typedef Uint16 uint16;
-typedef Uint32 uint32;
-typedef Uint64 uint64;
-
-typedef float real32;
-typedef double real64;
+/* Globals */
 
-#include "handmade.cpp"
+/*
+  NOTE: How the game's buffer gets to the window. Native draws the game at
+  the window's own size, so the game's cost grows with the window; the rest
+  draw it at a fixed size and scale it up (or down) to the largest size
+  that fits with the same aspect ratio, with black bars around it.
+*/
+enum sdl_scale_mode
+{
+  ScaleMode_Native,
+  ScaleMode_Renderer, // SDL_RenderCopy stretches it, on the GPU if there is one
+  ScaleMode_Integer,  // the largest whole multiple that fits, in software
+  ScaleMode_Nearest,  // in software
+  ScaleMode_Bilinear, // in software
+};
 
-/* Globals */
 struct sdl_offscreen_buffer
 {
   SDL_Texture *Texture;
+  // While the texture is locked this points straight at the driver's pixels;
+  // on the copy path it points at OwnMemory.
   void *Memory;
+  void *OwnMemory;
   int Width;
   int Height;
   int Pitch;
+  int OwnPitch;
   int BytesPerPixel;
+  pixel_format Format;     // how the game lays out its pixels...
+  Uint32 TextureFormat;    // ...and the same layout, as SDL names it
+  bool32 UseTextureLock;   // the renderer lets us lock the texture at all
+  bool32 DrawIntoTexture;  // lock it next frame, rather than copy dirty rects up
+  bool32 IsLocked;
+  bool32 OwnMemoryIsCurrent; // OwnMemory holds exactly what the texture does
+  bool32 IsPreserved;      // what the game gets told this frame
+  game_dirty_rects DirtyRects;
+
+  sdl_scale_mode ScaleMode;
+  SDL_Rect DestRect;       // where the texture goes in the window
+  // NOTE: Scaling in software, the texture is the size of DestRect and only
+  // ever gets written whole, by the scaler.
+  int TextureWidth;
+  int TextureHeight;
+  bool32 TextureIsCurrent;
+  scaler *Scaler;
+};
+
+struct sdl_present_stats
+{
+  int BytesCopied;       // bytes we pushed through SDL_UpdateTexture ourselves
+  uint64 UploadCounter;  // performance counter ticks spent handing pixels to the driver
+  real32 DirtyFraction;  // how much of the screen the game changed
+};
+
+/*
+  NOTE: Frame pacing. Each frame sleeps off most of whatever time is left
+  until the target frame time, then spins on the performance counter for the
+  last sliver, because a sleep can overshoot by as much as the scheduler
+  likes. How much to leave for spinning is measured once at startup.
+*/
+#define FRAME_PACING_BUCKET_COUNT 10
+#define FRAME_PACING_BUCKET_MS 0.1f
+
+struct sdl_frame_pacing
+{
+  int RefreshHz;
+  real32 TargetSecondsPerFrame;
+  real32 SleepOvershootMS; // worst we saw a 1ms sleep overrun by
+
+  uint32 FrameCount;
+  uint32 MissedFrameCount; // frames whose work alone ran past the target
+  // How far each frame's length landed from the target, in
+  // FRAME_PACING_BUCKET_MS steps; the last bucket takes everything beyond.
+  uint32 ErrorHistogram[FRAME_PACING_BUCKET_COUNT];
+};
+
+/*
+  NOTE: The game's clock. The game steps at SDL_UPDATE_HZ however fast
+  frames go out: each frame banks the time since the last one and runs an
+  update for every whole step in the bank, which may be none. Past
+  SDL_MAX_UPDATES_PER_FRAME steps the time is thrown away rather than made
+  up, since a frame that can't keep up with the clock would only fall
+  further behind running more updates; the game slows down instead.
+*/
+#define SDL_UPDATE_HZ 60
+#define SDL_MAX_UPDATES_PER_FRAME 4
+
+struct sdl_update_clock
+{
+  real32 SecondsPerUpdate;
+  real32 Accumulator; // banked toward the next update
+
+  uint32 UpdateCount;
+  uint32 DroppedUpdateCount; // steps thrown away to keep up
 };
 
 struct sdl_window_dimension
@@ -79,357 +155,2904 @@ struct sdl_window_dimension
   int Height;
 };
 
+/*
+  NOTE: Single-producer, single-consumer ring of audio bytes. The main thread
+  writes ahead of the audio device; SDL's audio thread drains it from the
+  callback. Each side only ever advances its own running byte count, so no
+  locks are needed. Size is a power of two, which keeps the ring offsets
+  right even when the running counts wrap.
+*/
+struct sdl_audio_ring_buffer
+{
+  uint32 Size;
+  uint8 *Data;
+
+  SDL_atomic_t ReadCount;  // running bytes consumed by the audio callback
+  SDL_atomic_t WriteCount; // running bytes produced by the main thread
+
+  SDL_atomic_t UnderrunCount; // callbacks that ran dry and had to pad with silence
+  int OverrunCount;           // writes that didn't fit and were dropped
+  uint8 Silence;              // the byte that means silence in the device's format
+};
+
+/*
+  NOTE: The game always hands us 16-bit stereo at SamplesPerSecond; the ring
+  holds the samples the way the device wants them, in whatever format and
+  channel count it actually opened with, and BytesPerSample is the size of
+  one of those frames.
+*/
 struct sdl_sound_output
 {
   int SamplesPerSecond; // sample rate
-  int SampleCount;
-  int ToneHz;
-  int16 ToneVolume;
-  uint32 RunningSampleIndex;
-  int WavePeriod;
+  int SampleCount; // size of the device's own buffer, in samples
   int BytesPerSample;
-  int BufferSize;
-  real32 tSine; // position in the sine wave
-  int LatencySampleCount; // how many samples we'll write at once
+  int LatencySampleCount; // how far ahead of the play cursor we keep the write cursor
+  int TargetQueueBytes; // the same, in bytes
+  int RefreshHz; // the frame rate the latency gets sized for
+  SDL_AudioFormat Format;
+  int ChannelCount;
+  SDL_AudioDeviceID Device;
+  int16 *Samples; // where the game writes its samples
+  uint8 *DeviceSamples; // scratch for converting to the device's format
+  sdl_audio_ring_buffer RingBuffer;
+  // NOTE: Samples written so far. Kept apart from the ring's byte counts,
+  // which wrap at a byte count that isn't a whole number of samples.
+  uint32 WriteCursor;
+
+  // NOTE: The device opens on a thread of its own at startup; none of the
+  // above may be touched from the main thread until this is set.
+  SDL_atomic_t IsReady;
+};
+
+struct platform_work_queue_entry
+{
+  platform_work_queue_callback *Callback;
+  void *Data;
+};
+
+/*
+  NOTE: A single-producer, multi-consumer ring of work entries. Only the main
+  thread adds entries (bumping NextEntryToWrite); workers race for entries by
+  compare-and-swapping NextEntryToRead. The semaphore counts entries that have
+  been added but not yet claimed, so idle workers sleep instead of spinning.
+*/
+struct platform_work_queue
+{
+  int CompletionGoal; // only touched by the producer
+  SDL_atomic_t CompletionCount;
+
+  SDL_atomic_t NextEntryToWrite;
+  SDL_atomic_t NextEntryToRead;
+  SDL_sem *SemaphoreHandle;
+
+  platform_work_queue_entry Entries[256];
+};
+
+struct sdl_game_code
+{
+  void *GameCodeSO;
+  // Both of these change when a fresh build is moved into place.
+  time_t SOLastWriteTime;
+  ino_t SOLastInode;
+
+  // IMPORTANT: This may be the stub; never assume it points into the game code.
+  game_update *Update;
+  game_render *Render;
+  game_get_sound_samples *GetSoundSamples;
+
+  bool32 IsValid;
+};
+
+/*
+  NOTE: An input recording is a header, a snapshot of the game's permanent
+  storage as it was when recording began, and then one game_input per update.
+  Transient storage is scratch by contract, so it isn't saved. Playing a
+  recording back restores the snapshot and feeds the same inputs in again,
+  looping forever, which makes for a repeatable workload to profile against.
+*/
+#define SDL_RECORDING_MAGIC 0x494D4D48 // "HMMI"
+
+struct sdl_recording_header
+{
+  uint32 Magic;
+  uint32 InputSize;
+  uint64 PermanentStorageSize;
+  bool32 IsInitialized;
+};
+
+/*
+  NOTE: Save states. Each slot is a copy of the game's permanent storage, in
+  a block reserved up front; the transient storage is scratch the game
+  rebuilds every frame, so it isn't kept. Saving and restoring compare the
+  two a page at a time and only write the pages that differ, split across
+  the render queue, so a game that's barely changed since the last save
+  costs little more than reading it.
+*/
+#define SNAPSHOT_SLOT_COUNT 4
+#define SNAPSHOT_PAGE_SIZE 4096
+#define SNAPSHOT_CHUNK_COUNT 64
+
+struct sdl_snapshot
+{
+  void *Memory;
+  bool32 IsValid;
+  bool32 IsInitialized;
+};
+
+struct sdl_state
+{
+  game_memory *GameMemory;
+
+  // Gamepad N shows up as controller N + 1 in game_input. Events name their
+  // gamepad by joystick instance ID, so we keep those alongside.
+  SDL_GameController *Controllers[MAX_CONTROLLERS];
+  SDL_JoystickID ControllerIDs[MAX_CONTROLLERS];
+
+  char RecordingPath[4096];
+  FILE *RecordingHandle;
+  FILE *PlaybackHandle;
+
+  // While playing back, one line per frame: loop, frame, framebuffer hash and
+  // frame time. Two runs of the same recording should hash identically.
+  char FrameHashPath[4096];
+  FILE *FrameHashHandle;
+  int PlaybackLoopIndex;
+  int PlaybackFrameIndex;
+
+  sdl_snapshot Snapshots[SNAPSHOT_SLOT_COUNT];
+};
+
+/*
+  NOTE: Asynchronous logging. Logging from the frame loop only copies the
+  format string pointer and the raw arguments into a fixed-size record in the
+  calling thread's own ring; a background thread formats the records and
+  writes them out in batches. Formats must be string literals, since their
+  address is all that gets kept. String arguments are copied into the record,
+  and get cut short if they don't fit.
+
+  Every ring is a fixed size and there is a fixed number of them, so logging
+  never allocates. When a ring is full the record is dropped and counted
+  instead, rather than holding up the thread that logged it.
+*/
+#define LOG_MAX_ARGS 12
+#define LOG_STRING_BYTES 64
+#define LOG_RING_RECORD_COUNT 1024 // NOTE: Must be a power of two.
+#define LOG_MAX_RINGS 8
+
+enum sdl_log_arg_type
+{
+  LogArg_Int,
+  LogArg_UInt,
+  LogArg_Long,
+  LogArg_ULong,
+  LogArg_LongLong,
+  LogArg_ULongLong,
+  LogArg_Double,
+  LogArg_Pointer,
+  LogArg_String, // offset into the record's StringBytes
+};
+
+struct sdl_log_arg
+{
+  uint32 Type;
+  union
+  {
+    int Int;
+    unsigned int UInt;
+    long Long;
+    unsigned long ULong;
+    long long LongLong;
+    unsigned long long ULongLong;
+    double Double;
+    void *Pointer;
+    uint32 StringOffset;
+  };
+};
+
+struct sdl_log_record
+{
+  uint64 Counter; // performance counter when it was logged
+  char *Format;
+  SDL_LogPriority Priority;
+  uint32 ArgCount;
+  uint32 StringBytesUsed;
+  sdl_log_arg Args[LOG_MAX_ARGS];
+  char StringBytes[LOG_STRING_BYTES];
+};
+
+// NOTE: Single producer (the thread that owns it), single consumer (the
+// logger thread), same running-count scheme as the audio ring.
+struct sdl_log_ring
+{
+  SDL_atomic_t ReadCount;
+  SDL_atomic_t WriteCount;
+  SDL_atomic_t DroppedCount;
+  sdl_log_record Records[LOG_RING_RECORD_COUNT];
+};
+
+struct sdl_logger
+{
+  SDL_LogPriority MinimumPriority;
+  uint64 StartCounter;
+
+  SDL_atomic_t RingCount;
+  SDL_atomic_t RinglessDroppedCount; // threads that came after the rings ran out
+  sdl_log_ring *Rings; // LOG_MAX_RINGS of them
+
+  SDL_atomic_t IsRunning;
+  SDL_Thread *Thread;
 };
 
 global_variable bool Running;
 global_variable sdl_offscreen_buffer GlobalBackBuffer;
+global_variable sdl_sound_output GlobalSoundOutput;
+global_variable sdl_logger GlobalLogger;
+global_variable __thread sdl_log_ring *ThreadLogRing;
+#if HANDMADE_SLOW
+// NOTE: See DEBUGCountHeapAllocations.
+global_variable SDL_atomic_t DEBUGGlobalHeapAllocationCount;
+#define DEBUG_COUNT_HEAP_ALLOCATION() SDL_AtomicIncRef(&DEBUGGlobalHeapAllocationCount)
+// NOTE: Frames to go before the frame loop has to stay off the heap. Anything
+// that goes to the heap from inside a frame on purpose starts it over.
+#define DEBUG_HEAP_WARMUP_FRAMES 8
+global_variable int DEBUGGlobalHeapWarmupFramesLeft = DEBUG_HEAP_WARMUP_FRAMES;
+#define DEBUG_RESTART_HEAP_WARMUP() (DEBUGGlobalHeapWarmupFramesLeft = DEBUG_HEAP_WARMUP_FRAMES)
+#else
+#define DEBUG_COUNT_HEAP_ALLOCATION()
+#define DEBUG_RESTART_HEAP_WARMUP()
+#endif
 
-internal void
-SDLDisplayBufferInWindow(sdl_offscreen_buffer Buffer, SDL_Renderer *Renderer)
+internal sdl_log_ring *
+SDLGetThreadLogRing()
 {
-  // Give our new texture fresh pixel data.
-  // TODO: Should we use SDL_{Lock,Unlock}Texture instead?
-  if (SDL_UpdateTexture(Buffer.Texture, NULL, Buffer.Memory, Buffer.Pitch))
+  sdl_log_ring *Ring = ThreadLogRing;
+  if (!Ring && GlobalLogger.Rings)
+  {
+    int RingIndex = SDL_AtomicAdd(&GlobalLogger.RingCount, 1);
+    if (RingIndex < LOG_MAX_RINGS)
     {
-      // TODO: Handle error.
-      SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Error updating texture map: %s", SDL_GetError());
+      Ring = ThreadLogRing = GlobalLogger.Rings + RingIndex;
     }
-  // Copy the texture to the screen.
-  SDL_RenderCopy(Renderer,
-                 Buffer.Texture,
-                 NULL, // Source rectangle (NULL means whole texture)
-                 NULL  // Destination rectangle (NULL means whole texture)
-                 );
-  // Show it.
-  SDL_RenderPresent(Renderer);
+  }
+  return(Ring);
 }
 
-internal void
-SDLHandleEvent(SDL_Event *Event, int* XOffset, int *YOffset)
+inline sdl_log_arg
+SDLLogArg(sdl_log_record *Record, int Value) { sdl_log_arg Arg; Arg.Type = LogArg_Int; Arg.Int = Value; return(Arg); }
+inline sdl_log_arg
+SDLLogArg(sdl_log_record *Record, unsigned int Value) { sdl_log_arg Arg; Arg.Type = LogArg_UInt; Arg.UInt = Value; return(Arg); }
+inline sdl_log_arg
+SDLLogArg(sdl_log_record *Record, long Value) { sdl_log_arg Arg; Arg.Type = LogArg_Long; Arg.Long = Value; return(Arg); }
+inline sdl_log_arg
+SDLLogArg(sdl_log_record *Record, unsigned long Value) { sdl_log_arg Arg; Arg.Type = LogArg_ULong; Arg.ULong = Value; return(Arg); }
+inline sdl_log_arg
+SDLLogArg(sdl_log_record *Record, long long Value) { sdl_log_arg Arg; Arg.Type = LogArg_LongLong; Arg.LongLong = Value; return(Arg); }
+inline sdl_log_arg
+SDLLogArg(sdl_log_record *Record, unsigned long long Value) { sdl_log_arg Arg; Arg.Type = LogArg_ULongLong; Arg.ULongLong = Value; return(Arg); }
+inline sdl_log_arg
+SDLLogArg(sdl_log_record *Record, double Value) { sdl_log_arg Arg; Arg.Type = LogArg_Double; Arg.Double = Value; return(Arg); }
+inline sdl_log_arg
+SDLLogArg(sdl_log_record *Record, void *Value) { sdl_log_arg Arg; Arg.Type = LogArg_Pointer; Arg.Pointer = Value; return(Arg); }
+
+inline sdl_log_arg
+SDLLogArg(sdl_log_record *Record, const char *Value)
 {
-  switch(Event->type)
-  {
-    case SDL_WINDOWEVENT:
-    {
-      switch(Event->window.event)
-      {
-        case SDL_WINDOWEVENT_CLOSE:
-        {
-          // TODO: Handle this with message to the user?
-          Running = false;
-        } break;
+  sdl_log_arg Arg;
+  Arg.Type = LogArg_String;
+  Arg.StringOffset = Record->StringBytesUsed;
 
-        // This is the main "paint" event.
-        case SDL_WINDOWEVENT_EXPOSED:
-        {
-          // SDL_LogDebug(SDL_LOG_CATEGORY_APPLICATION, "window exposed");
+  char *Dest = Record->StringBytes + Record->StringBytesUsed;
+  char *DestEnd = Record->StringBytes + LOG_STRING_BYTES - 1;
+  while (*Value && (Dest < DestEnd))
+  {
+    *Dest++ = *Value++;
+  }
+  *Dest++ = 0;
+  Record->StringBytesUsed = (uint32)(Dest - Record->StringBytes);
+  if (Record->StringBytesUsed >= LOG_STRING_BYTES)
+  {
+    // NOTE: Out of room; any further strings come out empty.
+    Record->StringBytesUsed = LOG_STRING_BYTES - 1;
+  }
+  return(Arg);
+}
 
-          SDL_Window *Window = SDL_GetWindowFromID(Event->window.windowID);
-          SDL_Renderer *Renderer = SDL_GetRenderer(Window);
-          SDLDisplayBufferInWindow(GlobalBackBuffer, Renderer);
-        } break;
-      }
-    } break;
+internal void
+SDLPackLogArgs(sdl_log_record *Record)
+{
+}
 
-    case SDL_KEYUP:
-    case SDL_KEYDOWN:
-    {
-      SDL_Keycode KeyCode = Event->key.keysym.sym;
-      bool WasDown = (Event->key.state == SDL_RELEASED) || Event->key.repeat;
-      bool IsDown = Event->key.state == SDL_PRESSED;
+template <typename type, typename... rest>
+internal void
+SDLPackLogArgs(sdl_log_record *Record, type Value, rest... Rest)
+{
+  static_assert(sizeof...(Rest) < LOG_MAX_ARGS, "Too many arguments to log");
+  Record->Args[Record->ArgCount++] = SDLLogArg(Record, Value);
+  SDLPackLogArgs(Record, Rest...);
+}
 
-      if (IsDown != WasDown)
-      {
-        switch(KeyCode)
-        {
-          case SDLK_w:
-          {
-            SDL_LogDebug(SDL_LOG_CATEGORY_APPLICATION, "w");
-            *YOffset += 12;
-          } break;
+/*
+  NOTE: Drop-in for SDL_LogDebug/SDL_LogInfo on the frame loop's hot path;
+  see the note above. Warnings and errors should keep going through SDL
+  directly, so they come out straight away.
+*/
+template <typename... args>
+internal void
+SDLLog(SDL_LogPriority Priority, const char *Format, args... Args)
+{
+  if (Priority < GlobalLogger.MinimumPriority)
+  {
+    return;
+  }
 
-          case SDLK_a:
-          {
-            SDL_LogDebug(SDL_LOG_CATEGORY_APPLICATION, "a");
-            *XOffset += 12;
-          } break;
+  sdl_log_ring *Ring = SDLGetThreadLogRing();
+  if (!Ring)
+  {
+    SDL_AtomicIncRef(&GlobalLogger.RinglessDroppedCount);
+    return;
+  }
 
-          case SDLK_s:
-          {
-            SDL_LogDebug(SDL_LOG_CATEGORY_APPLICATION, "s");
-            *YOffset -= 12;
-          } break;
+  uint32 WriteCount = (uint32)SDL_AtomicGet(&Ring->WriteCount);
+  if ((WriteCount - (uint32)SDL_AtomicGet(&Ring->ReadCount)) == LOG_RING_RECORD_COUNT)
+  {
+    SDL_AtomicIncRef(&Ring->DroppedCount);
+    return;
+  }
 
-          case SDLK_d:
-          {
-            SDL_LogDebug(SDL_LOG_CATEGORY_APPLICATION, "d");
-            *XOffset -= 12;
-          } break;
+  sdl_log_record *Record = Ring->Records + (WriteCount & (LOG_RING_RECORD_COUNT - 1));
+  Record->Counter = SDL_GetPerformanceCounter();
+  Record->Format = (char *)Format;
+  Record->Priority = Priority;
+  Record->ArgCount = 0;
+  Record->StringBytesUsed = 0;
+  SDLPackLogArgs(Record, Args...);
 
-          case SDLK_q:
-          {
-            SDL_LogDebug(SDL_LOG_CATEGORY_APPLICATION, "q");
-          } break;
+  // Publish the record.
+  SDL_AtomicSet(&Ring->WriteCount, (int)(WriteCount + 1));
+}
 
-          case SDLK_e:
-          {
-            SDL_LogDebug(SDL_LOG_CATEGORY_APPLICATION, "e");
-          } break;
+// Formats one record the way printf would have, a conversion at a time.
+internal int
+SDLFormatLogRecord(sdl_log_record *Record, char *Out, int OutSize)
+{
+  local_persist const char *PriorityNames[] = {"", "VERBOSE", "DEBUG", "INFO", "WARN", "ERROR", "CRITICAL"};
 
-          case SDLK_UP:
-          {
-            SDL_LogDebug(SDL_LOG_CATEGORY_APPLICATION, "up");
-          } break;
+  real64 Seconds = (real64)(Record->Counter - GlobalLogger.StartCounter) / (real64)SDL_GetPerformanceFrequency();
+  int Used = SDL_snprintf(Out, OutSize, "%10.4f %s: ", Seconds,
+                          ((uint32)Record->Priority < ArrayCount(PriorityNames)) ? PriorityNames[Record->Priority] : "");
 
-          case SDLK_DOWN:
-          {
-            SDL_LogDebug(SDL_LOG_CATEGORY_APPLICATION, "down");
-          } break;
+  uint32 ArgIndex = 0;
+  char *At = Record->Format;
+  while (*At && (Used < OutSize - 1))
+  {
+    if (*At != '%')
+    {
+      Out[Used++] = *At++;
+      continue;
+    }
+    if (At[1] == '%')
+    {
+      Out[Used++] = '%';
+      At += 2;
+      continue;
+    }
 
-          case SDLK_LEFT:
-          {
-            SDL_LogDebug(SDL_LOG_CATEGORY_APPLICATION, "left");
-          } break;
+    char Spec[16];
+    int SpecLength = 0;
+    Spec[SpecLength++] = *At++;
+    while (*At && (SpecLength < (int)sizeof(Spec) - 1))
+    {
+      char C = *At++;
+      Spec[SpecLength++] = C;
+      if (SDL_strchr("diouxXfFeEgGcsp", C))
+      {
+        break;
+      }
+    }
+    Spec[SpecLength] = 0;
 
-          case SDLK_RIGHT:
-          {
-            SDL_LogDebug(SDL_LOG_CATEGORY_APPLICATION, "right");
-          } break;
+    int Written = 0;
+    if (ArgIndex < Record->ArgCount)
+    {
+      sdl_log_arg *Arg = Record->Args + ArgIndex++;
+      char *Dest = Out + Used;
+      int Room = OutSize - Used;
+      switch (Arg->Type)
+      {
+        case LogArg_Int: Written = SDL_snprintf(Dest, Room, Spec, Arg->Int); break;
+        case LogArg_UInt: Written = SDL_snprintf(Dest, Room, Spec, Arg->UInt); break;
+        case LogArg_Long: Written = SDL_snprintf(Dest, Room, Spec, Arg->Long); break;
+        case LogArg_ULong: Written = SDL_snprintf(Dest, Room, Spec, Arg->ULong); break;
+        case LogArg_LongLong: Written = SDL_snprintf(Dest, Room, Spec, Arg->LongLong); break;
+        case LogArg_ULongLong: Written = SDL_snprintf(Dest, Room, Spec, Arg->ULongLong); break;
+        case LogArg_Double: Written = SDL_snprintf(Dest, Room, Spec, Arg->Double); break;
+        case LogArg_Pointer: Written = SDL_snprintf(Dest, Room, Spec, Arg->Pointer); break;
+        case LogArg_String: Written = SDL_snprintf(Dest, Room, Spec, Record->StringBytes + Arg->StringOffset); break;
+      }
+    }
+    if (Written > 0)
+    {
+      Used += Written;
+      if (Used > OutSize - 1)
+      {
+        Used = OutSize - 1;
+      }
+    }
+  }
 
-          case SDLK_ESCAPE:
-          {
-            SDL_LogDebug(SDL_LOG_CATEGORY_APPLICATION, "escape");
-          } break;
+  Out[Used++] = '\n';
+  return(Used);
+}
 
-          case SDLK_SPACE:
-          {
-            SDL_LogDebug(SDL_LOG_CATEGORY_APPLICATION, "space");
-          } break;
+/*
+  NOTE: Formats everything that's waiting, oldest first across all the rings,
+  and writes it out in as few writes as it can.
+*/
+internal void
+SDLFlushLogRecords(char *Batch, int BatchSize, int *LastDroppedCount)
+{
+  int BatchUsed = 0;
+  int RingCount = SDL_AtomicGet(&GlobalLogger.RingCount);
+  if (RingCount > LOG_MAX_RINGS)
+  {
+    RingCount = LOG_MAX_RINGS;
+  }
 
-          default:
-          {
-          } break;
+  for (;;)
+  {
+    sdl_log_ring *OldestRing = 0;
+    sdl_log_record *OldestRecord = 0;
+    for (int RingIndex = 0;
+         RingIndex < RingCount;
+         ++RingIndex)
+    {
+      sdl_log_ring *Ring = GlobalLogger.Rings + RingIndex;
+      uint32 ReadCount = (uint32)SDL_AtomicGet(&Ring->ReadCount);
+      if (ReadCount != (uint32)SDL_AtomicGet(&Ring->WriteCount))
+      {
+        sdl_log_record *Record = Ring->Records + (ReadCount & (LOG_RING_RECORD_COUNT - 1));
+        if (!OldestRecord || (Record->Counter < OldestRecord->Counter))
+        {
+          OldestRing = Ring;
+          OldestRecord = Record;
         }
       }
-    } break;
+    }
 
-    default:
+    if (!OldestRecord)
     {
-      // SDL_LogDebug("default");
-    } break;
+      break;
+    }
+
+    char Line[1024];
+    int LineLength = SDLFormatLogRecord(OldestRecord, Line, sizeof(Line));
+    SDL_AtomicAdd(&OldestRing->ReadCount, 1);
+
+    if (BatchUsed + LineLength > BatchSize)
+    {
+      fwrite(Batch, 1, BatchUsed, stderr);
+      BatchUsed = 0;
+    }
+    SDL_memcpy(Batch + BatchUsed, Line, LineLength);
+    BatchUsed += LineLength;
+  }
+
+  int DroppedCount = SDL_AtomicGet(&GlobalLogger.RinglessDroppedCount);
+  for (int RingIndex = 0;
+       RingIndex < RingCount;
+       ++RingIndex)
+  {
+    DroppedCount += SDL_AtomicGet(&GlobalLogger.Rings[RingIndex].DroppedCount);
+  }
+  if (DroppedCount != *LastDroppedCount)
+  {
+    // NOTE: Always fits; the longest int there is makes it 39 characters.
+    char Line[64];
+    int LineLength = SDL_snprintf(Line, sizeof(Line), "%d log records dropped so far\n", DroppedCount);
+    if (BatchUsed + LineLength > BatchSize)
+    {
+      fwrite(Batch, 1, BatchUsed, stderr);
+      BatchUsed = 0;
+    }
+    SDL_memcpy(Batch + BatchUsed, Line, LineLength);
+    BatchUsed += LineLength;
+    *LastDroppedCount = DroppedCount;
+  }
+
+  if (BatchUsed)
+  {
+    fwrite(Batch, 1, BatchUsed, stderr);
+    fflush(stderr);
+  }
+}
+
+internal int
+SDLLoggerThreadProc(void *Parameter)
+{
+  local_persist char Batch[Kilobytes(64)];
+  int LastDroppedCount = 0;
+  while (SDL_AtomicGet(&GlobalLogger.IsRunning))
+  {
+    SDLFlushLogRecords(Batch, sizeof(Batch), &LastDroppedCount);
+    SDL_Delay(10);
+  }
+
+  // One last pass, for anything logged on the way out.
+  SDLFlushLogRecords(Batch, sizeof(Batch), &LastDroppedCount);
+  return(0);
+}
+
+internal void
+SDLStartLogger()
+{
+  GlobalLogger.MinimumPriority = SDL_LogGetPriority(SDL_LOG_CATEGORY_APPLICATION);
+  GlobalLogger.StartCounter = SDL_GetPerformanceCounter();
+  GlobalLogger.Rings = (sdl_log_ring *)SDL_calloc(LOG_MAX_RINGS, sizeof(sdl_log_ring));
+  if (GlobalLogger.Rings)
+  {
+    SDL_AtomicSet(&GlobalLogger.IsRunning, 1);
+    GlobalLogger.Thread = SDL_CreateThread(SDLLoggerThreadProc, "HandmadeLogger", 0);
+  }
+  if (!GlobalLogger.Thread)
+  {
+    // NOTE: With no rings every record counts as dropped, which is better
+    // than piling them up with nobody to write them out.
+    SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Failed to start the logger: %s", SDL_GetError());
+    SDL_free(GlobalLogger.Rings);
+    GlobalLogger.Rings = 0;
+  }
+}
+
+internal void
+SDLStopLogger()
+{
+  if (GlobalLogger.Thread)
+  {
+    SDL_AtomicSet(&GlobalLogger.IsRunning, 0);
+    SDL_WaitThread(GlobalLogger.Thread, 0);
+    GlobalLogger.Thread = 0;
+  }
+}
+
+// Gives the buffer memory of our own to draw into and copy to the texture.
+internal void
+SDLAllocateOwnMemory(sdl_offscreen_buffer *Buffer)
+{
+  // Number of bytes in a row of pixels, rounded up to a whole number of cache
+  // lines so that render threads working on different rows never share one.
+  Buffer->OwnPitch = Align(Buffer->Width * Buffer->BytesPerPixel, CACHE_LINE_SIZE);
+
+  // SDL_LogDebug(SDL_LOG_CATEGORY_APPLICATION, "allocating new bitmap memory");
+  int BitmapMemorySize = Buffer->OwnPitch * Buffer->Height;
+  DEBUG_COUNT_HEAP_ALLOCATION();
+  if (posix_memalign(&Buffer->OwnMemory, CACHE_LINE_SIZE, BitmapMemorySize))
+  {
+    Buffer->OwnMemory = 0;
+  }
+  Buffer->OwnMemoryIsCurrent = false;
+}
+
+/*
+  NOTE: Gives the game somewhere to draw this frame. Our own memory keeps its
+  pixels from frame to frame, so the game only redraws what changed and only
+  those rects get copied up with SDL_UpdateTexture. A locked texture's pixels
+  are gone every time it's locked, but drawing straight into it saves the
+  copy, so we do that instead while every frame changes the whole screen.
+  Build with HANDMADE_TEXTURE_COPY=1 to never lock the texture.
+*/
+inline bool32
+SDLIsScaledInSoftware(sdl_offscreen_buffer *Buffer)
+{
+  return(Buffer->ScaleMode >= ScaleMode_Integer);
+}
+
+internal void
+SDLBeginBufferFrame(sdl_offscreen_buffer *Buffer)
+{
+  if (Buffer->UseTextureLock && Buffer->DrawIntoTexture && !Buffer->IsLocked &&
+      !SDLIsScaledInSoftware(Buffer))
+  {
+    if (SDL_LockTexture(Buffer->Texture, NULL, &Buffer->Memory, &Buffer->Pitch) == 0)
+    {
+      Buffer->IsLocked = true;
+    }
+    else
+    {
+      SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Error locking texture, falling back to copying: %s", SDL_GetError());
+      Buffer->UseTextureLock = false;
+    }
+  }
+
+  if (Buffer->IsLocked)
+  {
+    Buffer->IsPreserved = false;
+  }
+  else
+  {
+    Buffer->Memory = Buffer->OwnMemory;
+    Buffer->Pitch = Buffer->OwnPitch;
+    Buffer->IsPreserved = Buffer->OwnMemoryIsCurrent;
+  }
+}
+
+/*
+  NOTE: Puts this frame on the screen. DirtyRects is whatever the game said it
+  changed; pass 0 to just show the texture again as it is. Scaling in
+  software spreads the work over PlatformAPI's render queue.
+*/
+internal sdl_present_stats
+SDLDisplayBufferInWindow(sdl_offscreen_buffer *Buffer, SDL_Renderer *Renderer,
+                         game_dirty_rects *DirtyRects, platform_api *PlatformAPI)
+{
+  sdl_present_stats Stats = {};
+  uint64 UploadStart = SDL_GetPerformanceCounter();
+  BEGIN_BLOCK("TextureUpload");
+
+  if (SDLIsScaledInSoftware(Buffer))
+  {
+    // NOTE: The whole texture gets rescaled whenever anything changed.
+    if (DirtyRects && Buffer->Memory &&
+        (DirtyRects->Count || !Buffer->IsPreserved || !Buffer->TextureIsCurrent))
+    {
+      void *TexturePixels;
+      int TexturePitch;
+      if (SDL_LockTexture(Buffer->Texture, NULL, &TexturePixels, &TexturePitch) == 0)
+      {
+        game_offscreen_buffer Source = {};
+        Source.Memory = Buffer->Memory;
+        Source.Width = Buffer->Width;
+        Source.Height = Buffer->Height;
+        Source.Pitch = Buffer->Pitch;
+        Source.Format = Buffer->Format;
+
+        game_offscreen_buffer Dest = Source;
+        Dest.Memory = TexturePixels;
+        Dest.Width = Buffer->TextureWidth;
+        Dest.Height = Buffer->TextureHeight;
+        Dest.Pitch = TexturePitch;
+        ScaleBuffer(PlatformAPI, PlatformAPI->RenderQueue, Buffer->Scaler, &Source, &Dest);
+        SDL_UnlockTexture(Buffer->Texture);
+
+        Stats.BytesCopied = Buffer->TextureWidth * Buffer->TextureHeight * Buffer->BytesPerPixel;
+        Buffer->TextureIsCurrent = true;
+      }
+      else
+      {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Error locking texture to scale into: %s", SDL_GetError());
+      }
+    }
+    if (DirtyRects)
+    {
+      Buffer->OwnMemoryIsCurrent = true;
+    }
+  }
+  else if (Buffer->IsLocked)
+  {
+    // The game drew straight into the texture: just hand it back.
+    SDL_UnlockTexture(Buffer->Texture);
+    Buffer->IsLocked = false;
+    Buffer->OwnMemoryIsCurrent = false;
+  }
+  else if (DirtyRects && Buffer->Memory)
+  {
+    game_rect WholeBuffer = {0, 0, Buffer->Width, Buffer->Height};
+    game_rect *Rects = DirtyRects->Rects;
+    int RectCount = DirtyRects->Count;
+    if (!Buffer->IsPreserved)
+    {
+      // NOTE: The game redrew everything, and the texture may be stale
+      // (freshly made, or from before a playback rewind): send it all.
+      Rects = &WholeBuffer;
+      RectCount = 1;
+    }
+
+    for (int RectIndex = 0; RectIndex < RectCount; ++RectIndex)
+    {
+      game_rect *Rect = Rects + RectIndex;
+      SDL_Rect TextureRect = {Rect->MinX, Rect->MinY, Rect->MaxX - Rect->MinX, Rect->MaxY - Rect->MinY};
+      uint8 *Pixels = (uint8 *)Buffer->Memory + Rect->MinY*Buffer->Pitch + Rect->MinX*Buffer->BytesPerPixel;
+      if (SDL_UpdateTexture(Buffer->Texture, &TextureRect, Pixels, Buffer->Pitch))
+      {
+        // TODO: Handle error.
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Error updating texture map: %s", SDL_GetError());
+      }
+      else
+      {
+        Stats.BytesCopied += TextureRect.w * TextureRect.h * Buffer->BytesPerPixel;
+      }
+    }
+    Buffer->OwnMemoryIsCurrent = true;
+  }
+  // NOTE: Otherwise the texture still holds the last frame we uploaded.
+
+  if (DirtyRects)
+  {
+    int64 PixelCount = (int64)Buffer->Width * Buffer->Height;
+    Stats.DirtyFraction = PixelCount ? ((real32)DirtyRects->PixelCount / (real32)PixelCount) : 0.0f;
+    Buffer->DrawIntoTexture = (DirtyRects->PixelCount >= PixelCount);
+  }
+
+  END_BLOCK("TextureUpload");
+  Stats.UploadCounter = SDL_GetPerformanceCounter() - UploadStart;
+
+  TIMED_BLOCK("Present");
+  // Black out whatever the picture doesn't cover...
+  SDL_SetRenderDrawColor(Renderer, 0, 0, 0, 255);
+  SDL_RenderClear(Renderer);
+  // ...and copy the texture to the screen.
+  SDL_RenderCopy(Renderer,
+                 Buffer->Texture,
+                 NULL, // Source rectangle (NULL means whole texture)
+                 &Buffer->DestRect
+                 );
+  // Show it.
+  SDL_RenderPresent(Renderer);
+
+  return(Stats);
+}
+
+internal real32
+SDLGetSecondsElapsed(uint64 Start, uint64 End)
+{
+  real32 Result = ((real32)(End - Start) / (real32)SDL_GetPerformanceFrequency());
+  return(Result);
+}
+
+internal void
+SDLInitializeFramePacing(sdl_frame_pacing *Pacing, int RequestedHz)
+{
+  // Target the refresh rate of the display we're about to open on, unless
+  // we've been told otherwise.
+  int RefreshHz = RequestedHz;
+  SDL_DisplayMode Mode;
+  if ((RefreshHz <= 0) && (SDL_GetCurrentDisplayMode(0, &Mode) == 0))
+  {
+    RefreshHz = Mode.refresh_rate;
+  }
+  if (RefreshHz <= 0)
+  {
+    RefreshHz = 60;
+  }
+  Pacing->RefreshHz = RefreshHz;
+  Pacing->TargetSecondsPerFrame = 1.0f / (real32)RefreshHz;
+
+  for (int Trial = 0;
+       Trial < 8;
+       ++Trial)
+  {
+    uint64 SleepStart = SDL_GetPerformanceCounter();
+    SDL_Delay(1);
+    real32 OvershootMS = 1000.0f*SDLGetSecondsElapsed(SleepStart, SDL_GetPerformanceCounter()) - 1.0f;
+    if (OvershootMS > Pacing->SleepOvershootMS)
+    {
+      Pacing->SleepOvershootMS = OvershootMS;
+    }
+  }
+
+  SDLLog(SDL_LOG_PRIORITY_INFO, "Pacing frames at %dHz; sleeps overshoot by up to %fms",
+         Pacing->RefreshHz, Pacing->SleepOvershootMS);
+}
+
+/*
+  NOTE: Waits out the rest of the frame that began at LastCounter and hands
+  back the counter at the moment it ended.
+*/
+internal uint64
+SDLWaitForFrameEnd(sdl_frame_pacing *Pacing, uint64 LastCounter)
+{
+  TIMED_FUNCTION();
+
+  real32 TargetSeconds = Pacing->TargetSecondsPerFrame;
+  uint64 Counter = SDL_GetPerformanceCounter();
+  real32 SecondsElapsed = SDLGetSecondsElapsed(LastCounter, Counter);
+  if (SecondsElapsed < TargetSeconds)
+  {
+    real32 SleepMS = 1000.0f*(TargetSeconds - SecondsElapsed) - Pacing->SleepOvershootMS;
+    if (SleepMS >= 1.0f)
+    {
+      SDL_Delay((uint32)SleepMS);
+    }
+
+    do
+    {
+      _mm_pause();
+      Counter = SDL_GetPerformanceCounter();
+      SecondsElapsed = SDLGetSecondsElapsed(LastCounter, Counter);
+    } while (SecondsElapsed < TargetSeconds);
+  }
+  else
+  {
+    ++Pacing->MissedFrameCount;
+  }
+
+  real32 ErrorMS = 1000.0f*(SecondsElapsed - TargetSeconds);
+  int Bucket = (int)(ErrorMS / FRAME_PACING_BUCKET_MS);
+  if (Bucket >= FRAME_PACING_BUCKET_COUNT)
+  {
+    Bucket = FRAME_PACING_BUCKET_COUNT - 1;
+  }
+  ++Pacing->ErrorHistogram[Bucket];
+  ++Pacing->FrameCount;
+
+  return(Counter);
+}
+
+internal void
+SDLLogFramePacing(sdl_frame_pacing *Pacing)
+{
+  SDLLog(SDL_LOG_PRIORITY_INFO, "%u of %u frames missed the %fms target",
+         Pacing->MissedFrameCount, Pacing->FrameCount, 1000.0f*Pacing->TargetSecondsPerFrame);
+  for (int Bucket = 0;
+       Bucket < FRAME_PACING_BUCKET_COUNT;
+       ++Bucket)
+  {
+    real32 FromMS = Bucket*FRAME_PACING_BUCKET_MS;
+    SDLLog(SDL_LOG_PRIORITY_INFO, "  +%.1fms%s %u", FromMS,
+           (Bucket == FRAME_PACING_BUCKET_COUNT - 1) ? " and up:" : ":", Pacing->ErrorHistogram[Bucket]);
+  }
+}
+
+internal void
+SDLInitializeUpdateClock(sdl_update_clock *Clock, int UpdateHz)
+{
+  Clock->SecondsPerUpdate = 1.0f / (real32)UpdateHz;
+  // NOTE: Start a whole step in, so there's a state to draw on the first frame.
+  Clock->Accumulator = Clock->SecondsPerUpdate;
+}
+
+// Banks SecondsElapsed and hands back how many updates are due.
+internal int
+SDLBeginUpdates(sdl_update_clock *Clock, real32 SecondsElapsed)
+{
+  Clock->Accumulator += SecondsElapsed;
+  int Result = (int)(Clock->Accumulator / Clock->SecondsPerUpdate);
+  if (Result > SDL_MAX_UPDATES_PER_FRAME)
+  {
+    int DroppedCount = Result - SDL_MAX_UPDATES_PER_FRAME;
+    Clock->DroppedUpdateCount += DroppedCount;
+    Clock->Accumulator -= DroppedCount*Clock->SecondsPerUpdate;
+    Result = SDL_MAX_UPDATES_PER_FRAME;
+  }
+  Clock->Accumulator -= Result*Clock->SecondsPerUpdate;
+  Clock->UpdateCount += Result;
+  return(Result);
+}
+
+// How far the clock is from the next-to-last update (0) to the last (1).
+internal real32
+SDLGetRenderAlpha(sdl_update_clock *Clock)
+{
+  real32 Result = Clock->Accumulator / Clock->SecondsPerUpdate;
+  if (Result < 0.0f)
+  {
+    Result = 0.0f;
+  }
+  if (Result > 1.0f)
+  {
+    Result = 1.0f;
+  }
+  return(Result);
+}
+
+internal void
+SDLLogUpdateClock(sdl_update_clock *Clock)
+{
+  SDLLog(SDL_LOG_PRIORITY_INFO, "%u updates at %fms, %u dropped to keep up",
+         Clock->UpdateCount, 1000.0f*Clock->SecondsPerUpdate, Clock->DroppedUpdateCount);
+}
+
+internal void
+SDLBeginRecordingInput(sdl_state *State)
+{
+  Assert(!State->RecordingHandle);
+  game_memory *GameMemory = State->GameMemory;
+
+  // NOTE: Loads in flight write into the game's memory; let them land first.
+  GameMemory->PlatformAPI.CompleteAllWork(GameMemory->PlatformAPI.LowPriorityQueue);
+  // NOTE: stdio keeps the file, and its buffer, on the heap.
+  DEBUG_COUNT_HEAP_ALLOCATION();
+  DEBUG_RESTART_HEAP_WARMUP();
+  State->RecordingHandle = fopen(State->RecordingPath, "wb");
+  if(State->RecordingHandle)
+  {
+    sdl_recording_header Header = {};
+    Header.Magic = SDL_RECORDING_MAGIC;
+    Header.InputSize = sizeof(game_input);
+    Header.PermanentStorageSize = GameMemory->PermanentStorageSize;
+    Header.IsInitialized = GameMemory->IsInitialized;
+    fwrite(&Header, sizeof(Header), 1, State->RecordingHandle);
+    fwrite(GameMemory->PermanentStorage, GameMemory->PermanentStorageSize, 1, State->RecordingHandle);
+    SDLLog(SDL_LOG_PRIORITY_INFO, "Recording input to %s", State->RecordingPath);
+  }
+  else
+  {
+    SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Unable to record to %s", State->RecordingPath);
+  }
+}
+
+internal void
+SDLEndRecordingInput(sdl_state *State)
+{
+  fclose(State->RecordingHandle);
+  State->RecordingHandle = 0;
+}
+
+internal void
+SDLRecordInput(sdl_state *State, game_input *NewInput)
+{
+  fwrite(NewInput, sizeof(*NewInput), 1, State->RecordingHandle);
+}
+
+/*
+  NOTE: Restores the snapshot and leaves the file positioned at the first
+  frame of input. The snapshot is only meaningful if the game memory sits at
+  the same address it was recorded at, which HANDMADE_INTERNAL builds
+  guarantee by mapping it at a fixed base.
+*/
+internal bool32
+SDLRewindPlayback(sdl_state *State)
+{
+  game_memory *GameMemory = State->GameMemory;
+  bool32 Result = false;
+
+  // NOTE: Nothing may still be loading into the memory we're about to overwrite.
+  GameMemory->PlatformAPI.CompleteAllWork(GameMemory->PlatformAPI.LowPriorityQueue);
+  if(fseek(State->PlaybackHandle, 0, SEEK_SET) == 0)
+  {
+    sdl_recording_header Header = {};
+    if((fread(&Header, sizeof(Header), 1, State->PlaybackHandle) == 1) &&
+       (Header.Magic == SDL_RECORDING_MAGIC) &&
+       (Header.InputSize == sizeof(game_input)) &&
+       (Header.PermanentStorageSize == GameMemory->PermanentStorageSize) &&
+       (fread(GameMemory->PermanentStorage, GameMemory->PermanentStorageSize, 1, State->PlaybackHandle) == 1))
+    {
+      GameMemory->IsInitialized = Header.IsInitialized;
+      State->PlaybackFrameIndex = 0;
+      // NOTE: The game's idea of what's on screen just went back in time too.
+      GlobalBackBuffer.OwnMemoryIsCurrent = false;
+      Result = true;
+    }
+  }
+
+  return(Result);
+}
+
+internal void
+SDLEndInputPlayBack(sdl_state *State)
+{
+  fclose(State->PlaybackHandle);
+  State->PlaybackHandle = 0;
+
+  if(State->FrameHashHandle)
+  {
+    fclose(State->FrameHashHandle);
+    State->FrameHashHandle = 0;
+  }
+}
+
+internal void
+SDLBeginInputPlayBack(sdl_state *State)
+{
+  Assert(!State->PlaybackHandle);
+
+  DEBUG_COUNT_HEAP_ALLOCATION();
+  DEBUG_RESTART_HEAP_WARMUP();
+  State->PlaybackHandle = fopen(State->RecordingPath, "rb");
+  State->PlaybackLoopIndex = 0;
+  if(State->PlaybackHandle && SDLRewindPlayback(State))
+  {
+    DEBUG_COUNT_HEAP_ALLOCATION();
+    State->FrameHashHandle = fopen(State->FrameHashPath, "w");
+    SDLLog(SDL_LOG_PRIORITY_INFO, "Playing back input from %s", State->RecordingPath);
+  }
+  else
+  {
+    SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Unable to play back %s", State->RecordingPath);
+    if(State->PlaybackHandle)
+    {
+      SDLEndInputPlayBack(State);
+    }
+  }
+}
+
+internal void
+SDLPlayBackInput(sdl_state *State, game_input *NewInput)
+{
+  if(fread(NewInput, sizeof(*NewInput), 1, State->PlaybackHandle) != 1)
+  {
+    // NOTE: We've hit the end of the recording; go around again.
+    ++State->PlaybackLoopIndex;
+    if(!SDLRewindPlayback(State) ||
+       (fread(NewInput, sizeof(*NewInput), 1, State->PlaybackHandle) != 1))
+    {
+      SDLEndInputPlayBack(State);
+    }
+  }
+}
+
+// Not recording -> recording -> playing back what was recorded -> stopped.
+internal void
+SDLCycleInputRecording(sdl_state *State)
+{
+  if(State->RecordingHandle)
+  {
+    SDLEndRecordingInput(State);
+    SDLBeginInputPlayBack(State);
+  }
+  else if(State->PlaybackHandle)
+  {
+    SDLEndInputPlayBack(State);
+  }
+  else
+  {
+    SDLBeginRecordingInput(State);
+  }
+}
+
+struct sdl_snapshot_work
+{
+  uint8 *Dest;
+  uint8 *Source;
+  memory_index Size;
+  memory_index BytesWritten;
+};
+
+internal
+PLATFORM_WORK_QUEUE_CALLBACK(SDLDoSnapshotWork)
+{
+  sdl_snapshot_work *Work = (sdl_snapshot_work *)Data;
+  for(memory_index Offset = 0;
+      Offset < Work->Size;
+      Offset += SNAPSHOT_PAGE_SIZE)
+  {
+    memory_index PageSize = Work->Size - Offset;
+    if(PageSize > SNAPSHOT_PAGE_SIZE)
+    {
+      PageSize = SNAPSHOT_PAGE_SIZE;
+    }
+    // NOTE: Writing a page costs more than reading it, and a page that was
+    // never touched on either side reads as the shared zero page.
+    if(memcmp(Work->Dest + Offset, Work->Source + Offset, PageSize) != 0)
+    {
+      memcpy(Work->Dest + Offset, Work->Source + Offset, PageSize);
+      Work->BytesWritten += PageSize;
+    }
+  }
+}
+
+// Makes Dest match Source and returns how many bytes that took writing.
+internal memory_index
+SDLCopyChangedPages(platform_api *PlatformAPI, void *Dest, void *Source, memory_index Size)
+{
+  TIMED_FUNCTION();
+
+  memory_index PageCount = (Size + SNAPSHOT_PAGE_SIZE - 1) / SNAPSHOT_PAGE_SIZE;
+  memory_index ChunkSize = SNAPSHOT_PAGE_SIZE * ((PageCount + SNAPSHOT_CHUNK_COUNT - 1) / SNAPSHOT_CHUNK_COUNT);
+
+  sdl_snapshot_work Works[SNAPSHOT_CHUNK_COUNT];
+  int WorkCount = 0;
+  for(memory_index Offset = 0;
+      Offset < Size;
+      Offset += ChunkSize)
+  {
+    sdl_snapshot_work *Work = &Works[WorkCount++];
+    Work->Dest = (uint8 *)Dest + Offset;
+    Work->Source = (uint8 *)Source + Offset;
+    Work->Size = ((Size - Offset) < ChunkSize) ? (Size - Offset) : ChunkSize;
+    Work->BytesWritten = 0;
+    PlatformAPI->AddEntry(PlatformAPI->RenderQueue, SDLDoSnapshotWork, Work);
+  }
+  PlatformAPI->CompleteAllWork(PlatformAPI->RenderQueue);
+
+  memory_index Result = 0;
+  for(int WorkIndex = 0;
+      WorkIndex < WorkCount;
+      ++WorkIndex)
+  {
+    Result += Works[WorkIndex].BytesWritten;
+  }
+  return(Result);
+}
+
+internal void
+SDLSaveSnapshot(sdl_state *State, int SlotIndex)
+{
+  game_memory *GameMemory = State->GameMemory;
+  sdl_snapshot *Snapshot = &State->Snapshots[SlotIndex];
+  if(!Snapshot->Memory)
+  {
+    SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "No memory for save state %d", SlotIndex + 1);
+    return;
+  }
+
+  uint64 Start = SDL_GetPerformanceCounter();
+  // NOTE: Loads still in flight write into the permanent storage behind our back.
+  GameMemory->PlatformAPI.CompleteAllWork(GameMemory->PlatformAPI.LowPriorityQueue);
+  memory_index BytesWritten = SDLCopyChangedPages(&GameMemory->PlatformAPI, Snapshot->Memory,
+                                                  GameMemory->PermanentStorage, GameMemory->PermanentStorageSize);
+  Snapshot->IsInitialized = GameMemory->IsInitialized;
+  Snapshot->IsValid = true;
+  real32 SaveMS = 1000.0f*SDLGetSecondsElapsed(Start, SDL_GetPerformanceCounter());
+
+  SDLLog(SDL_LOG_PRIORITY_INFO, "Saved state %d in %fms, writing %llu of %llu bytes", SlotIndex + 1, SaveMS,
+         (unsigned long long)BytesWritten, (unsigned long long)GameMemory->PermanentStorageSize);
+}
+
+internal void
+SDLRestoreSnapshot(sdl_state *State, int SlotIndex)
+{
+  game_memory *GameMemory = State->GameMemory;
+  sdl_snapshot *Snapshot = &State->Snapshots[SlotIndex];
+  if(!Snapshot->IsValid)
+  {
+    SDLLog(SDL_LOG_PRIORITY_INFO, "Nothing saved in state %d", SlotIndex + 1);
+    return;
+  }
+  if(State->RecordingHandle || State->PlaybackHandle)
+  {
+    // A recording only plays back right from the state it started in.
+    SDLLog(SDL_LOG_PRIORITY_INFO, "Not restoring state %d while recording or playing back", SlotIndex + 1);
+    return;
+  }
+
+  uint64 Start = SDL_GetPerformanceCounter();
+  GameMemory->PlatformAPI.CompleteAllWork(GameMemory->PlatformAPI.LowPriorityQueue);
+  memory_index BytesWritten = SDLCopyChangedPages(&GameMemory->PlatformAPI, GameMemory->PermanentStorage,
+                                                  Snapshot->Memory, GameMemory->PermanentStorageSize);
+  GameMemory->IsInitialized = Snapshot->IsInitialized;
+  // NOTE: The game's idea of what's on screen just went back in time too.
+  GlobalBackBuffer.OwnMemoryIsCurrent = false;
+  real32 RestoreMS = 1000.0f*SDLGetSecondsElapsed(Start, SDL_GetPerformanceCounter());
+
+  SDLLog(SDL_LOG_PRIORITY_INFO, "Restored state %d in %fms, writing %llu of %llu bytes", SlotIndex + 1, RestoreMS,
+         (unsigned long long)BytesWritten, (unsigned long long)GameMemory->PermanentStorageSize);
+}
+
+/*
+  NOTE: FNV-1a over the visible part of each row, a 64-bit word at a time.
+  Not a great hash, but cheap, and any change to a single pixel changes it.
+*/
+internal uint64
+SDLHashFrame(game_offscreen_buffer *Buffer)
+{
+  uint64 Hash = 0xcbf29ce484222325ull;
+  uint8 *Row = (uint8 *)Buffer->Memory;
+  int RowBytes = Buffer->Width * GetBytesPerPixel(Buffer->Format);
+  for(int Y = 0;
+      Y < Buffer->Height;
+      ++Y)
+  {
+    uint8 *Byte = Row;
+    int Remaining = RowBytes;
+    for(;
+        Remaining >= (int)sizeof(uint64);
+        Remaining -= sizeof(uint64), Byte += sizeof(uint64))
+    {
+      uint64 Word;
+      SDL_memcpy(&Word, Byte, sizeof(Word));
+      Hash = (Hash ^ Word) * 0x100000001b3ull;
+    }
+    for(;
+        Remaining > 0;
+        --Remaining, ++Byte)
+    {
+      Hash = (Hash ^ *Byte) * 0x100000001b3ull;
+    }
+
+    Row += Buffer->Pitch;
+  }
+
+  return(Hash);
+}
+
+/*
+  NOTE: The SDL formats that lay pixels out the way one of ours does. The X
+  ones just ignore the alpha byte, which the game never relies on. SDL's
+  indexed textures need a palette, and most renderers won't take them at
+  all, so Indexed8 goes up as RGB332, which is its palette spelled out.
+*/
+struct sdl_pixel_format_mapping
+{
+  Uint32 TextureFormat;
+  pixel_format Format;
+};
+
+global_variable sdl_pixel_format_mapping GlobalPixelFormatMappings[] =
+{
+  {SDL_PIXELFORMAT_BGRA32, PixelFormat_BGRA32},
+  {SDL_PIXELFORMAT_RGB888, PixelFormat_BGRA32},
+  {SDL_PIXELFORMAT_RGBA32, PixelFormat_RGBA32},
+  {SDL_PIXELFORMAT_BGR888, PixelFormat_RGBA32},
+  {SDL_PIXELFORMAT_RGB565, PixelFormat_RGB565},
+  {SDL_PIXELFORMAT_RGB332, PixelFormat_Indexed8},
+};
+
+/*
+  NOTE: Picks the first format the renderer lists (it lists its favourites
+  first) that the game can draw in, so frames go up without SDL converting
+  them. Passing a format in asks for that one; if the renderer doesn't list
+  it, SDL converts on upload.
+*/
+internal void
+SDLChoosePixelFormat(sdl_offscreen_buffer *Buffer, SDL_Renderer *Renderer, pixel_format Requested)
+{
+  Buffer->Format = PixelFormat_BGRA32;
+  Buffer->TextureFormat = SDL_PIXELFORMAT_BGRA32;
+
+  bool32 Found = false;
+  SDL_RendererInfo Info;
+  if (SDL_GetRendererInfo(Renderer, &Info) == 0)
+  {
+    for (Uint32 FormatIndex = 0;
+         !Found && (FormatIndex < Info.num_texture_formats);
+         ++FormatIndex)
+    {
+      for (int MappingIndex = 0;
+           MappingIndex < (int)ArrayCount(GlobalPixelFormatMappings);
+           ++MappingIndex)
+      {
+        sdl_pixel_format_mapping *Mapping = GlobalPixelFormatMappings + MappingIndex;
+        if ((Mapping->TextureFormat == Info.texture_formats[FormatIndex]) &&
+            ((Requested == PixelFormat_Count) || (Requested == Mapping->Format)))
+        {
+          Buffer->Format = Mapping->Format;
+          Buffer->TextureFormat = Mapping->TextureFormat;
+          Found = true;
+          break;
+        }
+      }
+    }
+  }
+
+  if (!Found && (Requested != PixelFormat_Count))
+  {
+    for (int MappingIndex = 0;
+         MappingIndex < (int)ArrayCount(GlobalPixelFormatMappings);
+         ++MappingIndex)
+    {
+      if (GlobalPixelFormatMappings[MappingIndex].Format == Requested)
+      {
+        Buffer->Format = Requested;
+        Buffer->TextureFormat = GlobalPixelFormatMappings[MappingIndex].TextureFormat;
+        break;
+      }
+    }
+    SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "The renderer doesn't take %s textures as they are; SDL will convert them",
+                SDL_GetPixelFormatName(Buffer->TextureFormat));
+  }
+}
+
+internal void
+SDLCreateBufferTexture(sdl_offscreen_buffer *Buffer, SDL_Renderer *Renderer, int Width, int Height)
+{
+  // NOTE: A new texture comes off the heap, and so can whatever the renderer
+  // sets up for it on its first few uses.
+  DEBUG_RESTART_HEAP_WARMUP();
+  // Free any previously created texture.
+  if (Buffer->Texture)
+  {
+    // SDL_LogDebug(SDL_LOG_CATEGORY_APPLICATION, "texture exists: destroying");
+    SDL_DestroyTexture(Buffer->Texture);
+  }
+  Buffer->IsLocked = false;
+  Buffer->TextureIsCurrent = false;
+
+  // Let the renderer smooth the picture if it's the one stretching it.
+  SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, (Buffer->ScaleMode == ScaleMode_Renderer) ? "linear" : "nearest");
+
+  // SDL_LogDebug(SDL_LOG_CATEGORY_APPLICATION, "creating new texture");
+  // Create new texture buffer.
+  Buffer->Texture = SDL_CreateTexture(Renderer,
+                              /**
+                               * This describes the format of our pixel data, which is
+                               * whichever of the game's formats the renderer takes as
+                               * it is; see SDLChoosePixelFormat.
+                               */
+                              Buffer->TextureFormat,
+                              // A hint for the graphics driver about how we will access the texture.
+                              SDL_TEXTUREACCESS_STREAMING,
+                              Width,
+                              Height);
+  Buffer->TextureWidth = Width;
+  Buffer->TextureHeight = Height;
+
+#if HANDMADE_TEXTURE_COPY
+  Buffer->UseTextureLock = false;
+#else
+  // Make sure this renderer will actually let us draw into the texture directly.
+  void *LockedMemory;
+  int LockedPitch;
+  Buffer->UseTextureLock = (SDL_LockTexture(Buffer->Texture, NULL, &LockedMemory, &LockedPitch) == 0);
+  if (Buffer->UseTextureLock)
+  {
+    SDL_UnlockTexture(Buffer->Texture);
+  }
+#endif
+}
+
+internal void
+SDLResizeBuffer(sdl_offscreen_buffer *Buffer, SDL_Renderer *Renderer, int Width, int Height)
+{
+  // TODO: Bulletproof this.
+  // Maybe don't free first, free after, then free first if that fails.
+
+  // Free any previously created memory.
+  if (Buffer->OwnMemory)
+  {
+    // SDL_LogDebug(SDL_LOG_CATEGORY_APPLICATION, "bitmap exits: freeing");
+    free(Buffer->OwnMemory);
+    Buffer->OwnMemory = 0;
+  }
+  Buffer->Memory = 0;
+  DEBUG_RESTART_HEAP_WARMUP();
+
+  Buffer->Width = Width;
+  Buffer->Height = Height;
+  Buffer->BytesPerPixel = GetBytesPerPixel(Buffer->Format);
+
+  // NOTE: Always there, since we go back to it whenever the screen settles.
+  SDLAllocateOwnMemory(Buffer);
+  Buffer->DrawIntoTexture = false;
+
+  // Scaling in software, the texture is sized to fit the window instead.
+  if (!SDLIsScaledInSoftware(Buffer))
+  {
+    SDLCreateBufferTexture(Buffer, Renderer, Width, Height);
+  }
+}
+
+/*
+  NOTE: Works out where the buffer goes in a window this size. Natively that
+  means resizing the buffer to match; otherwise it's letterboxed, and
+  scaling in software gets a texture of the letterboxed size to scale into.
+*/
+internal void
+SDLFitBufferToWindow(sdl_offscreen_buffer *Buffer, SDL_Renderer *Renderer, int WindowWidth, int WindowHeight)
+{
+  if ((WindowWidth <= 0) || (WindowHeight <= 0))
+  {
+    return;
+  }
+
+  if (Buffer->ScaleMode == ScaleMode_Native)
+  {
+    if ((Buffer->Width != WindowWidth) || (Buffer->Height != WindowHeight))
+    {
+      SDLResizeBuffer(Buffer, Renderer, WindowWidth, WindowHeight);
+    }
+    Buffer->DestRect = {0, 0, WindowWidth, WindowHeight};
+    return;
+  }
+
+  // The biggest picture with the buffer's aspect ratio that fits...
+  int DestWidth = WindowWidth;
+  int DestHeight = (int)(((int64)WindowWidth * Buffer->Height) / Buffer->Width);
+  if (DestHeight > WindowHeight)
+  {
+    DestHeight = WindowHeight;
+    DestWidth = (int)(((int64)WindowHeight * Buffer->Width) / Buffer->Height);
+  }
+  if (Buffer->ScaleMode == ScaleMode_Integer)
+  {
+    // ...or in whole pixels. A window smaller than the buffer still gets
+    // the fractional shrink, though.
+    int Scale = WindowWidth / Buffer->Width;
+    if (Scale > WindowHeight / Buffer->Height)
+    {
+      Scale = WindowHeight / Buffer->Height;
+    }
+    if (Scale >= 1)
+    {
+      DestWidth = Scale * Buffer->Width;
+      DestHeight = Scale * Buffer->Height;
+    }
+  }
+  if (DestWidth < 1) DestWidth = 1;
+  if (DestHeight < 1) DestHeight = 1;
+
+  // ...in the middle of the window.
+  Buffer->DestRect = {(WindowWidth - DestWidth) / 2, (WindowHeight - DestHeight) / 2, DestWidth, DestHeight};
+
+  if (SDLIsScaledInSoftware(Buffer) && (Buffer->BytesPerPixel != 4))
+  {
+    // NOTE: The software scaler only works in 32-bit pixels.
+    SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Can't scale %d-bit pixels in software; leaving it to the renderer",
+                 8*Buffer->BytesPerPixel);
+    Buffer->ScaleMode = ScaleMode_Renderer;
+    SDLCreateBufferTexture(Buffer, Renderer, Buffer->Width, Buffer->Height);
+  }
+  else if (SDLIsScaledInSoftware(Buffer) &&
+      (!Buffer->Texture || (Buffer->TextureWidth != DestWidth) || (Buffer->TextureHeight != DestHeight)))
+  {
+    scale_filter Filter = (Buffer->ScaleMode == ScaleMode_Bilinear) ? ScaleFilter_Bilinear : ScaleFilter_Nearest;
+    if (InitializeScaler(Buffer->Scaler, Filter, Buffer->Width, Buffer->Height, DestWidth, DestHeight))
+    {
+      SDLCreateBufferTexture(Buffer, Renderer, DestWidth, DestHeight);
+    }
+    else
+    {
+      SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Can't scale %dx%d to %dx%d in software; leaving it to the renderer",
+                   Buffer->Width, Buffer->Height, DestWidth, DestHeight);
+      Buffer->ScaleMode = ScaleMode_Renderer;
+      SDLCreateBufferTexture(Buffer, Renderer, Buffer->Width, Buffer->Height);
+    }
+  }
+}
+
+internal void
+SDLProcessKeyboardMessage(game_button_state *NewState, bool32 IsDown)
+{
+  if(NewState->EndedDown != IsDown)
+  {
+    NewState->EndedDown = IsDown;
+    ++NewState->HalfTransitionCount;
+  }
+}
+
+// Maps -32768..32767 to -1..1, with everything inside the deadzone at 0.
+inline real32
+SDLProcessStickValue(int16 Value, int16 DeadZone)
+{
+  real32 Result = 0;
+  if(Value < -DeadZone)
+  {
+    Result = (real32)(Value + DeadZone) / (32768.0f - DeadZone);
+  }
+  else if(Value > DeadZone)
+  {
+    Result = (real32)(Value - DeadZone) / (32767.0f - DeadZone);
+  }
+  return(Result);
+}
+
+internal game_button_state *
+SDLGetGameControllerButton(game_controller_input *Controller, uint8 Button)
+{
+  game_button_state *Result = 0;
+  switch(Button)
+  {
+    case SDL_CONTROLLER_BUTTON_DPAD_UP: Result = &Controller->MoveUp; break;
+    case SDL_CONTROLLER_BUTTON_DPAD_DOWN: Result = &Controller->MoveDown; break;
+    case SDL_CONTROLLER_BUTTON_DPAD_LEFT: Result = &Controller->MoveLeft; break;
+    case SDL_CONTROLLER_BUTTON_DPAD_RIGHT: Result = &Controller->MoveRight; break;
+    case SDL_CONTROLLER_BUTTON_Y: Result = &Controller->ActionUp; break;
+    case SDL_CONTROLLER_BUTTON_A: Result = &Controller->ActionDown; break;
+    case SDL_CONTROLLER_BUTTON_X: Result = &Controller->ActionLeft; break;
+    case SDL_CONTROLLER_BUTTON_B: Result = &Controller->ActionRight; break;
+    case SDL_CONTROLLER_BUTTON_LEFTSHOULDER: Result = &Controller->LeftShoulder; break;
+    case SDL_CONTROLLER_BUTTON_RIGHTSHOULDER: Result = &Controller->RightShoulder; break;
+    case SDL_CONTROLLER_BUTTON_BACK: Result = &Controller->Back; break;
+    case SDL_CONTROLLER_BUTTON_START: Result = &Controller->Start; break;
+  }
+  return(Result);
+}
+
+// Which game_input controller a gamepad event is about, or 0 if we didn't open it.
+internal game_controller_input *
+SDLGetEventController(sdl_state *State, game_input *NewInput, SDL_JoystickID InstanceID)
+{
+  game_controller_input *Result = 0;
+  for(int ControllerIndex = 0;
+      ControllerIndex < MAX_CONTROLLERS;
+      ++ControllerIndex)
+  {
+    if(State->Controllers[ControllerIndex] && (State->ControllerIDs[ControllerIndex] == InstanceID))
+    {
+      Result = GetController(NewInput, ControllerIndex + 1);
+      break;
+    }
+  }
+  return(Result);
+}
+
+internal void
+SDLOpenGameController(sdl_state *State, int JoystickIndex)
+{
+  if(!SDL_IsGameController(JoystickIndex))
+  {
+    // Ignore any unsupported controllers
+    return;
+  }
+
+  // NOTE: SDL can send more than one added event for the same gamepad:
+  // one when it's found, and another if a mapping for it turns up later.
+  SDL_JoystickID InstanceID = SDL_JoystickGetDeviceInstanceID(JoystickIndex);
+  int FreeIndex = -1;
+  for(int ControllerIndex = 0;
+      ControllerIndex < MAX_CONTROLLERS;
+      ++ControllerIndex)
+  {
+    if(!State->Controllers[ControllerIndex])
+    {
+      if(FreeIndex == -1)
+      {
+        FreeIndex = ControllerIndex;
+      }
+    }
+    else if(State->ControllerIDs[ControllerIndex] == InstanceID)
+    {
+      return;
+    }
+  }
+
+  if(FreeIndex != -1)
+  {
+    // NOTE: Opening a controller goes to the heap, from inside the frame.
+    DEBUG_RESTART_HEAP_WARMUP();
+    // Initialize the controller and save a reference to it
+    SDL_GameController *Controller = SDL_GameControllerOpen(JoystickIndex);
+    if(Controller)
+    {
+      State->Controllers[FreeIndex] = Controller;
+      State->ControllerIDs[FreeIndex] = SDL_JoystickInstanceID(SDL_GameControllerGetJoystick(Controller));
+    }
+  }
+}
+
+internal void
+SDLCloseGameController(sdl_state *State, SDL_JoystickID InstanceID)
+{
+  for(int ControllerIndex = 0;
+      ControllerIndex < MAX_CONTROLLERS;
+      ++ControllerIndex)
+  {
+    if(State->Controllers[ControllerIndex] && (State->ControllerIDs[ControllerIndex] == InstanceID))
+    {
+      SDL_GameControllerClose(State->Controllers[ControllerIndex]);
+      State->Controllers[ControllerIndex] = 0;
+    }
+  }
+}
+
+/*
+  NOTE: Starts the next update's input off where the last one's ended:
+  buttons stay down, sticks stay put, and only the transition counts start
+  over. Gamepads only say anything when something changes, so everything
+  the events before the next update don't touch has to carry over like
+  this. A frame that runs no update leaves its events to the next one.
+*/
+internal void
+SDLBeginInputUpdate(sdl_state *State, game_input *OldInput, game_input *NewInput)
+{
+  for(int ControllerIndex = 0;
+      ControllerIndex < (int)ArrayCount(NewInput->Controllers);
+      ++ControllerIndex)
+  {
+    game_controller_input *OldController = GetController(OldInput, ControllerIndex);
+    game_controller_input *NewController = GetController(NewInput, ControllerIndex);
+    *NewController = *OldController;
+    for(int ButtonIndex = 0;
+        ButtonIndex < (int)ArrayCount(NewController->Buttons);
+        ++ButtonIndex)
+    {
+      NewController->Buttons[ButtonIndex].HalfTransitionCount = 0;
+    }
+  }
+
+  GetController(NewInput, 0)->IsConnected = true;
+  for(int ControllerIndex = 0;
+      ControllerIndex < MAX_CONTROLLERS;
+      ++ControllerIndex)
+  {
+    game_controller_input *NewController = GetController(NewInput, ControllerIndex + 1);
+    if(State->Controllers[ControllerIndex])
+    {
+      NewController->IsConnected = true;
+      NewController->IsAnalog = true;
+    }
+    else if(NewController->IsConnected)
+    {
+      // Unplugged: nothing is held down any more.
+      *NewController = {};
+    }
+  }
+}
+
+internal void
+SDLHandleEvent(SDL_Event *Event, sdl_state *State, game_input *NewInput)
+{
+  game_controller_input *KeyboardController = GetController(NewInput, 0);
+  switch(Event->type)
+  {
+    case SDL_WINDOWEVENT:
+    {
+      switch(Event->window.event)
+      {
+        case SDL_WINDOWEVENT_CLOSE:
+        {
+          // TODO: Handle this with message to the user?
+          Running = false;
+        } break;
+
+        // This is the main "paint" event.
+        case SDL_WINDOWEVENT_EXPOSED:
+        {
+          // SDL_LogDebug(SDL_LOG_CATEGORY_APPLICATION, "window exposed");
+
+          SDL_Window *Window = SDL_GetWindowFromID(Event->window.windowID);
+          SDL_Renderer *Renderer = SDL_GetRenderer(Window);
+          SDLDisplayBufferInWindow(&GlobalBackBuffer, Renderer, 0, 0);
+        } break;
+
+        case SDL_WINDOWEVENT_SIZE_CHANGED:
+        {
+          SDL_Window *Window = SDL_GetWindowFromID(Event->window.windowID);
+          SDL_Renderer *Renderer = SDL_GetRenderer(Window);
+          SDLFitBufferToWindow(&GlobalBackBuffer, Renderer, Event->window.data1, Event->window.data2);
+        } break;
+      }
+    } break;
+
+    case SDL_KEYUP:
+    case SDL_KEYDOWN:
+    {
+      SDL_Keycode KeyCode = Event->key.keysym.sym;
+      bool WasDown = (Event->key.state == SDL_RELEASED) || Event->key.repeat;
+      bool IsDown = Event->key.state == SDL_PRESSED;
+
+      if (IsDown != WasDown)
+      {
+        switch(KeyCode)
+        {
+          case SDLK_w:
+          {
+            SDLLog(SDL_LOG_PRIORITY_DEBUG, "w");
+            SDLProcessKeyboardMessage(&KeyboardController->MoveUp, IsDown);
+          } break;
+
+          case SDLK_a:
+          {
+            SDLLog(SDL_LOG_PRIORITY_DEBUG, "a");
+            SDLProcessKeyboardMessage(&KeyboardController->MoveLeft, IsDown);
+          } break;
+
+          case SDLK_s:
+          {
+            SDLLog(SDL_LOG_PRIORITY_DEBUG, "s");
+            SDLProcessKeyboardMessage(&KeyboardController->MoveDown, IsDown);
+          } break;
+
+          case SDLK_d:
+          {
+            SDLLog(SDL_LOG_PRIORITY_DEBUG, "d");
+            SDLProcessKeyboardMessage(&KeyboardController->MoveRight, IsDown);
+          } break;
+
+          case SDLK_q:
+          {
+            SDLLog(SDL_LOG_PRIORITY_DEBUG, "q");
+            SDLProcessKeyboardMessage(&KeyboardController->LeftShoulder, IsDown);
+          } break;
+
+          case SDLK_e:
+          {
+            SDLLog(SDL_LOG_PRIORITY_DEBUG, "e");
+            SDLProcessKeyboardMessage(&KeyboardController->RightShoulder, IsDown);
+          } break;
+
+          case SDLK_UP:
+          {
+            SDLLog(SDL_LOG_PRIORITY_DEBUG, "up");
+            SDLProcessKeyboardMessage(&KeyboardController->ActionUp, IsDown);
+          } break;
+
+          case SDLK_DOWN:
+          {
+            SDLLog(SDL_LOG_PRIORITY_DEBUG, "down");
+            SDLProcessKeyboardMessage(&KeyboardController->ActionDown, IsDown);
+          } break;
+
+          case SDLK_LEFT:
+          {
+            SDLLog(SDL_LOG_PRIORITY_DEBUG, "left");
+            SDLProcessKeyboardMessage(&KeyboardController->ActionLeft, IsDown);
+          } break;
+
+          case SDLK_RIGHT:
+          {
+            SDLLog(SDL_LOG_PRIORITY_DEBUG, "right");
+            SDLProcessKeyboardMessage(&KeyboardController->ActionRight, IsDown);
+          } break;
+
+          case SDLK_ESCAPE:
+          {
+            SDLLog(SDL_LOG_PRIORITY_DEBUG, "escape");
+            SDLProcessKeyboardMessage(&KeyboardController->Back, IsDown);
+          } break;
+
+          case SDLK_SPACE:
+          {
+            SDLLog(SDL_LOG_PRIORITY_DEBUG, "space");
+            SDLProcessKeyboardMessage(&KeyboardController->Start, IsDown);
+          } break;
+
+          // F1-F4 restore a save state; with shift held they save one.
+          case SDLK_F1:
+          case SDLK_F2:
+          case SDLK_F3:
+          case SDLK_F4:
+          {
+            if(IsDown)
+            {
+              int SlotIndex = KeyCode - SDLK_F1;
+              if(Event->key.keysym.mod & KMOD_SHIFT)
+              {
+                SDLSaveSnapshot(State, SlotIndex);
+              }
+              else
+              {
+                SDLRestoreSnapshot(State, SlotIndex);
+              }
+            }
+          } break;
+
+#if HANDMADE_INTERNAL
+          case SDLK_l:
+          {
+            if(IsDown)
+            {
+              SDLCycleInputRecording(State);
+            }
+          } break;
+#endif
+
+          default:
+          {
+          } break;
+        }
+      }
+    } break;
+
+    case SDL_CONTROLLERBUTTONDOWN:
+    case SDL_CONTROLLERBUTTONUP:
+    {
+      game_controller_input *Controller = SDLGetEventController(State, NewInput, Event->cbutton.which);
+      game_button_state *Button = Controller ? SDLGetGameControllerButton(Controller, Event->cbutton.button) : 0;
+      if(Button)
+      {
+        SDLProcessKeyboardMessage(Button, Event->cbutton.state == SDL_PRESSED);
+      }
+    } break;
+
+    case SDL_CONTROLLERAXISMOTION:
+    {
+      game_controller_input *Controller = SDLGetEventController(State, NewInput, Event->caxis.which);
+      if(Controller)
+      {
+        if(Event->caxis.axis == SDL_CONTROLLER_AXIS_LEFTX)
+        {
+          Controller->StickAverageX = SDLProcessStickValue(Event->caxis.value, STICK_DEADZONE);
+        }
+        else if(Event->caxis.axis == SDL_CONTROLLER_AXIS_LEFTY)
+        {
+          Controller->StickAverageY = SDLProcessStickValue(Event->caxis.value, STICK_DEADZONE);
+        }
+      }
+    } break;
+
+#if HANDMADE_SLOW
+    case SDL_JOYDEVICEADDED:
+    {
+      // NOTE: SDL has already gone to the heap for any device it finds,
+      // whether or not it turns out to be a gamepad we open.
+      DEBUG_RESTART_HEAP_WARMUP();
+    } break;
+#endif
+
+    case SDL_CONTROLLERDEVICEADDED:
+    {
+      SDLOpenGameController(State, Event->cdevice.which);
+    } break;
+
+    case SDL_CONTROLLERDEVICEREMOVED:
+    {
+      SDLCloseGameController(State, Event->cdevice.which);
+    } break;
+
+    default:
+    {
+      // SDL_LogDebug("default");
+    } break;
+  }
+}
+
+internal sdl_window_dimension
+SDLGetWindowDimension(SDL_Window *Window)
+{
+  sdl_window_dimension Result;
+  SDL_GetWindowSize(Window, &Result.Width, &Result.Height);
+  return(Result);
+}
+
+/*
+  NOTE: A startup task, once the game controller subsystem is up: adds
+  the mappings SDL doesn't come with. Nothing gets opened here. SDL sends
+  an added event for every gamepad already plugged in, and for any a new
+  mapping turns into one, and the main thread opens them as those come
+  in, like any other hotplug.
+*/
+internal int
+SDLAddGameControllerMappings(void *Data)
+{
+  if (SDL_GameControllerAddMapping(JOY_CON_L_MAPPING) == -1)
+  {
+    SDL_LogCritical(SDL_LOG_CATEGORY_APPLICATION, "Failed to add mapping for Joy-Con (L) controller: %s", SDL_GetError());
+  }
+  if (SDL_GameControllerAddMapping(JOY_CON_R_MAPPING) == -1)
+  {
+    SDL_LogCritical(SDL_LOG_CATEGORY_APPLICATION, "Failed to add mapping for Joy-Con (R) controller: %s", SDL_GetError());
+  }
+
+  return(0);
+}
+
+internal void
+SDLStopGameControllers(sdl_state *State)
+{
+  for (int ControllerIndex = 0;
+       ControllerIndex < MAX_CONTROLLERS;
+       ++ControllerIndex)
+  {
+    SDL_GameController *Controller = State->Controllers[ControllerIndex];
+    if (Controller)
+    {
+      SDL_GameControllerClose(Controller);
+    }
+    State->Controllers[ControllerIndex] = 0;
+  }
+}
+
+/*
+  NOTE: Runs on SDL's audio thread whenever the device wants more sound.
+  It must never block, so if we haven't written far enough ahead it plays
+  silence for the difference and counts an underrun.
+*/
+internal void
+SDLAudioCallback(void *UserData, Uint8 *AudioData, int Length)
+{
+  sdl_audio_ring_buffer *RingBuffer = (sdl_audio_ring_buffer *)UserData;
+
+  uint32 ReadCount = (uint32)SDL_AtomicGet(&RingBuffer->ReadCount);
+  uint32 BytesAvailable = (uint32)SDL_AtomicGet(&RingBuffer->WriteCount) - ReadCount;
+  uint32 BytesToCopy = ((uint32)Length < BytesAvailable) ? (uint32)Length : BytesAvailable;
+
+  // The bytes we want may wrap around the end of the ring.
+  uint32 ReadOffset = ReadCount & (RingBuffer->Size - 1);
+  uint32 Region1Size = BytesToCopy;
+  if (Region1Size > (RingBuffer->Size - ReadOffset))
+  {
+    Region1Size = RingBuffer->Size - ReadOffset;
+  }
+  uint32 Region2Size = BytesToCopy - Region1Size;
+  SDL_memcpy(AudioData, RingBuffer->Data + ReadOffset, Region1Size);
+  SDL_memcpy(AudioData + Region1Size, RingBuffer->Data, Region2Size);
+
+  if (BytesToCopy < (uint32)Length)
+  {
+    SDL_memset(AudioData + BytesToCopy, RingBuffer->Silence, Length - BytesToCopy);
+    SDL_AtomicIncRef(&RingBuffer->UnderrunCount);
+  }
+
+  // Publishing the new read count hands the bytes back to the writer.
+  SDL_AtomicAdd(&RingBuffer->ReadCount, (int)BytesToCopy);
+}
+
+/*
+  NOTE: Opens the device paused, and takes whatever rate, format and
+  channel count it came back with; everything we write from then on is
+  made to fit that. If it doesn't open, the sound output stays 16-bit
+  stereo at the rate we asked for, and just never gets played. Runs on a
+  startup thread, so it logs through SDL rather than taking a log ring.
+*/
+internal SDL_AudioDeviceID
+SDLInitializeAudio(sdl_sound_output *SoundOutput)
+{
+  SDL_AudioSpec DesiredSettings, ActualSettings;
+
+  SDL_memset(&DesiredSettings, 0, sizeof(DesiredSettings)); // zero-out the memory
+  DesiredSettings.freq = SoundOutput->SamplesPerSecond;
+  DesiredSettings.format = AUDIO_S16SYS; // signed 16-bit samples in native byte order
+  DesiredSettings.channels = 2;
+  DesiredSettings.samples = SoundOutput->SampleCount;
+  DesiredSettings.callback = SDLAudioCallback;
+  DesiredSettings.userdata = &SoundOutput->RingBuffer;
+
+  SDL_AudioDeviceID OpenedAudioDevice = SDL_OpenAudioDevice(0, 0, &DesiredSettings, &ActualSettings, SDL_AUDIO_ALLOW_ANY_CHANGE);
+  if (!OpenedAudioDevice)
+  {
+    // TODO: We failed to open the audio device. Do something about it.
+    SDL_LogCritical(SDL_LOG_CATEGORY_APPLICATION, "Unable to initialize audio: %s", SDL_GetError());
+    return(OpenedAudioDevice);
+  }
+
+  SoundOutput->SamplesPerSecond = ActualSettings.freq;
+  SoundOutput->Format = ActualSettings.format;
+  SoundOutput->ChannelCount = ActualSettings.channels;
+  SoundOutput->BytesPerSample = ActualSettings.channels * (SDL_AUDIO_BITSIZE(ActualSettings.format) / 8);
+  SoundOutput->RingBuffer.Silence = ActualSettings.silence;
+
+  // The device holds on to this many samples on top of whatever is in our ring.
+  SoundOutput->SampleCount = ActualSettings.samples;
+
+  SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Audio at %dHz, %d channels, %d-bit %s%s samples, %d in the device buffer",
+         ActualSettings.freq, ActualSettings.channels, SDL_AUDIO_BITSIZE(ActualSettings.format),
+         SDL_AUDIO_ISFLOAT(ActualSettings.format) ? "float" : (SDL_AUDIO_ISSIGNED(ActualSettings.format) ? "signed" : "unsigned"),
+         SDL_AUDIO_ISBIGENDIAN(ActualSettings.format) ? " big-endian" : "", ActualSettings.samples);
+
+  return(OpenedAudioDevice);
+}
+
+internal void
+SDLAddEntry(platform_work_queue *Queue, platform_work_queue_callback *Callback, void *Data)
+{
+  int EntryToWrite = SDL_AtomicGet(&Queue->NextEntryToWrite);
+  int NewNextEntryToWrite = (EntryToWrite + 1) % ArrayCount(Queue->Entries);
+  // TODO: Grow the ring (or block) instead of asserting when it's full.
+  Assert(NewNextEntryToWrite != SDL_AtomicGet(&Queue->NextEntryToRead));
+
+  platform_work_queue_entry *Entry = Queue->Entries + EntryToWrite;
+  Entry->Callback = Callback;
+  Entry->Data = Data;
+  ++Queue->CompletionGoal;
+
+  // Publishing the new write index is a full barrier, so the entry is visible
+  // to any worker that sees the index move.
+  SDL_AtomicSet(&Queue->NextEntryToWrite, NewNextEntryToWrite);
+  SDL_SemPost(Queue->SemaphoreHandle);
+}
+
+// Returns true when there was nothing left to claim.
+internal bool32
+SDLDoNextWorkQueueEntry(platform_work_queue *Queue)
+{
+  bool32 WeShouldSleep = false;
+
+  int OriginalNextEntryToRead = SDL_AtomicGet(&Queue->NextEntryToRead);
+  int NewNextEntryToRead = (OriginalNextEntryToRead + 1) % ArrayCount(Queue->Entries);
+  if (OriginalNextEntryToRead != SDL_AtomicGet(&Queue->NextEntryToWrite))
+  {
+    // Whoever wins the swap owns the entry; everyone else just tries again.
+    if (SDL_AtomicCAS(&Queue->NextEntryToRead, OriginalNextEntryToRead, NewNextEntryToRead))
+    {
+      platform_work_queue_entry Entry = Queue->Entries[OriginalNextEntryToRead];
+      Entry.Callback(Queue, Entry.Data);
+      SDL_AtomicIncRef(&Queue->CompletionCount);
+    }
+  }
+  else
+  {
+    WeShouldSleep = true;
+  }
+
+  return(WeShouldSleep);
+}
+
+internal void
+SDLCompleteAllWork(platform_work_queue *Queue)
+{
+  // Rather than sit idle, the main thread pitches in until everything is done.
+  while (Queue->CompletionGoal != SDL_AtomicGet(&Queue->CompletionCount))
+  {
+    SDLDoNextWorkQueueEntry(Queue);
+  }
+
+  Queue->CompletionGoal = 0;
+  SDL_AtomicSet(&Queue->CompletionCount, 0);
+}
+
+internal int
+SDLWorkerThreadProc(void *Parameter)
+{
+  platform_work_queue *Queue = (platform_work_queue *)Parameter;
+  for (;;)
+  {
+    if (SDLDoNextWorkQueueEntry(Queue))
+    {
+      SDL_SemWait(Queue->SemaphoreHandle);
+    }
+  }
+
+  // NOTE: Workers live for the whole run of the program.
+  return(0);
+}
+
+internal void
+SDLMakeQueue(platform_work_queue *Queue, int ThreadCount)
+{
+  Queue->CompletionGoal = 0;
+  SDL_AtomicSet(&Queue->CompletionCount, 0);
+  SDL_AtomicSet(&Queue->NextEntryToWrite, 0);
+  SDL_AtomicSet(&Queue->NextEntryToRead, 0);
+  Queue->SemaphoreHandle = SDL_CreateSemaphore(0);
+
+  for (int ThreadIndex = 0;
+       ThreadIndex < ThreadCount;
+       ++ThreadIndex)
+  {
+    SDL_Thread *Thread = SDL_CreateThread(SDLWorkerThreadProc, "HandmadeWorker", Queue);
+    if (!Thread)
+    {
+      // Not fatal: the main thread can always do the work itself.
+      SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Failed to launch worker thread: %s", SDL_GetError());
+      continue;
+    }
+    SDL_DetachThread(Thread);
+  }
+}
+
+/*
+  NOTE: Converts Count stereo 16-bit samples into the device's format. Mono
+  devices get the average of the two channels, and any channels past the
+  first two get silence.
+*/
+internal void
+SDLConvertSamples(sdl_sound_output *SoundOutput, int16 *Source, uint8 *Dest, int Count)
+{
+  SDL_AudioFormat Format = SoundOutput->Format;
+  int BytesPerChannel = SDL_AUDIO_BITSIZE(Format) / 8;
+
+  if ((Format == AUDIO_F32SYS) && (SoundOutput->ChannelCount == 2))
+  {
+    // NOTE: The usual one when we don't get 16-bit, so it gets its own loop.
+    real32 *Out = (real32 *)Dest;
+    for (int SampleIndex = 0; SampleIndex < 2*Count; ++SampleIndex)
+    {
+      Out[SampleIndex] = (1.0f / 32768.0f)*(real32)Source[SampleIndex];
+    }
+    return;
+  }
+
+  for (int SampleIndex = 0; SampleIndex < Count; ++SampleIndex)
+  {
+    int16 Left = Source[2*SampleIndex + 0];
+    int16 Right = Source[2*SampleIndex + 1];
+    for (int Channel = 0; Channel < SoundOutput->ChannelCount; ++Channel)
+    {
+      int32 Value = 0;
+      if (SoundOutput->ChannelCount == 1)
+      {
+        Value = ((int32)Left + (int32)Right) / 2;
+      }
+      else if (Channel < 2)
+      {
+        Value = (Channel == 0) ? Left : Right;
+      }
+
+      // NOTE: Build the sample as a number, then lay its bytes down in the device's order.
+      uint32 Bits;
+      if (SDL_AUDIO_ISFLOAT(Format))
+      {
+        real32 FloatValue = (1.0f / 32768.0f)*(real32)Value;
+        SDL_memcpy(&Bits, &FloatValue, sizeof(Bits));
+      }
+      else
+      {
+        // Shift the 16 bits to the top of however many the device has.
+        Bits = (BytesPerChannel >= 2) ? ((uint32)Value << (8*BytesPerChannel - 16)) : ((uint32)Value >> 8);
+        if (!SDL_AUDIO_ISSIGNED(Format))
+        {
+          Bits ^= (1u << (8*BytesPerChannel - 1));
+        }
+      }
+
+      for (int ByteIndex = 0; ByteIndex < BytesPerChannel; ++ByteIndex)
+      {
+        int Shift = SDL_AUDIO_ISBIGENDIAN(Format) ? (8*(BytesPerChannel - 1 - ByteIndex)) : (8*ByteIndex);
+        *Dest++ = (uint8)(Bits >> Shift);
+      }
+    }
+  }
+}
+
+// Copies the samples the game produced into the ring, behind the write cursor.
+internal void
+SDLFillSoundBuffer(sdl_sound_output* SoundOutput, game_sound_output_buffer *SourceBuffer)
+{
+  sdl_audio_ring_buffer *RingBuffer = &SoundOutput->RingBuffer;
+  uint32 BytesToWrite = SourceBuffer->SampleCount * SoundOutput->BytesPerSample;
+  if (!BytesToWrite) return;
+
+  // NOTE: 16-bit stereo goes straight in as the game wrote it.
+  uint8 *Source = (uint8 *)SourceBuffer->Samples;
+  if ((SoundOutput->Format != AUDIO_S16SYS) || (SoundOutput->ChannelCount != 2))
+  {
+    SDLConvertSamples(SoundOutput, SourceBuffer->Samples, SoundOutput->DeviceSamples, SourceBuffer->SampleCount);
+    Source = SoundOutput->DeviceSamples;
+  }
+
+  uint32 WriteCount = (uint32)SDL_AtomicGet(&RingBuffer->WriteCount);
+  uint32 BytesFree = RingBuffer->Size - (WriteCount - (uint32)SDL_AtomicGet(&RingBuffer->ReadCount));
+  if (BytesToWrite > BytesFree)
+  {
+    // NOTE: Whole samples only. With, say, six 16-bit channels a sample is
+    // 12 bytes, which doesn't divide the ring, and a partial one would shift
+    // every sample after it.
+    ++RingBuffer->OverrunCount;
+    BytesToWrite = BytesFree - (BytesFree % SoundOutput->BytesPerSample);
+  }
+
+  // The bytes we write may wrap around the end of the ring.
+  uint32 WriteOffset = WriteCount & (RingBuffer->Size - 1);
+  uint32 Region1Size = BytesToWrite;
+  if (Region1Size > (RingBuffer->Size - WriteOffset))
+  {
+    Region1Size = RingBuffer->Size - WriteOffset;
+  }
+  uint32 Region2Size = BytesToWrite - Region1Size;
+  SDL_memcpy(RingBuffer->Data + WriteOffset, Source, Region1Size);
+  SDL_memcpy(RingBuffer->Data, Source + Region1Size, Region2Size);
+
+  // Publishing the new write count hands the samples to the audio callback.
+  SDL_AtomicAdd(&RingBuffer->WriteCount, (int)BytesToWrite);
+  SoundOutput->WriteCursor += BytesToWrite / SoundOutput->BytesPerSample;
+}
+
+internal
+PLATFORM_GET_AUDIO_CURSORS(SDLGetAudioCursors)
+{
+  sdl_sound_output *SoundOutput = &GlobalSoundOutput;
+  sdl_audio_ring_buffer *RingBuffer = &SoundOutput->RingBuffer;
+
+  // NOTE: No sound until the device is open.
+  game_audio_cursors Result = {};
+  if (!SDL_AtomicGet(&SoundOutput->IsReady))
+  {
+    return(Result);
+  }
+  // NOTE: Bytes queued first, then samples, so it comes out right across
+  // the counts wrapping.
+  uint32 BytesQueued = (uint32)SDL_AtomicGet(&RingBuffer->WriteCount) - (uint32)SDL_AtomicGet(&RingBuffer->ReadCount);
+  Result.SamplesPerSecond = SoundOutput->SamplesPerSecond;
+  Result.WriteCursor = SoundOutput->WriteCursor;
+  Result.PlayCursor = Result.WriteCursor - BytesQueued / SoundOutput->BytesPerSample;
+  Result.LatencySampleCount = SoundOutput->LatencySampleCount;
+
+  return(Result);
+}
+
+/*
+  NOTE: Grabs a block of zeroed pages straight from the OS. Everything the
+  game ever allocates comes out of blocks like this one, reserved once up
+  front, so nothing in the frame loop has to go to the heap.
+
+  BaseAddress is only a hint; if something already lives there we take
+  whatever the OS gives us. Build with HANDMADE_HUGE_PAGES=1 to back the block
+  with huge pages, which cuts TLB misses when walking large buffers.
+*/
+internal void *
+SDLAllocateMemory(void *BaseAddress, memory_index Size)
+{
+  int Protection = PROT_READ | PROT_WRITE;
+  int Flags = MAP_PRIVATE | MAP_ANONYMOUS;
+  void *Result = MAP_FAILED;
+
+#if HANDMADE_HUGE_PAGES && defined(MAP_HUGETLB)
+  // Explicit huge pages have to be set aside by the OS ahead of time
+  // (vm.nr_hugepages), so this can fail on a perfectly healthy machine.
+  Result = mmap(BaseAddress, Size, Protection, Flags | MAP_HUGETLB, -1, 0);
+#endif
+
+  if (Result == MAP_FAILED)
+  {
+    Result = mmap(BaseAddress, Size, Protection, Flags, -1, 0);
+#if HANDMADE_HUGE_PAGES && defined(MADV_HUGEPAGE)
+    if (Result != MAP_FAILED)
+    {
+      // Fall back to asking for transparent huge pages instead.
+      madvise(Result, Size, MADV_HUGEPAGE);
+    }
+#endif
+  }
+
+  if (Result == MAP_FAILED)
+  {
+    SDL_LogCritical(SDL_LOG_CATEGORY_APPLICATION, "Unable to allocate %zu bytes of memory", Size);
+    return(0);
+  }
+
+  if (BaseAddress && (Result != BaseAddress))
+  {
+    SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "Game memory landed at %p instead of %p", Result, BaseAddress);
+  }
+
+  return(Result);
+}
+
+/*
+  NOTE: How fast this machine moves a frame's worth of memory with memcpy,
+  in bytes per second, so the upload timing can be read against it: an
+  upload near 1.0x of this is bound by the copy itself, one far below it
+  is stuck in the driver. Takes the fastest of a few copies, after one to
+  fault the pages in.
+*/
+internal real64
+SDLMeasureCopyBandwidth(memory_index Size, uint64 PerfCountFrequency)
+{
+  real64 Result = 0.0;
+  uint8 *Source = (uint8 *)SDLAllocateMemory(0, 2*Size);
+  if (Source)
+  {
+    uint8 *Dest = Source + Size;
+    memset(Source, 0x7F, Size);
+    memcpy(Dest, Source, Size);
+
+    uint64 BestCounter = ~0ull;
+    for (int CopyIndex = 0; CopyIndex < 8; ++CopyIndex)
+    {
+      uint64 CopyStart = SDL_GetPerformanceCounter();
+      memcpy(Dest, Source, Size);
+      uint64 CopyCounter = SDL_GetPerformanceCounter() - CopyStart;
+      if (CopyCounter < BestCounter)
+      {
+        BestCounter = CopyCounter;
+      }
+    }
+    if (BestCounter)
+    {
+      Result = (real64)Size * (real64)PerfCountFrequency / (real64)BestCounter;
+    }
+
+    munmap(Source, 2*Size);
+  }
+
+  return(Result);
+}
+
+#if HANDMADE_SLOW
+/*
+  NOTE: Counts heap allocations, so we can check that the frame loop never
+  goes to the heap once things have warmed up. What gets counted is every
+  allocation made through SDL's allocator, and the ones the platform makes
+  itself, through libc, wherever they say DEBUG_COUNT_HEAP_ALLOCATION.
+  Libraries that go straight to libc under SDL, like graphics drivers and
+  the X client libraries, aren't counted: we have no say over them, and
+  some allocate for every event. Interposing malloc would catch those too,
+  but then the check would fire on things we can't fix.
+*/
+global_variable SDL_malloc_func DEBUGRealMalloc;
+global_variable SDL_calloc_func DEBUGRealCalloc;
+global_variable SDL_realloc_func DEBUGRealRealloc;
+global_variable SDL_free_func DEBUGRealFree;
+
+internal void * SDLCALL
+DEBUGCountingMalloc(size_t Size)
+{
+  SDL_AtomicIncRef(&DEBUGGlobalHeapAllocationCount);
+  return(DEBUGRealMalloc(Size));
+}
+
+internal void * SDLCALL
+DEBUGCountingCalloc(size_t Count, size_t Size)
+{
+  SDL_AtomicIncRef(&DEBUGGlobalHeapAllocationCount);
+  return(DEBUGRealCalloc(Count, Size));
+}
+
+internal void * SDLCALL
+DEBUGCountingRealloc(void *Memory, size_t Size)
+{
+  SDL_AtomicIncRef(&DEBUGGlobalHeapAllocationCount);
+  return(DEBUGRealRealloc(Memory, Size));
+}
+
+// Must run before SDL allocates anything.
+internal void
+DEBUGCountHeapAllocations()
+{
+  SDL_GetMemoryFunctions(&DEBUGRealMalloc, &DEBUGRealCalloc, &DEBUGRealRealloc, &DEBUGRealFree);
+  SDL_SetMemoryFunctions(DEBUGCountingMalloc, DEBUGCountingCalloc, DEBUGCountingRealloc, DEBUGRealFree);
+}
+#endif
+
+/*
+  NOTE: Game code hot reloading. The game lives in its own shared object next
+  to the executable. Every frame we check whether a new build has landed and,
+  if so, swap it in between frames. Game memory belongs to the platform layer,
+  so the game picks up right where it left off.
+*/
+
+GAME_UPDATE(GameUpdateStub)
+{
+}
+
+GAME_RENDER(GameRenderStub)
+{
+}
+
+GAME_GET_SOUND_SAMPLES(GameGetSoundSamplesStub)
+{
+  // Silence is better than whatever was left in the buffer.
+  SDL_memset(SoundBuffer->Samples, 0, SoundBuffer->SampleCount * 2 * sizeof(int16));
+}
+
+internal bool32
+SDLGetFileIdentity(char *FileName, time_t *LastWriteTime, ino_t *Inode)
+{
+  struct stat FileStatus;
+  if (stat(FileName, &FileStatus) != 0)
+  {
+    return(false);
+  }
+
+  *LastWriteTime = FileStatus.st_mtime;
+  *Inode = FileStatus.st_ino;
+  return(true);
+}
+
+internal bool32
+SDLCopyFile(char *SourceFileName, char *DestFileName)
+{
+  bool32 Result = false;
+
+  int Source = open(SourceFileName, O_RDONLY);
+  int Dest = open(DestFileName, O_WRONLY | O_CREAT | O_TRUNC, 0700);
+  if ((Source >= 0) && (Dest >= 0))
+  {
+    Result = true;
+
+    uint8 Chunk[Kilobytes(64)];
+    ssize_t BytesRead;
+    while ((BytesRead = read(Source, Chunk, sizeof(Chunk))) > 0)
+    {
+      if (write(Dest, Chunk, BytesRead) != BytesRead)
+      {
+        Result = false;
+        break;
+      }
+    }
+    if (BytesRead < 0)
+    {
+      Result = false;
+    }
+  }
+
+  if (Source >= 0) close(Source);
+  if (Dest >= 0) close(Dest);
+
+  return(Result);
+}
+
+internal sdl_game_code
+SDLLoadGameCode(char *SourceSOName, int LoadIndex)
+{
+  sdl_game_code Result = {};
+
+  // NOTE: We load a copy, so the build is free to overwrite the original
+  // while we're running it. Each load gets its own name, so the loader can
+  // never hand us back a cached copy of the code we just unloaded.
+  char TempSOName[4096];
+  SDL_snprintf(TempSOName, sizeof(TempSOName), "%s.%d", SourceSOName, LoadIndex);
+
+  if (SDLGetFileIdentity(SourceSOName, &Result.SOLastWriteTime, &Result.SOLastInode) &&
+      SDLCopyFile(SourceSOName, TempSOName))
+  {
+    Result.GameCodeSO = SDL_LoadObject(TempSOName);
+    // The loader has it mapped now; don't leave copies lying around.
+    unlink(TempSOName);
+
+    if (Result.GameCodeSO)
+    {
+      Result.Update = (game_update *)
+        SDL_LoadFunction(Result.GameCodeSO, "GameUpdate");
+      Result.Render = (game_render *)
+        SDL_LoadFunction(Result.GameCodeSO, "GameRender");
+      Result.GetSoundSamples = (game_get_sound_samples *)
+        SDL_LoadFunction(Result.GameCodeSO, "GameGetSoundSamples");
+
+      Result.IsValid = (Result.Update && Result.Render && Result.GetSoundSamples);
+    }
+  }
+
+  if (!Result.IsValid)
+  {
+    SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "Unable to load game code from %s, running stubs: %s",
+                SourceSOName, SDL_GetError());
+    Result.Update = GameUpdateStub;
+    Result.Render = GameRenderStub;
+    Result.GetSoundSamples = GameGetSoundSamplesStub;
   }
-}
 
-internal sdl_window_dimension
-SDLGetWindowDimension(SDL_Window *Window)
-{
-  sdl_window_dimension Result;
-  SDL_GetWindowSize(Window, &Result.Width, &Result.Height);
   return(Result);
 }
 
 internal void
-SDLResizeBuffer(sdl_offscreen_buffer *Buffer, SDL_Renderer *Renderer, int Width, int Height)
+SDLUnloadGameCode(sdl_game_code *GameCode)
 {
-  // TODO: Bulletproof this.
-  // Maybe don't free first, free after, then free first if that fails.
-
-  // Free any previously created memory.
-  if (Buffer->Texture)
+  if (GameCode->GameCodeSO)
   {
-    // SDL_LogDebug(SDL_LOG_CATEGORY_APPLICATION, "texture exists: destroying");
-    SDL_DestroyTexture(Buffer->Texture);
+    SDL_UnloadObject(GameCode->GameCodeSO);
+    GameCode->GameCodeSO = 0;
   }
 
-  if (Buffer->Memory)
-  {
-    // SDL_LogDebug(SDL_LOG_CATEGORY_APPLICATION, "bitmap exits: freeing");
-    free(Buffer->Memory);
-  }
+  GameCode->IsValid = false;
+  GameCode->Update = GameUpdateStub;
+  GameCode->Render = GameRenderStub;
+  GameCode->GetSoundSamples = GameGetSoundSamplesStub;
+}
 
-  // SDL_LogDebug(SDL_LOG_CATEGORY_APPLICATION, "creating new texture");
-  // Create new texture buffer.
-  Buffer->Texture = SDL_CreateTexture(Renderer,
-                              /**
-                               * This describes the format of our pixel data.
-                               * We are going to use 32 bits (4 bytes) for each pixel:
-                               * 8 bits (1 byte) each for our Red, Green, Blue, and Alpha values.
-                               *
-                               * A big endian format (RGBA) would likely be more readable, but
-                               * to follow along with Casey's lessons, I'm choosing to use a
-                               * little endian forat to match Windows-style architecture.
-                               */
-                              SDL_PIXELFORMAT_BGRA32,
-                              // A hint for the graphics driver about how we will access the texture.
-                              SDL_TEXTUREACCESS_STREAMING,
-                              Width,
-                              Height);
+/*
+  NOTE: Startup. The first frame only has to wait for the window, the
+  renderer and the game code; opening the audio device can take hundreds
+  of ms, so it, and anything else nothing on screen depends on, runs as a
+  task on a thread of its own while the main thread gets on with it.
+  SDL's subsystems themselves all come up on the main thread, though: SDL
+  counts who's using each of them without any locking. The main thread
+  times its own phases as it goes and logs the lot once the first frame
+  is out; tasks log when they finish, through SDL, so they don't each keep
+  a log ring.
+*/
+#define SDL_MAX_STARTUP_PHASES 16
 
-  Buffer->Width = Width;
-  Buffer->Height = Height;
-  Buffer->BytesPerPixel = 4;
-  Buffer->Pitch = Width * Buffer->BytesPerPixel; // number of bytes in a row of pixels
+struct sdl_startup_phase
+{
+  char const *Name;
+  real32 MS;
+};
 
-  // SDL_LogDebug(SDL_LOG_CATEGORY_APPLICATION, "allocating new bitmap memory");
-  int BitmapMemorySize = (Width * Height) * Buffer->BytesPerPixel;
-  Buffer->Memory = malloc(BitmapMemorySize);
+struct sdl_startup_timer
+{
+  uint64 LaunchCounter;
+  uint64 LastCounter;
+  int PhaseCount;
+  sdl_startup_phase Phases[SDL_MAX_STARTUP_PHASES];
+};
+
+struct sdl_startup_task
+{
+  char const *Name;
+  SDL_ThreadFunction Work;
+  void *Data;
+  uint64 LaunchCounter;
+  SDL_Thread *Thread;
+  SDL_atomic_t IsDone;
+};
+
+internal void
+SDLInitializeStartupTimer(sdl_startup_timer *Timer, uint64 LaunchCounter)
+{
+  Timer->LaunchCounter = LaunchCounter;
+  Timer->LastCounter = LaunchCounter;
+  Timer->PhaseCount = 0;
 }
 
-// The `Foo *(&X)[BAR]` syntax in a type signature means "X is a reference to an array of pointers to Foo and has a size of BAR".
+// Ends the phase the main thread was in, which started when the last one ended.
 internal void
-SDLStartGameControllers(SDL_GameController *(&Controllers)[MAX_CONTROLLERS])
+SDLEndStartupPhase(sdl_startup_timer *Timer, char const *Name)
 {
-  if (SDL_GameControllerAddMapping(JOY_CON_L_MAPPING) == -1)
+  uint64 Counter = SDL_GetPerformanceCounter();
+  if (Timer->PhaseCount < SDL_MAX_STARTUP_PHASES)
   {
-    SDL_LogCritical(SDL_LOG_CATEGORY_APPLICATION, "Failed to add mapping for Joy-Con (L) controller: %s", SDL_GetError());
+    sdl_startup_phase *Phase = Timer->Phases + Timer->PhaseCount++;
+    Phase->Name = Name;
+    Phase->MS = 1000.0f*SDLGetSecondsElapsed(Timer->LastCounter, Counter);
   }
-  if (SDL_GameControllerAddMapping(JOY_CON_R_MAPPING) == -1)
+  Timer->LastCounter = Counter;
+}
+
+internal int
+SDLStartupTaskThreadProc(void *Parameter)
+{
+  sdl_startup_task *Task = (sdl_startup_task *)Parameter;
+  uint64 Start = SDL_GetPerformanceCounter();
+  Task->Work(Task->Data);
+  uint64 End = SDL_GetPerformanceCounter();
+
+  SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Startup: %s took %fms, done %fms after launch", Task->Name,
+              1000.0f*SDLGetSecondsElapsed(Start, End), 1000.0f*SDLGetSecondsElapsed(Task->LaunchCounter, End));
+  SDL_AtomicSet(&Task->IsDone, 1);
+  return(0);
+}
+
+// NOTE: If there's no thread to be had, the task just runs here and now.
+internal void
+SDLStartStartupTask(sdl_startup_task *Task, sdl_startup_timer *Timer, char const *Name,
+                    SDL_ThreadFunction Work, void *Data)
+{
+  Task->Name = Name;
+  Task->Work = Work;
+  Task->Data = Data;
+  Task->LaunchCounter = Timer->LaunchCounter;
+  SDL_AtomicSet(&Task->IsDone, 0);
+  Task->Thread = SDL_CreateThread(SDLStartupTaskThreadProc, "HandmadeStartup", Task);
+  if (!Task->Thread)
   {
-    SDL_LogCritical(SDL_LOG_CATEGORY_APPLICATION, "Failed to add mapping for Joy-Con (R) controller: %s", SDL_GetError());
+    SDLStartupTaskThreadProc(Task);
   }
+}
 
-  int MaxJoysticks = SDL_NumJoysticks();
-  int NumControllers = 0;
-  for (int JoystickIndex = 0;
-       JoystickIndex < MaxJoysticks;
-       ++JoystickIndex)
-  {
-    if (NumControllers >= MAX_CONTROLLERS)
-    {
-      // Ignore any additional controllers
-      break;
-    }
+// NOTE: For a task that can't run at all, so nobody waits on it.
+internal void
+SDLSkipStartupTask(sdl_startup_task *Task, char const *Name)
+{
+  Task->Name = Name;
+  Task->Thread = 0;
+  SDL_AtomicSet(&Task->IsDone, 1);
+}
 
-    if (!SDL_IsGameController(JoystickIndex))
-    {
-      // Ignore any unsupported controllers
-      continue;
-    }
+internal void
+SDLFinishStartupTask(sdl_startup_task *Task)
+{
+  if (Task->Thread)
+  {
+    SDL_WaitThread(Task->Thread, 0);
+    Task->Thread = 0;
+  }
+}
 
-    // Initialize the controller and save a reference to it
-    SDL_GameController *Controller = SDL_GameControllerOpen(JoystickIndex);
-    Controllers[NumControllers++] = Controller;
+internal bool32
+SDLStartupTasksAreDone(sdl_startup_task **Tasks, int TaskCount)
+{
+  bool32 Result = true;
+  for (int TaskIndex = 0;
+       TaskIndex < TaskCount;
+       ++TaskIndex)
+  {
+    Result &= (SDL_AtomicGet(&Tasks[TaskIndex]->IsDone) != 0);
   }
+  return(Result);
 }
 
-// The `Foo *(&X)[BAR]` syntax in a type signature means "X is a reference to an array of pointers to Foo and has a size of BAR".
 internal void
-SDLStopGameControllers(SDL_GameController *(&Controllers)[MAX_CONTROLLERS])
+SDLLogStartup(sdl_startup_timer *Timer, sdl_startup_task **Tasks, int TaskCount)
 {
-  for (int ControllerIndex = 0;
-       ControllerIndex < MAX_CONTROLLERS;
-       ++ControllerIndex)
+  SDLLog(SDL_LOG_PRIORITY_INFO, "Startup: first frame out %fms after launch",
+         1000.0f*SDLGetSecondsElapsed(Timer->LaunchCounter, Timer->LastCounter));
+  for (int PhaseIndex = 0;
+       PhaseIndex < Timer->PhaseCount;
+       ++PhaseIndex)
+  {
+    sdl_startup_phase *Phase = Timer->Phases + PhaseIndex;
+    SDLLog(SDL_LOG_PRIORITY_INFO, "  %-16s %fms", Phase->Name, Phase->MS);
+  }
+  for (int TaskIndex = 0;
+       TaskIndex < TaskCount;
+       ++TaskIndex)
   {
-    SDL_GameController *Controller = Controllers[ControllerIndex];
-    SDL_GameControllerClose(Controller);
+    if (!SDL_AtomicGet(&Tasks[TaskIndex]->IsDone))
+    {
+      SDLLog(SDL_LOG_PRIORITY_INFO, "  %-16s still going", Tasks[TaskIndex]->Name);
+    }
   }
 }
 
-internal SDL_AudioDeviceID
-SDLInitializeAudio(int SamplesPerSecond, uint16 BufferSize)
+/*
+  NOTE: A startup task, once the audio subsystem is up: opens the device,
+  sizes the ring for whatever the device came back with and fills it with
+  silence before the device starts pulling on it.
+*/
+internal int
+SDLStartAudio(void *Data)
 {
-  SDL_AudioSpec DesiredSettings, ActualSettings;
-
-  SDL_memset(&DesiredSettings, 0, sizeof(DesiredSettings)); // zero-out the memory
-  DesiredSettings.freq = SamplesPerSecond;
-  DesiredSettings.format = AUDIO_S16LSB; // signed 16-bit samples in little-endian byte order
-  DesiredSettings.channels = 2;
-  DesiredSettings.samples = BufferSize;
-  DesiredSettings.callback = NULL;
+  sdl_sound_output *SoundOutput = (sdl_sound_output *)Data;
+  SoundOutput->Device = SDLInitializeAudio(SoundOutput);
 
-  SDL_AudioDeviceID OpenedAudioDevice = SDL_OpenAudioDevice(0, 0, &DesiredSettings, &ActualSettings, SDL_AUDIO_ALLOW_ANY_CHANGE);
-  if (!OpenedAudioDevice)
+  // NOTE: Everything from here on is sized for the device we actually got.
+  int SamplesPerFrame = SoundOutput->SamplesPerSecond / SoundOutput->RefreshHz;
+  SoundOutput->LatencySampleCount = (SoundOutput->SamplesPerSecond * AUDIO_LATENCY_MS) / 1000;
+  if (SoundOutput->LatencySampleCount < 2*SamplesPerFrame)
   {
-    // TODO: We failed to open the audio device. Do something about it.
-    SDL_LogCritical(SDL_LOG_CATEGORY_APPLICATION, "Unable to initialize audio: %s", SDL_GetError());
+    SoundOutput->LatencySampleCount = 2*SamplesPerFrame;
   }
+  SoundOutput->TargetQueueBytes = SoundOutput->LatencySampleCount * SoundOutput->BytesPerSample;
 
-  if (ActualSettings.format != DesiredSettings.format)
+  // The ring only ever has to hold the latency target, but it must be a power
+  // of two; leave at least that much headroom again on top.
+  sdl_audio_ring_buffer *RingBuffer = &SoundOutput->RingBuffer;
+  RingBuffer->Size = 1;
+  while (RingBuffer->Size < (uint32)(2 * SoundOutput->TargetQueueBytes))
   {
-    // TODO: We didn't get the settings we wanted. Figure out how to handle this.
-    SDL_LogDebug(SDL_LOG_CATEGORY_APPLICATION, "Unable to initialize audio with desired format: %s", SDL_GetError());
+    RingBuffer->Size <<= 1;
+  }
+  RingBuffer->Data = (uint8 *)SDLAllocateMemory(0, RingBuffer->Size);
+
+  // The game writes its samples here before we convert and copy them into
+  // the ring. We never write more than the latency target, so that's all
+  // the room we need.
+  SoundOutput->Samples = (int16 *)SDLAllocateMemory(0, SoundOutput->LatencySampleCount * 2 * sizeof(int16));
+  SoundOutput->DeviceSamples = (uint8 *)SDLAllocateMemory(0, SoundOutput->TargetQueueBytes);
+  if (!RingBuffer->Data || !SoundOutput->Samples || !SoundOutput->DeviceSamples)
+  {
+    SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "No memory for sound; running without it");
+    return(1);
   }
 
-  return(OpenedAudioDevice);
+  // Get a full latency's worth of silence in before the device starts pulling.
+  game_sound_output_buffer SilenceBuffer = {};
+  SilenceBuffer.SamplesPerSecond = SoundOutput->SamplesPerSecond;
+  SilenceBuffer.SampleCount = SoundOutput->LatencySampleCount;
+  SilenceBuffer.Samples = SoundOutput->Samples; // NOTE: still zeroed, straight from mmap
+  SDLFillSoundBuffer(SoundOutput, &SilenceBuffer);
+  SDL_PauseAudioDevice(SoundOutput->Device, 0); // audio starts paused: a value of 0 here unpauses it
+
+  SDL_AtomicSet(&SoundOutput->IsReady, 1);
+  return(0);
 }
 
-internal void
-SDLFillSoundBuffer(SDL_AudioDeviceID AudioDevice, sdl_sound_output* SoundOutput, int BytesToWrite)
+struct sdl_game_code_load
 {
-  if (!BytesToWrite) return;
+  char *SourceSOName;
+  int LoadIndex;
+  sdl_game_code Result;
+};
 
-  void *SoundBuffer = malloc(BytesToWrite);
-  int16 *AudioSampleOutput = (int16 *)SoundBuffer;
-  for (int AudioSampleIndex = 0;
-       AudioSampleIndex < SoundOutput->SampleCount;
-       AudioSampleIndex++)
-  {
-    real32 SineValue = sinf(SoundOutput->tSine);
-    int16 AudioSampleValue = (int16)(SineValue * SoundOutput->ToneVolume);
-    // Write to both audio channels (i.e. left and right in a stereo setting).
-    *AudioSampleOutput++ = AudioSampleValue;
-    *AudioSampleOutput++ = AudioSampleValue;
+// NOTE: A startup task: copying the game code and linking it in has nothing to wait on.
+internal int
+SDLStartLoadingGameCode(void *Data)
+{
+  sdl_game_code_load *Load = (sdl_game_code_load *)Data;
+  Load->Result = SDLLoadGameCode(Load->SourceSOName, Load->LoadIndex);
+  return(0);
+}
 
-    SoundOutput->tSine += 2.0f * Pi32 * 1.0f/(real32)SoundOutput->WavePeriod;
-    ++SoundOutput->RunningSampleIndex;
-  }
-  SDL_QueueAudio(AudioDevice, SoundBuffer, BytesToWrite);
-  free(SoundBuffer);
+struct sdl_copy_bandwidth
+{
+  memory_index Size;
+  uint64 PerfCountFrequency;
+  real64 Result;
+};
+
+// NOTE: A startup task: the upload stats can do without it for the first few frames.
+internal int
+SDLStartMeasuringCopyBandwidth(void *Data)
+{
+  sdl_copy_bandwidth *Bandwidth = (sdl_copy_bandwidth *)Data;
+  Bandwidth->Result = SDLMeasureCopyBandwidth(Bandwidth->Size, Bandwidth->PerfCountFrequency);
+  SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "memcpy moves a frame at %f GB/s", Bandwidth->Result / 1.0e9);
+  return(0);
 }
 
 // ********
 
-int main()
+#if HANDMADE_INTERNAL
+/*
+  NOTE: Every block the frame ran, in the order they first finished. Cycle
+  counts are summed over every thread that ran the block.
+*/
+internal void
+SDLLogDebugFrame(debug_frame *Frame)
+{
+  SDLLog(SDL_LOG_PRIORITY_DEBUG, "%u events (%u dropped) on %u threads",
+         Frame->EventCount, Frame->DroppedEventCount, Frame->ThreadCount);
+  for (uint32 BlockIndex = 0;
+       BlockIndex < Frame->BlockCount;
+       ++BlockIndex)
+  {
+    debug_block_stats *Block = Frame->Blocks + BlockIndex;
+    SDLLog(SDL_LOG_PRIORITY_DEBUG, "  %-28s %12llucy self %12llucy incl %5uh %12llucy/h",
+           Block->Name,
+           (unsigned long long)Block->SelfCycles,
+           (unsigned long long)Block->InclusiveCycles,
+           Block->HitCount,
+           (unsigned long long)(Block->InclusiveCycles / Block->HitCount));
+  }
+}
+#endif
+
+int main(int argc, char **argv)
 {
+#if HANDMADE_SLOW
+  DEBUGCountHeapAllocations();
+#endif
+
+  // NOTE: Time to first frame counts from here.
+  sdl_startup_timer Startup;
+  SDLInitializeStartupTimer(&Startup, SDL_GetPerformanceCounter());
+
   uint64 PerfCountFrequency = SDL_GetPerformanceFrequency();
 
+  // --playback <file> starts out playing back an input recording;
+  // --hz <rate> paces frames at that rate rather than the display's;
+  // --resolution <w>x<h> draws the game at that size whatever the window's,
+  // or "window" to draw it at the window's size;
+  // --scaler renderer|integer|nearest|bilinear picks how a fixed-size
+  // picture gets scaled to the window;
+  // --pixel-format bgra32|rgba32|rgb565|indexed8 draws in that format rather
+  // than whichever the renderer likes best.
+  char *PlaybackPath = 0;
+  int RequestedHz = 0;
+  int BufferWidth = 1280;
+  int BufferHeight = 720;
+  sdl_scale_mode ScaleMode = ScaleMode_Renderer;
+  bool32 FollowWindow = false;
+  pixel_format RequestedFormat = PixelFormat_Count;
+  for (int ArgIndex = 1;
+       ArgIndex < argc;
+       ++ArgIndex)
+  {
+    if ((SDL_strcmp(argv[ArgIndex], "--playback") == 0) && (ArgIndex + 1 < argc))
+    {
+      PlaybackPath = argv[++ArgIndex];
+    }
+    else if ((SDL_strcmp(argv[ArgIndex], "--hz") == 0) && (ArgIndex + 1 < argc))
+    {
+      RequestedHz = SDL_atoi(argv[++ArgIndex]);
+    }
+    else if ((SDL_strcmp(argv[ArgIndex], "--resolution") == 0) && (ArgIndex + 1 < argc))
+    {
+      char *Resolution = argv[++ArgIndex];
+      int Width, Height;
+      if (SDL_strcmp(Resolution, "window") == 0)
+      {
+        FollowWindow = true;
+      }
+      else if ((SDL_sscanf(Resolution, "%dx%d", &Width, &Height) == 2) && (Width > 0) && (Height > 0))
+      {
+        BufferWidth = Width;
+        BufferHeight = Height;
+      }
+    }
+    else if ((SDL_strcmp(argv[ArgIndex], "--pixel-format") == 0) && (ArgIndex + 1 < argc))
+    {
+      char *Format = argv[++ArgIndex];
+      if (SDL_strcmp(Format, "bgra32") == 0) RequestedFormat = PixelFormat_BGRA32;
+      else if (SDL_strcmp(Format, "rgba32") == 0) RequestedFormat = PixelFormat_RGBA32;
+      else if (SDL_strcmp(Format, "rgb565") == 0) RequestedFormat = PixelFormat_RGB565;
+      else if (SDL_strcmp(Format, "indexed8") == 0) RequestedFormat = PixelFormat_Indexed8;
+    }
+    else if ((SDL_strcmp(argv[ArgIndex], "--scaler") == 0) && (ArgIndex + 1 < argc))
+    {
+      char *Scaler = argv[++ArgIndex];
+      if (SDL_strcmp(Scaler, "integer") == 0) ScaleMode = ScaleMode_Integer;
+      else if (SDL_strcmp(Scaler, "nearest") == 0) ScaleMode = ScaleMode_Nearest;
+      else if (SDL_strcmp(Scaler, "bilinear") == 0) ScaleMode = ScaleMode_Bilinear;
+      else ScaleMode = ScaleMode_Renderer;
+    }
+  }
+  if (FollowWindow)
+  {
+    ScaleMode = ScaleMode_Native;
+  }
+
 #if 1
   SDL_LogSetAllPriority(SDL_LOG_PRIORITY_DEBUG);
 #endif
 
-  uint32 Subsystems =
-      SDL_INIT_VIDEO           // graphics and window management
-    | SDL_INIT_GAMECONTROLLER  // game controllers and joysticks
-    | SDL_INIT_AUDIO;          // audio system
-
-  // Initialize SDL
-  if (SDL_InitSubSystem(Subsystems) != 0)
+  if (SDL_InitSubSystem(SDL_INIT_EVENTS) != 0)
   {
     SDL_LogCritical(SDL_LOG_CATEGORY_APPLICATION, "Unable to initialize SDL: %s", SDL_GetError());
     return(1);
   }
-  // SDL_LogDebug(SDL_LOG_CATEGORY_APPLICATION, "SDL initialized");
 
   // Shutdown SDL on exit
   atexit(SDL_Quit);
 
-  // Setup audio system
-  sdl_sound_output SoundOutput = {};
-  SoundOutput.SamplesPerSecond = 48000; // sample rate
-  SoundOutput.BytesPerSample = sizeof(int16) * 2;
-  SoundOutput.SampleCount = SoundOutput.SamplesPerSecond / 60;
-  SoundOutput.BufferSize = SoundOutput.SampleCount * SoundOutput.BytesPerSample;
-  SoundOutput.LatencySampleCount = SoundOutput.SamplesPerSecond / 15; // sound latency: 1/15 of a second, aka 4 frames @ 60FPS
-  SoundOutput.ToneHz = 256; // close to a middle C note
-  SoundOutput.ToneVolume = 7000;
-  SoundOutput.RunningSampleIndex = 0;
-  SoundOutput.WavePeriod = SoundOutput.SamplesPerSecond / SoundOutput.ToneHz;
-  int TargetQueueBytes = SoundOutput.LatencySampleCount * SoundOutput.BytesPerSample;
-
-  SDL_AudioDeviceID AudioDevice = SDLInitializeAudio(SoundOutput.SamplesPerSecond, SoundOutput.SampleCount);
-  SDL_PauseAudioDevice(AudioDevice, 0); // audio starts paused: a value of 0 here unpauses it
+  // Get logging off the frame loop before anything logs from it.
+  SDLStartLogger();
+
+  SDLEndStartupPhase(&Startup, "events and logger");
+
+  // Nothing on screen depends on the game controllers, so their mappings
+  // go in on their own while we get a window open.
+  sdl_startup_task ControllerTask = {};
+  if (SDL_InitSubSystem(SDL_INIT_GAMECONTROLLER) == 0)
+  {
+    SDLStartStartupTask(&ControllerTask, &Startup, "controllers", SDLAddGameControllerMappings, 0);
+  }
+  else
+  {
+    SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Unable to initialize game controllers: %s", SDL_GetError());
+    SDLSkipStartupTask(&ControllerTask, "controllers");
+  }
+  SDLEndStartupPhase(&Startup, "controllers");
+
+  if (SDL_InitSubSystem(SDL_INIT_VIDEO) != 0)
+  {
+    SDL_LogCritical(SDL_LOG_CATEGORY_APPLICATION, "Unable to initialize video: %s", SDL_GetError());
+    return(1);
+  }
+  SDLEndStartupPhase(&Startup, "video");
+
+  sdl_frame_pacing FramePacing = {};
+  SDLInitializeFramePacing(&FramePacing, RequestedHz);
+  sdl_update_clock UpdateClock = {};
+  SDLInitializeUpdateClock(&UpdateClock, SDL_UPDATE_HZ);
+
+  // Setup audio system, off on its own too; frames go out silent until it's ready.
+  sdl_sound_output *SoundOutput = &GlobalSoundOutput;
+  SoundOutput->SamplesPerSecond = 48000; // sample rate we ask for; the device may pick another
+  SoundOutput->BytesPerSample = sizeof(int16) * 2;
+  SoundOutput->Format = AUDIO_S16SYS;
+  SoundOutput->ChannelCount = 2;
+  SoundOutput->RefreshHz = FramePacing.RefreshHz;
+  // One frame's worth of sound per device buffer, and we keep at least two
+  // frames queued ahead of it, however slow the frame rate.
+  SoundOutput->SampleCount = SoundOutput->SamplesPerSecond / FramePacing.RefreshHz;
+  sdl_startup_task AudioTask = {};
+  if (SDL_InitSubSystem(SDL_INIT_AUDIO) == 0)
+  {
+    SDLStartStartupTask(&AudioTask, &Startup, "audio", SDLStartAudio, SoundOutput);
+  }
+  else
+  {
+    SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Unable to initialize audio: %s", SDL_GetError());
+    SDLSkipStartupTask(&AudioTask, "audio");
+  }
+  SDLEndStartupPhase(&Startup, "audio");
+
+  // Relative paths, like the game's asset files, start from wherever the
+  // executable lives, not wherever we were launched from. Paths we were
+  // given on the command line still mean what they did where we started.
+  char PlaybackFullPath[PATH_MAX];
+  if (PlaybackPath && realpath(PlaybackPath, PlaybackFullPath))
+  {
+    PlaybackPath = PlaybackFullPath;
+  }
+  char *BasePath = SDL_GetBasePath();
+  if (BasePath && (chdir(BasePath) != 0))
+  {
+    SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "Unable to change directory to %s", BasePath);
+  }
+
+  // Find the game code next to our executable, and start loading it while
+  // the window opens.
+  char SourceGameCodeSOFullPath[4096];
+  SDL_snprintf(SourceGameCodeSOFullPath, sizeof(SourceGameCodeSOFullPath), "%slibhandmade.so", BasePath ? BasePath : "./");
+  int GameCodeLoadCount = 0;
+  sdl_game_code_load GameCodeLoad = {};
+  GameCodeLoad.SourceSOName = SourceGameCodeSOFullPath;
+  GameCodeLoad.LoadIndex = GameCodeLoadCount++;
+  sdl_startup_task GameCodeTask = {};
+  SDLStartStartupTask(&GameCodeTask, &Startup, "game code", SDLStartLoadingGameCode, &GameCodeLoad);
+
+  // Launch the worker threads. The main thread helps out while it waits on
+  // them, so one fewer worker than there are cores keeps every core busy.
+  platform_work_queue RenderQueue = {};
+  SDLMakeQueue(&RenderQueue, SDL_GetCPUCount() - 1);
+
+  // Loading threads mostly sit waiting on the disk, so a couple of them
+  // on top of the render workers costs next to nothing.
+  platform_work_queue LowPriorityQueue = {};
+  SDLMakeQueue(&LowPriorityQueue, 2);
+
+  // Reserve all of the game's memory up front.
+#if HANDMADE_INTERNAL
+  // A fixed address keeps pointers stable from run to run, which makes
+  // debugging (and later, replaying) much easier.
+  void *BaseAddress = (void *)Terabytes(2);
+#else
+  void *BaseAddress = 0;
+#endif
+
+  game_memory GameMemory = {};
+  GameMemory.PermanentStorageSize = Megabytes(64);
+  GameMemory.TransientStorageSize = Gigabytes(1);
+  GameMemory.PlatformAPI.RenderQueue = &RenderQueue;
+  GameMemory.PlatformAPI.LowPriorityQueue = &LowPriorityQueue;
+  GameMemory.PlatformAPI.AddEntry = SDLAddEntry;
+  GameMemory.PlatformAPI.CompleteAllWork = SDLCompleteAllWork;
+  GameMemory.PlatformAPI.GetAudioCursors = SDLGetAudioCursors;
+  GameMemory.PlatformAPI.ReadEntireFile = PosixReadEntireFile;
+  GameMemory.PlatformAPI.FreeFileMemory = PosixFreeFileMemory;
+  GameMemory.PlatformAPI.WriteEntireFile = PosixWriteEntireFile;
+  GameMemory.PlatformAPI.OpenFile = PosixOpenFile;
+  GameMemory.PlatformAPI.ReadDataFromFile = PosixReadDataFromFile;
+  GameMemory.PlatformAPI.CloseFile = PosixCloseFile;
+
+  // NOTE: mmap hands back zeroed pages, which the game relies on.
+  uint64 TotalSize = GameMemory.PermanentStorageSize + GameMemory.TransientStorageSize;
+  GameMemory.PermanentStorage = SDLAllocateMemory(BaseAddress, TotalSize);
+  if (!GameMemory.PermanentStorage)
+  {
+    return(1);
+  }
+  GameMemory.TransientStorage = ((uint8 *)GameMemory.PermanentStorage + GameMemory.PermanentStorageSize);
+
+#if HANDMADE_INTERNAL
+  // The profiler's event arrays, shared with the game code.
+  GameMemory.DebugTable = (debug_table *)SDLAllocateMemory(0, sizeof(debug_table));
+  if (!GameMemory.DebugTable)
+  {
+    return(1);
+  }
+  GlobalDebugTable = GameMemory.DebugTable;
+  debug_frame *DebugFrame = (debug_frame *)SDLAllocateMemory(0, sizeof(debug_frame));
+  if (!DebugFrame)
+  {
+    return(1);
+  }
+  int DebugFrameIndex = 0;
+#endif
+  SDLEndStartupPhase(&Startup, "threads and memory");
 
   // Setup initial Window
   uint32 WindowFlags =
@@ -447,6 +3070,7 @@ int main()
     return(1);
   }
   // SDL_LogDebug(SDL_LOG_CATEGORY_APPLICATION, "Application window created");
+  SDLEndStartupPhase(&Startup, "window");
 
   // Setup a rendering context.
   int AUTODETECT_DRIVER = -1;
@@ -457,25 +3081,119 @@ int main()
     SDL_LogCritical(SDL_LOG_CATEGORY_APPLICATION, "Failed to create rendering context: %s", SDL_GetError());
     return(1);
   }
+  SDLEndStartupPhase(&Startup, "renderer");
 
   sdl_window_dimension Dimension = SDLGetWindowDimension(Window);
-  SDLResizeBuffer(&GlobalBackBuffer, Renderer, Dimension.Width, Dimension.Height);
+  SDLChoosePixelFormat(&GlobalBackBuffer, Renderer, RequestedFormat);
+  GlobalBackBuffer.ScaleMode = ScaleMode;
+  if (ScaleMode == ScaleMode_Native)
+  {
+    BufferWidth = Dimension.Width;
+    BufferHeight = Dimension.Height;
+  }
+  else if (SDLIsScaledInSoftware(&GlobalBackBuffer))
+  {
+    GlobalBackBuffer.Scaler = (scaler *)SDLAllocateMemory(0, sizeof(scaler));
+    if (!GlobalBackBuffer.Scaler)
+    {
+      return(1);
+    }
+  }
+  SDLResizeBuffer(&GlobalBackBuffer, Renderer, BufferWidth, BufferHeight);
+  SDLFitBufferToWindow(&GlobalBackBuffer, Renderer, Dimension.Width, Dimension.Height);
+  SDLLog(SDL_LOG_PRIORITY_INFO, "Drawing at %dx%d in %s, shown at %dx%d", GlobalBackBuffer.Width, GlobalBackBuffer.Height,
+         SDL_GetPixelFormatName(GlobalBackBuffer.TextureFormat), GlobalBackBuffer.DestRect.w, GlobalBackBuffer.DestRect.h);
+
+  // NOTE: Only the upload stats want this, and they can go without for a few frames.
+  sdl_copy_bandwidth CopyBandwidth = {};
+  CopyBandwidth.Size = (memory_index)GlobalBackBuffer.Pitch * GlobalBackBuffer.Height;
+  CopyBandwidth.PerfCountFrequency = PerfCountFrequency;
+  sdl_startup_task CopyBandwidthTask = {};
+  SDLStartStartupTask(&CopyBandwidthTask, &Startup, "memcpy bandwidth", SDLStartMeasuringCopyBandwidth, &CopyBandwidth);
+  SDLEndStartupPhase(&Startup, "backbuffer");
+
+  // Input recordings live next to the executable too, unless we're asked to
+  // play a particular one back.
+  sdl_state State = {};
+  State.GameMemory = &GameMemory;
+
+  // NOTE: Only address space until a slot gets saved into.
+  for (int SlotIndex = 0;
+       SlotIndex < SNAPSHOT_SLOT_COUNT;
+       ++SlotIndex)
+  {
+    State.Snapshots[SlotIndex].Memory = SDLAllocateMemory(0, GameMemory.PermanentStorageSize);
+  }
 
-  // Initialize any game controllers plugged in at the start of our game.
-  // TODO: Enable haptics
-  SDL_GameController *Controllers[MAX_CONTROLLERS];
-  SDLStartGameControllers(Controllers);
+  SDL_snprintf(State.RecordingPath, sizeof(State.RecordingPath), "%shandmade.hmi", BasePath ? BasePath : "./");
+  SDL_free(BasePath);
+
+  if (PlaybackPath)
+  {
+    SDL_strlcpy(State.RecordingPath, PlaybackPath, sizeof(State.RecordingPath));
+  }
+  SDL_snprintf(State.FrameHashPath, sizeof(State.FrameHashPath), "%s.frames", State.RecordingPath);
+
+  // The first frame can't go without the game code, though.
+  SDLFinishStartupTask(&GameCodeTask);
+  sdl_game_code Game = GameCodeLoad.Result;
+  SDLEndStartupPhase(&Startup, "game code");
+
+  sdl_startup_task *StartupTasks[] = {&ControllerTask, &AudioTask, &GameCodeTask, &CopyBandwidthTask};
+  bool32 StartupIsLogged = false;
 
   // Main event loop
   Running = true;
-  int XOffset = 0;
-  int YOffset = 0;
+  // NOTE: Double-buffered, so each update's input starts from the last one's.
+  game_input Input[2] = {};
+  game_input *NewInput = &Input[0];
+  game_input *OldInput = &Input[1];
+  SDLBeginInputUpdate(&State, OldInput, NewInput);
+
+  if (PlaybackPath)
+  {
+    SDLBeginInputPlayBack(&State);
+  }
 
   uint64 LastCounter = SDL_GetPerformanceCounter();
   uint64 LastCycleCount = __rdtsc();
+  uint64 LastClockCounter = LastCounter;
+
+#if HANDMADE_SLOW
+  // SDL sets a few things up lazily on the first frames; after that, the frame
+  // loop must not touch the heap, as far as DEBUGCountHeapAllocations can
+  // see. Resizing, hotplugging and starting a recording or playback go to
+  // the heap on purpose, and start the warmup over.
+  DEBUG_RESTART_HEAP_WARMUP();
+#endif
 
   while(Running)
   {
+    time_t NewSOWriteTime;
+    ino_t NewSOInode;
+    if (SDLGetFileIdentity(SourceGameCodeSOFullPath, &NewSOWriteTime, &NewSOInode) &&
+        ((NewSOWriteTime != Game.SOLastWriteTime) || (NewSOInode != Game.SOLastInode)))
+    {
+      uint64 ReloadStart = SDL_GetPerformanceCounter();
+
+      // NOTE: Work on the queues runs the game's own callbacks, which go
+      // away with the code; all of it has to be done before we unload.
+      SDLCompleteAllWork(&LowPriorityQueue);
+      SDLCompleteAllWork(&RenderQueue);
+      SDLUnloadGameCode(&Game);
+      Game = SDLLoadGameCode(SourceGameCodeSOFullPath, GameCodeLoadCount++);
+
+      real32 ReloadMS = ((1000.0f*(real32)(SDL_GetPerformanceCounter() - ReloadStart)) / (real32)PerfCountFrequency);
+      SDLLog(SDL_LOG_PRIORITY_INFO, "Reloaded game code in %fms", ReloadMS);
+    }
+
+#if HANDMADE_SLOW
+    int DEBUGHeapAllocationsAtFrameStart = SDL_AtomicGet(&DEBUGGlobalHeapAllocationCount);
+#endif
+
+    // Everything that happened since the last update gets batched up into
+    // NewInput, then handed to the next one all at once.
+    BEGIN_BLOCK("EventPump");
     SDL_Event Event;
     while(SDL_PollEvent(&Event))
     {
@@ -483,85 +3201,206 @@ int main()
       {
         Running = false;
       }
-      SDLHandleEvent(&Event, &XOffset, &YOffset);
+      SDLHandleEvent(&Event, &State, NewInput);
+    }
+    END_BLOCK("EventPump");
+
+    uint64 ClockCounter = SDL_GetPerformanceCounter();
+    int UpdateCount = SDLBeginUpdates(&UpdateClock, SDLGetSecondsElapsed(LastClockCounter, ClockCounter));
+    real32 Alpha = SDLGetRenderAlpha(&UpdateClock);
+    LastClockCounter = ClockCounter;
+    if (State.PlaybackHandle)
+    {
+      // NOTE: Played back a step per frame and drawn as of that step, so
+      // what gets drawn, and hashed, doesn't depend on how long frames took.
+      UpdateCount = 1;
+      Alpha = 1.0f;
     }
 
-    // Input handling
-    for (int ControllerIndex = 0;
-         ControllerIndex < MAX_CONTROLLERS;
-         ++ControllerIndex)
+    for (int UpdateIndex = 0;
+         UpdateIndex < UpdateCount;
+         ++UpdateIndex)
     {
-      SDL_GameController *Controller = Controllers[ControllerIndex];
-      if (SDL_GameControllerGetAttached(Controller))
+      NewInput->dtForUpdate = UpdateClock.SecondsPerUpdate;
+      if (State.RecordingHandle)
       {
-        bool Up = SDL_GameControllerGetButton(Controller, SDL_CONTROLLER_BUTTON_DPAD_UP);
-        bool Down = SDL_GameControllerGetButton(Controller, SDL_CONTROLLER_BUTTON_DPAD_DOWN);
-        bool Left = SDL_GameControllerGetButton(Controller, SDL_CONTROLLER_BUTTON_DPAD_LEFT);
-        bool Right = SDL_GameControllerGetButton(Controller, SDL_CONTROLLER_BUTTON_DPAD_RIGHT);
-        bool Start = SDL_GameControllerGetButton(Controller, SDL_CONTROLLER_BUTTON_START);
-        bool Back = SDL_GameControllerGetButton(Controller, SDL_CONTROLLER_BUTTON_BACK);
-        bool LeftShoulder = SDL_GameControllerGetButton(Controller, SDL_CONTROLLER_BUTTON_LEFTSHOULDER);
-        bool RightShoulder = SDL_GameControllerGetButton(Controller, SDL_CONTROLLER_BUTTON_RIGHTSHOULDER);
-        bool AButton = SDL_GameControllerGetButton(Controller, SDL_CONTROLLER_BUTTON_A);
-        bool BButton = SDL_GameControllerGetButton(Controller, SDL_CONTROLLER_BUTTON_B);
-        bool XButton = SDL_GameControllerGetButton(Controller, SDL_CONTROLLER_BUTTON_X);
-        bool YButton = SDL_GameControllerGetButton(Controller, SDL_CONTROLLER_BUTTON_Y);
-
-        int16 StickX = SDL_GameControllerGetAxis(Controller, SDL_CONTROLLER_AXIS_LEFTX);
-        int16 StickY = SDL_GameControllerGetAxis(Controller, SDL_CONTROLLER_AXIS_LEFTY);
-
-        // Control side-scrolling with joystick.
-        XOffset += StickX / ( 4096 * 2 );
-        YOffset += StickY / ( 4096 * 2 );
-
-        // Control pitch with joystick
-        SoundOutput.ToneHz = 512 + (int)(256.0f*((real32)StickY / 30000.0f));
-        SoundOutput.WavePeriod = SoundOutput.SamplesPerSecond / SoundOutput.ToneHz;
-
-        // TODO: Rumble support
+        SDLRecordInput(&State, NewInput);
       }
-      else
+      if (State.PlaybackHandle)
       {
-        // TODO: Controller not plugged in anymore; do something about it.
+        SDLPlayBackInput(&State, NewInput);
       }
+
+      Game.Update(&GameMemory, NewInput);
+
+      game_input *Temp = NewInput;
+      NewInput = OldInput;
+      OldInput = Temp;
+      SDLBeginInputUpdate(&State, OldInput, NewInput);
     }
 
     // Screen drawing
+    SDLBeginBufferFrame(&GlobalBackBuffer);
+
     game_offscreen_buffer Buffer = {};
     Buffer.Memory = GlobalBackBuffer.Memory;
     Buffer.Width = GlobalBackBuffer.Width;
     Buffer.Height = GlobalBackBuffer.Height;
     Buffer.Pitch = GlobalBackBuffer.Pitch;
-    GameUpdateAndRender(&Buffer, XOffset, YOffset);
+    Buffer.Format = GlobalBackBuffer.Format;
+    Buffer.IsPreserved = GlobalBackBuffer.IsPreserved;
+    Buffer.DirtyRects = &GlobalBackBuffer.DirtyRects;
+    game_render_stats RenderStats = {};
+    Buffer.RenderStats = &RenderStats;
+    Game.Render(&GameMemory, &Buffer, Alpha);
+
+    // Hash before presenting: a locked texture's pixels are gone once it's
+    // handed back to the driver.
+    uint64 FrameHash = 0;
+    if (State.FrameHashHandle)
+    {
+      FrameHash = SDLHashFrame(&Buffer);
+    }
+
+    // Hold the picture back until the frame is due, so frames go out at an
+    // even pace; the audio write right after it then lands once per frame.
+    // The very first frame goes straight out, with nothing before it to keep
+    // pace with.
+    uint64 EndCounter = StartupIsLogged ? SDLWaitForFrameEnd(&FramePacing, LastCounter) : SDL_GetPerformanceCounter();
+    uint64 EndCycleCount = __rdtsc();
 
-    SDLDisplayBufferInWindow(GlobalBackBuffer, Renderer);
+    sdl_present_stats PresentStats = SDLDisplayBufferInWindow(&GlobalBackBuffer, Renderer, &GlobalBackBuffer.DirtyRects,
+                                                                &GameMemory.PlatformAPI);
+
+    if (!StartupIsLogged)
+    {
+      SDLEndStartupPhase(&Startup, "first frame");
+      SDLLogStartup(&Startup, StartupTasks, ArrayCount(StartupTasks));
+      StartupIsLogged = true;
+    }
 
     // Audio generation
-    // TODO Why does this introduce sound artifacts?
-    // int BytesToWrite = TargetQueueBytes - SDL_GetQueuedAudioSize(AudioDevice);
-    int BytesToWrite = SoundOutput.BufferSize;
-    SDLFillSoundBuffer(AudioDevice, &SoundOutput, BytesToWrite);
+    BEGIN_BLOCK("AudioFill");
+    // NOTE: Keep the write cursor a fixed latency ahead of the play cursor,
+    // however long (or short) this frame took.
+    sdl_audio_ring_buffer *RingBuffer = &SoundOutput->RingBuffer;
+    bool32 AudioIsReady = SDL_AtomicGet(&SoundOutput->IsReady);
+    if (AudioIsReady)
+    {
+      uint32 BytesQueued = (uint32)SDL_AtomicGet(&RingBuffer->WriteCount) - (uint32)SDL_AtomicGet(&RingBuffer->ReadCount);
+      int BytesToWrite = SoundOutput->TargetQueueBytes - (int)BytesQueued;
+      if (BytesToWrite > 0)
+      {
+        game_sound_output_buffer SoundBuffer = {};
+        SoundBuffer.SamplesPerSecond = SoundOutput->SamplesPerSecond;
+        SoundBuffer.SampleCount = BytesToWrite / SoundOutput->BytesPerSample;
+        SoundBuffer.Samples = SoundOutput->Samples;
+        Game.GetSoundSamples(&GameMemory, &SoundBuffer);
 
-    // Performance measurement / Dimensional analysis
-    uint64 EndCycleCount = __rdtsc();
+        SDLFillSoundBuffer(SoundOutput, &SoundBuffer);
+      }
+    }
+    END_BLOCK("AudioFill");
 
-    uint64 EndCounter = SDL_GetPerformanceCounter();
+    // Performance measurement / Dimensional analysis
     uint64 CyclesElapsed = EndCycleCount - LastCycleCount;
     uint64 CounterElapsed = EndCounter - LastCounter;
     real32 MSPerFrame = ((1000.0f*(real32)CounterElapsed) / (real32)PerfCountFrequency);
     real32 FPS = ((real32)PerfCountFrequency / (real32)CounterElapsed);
     real32 MCPF = ((real32)CyclesElapsed / (1000.0f*1000.0f));
 
-    SDL_LogDebug(SDL_LOG_CATEGORY_APPLICATION, "%fms/f, %ff/s, %fmc/f", MSPerFrame, FPS, MCPF);
+    real32 UploadMS = ((1000.0f*(real32)PresentStats.UploadCounter) / (real32)PerfCountFrequency);
+    // NOTE: The upload as a fraction of what memcpy manages on the same
+    // number of bytes; the pixel copy itself is about all that's left to win
+    // once this gets near 1.
+    real32 UploadOfPeak = 0.0f;
+    if (PresentStats.UploadCounter && SDL_AtomicGet(&CopyBandwidthTask.IsDone) && (CopyBandwidth.Result > 0.0))
+    {
+      real64 UploadBandwidth = ((real64)PresentStats.BytesCopied * (real64)PerfCountFrequency /
+                                (real64)PresentStats.UploadCounter);
+      UploadOfPeak = (real32)(UploadBandwidth / CopyBandwidth.Result);
+    }
+
+    // A sample written now gets played once everything ahead of it in our
+    // ring and in the device's own buffer has played.
+    real32 AudioLatencyMS = 0.0f;
+    if (AudioIsReady)
+    {
+      game_audio_cursors AudioCursors = SDLGetAudioCursors();
+      uint32 SamplesAhead = (AudioCursors.WriteCursor - AudioCursors.PlayCursor) + SoundOutput->SampleCount;
+      AudioLatencyMS = ((1000.0f*(real32)SamplesAhead) / (real32)SoundOutput->SamplesPerSecond);
+    }
+
+    SDLLog(SDL_LOG_PRIORITY_DEBUG, "%fms/f, %ff/s, %fmc/f, %d commands, %lld pixels drawn, %fms upload, %f%% dirty, %d bytes copied at %f%% of memcpy, %fms audio latency, %d underruns, %d overruns",
+           MSPerFrame, FPS, MCPF, RenderStats.CommandCount, (long long)RenderStats.PixelCount, UploadMS,
+           100.0f*PresentStats.DirtyFraction, PresentStats.BytesCopied, 100.0f*UploadOfPeak,
+           AudioLatencyMS, SDL_AtomicGet(&RingBuffer->UnderrunCount), RingBuffer->OverrunCount);
+
+    if (State.FrameHashHandle)
+    {
+      fprintf(State.FrameHashHandle, "%d %d %016llx %f\n", State.PlaybackLoopIndex,
+              State.PlaybackFrameIndex++, (unsigned long long)FrameHash, MSPerFrame);
+    }
+
+#if HANDMADE_INTERNAL
+    // NOTE: Nothing may be inside a block here; anything still open when the
+    // event arrays swap over gets dropped.
+    DEBUGCollateEvents(GameMemory.DebugTable, DebugFrame);
+    if ((++DebugFrameIndex % FramePacing.RefreshHz) == 0)
+    {
+      SDLLogDebugFrame(DebugFrame);
+    }
+#endif
+
+    if ((FramePacing.FrameCount % (10*FramePacing.RefreshHz)) == 0)
+    {
+      SDLLogFramePacing(&FramePacing);
+      SDLLogUpdateClock(&UpdateClock);
+    }
 
     LastCounter = EndCounter;
     LastCycleCount = EndCycleCount;
+
+#if HANDMADE_SLOW
+    if (DEBUGGlobalHeapWarmupFramesLeft > 0)
+    {
+      // NOTE: Startup tasks still running go to the heap behind the frame's
+      // back, so the warmup only starts once they're all done.
+      if (SDLStartupTasksAreDone(StartupTasks, ArrayCount(StartupTasks)))
+      {
+        --DEBUGGlobalHeapWarmupFramesLeft;
+      }
+    }
+    else
+    {
+      Assert(SDL_AtomicGet(&DEBUGGlobalHeapAllocationCount) == DEBUGHeapAllocationsAtFrameStart);
+    }
+#endif
+  }
+
+  SDLLogFramePacing(&FramePacing);
+  SDLLogUpdateClock(&UpdateClock);
+  SDLCompleteAllWork(&LowPriorityQueue);
+  SDLCompleteAllWork(&RenderQueue);
+  SDLUnloadGameCode(&Game);
+
+  // Anything still starting up has to finish before we can shut it down.
+  for (int TaskIndex = 0;
+       TaskIndex < (int)ArrayCount(StartupTasks);
+       ++TaskIndex)
+  {
+    SDLFinishStartupTask(StartupTasks[TaskIndex]);
   }
 
   // Clean up our game controllers
-  SDLStopGameControllers(Controllers);
+  SDLStopGameControllers(&State);
   // Close our audio output
-  SDL_CloseAudioDevice(AudioDevice);
+  if (SoundOutput->Device)
+  {
+    SDL_CloseAudioDevice(SoundOutput->Device);
+  }
+  // Write out whatever is still waiting to be logged.
+  SDLStopLogger();
 
   return(0);
 }